@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/thread_pool.hpp>
+
+#include "../business_logic/lib/uuid_v7.h"
+#include "../web/lib/push_hub.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr std::size_t kMessageCount = 50;
+
+class CountingSink : public PushTarget {
+public:
+    explicit CountingSink(std::atomic<std::uint64_t>& delivered)
+        : delivered_(delivered)
+    {}
+
+    void push(std::shared_ptr<const std::string> frame) override {
+        bytes_ += frame->size();
+        delivered_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void supersede() override {}
+
+private:
+    std::atomic<std::uint64_t>& delivered_;
+    std::size_t bytes_ = 0;
+};
+
+void run(std::size_t members, std::size_t shards) {
+    boost::asio::thread_pool pool(shards);
+    PushHub hub(ReplayOptions{}, FanoutOptions{shards}, pool.get_executor());
+
+    std::atomic<std::uint64_t> delivered{0};
+    std::vector<std::shared_ptr<CountingSink>> sinks;
+    ChatEvent event{ChatEvent::Type::MESSAGE_SENT, generateTimeOrderedId(), {}, generateTimeOrderedId(),
+        "Announcement for everyone"};
+
+    for (std::size_t i = 0; i < members; ++i) {
+        auto user = generateTimeOrderedId();
+        sinks.push_back(std::make_shared<CountingSink>(delivered));
+        hub.attach(user, sinks.back());
+        hub.publish(ChatEvent{ChatEvent::Type::MEMBER_JOINED, event.roomId, {}, user, {}});
+    }
+
+    std::vector<double> publishMicros;
+    auto start = BenchClock::now();
+    for (std::size_t m = 0; m < kMessageCount; ++m) {
+        event.messageId = generateTimeOrderedId();
+        auto publishStart = BenchClock::now();
+        hub.publish(event);
+        std::chrono::duration<double, std::micro> elapsed = BenchClock::now() - publishStart;
+        publishMicros.push_back(elapsed.count());
+    }
+
+    const auto expected = static_cast<std::uint64_t>(members) * kMessageCount;
+    while (delivered.load(std::memory_order_relaxed) < expected) {
+        std::this_thread::yield();
+    }
+    std::chrono::duration<double> seconds = BenchClock::now() - start;
+    pool.join();
+
+    std::sort(publishMicros.begin(), publishMicros.end());
+    std::cout << "members=" << members << " shards=" << shards
+              << " deliveries/s=" << static_cast<std::uint64_t>(static_cast<double>(expected) / seconds.count())
+              << " per_message_ms=" << seconds.count() * 1000 / kMessageCount
+              << " sender_p50_us=" << publishMicros[publishMicros.size() / 2]
+              << " sender_max_us=" << publishMicros.back() << "\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t members = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000;
+    const std::size_t maxShards = argc > 2
+        ? std::strtoull(argv[2], nullptr, 10)
+        : std::max(1u, std::thread::hardware_concurrency());
+
+    for (std::size_t shards = 1; shards <= maxShards; shards *= 2) {
+        run(members, shards);
+    }
+
+    return 0;
+}
@@ -0,0 +1,141 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../web/lib/server.h"
+#include "../web/lib/commands.h"
+
+using BenchClock = std::chrono::steady_clock;
+using tcp = ip::tcp;
+
+namespace {
+
+constexpr unsigned short kFirstPort = 8095;
+constexpr unsigned short kFirstClusterPort = 9095;
+
+struct Client {
+    asio::io_context ioc;
+    websocket::stream<tcp::socket> ws{ioc};
+    std::string userId;
+    std::string room;
+
+    void connect(unsigned short port) {
+        tcp::resolver resolver(ioc);
+        asio::connect(ws.next_layer(), resolver.resolve("localhost", std::to_string(port)));
+        ws.next_layer().set_option(tcp::no_delay(true));
+        ws.handshake("localhost", "/");
+        beast::flat_buffer created;
+        ws.read(created);
+        auto text = beast::buffers_to_string(created.data());
+        userId = text.substr(text.find(' ') + 1);
+    }
+
+    // Skips the pushes that arrive ahead of the reply.
+    std::string roundTrip(const std::string& request) {
+        ws.write(asio::buffer(request));
+        while (true) {
+            beast::flat_buffer buffer;
+            ws.read(buffer);
+            auto reply = beast::buffers_to_string(buffer.data());
+            const int code = std::stoi(reply);
+            if (code < int(OutCommand::PUSH_MSG_SENT) || code > int(OutCommand::PUSH_MSG_REMOVED)) {
+                return reply;
+            }
+        }
+    }
+};
+
+// Pairs chat across neighbouring nodes, so about half of all sends are
+// forwarded. Every node runs in this process on the same cores, so this
+// measures the forwarding cost and how it spreads, not the scaling a
+// cluster of separate machines would see.
+void run(std::size_t nodes, std::size_t pairs, std::size_t messages, std::size_t threads) {
+    std::vector<std::unique_ptr<Server>> servers;
+    std::vector<std::thread> serverThreads;
+    for (std::size_t n = 0; n < nodes; ++n) {
+        ServerOptions options;
+        options.rateLimits = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+        options.cluster.port = kFirstClusterPort + n;
+        options.cluster.secret = "bench-cluster";
+        for (std::size_t seed = 0; seed < n; ++seed) {
+            options.cluster.seeds.push_back({"127.0.0.1", static_cast<unsigned short>(kFirstClusterPort + seed)});
+        }
+        servers.push_back(std::make_unique<Server>(threads, kFirstPort + n, std::make_shared<MockTimeProvider>(),
+            options));
+        serverThreads.emplace_back([server = servers.back().get()] { server->start(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    }
+
+    std::vector<std::unique_ptr<Client>> clients;
+    for (std::size_t i = 0; i < 2 * pairs; ++i) {
+        clients.push_back(std::make_unique<Client>());
+        clients.back()->connect(kFirstPort + (i / 2 + i % 2) % nodes);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    for (std::size_t pair = 0; pair < pairs; ++pair) {
+        auto& alice = *clients[2 * pair];
+        auto& bob = *clients[2 * pair + 1];
+        auto chat = alice.roundTrip(std::to_string(int(InCommand::CREATE_PERSONAL_CHAT)) + ' ' + bob.userId
+            + " bench");
+        alice.room = bob.room = chat.substr(chat.find(' ') + 1);
+    }
+
+    std::atomic<bool> go{false};
+    std::atomic<std::uint64_t> failures{0};
+    std::vector<std::thread> workers;
+    for (auto& client : clients) {
+        workers.emplace_back([&client, &go, &failures, messages] {
+            const auto request = std::to_string(int(InCommand::SEND_MESSAGE)) + ' ' + client->room + " ping";
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            for (std::size_t m = 0; m < messages; ++m) {
+                if (std::stoi(client->roundTrip(request)) != int(OutCommand::MESSAGE_SENT)) {
+                    failures.fetch_add(1);
+                }
+            }
+        });
+    }
+
+    const auto start = BenchClock::now();
+    go.store(true);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::chrono::duration<double> seconds = BenchClock::now() - start;
+
+    for (auto& client : clients) {
+        client->ws.close(websocket::close_code::normal);
+    }
+    for (auto& server : servers) {
+        server->stop();
+    }
+    for (auto& thread : serverThreads) {
+        thread.join();
+    }
+
+    const double total = double(clients.size() * messages);
+    std::cout << "nodes=" << nodes << " clients=" << clients.size()
+              << " msgs/s=" << static_cast<std::uint64_t>(total / seconds.count())
+              << " failures=" << failures.load() << "\n";
+}
+
+} // namespace
+
+// bench_cluster [max nodes [pairs [messages [threads per node]]]]
+int main(int argc, char** argv) {
+    const std::size_t maxNodes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 4;
+    const std::size_t pairs = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8;
+    const std::size_t messages = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 2'000;
+    const std::size_t threads = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 1;
+
+    for (std::size_t nodes = 1; nodes <= maxNodes; ++nodes) {
+        run(nodes, pairs, messages, threads);
+    }
+    return 0;
+}
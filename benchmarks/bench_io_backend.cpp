@@ -0,0 +1,214 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../web/lib/io_backend.h"
+#include "../web/lib/server.h"
+
+using BenchClock = std::chrono::steady_clock;
+using tcp = ip::tcp;
+
+namespace {
+
+// Counts syscalls of this process (threads started later included) through
+// the raw_syscalls:sys_enter tracepoint. Needs tracefs and a permissive
+// perf_event_paranoid; without them the column reads n/a.
+class SyscallCounter {
+public:
+    SyscallCounter() {
+        for (const char* root : {"/sys/kernel/tracing", "/sys/kernel/debug/tracing"}) {
+            std::ifstream idFile(std::string(root) + "/events/raw_syscalls/sys_enter/id");
+            std::uint64_t id = 0;
+            if (!(idFile >> id)) {
+                continue;
+            }
+
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.size = sizeof(attr);
+            attr.config = id;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (fd_ >= 0) {
+                return;
+            }
+        }
+    }
+
+    ~SyscallCounter() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    void start() {
+        if (fd_ >= 0) {
+            ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    std::optional<std::uint64_t> stop() {
+        std::uint64_t count = 0;
+        if (fd_ < 0) {
+            return std::nullopt;
+        }
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+            return std::nullopt;
+        }
+        return count;
+    }
+
+private:
+    int fd_ = -1;
+};
+
+struct Client {
+    explicit Client(unsigned short port)
+        : ws(ioc)
+    {
+        tcp::resolver resolver(ioc);
+        asio::connect(ws.next_layer(), resolver.resolve("localhost", std::to_string(port)));
+        ws.next_layer().set_option(tcp::no_delay(true));
+        ws.handshake("localhost", "/");
+        id = payload(read());
+    }
+
+    std::string read() {
+        buffer.clear();
+        ws.read(buffer);
+        return beast::buffers_to_string(buffer.cdata());
+    }
+
+    // Skips pushes and other traffic until a frame with the given code arrives.
+    std::string await(OutCommand code) {
+        const auto prefix = std::to_string(int(code));
+        while (true) {
+            auto frame = read();
+            if (frame.compare(0, prefix.size(), prefix) == 0
+                && (frame.size() == prefix.size() || frame[prefix.size()] == ' ')) {
+                return frame;
+            }
+        }
+    }
+
+    void send(InCommand command, const std::string& args) {
+        ws.write(asio::buffer(std::to_string(int(command)) + ' ' + args));
+    }
+
+    static std::string payload(const std::string& frame) {
+        auto space = frame.find(' ');
+        return space == std::string::npos ? std::string{} : frame.substr(space + 1);
+    }
+
+    asio::io_context ioc;
+    websocket::stream<tcp::socket> ws;
+    beast::flat_buffer buffer;
+    std::string id;
+};
+
+// One sender posts into an open group of `listeners` members; each message
+// is one reply plus a push per listener, which is the fan-out shape whose
+// per-frame send/recv cost the backend choice is about.
+void run(unsigned short port, std::size_t listeners, std::size_t messages) {
+    ServerOptions options;
+    options.rateLimits = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+    Server server(2, port, std::make_shared<MockTimeProvider>(), options);
+    std::thread serverThread([&server] { server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    Client sender(port);
+    sender.send(InCommand::CREATE_OPEN_GROUP, "loadgen");
+    const auto room = Client::payload(sender.await(OutCommand::CHAT_CREATED));
+
+    std::vector<std::unique_ptr<Client>> members;
+    for (std::size_t i = 0; i < listeners; ++i) {
+        members.push_back(std::make_unique<Client>(port));
+        sender.send(InCommand::ADD_PARTICIPANT, room + ' ' + members.back()->id);
+        sender.await(OutCommand::PARTICIPANT_ADDED);
+    }
+
+    SyscallCounter syscalls;
+    rusage usageBefore;
+    getrusage(RUSAGE_SELF, &usageBefore);
+    syscalls.start();
+    const auto start = BenchClock::now();
+
+    std::vector<std::thread> readers;
+    for (auto& member : members) {
+        readers.emplace_back([&member, messages] {
+            for (std::size_t m = 0; m < messages; ++m) {
+                member->await(OutCommand::PUSH_MSG_SENT);
+            }
+        });
+    }
+
+    const std::string text = room + " load generator message";
+    for (std::size_t m = 0; m < messages; ++m) {
+        sender.send(InCommand::SEND_MESSAGE, text);
+        sender.await(OutCommand::MESSAGE_SENT);
+    }
+    for (auto& reader : readers) {
+        reader.join();
+    }
+
+    std::chrono::duration<double> seconds = BenchClock::now() - start;
+    const auto syscallCount = syscalls.stop();
+    rusage usageAfter;
+    getrusage(RUSAGE_SELF, &usageAfter);
+
+    for (auto& member : members) {
+        member->ws.close(websocket::close_code::normal);
+    }
+    sender.ws.close(websocket::close_code::normal);
+    server.stop();
+    serverThread.join();
+
+    // Client and server share the process, so syscalls cover both ends.
+    const double frames = double(messages * (listeners + 1));
+    const auto switches = (usageAfter.ru_nvcsw - usageBefore.ru_nvcsw) + (usageAfter.ru_nivcsw - usageBefore.ru_nivcsw);
+    std::cout << "backend=" << IoBackend::socketBackend() << " listeners=" << listeners
+              << " msgs/s=" << static_cast<std::uint64_t>(double(messages) / seconds.count())
+              << " frames/s=" << static_cast<std::uint64_t>(frames / seconds.count())
+              << " syscalls_per_frame=";
+    if (syscallCount) {
+        std::cout << double(*syscallCount) / frames;
+    } else {
+        std::cout << "n/a";
+    }
+    std::cout << " ctx_switches_per_frame=" << double(switches) / frames << "\n";
+}
+
+} // namespace
+
+// Build once with the default epoll reactor and once with
+// PRISECCHAT_IO_URING_SOCKETS, then compare the two outputs.
+int main(int argc, char** argv) {
+    const std::size_t listeners = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 32;
+    const std::size_t messages = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 2'000;
+
+    if (IoBackend::uringSockets && !IoBackend::uringAvailable()) {
+        std::cerr << "io_uring is not available on this kernel\n";
+        return 1;
+    }
+
+    run(8092, listeners, messages);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/uuid/random_generator.hpp>
+
+#include "../business_logic/lib/search_index.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr std::size_t kVocabularySize = 50'000;
+constexpr std::size_t kWordsPerMessage = 8;
+constexpr std::size_t kRoomCount = 10'000;
+constexpr std::size_t kRoomsPerUser = 20;
+constexpr std::size_t kQueryCount = 1'000;
+constexpr std::size_t kResultLimit = 50;
+
+std::string makeWord(std::size_t index) {
+    std::string word;
+    do {
+        word.push_back(static_cast<char>('a' + index % 26));
+        index /= 26;
+    } while (index != 0);
+    return word;
+}
+
+double percentile(std::vector<double> samples, double p) {
+    std::sort(samples.begin(), samples.end());
+    auto index = static_cast<std::size_t>(p * static_cast<double>(samples.size() - 1));
+    return samples[index];
+}
+
+void reportLatency(const std::string& name, const std::vector<double>& micros) {
+    std::cout << name << ": p50=" << percentile(micros, 0.5) << "us"
+              << " p99=" << percentile(micros, 0.99) << "us"
+              << " max=" << percentile(micros, 1.0) << "us\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t messageCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10'000'000;
+
+    std::vector<std::string> vocabulary;
+    std::vector<double> weights;
+    for (std::size_t i = 0; i < kVocabularySize; ++i) {
+        vocabulary.push_back(makeWord(i));
+        weights.push_back(1.0 / static_cast<double>(i + 1));
+    }
+
+    std::mt19937_64 rng(42);
+    std::discrete_distribution<std::size_t> zipf(weights.begin(), weights.end());
+    std::uniform_int_distribution<std::size_t> roomPick(0, kRoomCount - 1);
+
+    boost::uuids::random_generator uuidGenerator;
+    std::vector<SearchIndex::ChatRoomId> rooms;
+    for (std::size_t i = 0; i < kRoomCount; ++i) {
+        rooms.push_back(uuidGenerator());
+    }
+
+    SearchIndex index;
+    const auto author = uuidGenerator();
+    const auto timestamp = std::chrono::system_clock::now();
+
+    auto indexStart = BenchClock::now();
+    std::string text;
+    for (std::size_t i = 0; i < messageCount; ++i) {
+        text.clear();
+        for (std::size_t w = 0; w < kWordsPerMessage; ++w) {
+            if (w != 0) text.push_back(' ');
+            text += vocabulary[zipf(rng)];
+        }
+        index.addMessage(rooms[roomPick(rng)], Message(uuidGenerator(), author, text, timestamp));
+    }
+    std::chrono::duration<double> indexSeconds = BenchClock::now() - indexStart;
+
+    std::cout << "messages indexed: " << messageCount << "\n"
+              << "indexing rate: " << static_cast<double>(messageCount) / indexSeconds.count() << " msg/s\n"
+              << "distinct terms: " << index.termCount() << "\n"
+              << "index memory: " << index.memoryUsage() / (1024 * 1024) << " MiB ("
+              << index.memoryUsage() / std::max<std::size_t>(messageCount, 1) << " B/msg)\n";
+
+    std::unordered_set<SearchIndex::ChatRoomId> userRooms;
+    while (userRooms.size() < kRoomsPerUser) {
+        userRooms.insert(rooms[roomPick(rng)]);
+    }
+    std::unordered_set<SearchIndex::ChatRoomId> allRooms(rooms.begin(), rooms.end());
+
+    std::uniform_int_distribution<std::size_t> rareWord(1'000, kVocabularySize - 1);
+    auto runQueries = [&](const std::unordered_set<SearchIndex::ChatRoomId>& scope, bool common) {
+        std::vector<double> micros;
+        for (std::size_t q = 0; q < kQueryCount; ++q) {
+            std::string query = vocabulary[common ? zipf(rng) : rareWord(rng)] + " " + vocabulary[rareWord(rng)];
+            auto start = BenchClock::now();
+            auto hits = index.search(query, scope, kResultLimit);
+            std::chrono::duration<double, std::micro> elapsed = BenchClock::now() - start;
+            micros.push_back(elapsed.count());
+        }
+        return micros;
+    };
+
+    reportLatency("query (user scope, rare terms)", runQueries(userRooms, false));
+    reportLatency("query (user scope, common terms)", runQueries(userRooms, true));
+    reportLatency("query (all rooms, rare terms)", runQueries(allRooms, false));
+
+    return 0;
+}
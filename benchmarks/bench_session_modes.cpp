@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../web/lib/server.h"
+#include "../business_logic/lib/alloc_tracker.h"
+
+using BenchClock = std::chrono::steady_clock;
+using tcp = ip::tcp;
+
+#if PRISECCHAT_ALLOC_TRACKING
+std::uint64_t allocationCount() {
+    std::uint64_t total = 0;
+    for (std::size_t tag = 0; tag < std::size_t(AllocTag::COUNT); ++tag) {
+        total += AllocTracker::tagUsage(AllocTag(tag)).allocations;
+    }
+    return total;
+}
+#else
+std::atomic<std::uint64_t> globalAllocations{0};
+
+std::uint64_t allocationCount() {
+    return globalAllocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) {
+    globalAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+namespace {
+
+// Client and server share the process, so both columns include the same
+// client-side cost; the difference between modes is the server's.
+void run(bool coroutines, unsigned short port, std::size_t clients, std::size_t messages) {
+    ServerOptions options;
+    options.coroutineSessions = coroutines;
+    options.rateLimits = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+    Server server(2, port, std::make_shared<MockTimeProvider>(), options);
+    std::thread serverThread([&server] { server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    std::vector<std::unique_ptr<asio::io_context>> contexts;
+    std::vector<std::unique_ptr<websocket::stream<tcp::socket>>> sockets;
+    for (std::size_t i = 0; i < clients; ++i) {
+        contexts.push_back(std::make_unique<asio::io_context>());
+        sockets.push_back(std::make_unique<websocket::stream<tcp::socket>>(*contexts.back()));
+        tcp::resolver resolver(*contexts.back());
+        asio::connect(sockets.back()->next_layer(), resolver.resolve("localhost", std::to_string(port)));
+        sockets.back()->next_layer().set_option(tcp::no_delay(true));
+        sockets.back()->handshake("localhost", "/");
+        beast::flat_buffer created;
+        sockets.back()->read(created);
+    }
+
+    // A cheap command that runs inline on the io thread, so the session's
+    // own read/dispatch/write path dominates.
+    const std::string request = std::to_string(int(InCommand::RENAME_USER)) + " bench";
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (auto& ws : sockets) {
+        threads.emplace_back([&ws, &request, &go, messages] {
+            beast::flat_buffer buffer;
+            while (!go.load()) {
+                std::this_thread::yield();
+            }
+            for (std::size_t m = 0; m < messages; ++m) {
+                ws->write(asio::buffer(request));
+                buffer.clear();
+                ws->read(buffer);
+            }
+        });
+    }
+
+    const auto allocationsBefore = allocationCount();
+    const auto cpuBefore = std::clock();
+    const auto start = BenchClock::now();
+    go.store(true);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> seconds = BenchClock::now() - start;
+    const double cpuSeconds = double(std::clock() - cpuBefore) / CLOCKS_PER_SEC;
+    const auto allocations = allocationCount() - allocationsBefore;
+
+    for (auto& ws : sockets) {
+        ws->close(websocket::close_code::normal);
+    }
+    server.stop();
+    serverThread.join();
+
+    const double total = double(clients * messages);
+    std::cout << (coroutines ? "coroutine" : "callback ") << " clients=" << clients
+              << " msgs/s=" << static_cast<std::uint64_t>(total / seconds.count())
+              << " cpu_us_per_msg=" << cpuSeconds * 1e6 / total
+              << " allocs_per_msg=" << double(allocations) / total << "\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t clients = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 8;
+    const std::size_t messages = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 5'000;
+
+    run(false, 8090, clients, messages);
+    run(true, 8091, clients, messages);
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "../business_logic/lib/chat_manager.h"
+#include "../business_logic/lib/time_provider/mock_time_provider.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr std::size_t kRoomCount = 1'000;
+constexpr std::size_t kColdReads = 200;
+
+std::size_t residentBytes() {
+    std::ifstream statm("/proc/self/statm");
+    std::size_t pages = 0;
+    std::size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * 4096;
+}
+
+void releaseFreeMemory() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+void reportRss(const std::string& stage, std::size_t baseline, std::size_t messages) {
+    releaseFreeMemory();
+    const auto used = residentBytes() - std::min(baseline, residentBytes());
+    std::cout << stage << ": rss=" << used / (1024 * 1024) << " MiB ("
+              << static_cast<double>(used) / (1024.0 * 1024.0) / (static_cast<double>(messages) / 1e6)
+              << " MiB per million messages)\n";
+}
+
+void reportReads(const std::string& stage, ChatManager& manager, const std::vector<ChatManager::ChatRoomId>& rooms) {
+    std::mt19937_64 rng(7);
+    std::uniform_int_distribution<std::size_t> pick(0, rooms.size() - 1);
+
+    std::vector<double> micros;
+    for (std::size_t i = 0; i < kColdReads; ++i) {
+        auto start = BenchClock::now();
+        auto history = manager.getHistory(rooms[pick(rng)]);
+        std::chrono::duration<double, std::micro> elapsed = BenchClock::now() - start;
+        micros.push_back(elapsed.count());
+    }
+
+    std::sort(micros.begin(), micros.end());
+    std::cout << stage << " getHistory: p50=" << micros[micros.size() / 2] << "us"
+              << " p99=" << micros[micros.size() * 99 / 100] << "us\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t messageCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+
+    releaseFreeMemory();
+    const auto baseline = residentBytes();
+
+    MockTimeProvider timeProvider;
+    UserManager users;
+    ChatManager manager(timeProvider, users);
+
+    auto author = users.registerUser("author");
+    auto reader = users.registerUser("reader");
+    std::vector<ChatManager::ChatRoomId> rooms;
+    for (std::size_t i = 0; i < kRoomCount; ++i) {
+        rooms.push_back(manager.createPersonalChat("room", author, reader));
+    }
+
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<std::size_t> pick(0, rooms.size() - 1);
+    for (std::size_t i = 0; i < messageCount; ++i) {
+        manager.sendMessage(rooms[pick(rng)], author, "message number " + std::to_string(i) + " about the weather");
+    }
+
+    reportRss("hot", baseline, messageCount);
+    std::cout << "of which search index: " << manager.searchIndexMemoryUsage() / (1024 * 1024)
+              << " MiB (not tiered)\n";
+    reportReads("hot", manager, rooms);
+
+    TieringOptions options;
+    options.idleAfter = std::chrono::hours(1);
+    options.memoryBudget = std::numeric_limits<std::size_t>::max();
+    manager.setTieringOptions(options);
+    timeProvider.advanceTime(std::chrono::hours(2));
+
+    auto freezeStart = BenchClock::now();
+    auto stats = manager.tierIdleRooms();
+    std::chrono::duration<double> freezeSeconds = BenchClock::now() - freezeStart;
+    std::cout << "froze " << stats.frozenRooms << " rooms in " << freezeSeconds.count() << "s, "
+              << stats.residentFrozenBytes / (1024 * 1024) << " MiB compressed\n";
+    reportRss("frozen", baseline, messageCount);
+    reportReads("frozen", manager, rooms);
+
+    options.memoryBudget = 0;
+    manager.setTieringOptions(options);
+    stats = manager.tierIdleRooms();
+    std::cout << "spilled " << stats.spilledRooms << " rooms, " << stats.spilledBytes / (1024 * 1024) << " MiB on disk\n";
+    reportRss("spilled", baseline, messageCount);
+    reportReads("spilled", manager, rooms);
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "../business_logic/lib/user_manager.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr std::size_t kUserCount = 100'000;
+constexpr auto kRunTime = std::chrono::seconds(2);
+constexpr std::size_t kPresenceEvery = 64;
+
+// Mix resembling ChatManager traffic: existence checks dominate, with
+// occasional presence churn from connects and disconnects.
+double run(UserManager& users, const std::vector<UserManager::UserId>& ids, std::size_t threads) {
+    std::atomic<bool> stop{false};
+    std::atomic<std::uint64_t> total{0};
+    std::vector<std::thread> workers;
+
+    for (std::size_t t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            std::mt19937_64 rng(t + 1);
+            std::uniform_int_distribution<std::size_t> pick(0, ids.size() - 1);
+            std::uint64_t ops = 0;
+
+            while (!stop.load(std::memory_order_relaxed)) {
+                const auto& id = ids[pick(rng)];
+                if (ops % kPresenceEvery == 0) {
+                    users.setLoggedIn(id, ops % (2 * kPresenceEvery) == 0);
+                } else if (!users.userExists(id)) {
+                    std::abort();
+                }
+                ++ops;
+            }
+            total.fetch_add(ops, std::memory_order_relaxed);
+        });
+    }
+
+    std::this_thread::sleep_for(kRunTime);
+    stop = true;
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    std::chrono::duration<double> seconds = kRunTime;
+    return static_cast<double>(total.load()) / seconds.count();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t maxThreads = argc > 1
+        ? std::strtoull(argv[1], nullptr, 10)
+        : std::max(1u, std::thread::hardware_concurrency());
+
+    UserManager users;
+    std::vector<UserManager::UserId> ids;
+    for (std::size_t i = 0; i < kUserCount; ++i) {
+        ids.push_back(users.registerUser("user" + std::to_string(i)));
+    }
+
+    double baseline = 0;
+    for (std::size_t threads = 1; threads <= maxThreads; threads *= 2) {
+        const double rate = run(users, ids, threads);
+        if (threads == 1) {
+            baseline = rate;
+        }
+        std::cout << "threads=" << threads << " ops/s=" << static_cast<std::uint64_t>(rate)
+                  << " speedup=" << rate / baseline << "\n";
+    }
+
+    return 0;
+}
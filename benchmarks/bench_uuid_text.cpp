@@ -0,0 +1,80 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/uuid/string_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+#include "../business_logic/lib/uuid_text.h"
+#include "../business_logic/lib/uuid_v7.h"
+
+using BenchClock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr std::size_t kIdCount = 4096;
+
+// Keeps the optimizer from dropping results.
+volatile std::uint64_t sink = 0;
+
+template <typename Body>
+double nanosPerId(std::size_t rounds, Body body) {
+    const auto start = BenchClock::now();
+    for (std::size_t round = 0; round < rounds; ++round) {
+        for (std::size_t i = 0; i < kIdCount; ++i) {
+            body(i);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = BenchClock::now() - start;
+    return elapsed.count() / static_cast<double>(rounds * kIdCount);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const std::size_t rounds = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 500;
+
+    std::vector<boost::uuids::uuid> ids;
+    std::vector<std::string> texts;
+    for (std::size_t i = 0; i < kIdCount; ++i) {
+        ids.push_back(generateTimeOrderedId());
+        texts.push_back(boost::uuids::to_string(ids.back()));
+    }
+
+    char buffer[kUuidTextLength];
+    const double boostFormat = nanosPerId(rounds, [&](std::size_t i) {
+        sink = sink + boost::uuids::to_string(ids[i]).size();
+    });
+    const double fastFormat = nanosPerId(rounds, [&](std::size_t i) {
+        formatUuid(ids[i], buffer);
+        sink = sink + static_cast<unsigned char>(buffer[35]);
+    });
+
+    // Replies are built on an ostream, so compare the streaming paths too.
+    std::ostringstream boostStream;
+    const double boostStreamed = nanosPerId(rounds, [&](std::size_t i) {
+        if (i == 0) boostStream.str({});
+        boostStream << ids[i];
+    });
+    std::ostringstream fastStream;
+    const double fastStreamed = nanosPerId(rounds, [&](std::size_t i) {
+        if (i == 0) fastStream.str({});
+        fastStream << UuidText{ids[i]};
+    });
+
+    const double boostParse = nanosPerId(rounds, [&](std::size_t i) {
+        sink = sink + boost::uuids::string_generator()(texts[i]).data[15];
+    });
+    const double fastParse = nanosPerId(rounds, [&](std::size_t i) {
+        sink = sink + parseUuidText(texts[i])->data[15];
+    });
+
+    std::cout << "backend=" << uuidTextBackend() << "\n"
+              << "format  boost_to_string_ns=" << boostFormat << " formatUuid_ns=" << fastFormat << "\n"
+              << "stream  boost_operator_ns=" << boostStreamed << " UuidText_ns=" << fastStreamed << "\n"
+              << "parse   string_generator_ns=" << boostParse << " parseUuidText_ns=" << fastParse << "\n";
+    return 0;
+}
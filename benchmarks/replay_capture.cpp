@@ -0,0 +1,144 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../web/lib/server.h"
+#include "../web/lib/commands.h"
+#include "../web/lib/traffic_replay.h"
+
+using tcp = ip::tcp;
+
+namespace {
+
+constexpr unsigned short kRecordPort = 8093;
+constexpr unsigned short kReplayPort = 8094;
+
+// Without a capture to replay, records a small synthetic one: pairs of
+// users chatting, with edits on either side of the one-hour edit window.
+void recordSample(const std::filesystem::path& file, std::size_t pairs, std::size_t messages) {
+    auto clock = std::make_shared<MockTimeProvider>();
+    ServerOptions options;
+    options.rateLimits = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+    options.capture.file = file;
+    Server server(2, kRecordPort, clock, options);
+    std::thread serverThread([&server] { server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    asio::io_context ioc;
+    // Skips the pushes that arrive ahead of the reply.
+    auto roundTrip = [](websocket::stream<tcp::socket>& ws, const std::string& request) {
+        ws.write(asio::buffer(request));
+        while (true) {
+            beast::flat_buffer buffer;
+            ws.read(buffer);
+            auto reply = beast::buffers_to_string(buffer.data());
+            const int code = std::stoi(reply);
+            if (code < int(OutCommand::PUSH_MSG_SENT) || code > int(OutCommand::PUSH_MSG_REMOVED)) {
+                return reply;
+            }
+        }
+    };
+    auto command = [](InCommand cmd, const std::string& payload) {
+        return std::to_string(int(cmd)) + ' ' + payload;
+    };
+
+    std::vector<std::unique_ptr<websocket::stream<tcp::socket>>> sockets;
+    std::vector<std::string> userIds;
+    for (std::size_t i = 0; i < 2 * pairs; ++i) {
+        sockets.push_back(std::make_unique<websocket::stream<tcp::socket>>(ioc));
+        tcp::resolver resolver(ioc);
+        asio::connect(sockets.back()->next_layer(), resolver.resolve("localhost", std::to_string(kRecordPort)));
+        sockets.back()->handshake("localhost", "/");
+        beast::flat_buffer created;
+        sockets.back()->read(created);
+        auto text = beast::buffers_to_string(created.data());
+        userIds.push_back(text.substr(text.find(' ') + 1));
+    }
+
+    std::vector<std::string> chats;
+    std::vector<std::string> lastMessages;
+    for (std::size_t pair = 0; pair < pairs; ++pair) {
+        auto& alice = *sockets[2 * pair];
+        auto& bob = *sockets[2 * pair + 1];
+        auto chat = roundTrip(alice, command(InCommand::CREATE_PERSONAL_CHAT, userIds[2 * pair + 1] + " sample"));
+        chat = chat.substr(chat.find(' ') + 1);
+        chats.push_back(chat);
+
+        for (std::size_t m = 0; m < messages; ++m) {
+            auto sent = roundTrip(alice, command(InCommand::SEND_MESSAGE_ONCE,
+                chat + " key" + std::to_string(m) + " message " + std::to_string(m)));
+            auto messageId = sent.substr(sent.find(' ') + 1);
+            if (m + 1 == messages) {
+                lastMessages.push_back(messageId);
+            }
+            if (m % 10 == 0) {
+                roundTrip(alice, command(InCommand::EDIT_MESSAGE, chat + ' ' + messageId + " edited"));
+            }
+            if (m % 25 == 0) {
+                roundTrip(bob, command(InCommand::GET_HISTORY, chat));
+            }
+        }
+    }
+
+    // Past the edit window: these edits must fail in the replay too.
+    clock->advanceTime(std::chrono::hours(2));
+    for (std::size_t pair = 0; pair < pairs && pair < lastMessages.size(); ++pair) {
+        auto& alice = *sockets[2 * pair];
+        roundTrip(alice, command(InCommand::EDIT_MESSAGE, chats[pair] + ' ' + lastMessages[pair] + " too late"));
+        roundTrip(*sockets[2 * pair + 1], std::to_string(int(InCommand::LIST_CHATS)));
+    }
+
+    for (auto& ws : sockets) {
+        ws->close(websocket::close_code::normal);
+    }
+    server.stop();
+    serverThread.join();
+}
+
+ReplayReport replay(const std::filesystem::path& file, double speed, std::size_t window) {
+    auto clock = std::make_shared<MockTimeProvider>();
+    ServerOptions options;
+    options.rateLimits = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+    Server server(2, kReplayPort, clock, options);
+    std::thread serverThread([&server] { server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    CaptureReplayOptions replayOptions;
+    replayOptions.port = std::to_string(kReplayPort);
+    replayOptions.speed = speed;
+    replayOptions.window = window;
+    auto report = CaptureReplayer(*clock, replayOptions).run(file);
+
+    server.stop();
+    serverThread.join();
+    return report;
+}
+
+} // namespace
+
+// replay_capture [capture [speed [window]]]
+// speed 0 replays as fast as possible, 1 at the captured pace.
+int main(int argc, char** argv) {
+    std::filesystem::path file = argc > 1 ? argv[1] : "";
+    const double speed = argc > 2 ? std::strtod(argv[2], nullptr) : 0;
+    const std::size_t window = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 1;
+
+    if (file.empty()) {
+        file = std::filesystem::temp_directory_path() / "prisecchat_sample.cap";
+        recordSample(file, 8, 200);
+        std::cout << "recorded " << file << " (" << std::filesystem::file_size(file) << " bytes)\n";
+    }
+
+    try {
+        std::cout << replay(file, speed, window).summary();
+    } catch (const std::exception& ex) {
+        std::cerr << "Replay failed: " << ex.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#ifndef PRISECCHAT_ALLOC_TRACKING
+#define PRISECCHAT_ALLOC_TRACKING 0
+#endif
+
+
+enum class AllocTag : std::uint8_t {
+    OTHER                = 0,
+    SESSION_BUFFERS      = 1,
+    OUTBOUND_QUEUES      = 2,
+    DISPATCH_TEMPORARIES = 3,
+    ROOM_MESSAGES        = 4,
+    USER_TABLE           = 5,
+    COUNT                = 6,
+};
+
+// Global heap accounting. With tracking compiled in, operator new and
+// delete are replaced: every block carries a small header naming the tag
+// and command that were active on the allocating thread, so frees are
+// charged back to whoever allocated, whichever thread releases the block.
+class AllocTracker {
+ public:
+    static constexpr bool enabled = PRISECCHAT_ALLOC_TRACKING;
+
+    // Commands are opaque small integers; the web layer passes InCommand.
+    static constexpr int kMaxCommands = 64;
+    static constexpr int kNoCommand = -1;
+
+    struct Usage {
+        std::uint64_t liveBytes = 0;
+        std::uint64_t peakBytes = 0;
+        std::uint64_t allocations = 0;
+    };
+
+    struct CommandUsage {
+        int   command;
+        Usage usage;
+    };
+
+    static Usage tagUsage(AllocTag tag);
+    // Commands that allocated at least once, in command order.
+    static std::vector<CommandUsage> commandUsage();
+    static const char* tagName(AllocTag tag);
+
+    // Drops counts and lowers peaks to the current live bytes.
+    static void resetPeaks();
+};
+
+// Attributes allocations of the current thread to a tag (and optionally a
+// command) until destroyed; scopes nest and restore the outer one. Passing
+// kNoCommand keeps the command of the enclosing scope.
+class AllocScope {
+ public:
+    explicit AllocScope(AllocTag tag, int command = AllocTracker::kNoCommand);
+    ~AllocScope();
+
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+
+ private:
+#if PRISECCHAT_ALLOC_TRACKING
+    std::uint8_t previousTag_;
+    std::uint8_t previousCommand_;
+#endif
+};
+
+#if !PRISECCHAT_ALLOC_TRACKING
+inline AllocScope::AllocScope(AllocTag, int) {}
+inline AllocScope::~AllocScope() = default;
+#endif
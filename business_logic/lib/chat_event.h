@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+#include <boost/uuid/uuid.hpp>
+
+#include "user.h"
+
+
+// Membership changes are published under the manager lock, so listeners
+// see them in the order they happened and can keep their own copy of who
+// is in each room; message events then name only the room.
+struct ChatEvent {
+    enum class Type {
+        MESSAGE_SENT,
+        MESSAGE_EDITED,
+        MESSAGE_REMOVED,
+        // actorId joined or left roomId.
+        MEMBER_JOINED,
+        MEMBER_LEFT,
+        // roomId is gone, with everyone still in it.
+        ROOM_CLOSED,
+    };
+
+    Type                      type;
+    boost::uuids::uuid        roomId;
+    boost::uuids::uuid        messageId;
+    User::UserId              actorId;
+    std::string               text;
+
+    [[nodiscard]] bool isMembershipChange() const {
+        return type == Type::MEMBER_JOINED || type == Type::MEMBER_LEFT || type == Type::ROOM_CLOSED;
+    }
+};
@@ -1,57 +1,181 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <shared_mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "user.h"
 #include "message.h"
+#include "chat_event.h"
+#include "dedup_table.h"
+#include "expiry_wheel.h"
+#include "frozen_history.h"
+#include "lock_profiler.h"
 #include "user_manager.h"
+#include "search_index.h"
 #include "chat_room/abstract_chat.h"
 #include "time_provider/abstract_time_provider.h"
 
 
+struct TieringOptions {
+    std::chrono::hours    idleAfter{72};
+    std::size_t           memoryBudget = 256 * 1024 * 1024;
+    std::filesystem::path spillDirectory = std::filesystem::temp_directory_path() / "prisecchat-spill";
+    // Empty writes spills with a plain ofstream.
+    FrozenHistory::Writer spillWriter;
+};
+
+// Everything needed to rebuild a room on another node. Idempotency keys
+// and the room's place in the tiering order are not carried over.
+struct RoomSnapshot {
+    enum class Kind : std::uint8_t { PERSONAL = 0, OPEN_GROUP = 1, CLOSE_GROUP = 2, BROADCAST = 3 };
+
+    Kind                                  kind = Kind::PERSONAL;
+    boost::uuids::uuid                    id{};
+    std::string                           name;
+    User::UserId                          adminId{};    // nil for personal chats
+    std::vector<User::UserId>             participants; // join order
+    std::chrono::seconds                  messageTtl{0};
+    std::chrono::system_clock::time_point lastActivity;
+    std::vector<Message>                  messages;
+};
+
+struct TieringStats {
+    std::size_t   hotRooms = 0;
+    std::size_t   frozenRooms = 0;
+    std::size_t   spilledRooms = 0;
+    std::size_t   hotMessages = 0;
+    std::size_t   frozenMessages = 0;
+    std::size_t   residentFrozenBytes = 0;
+    std::size_t   spilledBytes = 0;
+    std::uint64_t coldReads = 0;
+    std::uint64_t coldReadMaxMicros = 0;
+};
+
 class ChatManager {
  public:
     using UserId = User::UserId;
     using ChatRoomId = boost::uuids::uuid;
     using MessageId = boost::uuids::uuid;
     using Clock = std::chrono::system_clock;
+    using EventListener = std::function<void(const ChatEvent&)>;
+    using Placement = std::function<bool(ChatRoomId)>;
 
     explicit ChatManager(const AbstractTimeProvider& time_provider, UserManager& user_manager);
+    ~ChatManager();
+
+    // Receives every message event after the change, and every membership
+    // change (room creation included) in the order it happened.
+    void setEventListener(EventListener listener);
+    // New room ids are drawn until `placement` accepts one, so a sharded
+    // deployment creates rooms only on the node that owns their id.
+    void setPlacement(Placement placement);
 
     ChatRoomId createPersonalChat(const std::string& name, UserId user1, UserId user2);
     ChatRoomId createOpenGroup(const std::string& name, UserId admin_id);
     ChatRoomId createCloseGroup(const std::string& name, UserId admin_id);
+    ChatRoomId createBroadcastChat(const std::string& name, UserId admin_id);
     bool deleteChat(ChatRoomId id, UserId user_id);
 
     bool addParticipant(ChatRoomId room_id, UserId user_add, UserId user_get_add);
     bool removeParticipant(ChatRoomId room_id, UserId user_remove, UserId user_get_remove);
 
     bool sendMessage(ChatRoomId room_id, UserId sender_id, const std::string& message);
+    std::optional<MessageId> sendMessage(ChatRoomId room_id, UserId sender_id, const std::string& message,
+        std::string_view idempotency_key);
     bool editMessage(ChatRoomId room_id, UserId user_edit, MessageId id, const std::string& new_text);
     bool removeMessage(ChatRoomId room_id, UserId user_remove, MessageId id);
 
+    bool setMessageTtl(ChatRoomId room_id, UserId user_id, std::chrono::seconds ttl);
+    void expireMessages(Clock::time_point now);
+    std::size_t pendingExpirations() const;
+
     std::vector<Message> getHistory(ChatRoomId roomId) const;
+    std::vector<Message> getHistoryAfter(ChatRoomId roomId, MessageId after) const;
+    void visitHistory(ChatRoomId room_id, std::optional<MessageId> after,
+        const std::function<void(const Message&)>& visitor) const;
     UserId getChatAdmin(ChatRoomId room_id) const;
     bool chatExists(ChatRoomId roomId) const;
 
     std::vector<ChatRoomId> getUserChats(UserId user_id) const;
     std::vector<UserId>     getChatParticipants(ChatRoomId room_id) const;
 
+    std::vector<SearchIndex::Hit> searchMessages(UserId user_id, const std::string& query, std::size_t limit) const;
+    std::size_t searchIndexMemoryUsage() const;
+    std::size_t searchIndexDocumentCount() const;
+    std::size_t searchIndexTermCount() const;
+
+    void setDedupOptions(DedupOptions options);
+    DedupStats dedupStats() const;
+
+    void setTieringOptions(TieringOptions options);
+    TieringStats tierIdleRooms();
+    TieringStats tieringStats() const;
+
     Clock::time_point now() const;
+    // Mean exclusive-lock wait since the previous call.
+    std::chrono::microseconds takeLockWait();
+
+    // Moving rooms between managers: extractRoom removes the room and
+    // returns its state; adoptRoom rebuilds it, pinning its participants,
+    // and fails if the id is taken or a participant is unknown here.
+    std::vector<ChatRoomId> roomIds() const;
+    std::optional<RoomSnapshot> extractRoom(ChatRoomId room_id);
+    bool adoptRoom(RoomSnapshot snapshot);
+    // Runs `update`, which changes what the placement accepts, under the
+    // lock room creation takes, and returns the rooms it no longer accepts.
+    // They stay here, read-only, until dropRoom once the new owner holds
+    // them, or keepRoom if it does not, so a failed handoff loses nothing.
+    std::vector<RoomSnapshot> changePlacement(const std::function<void()>& update);
+    bool dropRoom(ChatRoomId room_id);
+    void keepRoom(ChatRoomId room_id);
 
  private:
-    ChatRoomId generateChatRoomId();
-    MessageId generateMessageId();
-    bool validateUserExists(UserId user) const;
+    using RoomMap = std::unordered_map<ChatRoomId, std::unique_ptr<AbstractChat>>;
 
-    std::unordered_map<ChatRoomId, std::unique_ptr<AbstractChat>> chatRooms_;
+    ChatRoomId generateChatRoomId() const;
+    static MessageId generateMessageId();
+    bool validateUserExists(UserId user) const;
+    bool retainUser(UserId user);
+    ExclusiveProfiledLock lockExclusive(const char* site);
+    static RoomSnapshot snapshotRoom(const AbstractChat& room);
+    ChatEvent makeEvent(ChatEvent::Type type, const AbstractChat& room, MessageId message_id,
+        UserId actor_id, std::string text) const;
+    void publish(const ChatEvent& event) const;
+    // Under the manager lock, so membership reaches listeners in order.
+    void publishMembership(ChatEvent::Type type, ChatRoomId room_id, UserId user_id = {}) const;
+    void eraseRoom(ChatRoomId room_id);
+    RoomMap::iterator findWritable(ChatRoomId room_id);
+    std::vector<Message> readHistory(const AbstractChat& room) const;
+    TieringStats collectTieringStats() const;
+
+    RoomMap                        chatRooms_;
+    std::unordered_set<ChatRoomId> handingOff_;
+    SearchIndex searchIndex_;
     UserManager& userManager_;
 
     const AbstractTimeProvider& timeProvider_;
+    EventListener eventListener_;
+    Placement placement_;
+
+    ExpiryWheel expiryWheel_;
+    std::size_t timeSubscription_;
+
+    DedupTable dedup_;
 
-    boost::uuids::random_generator chatRoomGenerator_;
-    boost::uuids::random_generator messageGenerator_;
+    TieringOptions tiering_;
+    // One tiering pass at a time: two would spill a room to the same file.
+    std::mutex tieringMutex_;
+    mutable std::atomic<std::uint64_t> coldReads_{0};
+    mutable std::atomic<std::uint64_t> coldReadMaxMicros_{0};
 
     mutable std::shared_mutex mutex_;
+    std::atomic<std::int64_t> lockWaitMicros_{0};
+    std::atomic<std::int64_t> lockAcquisitions_{0};
 };
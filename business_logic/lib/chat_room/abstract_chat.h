@@ -1,9 +1,13 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
 
+#include "frozen_history.h"
 #include "message.h"
+#include "participant_set.h"
 #include "user.h"
 
 
@@ -17,10 +21,38 @@ class AbstractChat {
 
     [[nodiscard]] ChatRoomId getId() const;
     [[nodiscard]] const std::string& getName() const;
-    [[nodiscard]] const std::vector<User::UserId>& getParticipants() const;
+    [[nodiscard]] std::vector<User::UserId> getParticipants() const;
+    [[nodiscard]] bool isParticipant(User::UserId user_id) const;
+    [[nodiscard]] std::size_t participantCount() const;
+    [[nodiscard]] virtual bool canPost(User::UserId user_id) const;
+    // Hot rooms only: a frozen room's vector is empty, so these would
+    // silently miss its history. Use copyMessages, or thaw first.
     [[nodiscard]] const std::vector<Message>& getMessages() const;
+    [[nodiscard]] std::vector<Message> copyMessages() const;
+    [[nodiscard]] const Message* findMessage(Message::MessageId message_id) const;
 
+    // `drawn` if it sorts after every id this room has handed out,
+    // otherwise the next id after the newest one. Ids are drawn before
+    // the manager lock, so another thread's later send can append first.
+    [[nodiscard]] Message::MessageId orderedId(Message::MessageId drawn) const;
     void addMessage(const Message& message);
+    bool eraseMessage(Message::MessageId message_id);
+
+    void setMessageTtl(std::chrono::seconds ttl);
+    [[nodiscard]] std::chrono::seconds getMessageTtl() const;
+
+    // Idle rooms give up their message vector for a compressed block; any
+    // mutating access thaws them back transparently. Blocks are built off
+    // the manager lock from state read at historyVersion(), and
+    // installFrozen only takes one if the history has not changed since.
+    bool installFrozen(std::uint64_t version, const std::shared_ptr<const FrozenHistory>& frozen);
+    void thaw();
+    [[nodiscard]] const FrozenHistory* frozenHistory() const;
+    [[nodiscard]] std::shared_ptr<const FrozenHistory> shareFrozenHistory() const;
+    [[nodiscard]] std::uint64_t historyVersion() const;
+
+    void touch(std::chrono::system_clock::time_point now);
+    [[nodiscard]] std::chrono::system_clock::time_point lastActivity() const;
 
     bool editMessage(User::UserId user, Message::MessageId message_id,
         const std::string& new_text, std::chrono::system_clock::time_point now);
@@ -33,8 +65,15 @@ class AbstractChat {
     virtual bool canDeleteChat(User::UserId user_id) = 0;
 
  protected:
+    std::vector<Message>::iterator locateMessage(Message::MessageId message_id);
+
     ChatRoomId                id_;
     std::string               name_;
-    std::vector<User::UserId> participants_;
+    ParticipantSet            participants_;
     std::vector<Message>      messages_;
+    Message::MessageId        lastMessageId_{};
+    std::shared_ptr<const FrozenHistory> frozen_;
+    std::uint64_t             historyVersion_ = 0;
+    std::chrono::system_clock::time_point lastActivity_;
+    std::chrono::seconds      messageTtl_{0};
 };
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "abstract_group_chat.h"
+
+
+// Announcement room: anyone may join, only the admin posts.
+class BroadcastChat : public AbstractGroupChat {
+ public:
+    BroadcastChat(ChatRoomId id, const std::string& name, User::UserId admin_id);
+
+    bool addParticipant(User::UserId user_add, User::UserId user_get_added) override;
+    [[nodiscard]] bool canPost(User::UserId user_id) const override;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "user.h"
+
+
+// Membership of a room. Reads are lock-free: they see an immutable snapshot
+// published by the last writer. Writers copy the snapshot, modify it and
+// swap it in; the old one is reclaimed through EpochDomain.
+class ParticipantSet {
+ public:
+    using UserId = User::UserId;
+
+    ParticipantSet();
+    ~ParticipantSet();
+
+    ParticipantSet(const ParticipantSet&) = delete;
+    ParticipantSet& operator=(const ParticipantSet&) = delete;
+
+    [[nodiscard]] bool contains(UserId user_id) const;
+    [[nodiscard]] std::vector<UserId> members() const;
+    [[nodiscard]] std::optional<UserId> first() const;
+    [[nodiscard]] std::size_t size() const;
+    [[nodiscard]] bool empty() const;
+
+    bool insert(UserId user_id, std::size_t capacity = std::numeric_limits<std::size_t>::max());
+    bool erase(UserId user_id);
+
+ private:
+    struct Snapshot {
+        std::vector<UserId> ordered;    // join order
+        std::vector<UserId> sorted;
+    };
+
+    void publish(const Snapshot* next);
+
+    std::atomic<const Snapshot*> current_;
+    std::mutex writerMutex_;
+};
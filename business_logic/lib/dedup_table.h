@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <boost/uuid/uuid.hpp>
+
+
+struct DedupOptions {
+    std::chrono::seconds window{600};
+    std::size_t          maxKeys = 1'000'000;
+    // Longer keys are refused rather than stored.
+    std::size_t          maxKeyBytes = 64;
+};
+
+struct DedupStats {
+    std::size_t   keys = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t conflicts = 0;
+    std::uint64_t evicted = 0;
+};
+
+// Remembers which message a user's idempotency key produced. Keys are
+// scoped per user and stored whole, so two keys never share an entry, and
+// capped at maxKeyBytes, so an entry stays small whatever the client sends.
+// Entries leave in insertion order once they fall out of the window (on the
+// chat manager's clock) or the table exceeds maxKeys.
+class DedupTable {
+ public:
+    using UserId = boost::uuids::uuid;
+    using ChatRoomId = boost::uuids::uuid;
+    using MessageId = boost::uuids::uuid;
+    using TimePoint = std::chrono::system_clock::time_point;
+
+    struct Lookup {
+        bool      conflict;
+        MessageId messageId;
+    };
+
+    explicit DedupTable(DedupOptions options = {});
+
+    [[nodiscard]] bool accepts(std::string_view key) const;
+    std::optional<Lookup> find(UserId user_id, std::string_view key, ChatRoomId room_id, TimePoint now);
+    void remember(UserId user_id, std::string_view key, ChatRoomId room_id, MessageId message_id, TimePoint now);
+
+    void setOptions(DedupOptions options);
+    [[nodiscard]] DedupStats stats() const;
+
+ private:
+    struct Key {
+        UserId      user;
+        std::string bytes;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(const Key& key) const;
+    };
+
+    struct Entry {
+        ChatRoomId roomId;
+        MessageId  messageId;
+        TimePoint  insertedAt;
+    };
+
+    static Key makeKey(UserId user_id, std::string_view key);
+    void evict(TimePoint now);
+
+    DedupOptions options_;
+    std::unordered_map<Key, Entry, KeyHash> entries_;
+    std::deque<Key> order_;
+
+    std::uint64_t hits_ = 0;
+    std::uint64_t conflicts_ = 0;
+    std::uint64_t evicted_ = 0;
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+// Epoch-based reclamation. Readers pin the current epoch for the duration
+// of a lock-free read; writers retire replaced objects, which are freed once
+// every pinned reader has moved past the epoch they were retired in.
+// Process-wide: per-thread pins are shared, so there is a single domain.
+class EpochDomain {
+ public:
+    static constexpr std::size_t kMaxThreads = 512;
+
+    class Guard {
+     public:
+        explicit Guard(EpochDomain& domain);
+        ~Guard();
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+     private:
+        EpochDomain& domain_;
+    };
+
+    static EpochDomain& instance();
+
+    void retire(std::function<void()> reclaim);
+    void collect();
+
+    [[nodiscard]] std::size_t pendingCount() const;
+    [[nodiscard]] std::uint64_t reclaimedCount() const;
+
+ private:
+    static constexpr std::uint64_t kIdle = ~std::uint64_t{0};
+    static constexpr std::size_t kCollectThreshold = 64;
+
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> epoch{kIdle};
+        std::atomic<bool>          claimed{false};
+    };
+
+    struct Retired {
+        std::uint64_t         epoch;
+        std::function<void()> reclaim;
+    };
+
+    EpochDomain() = default;
+
+    std::atomic<std::uint64_t>& threadEpoch();
+    void enter();
+    void leave();
+
+    std::atomic<std::uint64_t> epoch_{1};
+    std::array<Slot, kMaxThreads> slots_;
+
+    mutable std::mutex retiredMutex_;
+    std::vector<Retired> retired_;
+    std::atomic<std::uint64_t> reclaimed_{0};
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/uuid/uuid.hpp>
+
+
+// Hierarchical timing wheel with one-second ticks: four levels of 64 slots
+// cover ~194 days, later deadlines park in the last level and re-cascade.
+// schedule and cancel are O(1); advance costs one step per elapsed tick,
+// skipping straight to the target when the wheel is empty.
+class ExpiryWheel {
+ public:
+    using ChatRoomId = boost::uuids::uuid;
+    using MessageId = boost::uuids::uuid;
+    using TimePoint = std::chrono::system_clock::time_point;
+
+    struct Expiry {
+        ChatRoomId roomId;
+        MessageId  messageId;
+    };
+
+    explicit ExpiryWheel(TimePoint start);
+
+    void schedule(ChatRoomId room_id, MessageId message_id, TimePoint deadline);
+    bool cancel(MessageId message_id);
+
+    std::vector<Expiry> advance(TimePoint now);
+
+    [[nodiscard]] std::size_t size() const;
+
+ private:
+    static constexpr std::size_t kLevels = 4;
+    static constexpr std::size_t kSlotBits = 6;
+    static constexpr std::size_t kSlots = std::size_t{1} << kSlotBits;
+
+    struct Entry {
+        Expiry        expiry;
+        std::uint64_t deadline;
+    };
+
+    using Slot = std::list<Entry>;
+
+    struct Location {
+        std::size_t     level;
+        std::size_t     slot;
+        Slot::iterator  entry;
+    };
+
+    static std::uint64_t toTick(TimePoint time);
+
+    void place(Entry entry);
+    void cascade(std::size_t level);
+
+    std::array<std::array<Slot, kSlots>, kLevels> wheel_;
+    std::unordered_map<MessageId, Location> locations_;
+    std::uint64_t current_;
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "message.h"
+
+
+// Immutable, deflate-compressed copy of a room's history. The block lives
+// in memory until spilled, after which it is read through a file mapping
+// and paged in by the kernel on access.
+class FrozenHistory {
+ public:
+    // Writes a whole spill file; returns false on failure. Lets the server
+    // route spills through its own I/O backend.
+    using Writer = std::function<bool(const std::filesystem::path&, std::span<const std::uint8_t>)>;
+
+    static std::unique_ptr<FrozenHistory> freeze(const std::vector<Message>& messages);
+
+    ~FrozenHistory();
+
+    FrozenHistory(const FrozenHistory&) = delete;
+    FrozenHistory& operator=(const FrozenHistory&) = delete;
+
+    [[nodiscard]] std::vector<Message> thaw() const;
+
+    // A copy read through a mapping of `file`, or null if writing or mapping
+    // it failed. Const, so it can run off the lock while readers use this one.
+    [[nodiscard]] std::unique_ptr<FrozenHistory> spill(const std::filesystem::path& file,
+        const Writer& writer = {}) const;
+
+    [[nodiscard]] bool isSpilled() const;
+    [[nodiscard]] std::size_t messageCount() const;
+    [[nodiscard]] std::size_t compressedBytes() const;
+    [[nodiscard]] std::size_t residentBytes() const;
+
+ private:
+    FrozenHistory() = default;
+
+    [[nodiscard]] const std::uint8_t* data() const;
+
+    std::vector<std::uint8_t> block_;
+    std::size_t               compressedSize_ = 0;
+    std::size_t               rawSize_ = 0;
+    std::size_t               messageCount_ = 0;
+
+    std::filesystem::path                                file_;
+    std::optional<boost::interprocess::file_mapping>     mapping_;
+    std::optional<boost::interprocess::mapped_region>    region_;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef PRISECCHAT_LOCK_PROFILING
+#define PRISECCHAT_LOCK_PROFILING 0
+#endif
+
+
+// Per call-site lock statistics. Each thread records into its own table;
+// report() merges them. Sites are string literals such as
+// "sendMessage/exclusive" and are compared by text when merging.
+class LockProfiler {
+ public:
+    static constexpr bool enabled = PRISECCHAT_LOCK_PROFILING;
+
+    struct Percentiles {
+        std::uint64_t p50 = 0;
+        std::uint64_t p99 = 0;
+        std::uint64_t max = 0;
+    };
+
+    struct SiteReport {
+        std::string   site;
+        std::uint64_t acquisitions = 0;
+        std::uint64_t contended = 0;
+        Percentiles   waitNanos;
+        Percentiles   holdNanos;
+    };
+
+    static void record(const char* site, std::chrono::nanoseconds wait, std::chrono::nanoseconds hold,
+        bool contended);
+    static std::vector<SiteReport> report();
+    static void reset();
+};
+
+// Wraps std::unique_lock / std::shared_lock. With profiling compiled out
+// it is the bare lock; otherwise it tries the lock first to detect
+// contention, then times the wait and the hold.
+template <typename Lock>
+class ProfiledLock {
+ public:
+    using mutex_type = typename Lock::mutex_type;
+    using Clock = std::chrono::steady_clock;
+
+#if PRISECCHAT_LOCK_PROFILING
+    ProfiledLock(mutex_type& mutex, const char* site)
+        : lock_(mutex, std::defer_lock),
+          site_(site)
+    {
+        const auto start = Clock::now();
+        contended_ = !lock_.try_lock();
+        if (contended_) {
+            lock_.lock();
+        }
+        acquired_ = Clock::now();
+        waited_ = acquired_ - start;
+    }
+
+    ProfiledLock(ProfiledLock&& other) noexcept
+        : lock_(std::move(other.lock_)),
+          site_(other.site_),
+          acquired_(other.acquired_),
+          waited_(other.waited_),
+          contended_(other.contended_)
+    {}
+
+    ~ProfiledLock() {
+        if (lock_.owns_lock()) {
+            unlock();
+        }
+    }
+
+    void unlock() {
+        lock_.unlock();
+        LockProfiler::record(site_, waited_, Clock::now() - acquired_, contended_);
+    }
+#else
+    ProfiledLock(mutex_type& mutex, const char*)
+        : lock_(mutex)
+    {}
+
+    ProfiledLock(ProfiledLock&&) noexcept = default;
+
+    void unlock() {
+        lock_.unlock();
+    }
+#endif
+
+    ProfiledLock& operator=(ProfiledLock&&) = delete;
+
+    [[nodiscard]] bool owns_lock() const {
+        return lock_.owns_lock();
+    }
+
+ private:
+    Lock lock_;
+#if PRISECCHAT_LOCK_PROFILING
+    const char*              site_;
+    Clock::time_point        acquired_;
+    std::chrono::nanoseconds waited_{0};
+    bool                     contended_ = false;
+#endif
+};
+
+using ExclusiveProfiledLock = ProfiledLock<std::unique_lock<std::shared_mutex>>;
+using SharedProfiledLock = ProfiledLock<std::shared_lock<std::shared_mutex>>;
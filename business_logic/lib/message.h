@@ -12,7 +12,7 @@ class Message {
     using TimePoint = std::chrono::system_clock::time_point;
     using MessageId = boost::uuids::uuid;
 
-    Message(MessageId id, User::UserId author_id, std::string text, TimePoint timestamp);
+    Message(MessageId id, User::UserId author_id, std::string text, TimePoint timestamp, bool edited = false);
 
     [[nodiscard]] MessageId getId() const;
     [[nodiscard]] User::UserId getAuthorId() const;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/uuid/uuid.hpp>
+
+#include "message.h"
+
+
+class SearchIndex {
+ public:
+    using ChatRoomId = boost::uuids::uuid;
+    using MessageId = Message::MessageId;
+
+    struct Hit {
+        ChatRoomId roomId;
+        MessageId  messageId;
+        double     score;
+    };
+
+    void addMessage(ChatRoomId room_id, const Message& message);
+    void updateMessage(ChatRoomId room_id, const Message& message);
+    void removeMessage(MessageId message_id);
+    // Drops every message of the room and frees its slot.
+    void removeRoom(ChatRoomId room_id);
+
+    // Walks only the postings of `rooms`, so a query costs what the
+    // caller's rooms hold, not the whole server.
+    [[nodiscard]] std::vector<Hit> search(const std::string& query,
+        const std::unordered_set<ChatRoomId>& rooms, std::size_t limit) const;
+
+    [[nodiscard]] std::size_t documentCount() const;
+    [[nodiscard]] std::size_t termCount() const;
+    [[nodiscard]] std::size_t memoryUsage() const;
+
+    static std::vector<std::string> tokenize(const std::string& text);
+
+ private:
+    using DocId = std::uint32_t;
+    using RoomSlot = std::uint32_t;
+
+    struct Document {
+        MessageId messageId;
+        RoomSlot  room;
+        bool      alive;
+    };
+
+    struct Posting {
+        DocId         doc;
+        std::uint32_t frequency;
+    };
+
+    struct RoomIndex {
+        ChatRoomId                                            id;
+        std::unordered_map<std::string, std::vector<Posting>> postings;
+    };
+
+    RoomSlot roomSlot(ChatRoomId room_id);
+    void compact();
+
+    std::vector<Document>                         documents_;
+    std::unordered_map<MessageId, DocId>          docByMessage_;
+    // Postings across every room, dead documents included until the next
+    // compaction; only feeds the idf.
+    std::unordered_map<std::string, std::uint32_t> documentFrequency_;
+
+    std::vector<RoomIndex>                        rooms_;
+    std::vector<RoomSlot>                         freeSlots_;
+    std::unordered_map<ChatRoomId, RoomSlot>      roomSlots_;
+
+    std::size_t deadDocuments_ = 0;
+};
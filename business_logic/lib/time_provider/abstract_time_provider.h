@@ -1,18 +1,46 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <vector>
 
 
 class AbstractTimeProvider {
  public:
+    using TimePoint = std::chrono::system_clock::time_point;
+    using Listener = std::function<void(TimePoint)>;
+
     explicit AbstractTimeProvider(std::chrono::system_clock::time_point initial);
 
     [[nodiscard]] std::chrono::system_clock::time_point now() const;
 
     void advanceTime(std::chrono::seconds delta);
+    // Real clocks catch up with wall time here; the server calls it about
+    // once a second. Mocks only move on advanceTime.
+    virtual void tick() {}
+
+    // Listeners observe the clock without changing it, so subscribing
+    // works through a const reference. Called after every advanceTime, on a
+    // snapshot taken outside the lock, so a listener may (un)subscribe and
+    // one removed concurrently can still see a final call.
+    std::size_t subscribe(Listener listener) const;
+    void unsubscribe(std::size_t id) const;
 
     virtual ~AbstractTimeProvider() = default;
 
  protected:
-    std::chrono::system_clock::time_point currentTime_;
+    void notify(TimePoint now) const;
+
+    // The time point's rep, so timer threads can move it while request
+    // threads read it.
+    std::atomic<TimePoint::rep> currentTime_;
+
+ private:
+    mutable std::mutex                      listenersMutex_;
+    mutable std::map<std::size_t, Listener> listeners_;
+    mutable std::size_t nextListenerId_ = 0;
 };
@@ -3,7 +3,12 @@
 #include "abstract_time_provider.h"
 
 
+// Wall time, advanced by tick() rather than read on every now(), so every
+// caller between two ticks sees the same instant.
 class TimeProvider : public AbstractTimeProvider {
  public:
     TimeProvider();
-};
\ No newline at end of file
+
+    // Never steps back: a wall clock set backwards is waited out.
+    void tick() override;
+};
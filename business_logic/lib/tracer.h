@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+struct TraceOptions {
+    std::uint32_t sampleOneIn = 1000;
+    std::size_t   ringCapacity = 8192;
+};
+
+// Sampled request tracing. A trace is started for one request in
+// sampleOneIn; spans of the active trace go into a fixed-size ring owned
+// by the recording thread. Writers never block: each slot is a seqlock,
+// and the exporter skips slots that are mid-write.
+class Tracer {
+ public:
+    using Nanos = std::uint64_t;
+
+    static void configure(TraceOptions options);
+
+    // New trace id, or 0 when this request is not sampled.
+    static std::uint64_t sample();
+    static std::uint64_t current();
+    static Nanos now();
+
+    static void record(const char* name, std::uint64_t trace_id, Nanos start, Nanos end);
+
+    // Recent spans of every thread as Chrome trace_event JSON.
+    static std::string exportChromeTrace();
+};
+
+// Makes a trace active on this thread, e.g. on the worker running a request.
+class TraceContext {
+ public:
+    explicit TraceContext(std::uint64_t trace_id);
+    ~TraceContext();
+
+    TraceContext(const TraceContext&) = delete;
+    TraceContext& operator=(const TraceContext&) = delete;
+
+ private:
+    std::uint64_t previous_;
+};
+
+// Records a span named after a string literal if a trace is active.
+class TraceScope {
+ public:
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+ private:
+    const char*    name_;
+    std::uint64_t  trace_;
+    Tracer::Nanos  start_ = 0;
+};
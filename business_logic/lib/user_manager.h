@@ -1,12 +1,15 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <unordered_map>
 #include <optional>
+#include <set>
 #include <shared_mutex>
-#include <unordered_set>
+#include <string>
+#include <vector>
 
 #include <boost/uuid/uuid.hpp>
-#include <boost/uuid/random_generator.hpp>
 
 #include "user.h"
 
@@ -14,20 +17,81 @@ class UserManager {
 public:
     using UserId = boost::uuids::uuid;
 
+    static constexpr std::size_t kStripeCount = 64;
+
+    struct Stats {
+        std::size_t liveUsers;
+        std::size_t reclaimableUsers;
+        std::size_t reclaimedUsers;
+        std::size_t loggedInUsers;
+    };
+
+    struct DirectoryEntry {
+        UserId      id;
+        std::string name;
+    };
+
+    // A copy taken under the stripe lock; records can be renamed or erased
+    // as soon as the lock is dropped, so no reference to one leaves here.
+    struct UserSnapshot {
+        UserId      id;
+        std::string name;
+        bool        ephemeral;
+        bool        adopted;
+        bool        loggedIn;
+    };
+
     UserManager() = default;
     UserId registerUser(const std::string& nickname = "Anonymous");
+    UserId registerEphemeralUser();
+    // Adds, or renames, a copy of a user registered on another node, so
+    // rooms here can refer to it. A registered user is adopted pinned; an
+    // ephemeral copy lives until releaseAdoptedUser, since only the home
+    // node knows when the user is gone.
+    void adoptUser(const UserId& id, const std::string& nickname, bool ephemeral);
+    bool pinUser(const UserId& id);
+    // Never releases an adopted copy; see releaseAdoptedUser.
+    bool releaseUser(const UserId& id);
+    bool releaseAdoptedUser(const UserId& id);
+    [[nodiscard]] bool isEphemeral(const UserId& id) const;
     bool renameUser(User::UserId id, const std::string& newName);
-    std::optional<std::reference_wrapper<User>> getUser(const UserId& id);
+    [[nodiscard]] std::optional<UserSnapshot> getUser(const UserId& id) const;
     [[nodiscard]] bool userExists(const UserId& id) const;
-    std::vector<std::pair<User::UserId, std::string>> getAllUsers() const;
+    std::vector<DirectoryEntry> listUsers(const std::string& prefix, const std::optional<DirectoryEntry>& after,
+        std::size_t limit) const;
     bool nameExists(const std::string& name) const;
     std::optional<UserId> findByName(const std::string& name) const;
     void setLoggedIn(UserId id, bool loggedIn);
     bool isLoggedIn(UserId id) const;
+    Stats getStats() const;
 
 private:
-    std::unordered_map<UserId, User> users_;
-    boost::uuids::random_generator generator_;
-    mutable std::shared_mutex mutex_;
-    std::unordered_set<UserId> loggedIn_;
+    struct Record {
+        explicit Record(User u) : user(std::move(u)) {}
+
+        User              user;
+        bool              ephemeral = false;
+        bool              adopted = false;
+        std::atomic<bool> loggedIn{false};
+    };
+
+    // Presence flips only touch Record::loggedIn under a shared stripe lock.
+    struct alignas(64) Stripe {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<UserId, Record> users;
+        std::size_t ephemeralCount = 0;
+    };
+
+    Stripe& stripeFor(const UserId& id);
+    const Stripe& stripeFor(const UserId& id) const;
+    UserId insertUser(UserId id, const std::string& nickname, bool ephemeral, bool adopted = false);
+    bool release(const UserId& id, bool adopted);
+
+    std::array<Stripe, kStripeCount> stripes_;
+
+    mutable std::shared_mutex directoryMutex_;
+    std::set<std::pair<std::string, UserId>> nameIndex_;
+
+    std::atomic<std::size_t> reclaimed_{0};
+    std::atomic<std::size_t> loggedIn_{0};
 };
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+#include <boost/uuid/uuid.hpp>
+
+
+// Canonical 8-4-4-4-12 hex form, lower case on output and either case on
+// input. Vectorized with AVX2 or SSE2 where the build targets them, with a
+// table-driven scalar fallback; all paths produce identical results.
+constexpr std::size_t kUuidTextLength = 36;
+
+// Writes exactly kUuidTextLength characters, no terminator.
+void formatUuid(const boost::uuids::uuid& id, char* out);
+std::string uuidToString(const boost::uuids::uuid& id);
+
+// Only the canonical form is accepted; anything else is nullopt.
+std::optional<boost::uuids::uuid> parseUuidText(std::string_view text);
+
+// Which implementation formatUuid/parseUuidText were built with.
+const char* uuidTextBackend();
+
+// Streams the canonical form without going through the locale-aware
+// operator<< from uuid_io.hpp.
+struct UuidText {
+    const boost::uuids::uuid& id;
+};
+
+inline std::ostream& operator<<(std::ostream& out, UuidText text) {
+    char buffer[kUuidTextLength];
+    formatUuid(text.id, buffer);
+    return out.write(buffer, kUuidTextLength);
+}
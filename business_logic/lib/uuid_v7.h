@@ -0,0 +1,14 @@
+#pragma once
+
+#include <boost/uuid/uuid.hpp>
+
+
+// RFC 9562 version 7 id: 48-bit unix milliseconds, then a per-thread
+// counter and random bits. Ids from one thread are strictly increasing,
+// so they sort by creation time. Safe to call concurrently without locks.
+boost::uuids::uuid generateTimeOrderedId();
+
+// An id that sorts right after `previous`: one more in its counter, with
+// fresh random bits. Lets a room keep its own ids increasing when ids
+// drawn on different threads arrive out of order.
+boost::uuids::uuid timeOrderedIdAfter(const boost::uuids::uuid& previous);
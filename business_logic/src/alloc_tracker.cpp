@@ -0,0 +1,165 @@
+#include "alloc_tracker.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+
+namespace {
+
+constexpr std::uint8_t kNoCommandSlot = 0xFF;
+
+struct Counter {
+    alignas(64) std::atomic<std::uint64_t> live{0};
+    std::atomic<std::uint64_t> peak{0};
+    std::atomic<std::uint64_t> count{0};
+
+    void charge(std::uint64_t bytes) {
+        count.fetch_add(1, std::memory_order_relaxed);
+        const auto now = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        auto seen = peak.load(std::memory_order_relaxed);
+        while (seen < now && !peak.compare_exchange_weak(seen, now, std::memory_order_relaxed)) {}
+    }
+
+    void release(std::uint64_t bytes) {
+        live.fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    AllocTracker::Usage usage() const {
+        return {live.load(std::memory_order_relaxed), peak.load(std::memory_order_relaxed),
+            count.load(std::memory_order_relaxed)};
+    }
+
+    void resetPeak() {
+        count.store(0, std::memory_order_relaxed);
+        peak.store(live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+};
+
+std::array<Counter, std::size_t(AllocTag::COUNT)> tagCounters;
+std::array<Counter, AllocTracker::kMaxCommands> commandCounters;
+
+#if PRISECCHAT_ALLOC_TRACKING
+
+// Constant-initialized, so reading them from operator new needs no guard.
+thread_local std::uint8_t currentTag = std::uint8_t(AllocTag::OTHER);
+thread_local std::uint8_t currentCommand = kNoCommandSlot;
+
+// Keeps the user pointer aligned as malloc's own result would be.
+struct alignas(std::max_align_t) Header {
+    std::uint64_t size;
+    std::uint8_t  tag;
+    std::uint8_t  command;
+};
+
+void* trackedAllocate(std::size_t size) noexcept {
+    auto* block = static_cast<Header*>(std::malloc(sizeof(Header) + size));
+    if (!block) {
+        return nullptr;
+    }
+
+    block->size = size;
+    block->tag = currentTag;
+    block->command = currentCommand;
+    tagCounters[block->tag].charge(size);
+    if (block->command != kNoCommandSlot) {
+        commandCounters[block->command].charge(size);
+    }
+    return block + 1;
+}
+
+void trackedFree(void* pointer) noexcept {
+    if (!pointer) {
+        return;
+    }
+
+    auto* block = static_cast<Header*>(pointer) - 1;
+    tagCounters[block->tag].release(block->size);
+    if (block->command != kNoCommandSlot) {
+        commandCounters[block->command].release(block->size);
+    }
+    std::free(block);
+}
+
+void* trackedAllocateOrThrow(std::size_t size) {
+    while (true) {
+        if (void* pointer = trackedAllocate(size)) {
+            return pointer;
+        }
+        auto handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+#endif
+
+} // namespace
+
+#if PRISECCHAT_ALLOC_TRACKING
+
+// Aligned overloads keep the library defaults: they pair among themselves
+// and are not counted.
+void* operator new(std::size_t size) { return trackedAllocateOrThrow(size); }
+void* operator new[](std::size_t size) { return trackedAllocateOrThrow(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return trackedAllocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return trackedAllocate(size); }
+
+void operator delete(void* pointer) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer) noexcept { trackedFree(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { trackedFree(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { trackedFree(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { trackedFree(pointer); }
+
+AllocScope::AllocScope(AllocTag tag, int command)
+    : previousTag_(currentTag),
+      previousCommand_(currentCommand)
+{
+    currentTag = std::uint8_t(tag);
+    if (command >= 0 && command < AllocTracker::kMaxCommands) {
+        currentCommand = std::uint8_t(command);
+    }
+}
+
+AllocScope::~AllocScope() {
+    currentTag = previousTag_;
+    currentCommand = previousCommand_;
+}
+
+#endif
+
+AllocTracker::Usage AllocTracker::tagUsage(AllocTag tag) {
+    return tagCounters[std::size_t(tag)].usage();
+}
+
+std::vector<AllocTracker::CommandUsage> AllocTracker::commandUsage() {
+    std::vector<CommandUsage> out;
+    for (int command = 0; command < kMaxCommands; ++command) {
+        auto usage = commandCounters[command].usage();
+        if (usage.allocations != 0 || usage.liveBytes != 0) {
+            out.push_back({command, usage});
+        }
+    }
+    return out;
+}
+
+const char* AllocTracker::tagName(AllocTag tag) {
+    switch (tag) {
+        case AllocTag::SESSION_BUFFERS:      return "session_buffers";
+        case AllocTag::OUTBOUND_QUEUES:      return "outbound_queues";
+        case AllocTag::DISPATCH_TEMPORARIES: return "dispatch_temporaries";
+        case AllocTag::ROOM_MESSAGES:        return "room_messages";
+        case AllocTag::USER_TABLE:           return "user_table";
+        default:                             return "other";
+    }
+}
+
+void AllocTracker::resetPeaks() {
+    for (auto& counter : tagCounters) counter.resetPeak();
+    for (auto& counter : commandCounters) counter.resetPeak();
+}
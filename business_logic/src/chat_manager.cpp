@@ -1,184 +1,602 @@
 #include "chat_manager.h"
 
-#include <mutex>
-#include <shared_mutex>
+#include <algorithm>
+#include <unordered_set>
 
+#include "alloc_tracker.h"
+#include "chat_room/broadcast_chat.h"
 #include "chat_room/group_close_chat.h"
 #include "chat_room/group_open_chat.h"
 #include "chat_room/personal_chat.h"
+#include "tracer.h"
+#include "uuid_text.h"
+#include "uuid_v7.h"
 
 
 ChatManager::ChatManager(const AbstractTimeProvider& time_provider, UserManager& user_manager)
-    : timeProvider_(time_provider),
-      userManager_(user_manager)
+    : userManager_(user_manager),
+      timeProvider_(time_provider),
+      expiryWheel_(time_provider.now()),
+      timeSubscription_(time_provider.subscribe([this](Clock::time_point now) { expireMessages(now); }))
 {}
 
-ChatManager::ChatRoomId ChatManager::generateChatRoomId() {
-    return chatRoomGenerator_();
+ChatManager::~ChatManager() {
+    timeProvider_.unsubscribe(timeSubscription_);
 }
 
+// Ids are random past the timestamp, so a node owning 1/n of the hash
+// space accepts one in about n draws; the cap only guards a bad placement.
+// Called under the exclusive lock, which changePlacement also holds, so a
+// room is never created against a placement that is being replaced.
+ChatManager::ChatRoomId ChatManager::generateChatRoomId() const {
+    constexpr int kMaxDraws = 4096;
+
+    auto id = generateTimeOrderedId();
+    for (int draw = 1; placement_ && draw < kMaxDraws && !placement_(id); ++draw) {
+        id = generateTimeOrderedId();
+    }
+    return id;
+}
+
+// Drawn before the exclusive lock; the room then moves it past its newest
+// id if needed (AbstractChat::orderedId), so appends stay in id order and
+// a getHistoryAfter cursor never has a later insert land behind it.
 ChatManager::MessageId ChatManager::generateMessageId() {
-    return messageGenerator_();
+    TraceScope trace("ChatManager::generateMessageId");
+    return generateTimeOrderedId();
+}
+
+void ChatManager::setEventListener(EventListener listener) {
+    auto lock = lockExclusive("setEventListener/exclusive");
+    eventListener_ = std::move(listener);
+}
+
+void ChatManager::setPlacement(Placement placement) {
+    auto lock = lockExclusive("setPlacement/exclusive");
+    placement_ = std::move(placement);
+}
+
+ChatEvent ChatManager::makeEvent(ChatEvent::Type type, const AbstractChat& room, MessageId message_id,
+    UserId actor_id, std::string text) const {
+
+    return ChatEvent{type, room.getId(), message_id, actor_id, std::move(text)};
+}
+
+void ChatManager::publish(const ChatEvent& event) const {
+    TraceScope trace("ChatManager::publish");
+    if (eventListener_) {
+        eventListener_(event);
+    }
+}
+
+void ChatManager::publishMembership(ChatEvent::Type type, ChatRoomId room_id, UserId user_id) const {
+    publish(ChatEvent{type, room_id, {}, user_id, {}});
 }
 
 bool ChatManager::validateUserExists(UserId user) const {
     return userManager_.userExists(user);
 }
 
+bool ChatManager::retainUser(UserId user) {
+    return userManager_.pinUser(user);
+}
+
+// Rooms being handed to another node are read-only here: a write landing
+// after the snapshot was taken would be lost when the room is dropped.
+ChatManager::RoomMap::iterator ChatManager::findWritable(ChatRoomId room_id) {
+    if (handingOff_.contains(room_id)) {
+        return chatRooms_.end();
+    }
+    return chatRooms_.find(room_id);
+}
+
+void ChatManager::eraseRoom(ChatRoomId room_id) {
+    auto it = chatRooms_.find(room_id);
+    for (const auto& message : it->second->copyMessages()) {
+        expiryWheel_.cancel(message.getId());
+    }
+    searchIndex_.removeRoom(room_id);
+    chatRooms_.erase(it);
+    handingOff_.erase(room_id);
+}
+
 ChatManager::Clock::time_point ChatManager::now() const {
     return timeProvider_.now();
 }
 
+ExclusiveProfiledLock ChatManager::lockExclusive(const char* site) {
+    const auto traceStart = Tracer::now();
+    auto start = std::chrono::steady_clock::now();
+    ExclusiveProfiledLock lock(mutex_, site);
+    auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    Tracer::record("ChatManager::lockWait", Tracer::current(), traceStart, Tracer::now());
+
+    lockWaitMicros_.fetch_add(waited, std::memory_order_relaxed);
+    lockAcquisitions_.fetch_add(1, std::memory_order_relaxed);
+    return lock;
+}
+
+std::vector<Message> ChatManager::readHistory(const AbstractChat& room) const {
+    if (!room.frozenHistory()) {
+        return room.getMessages();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto messages = room.copyMessages();
+    auto micros = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+
+    coldReads_.fetch_add(1, std::memory_order_relaxed);
+    auto seen = coldReadMaxMicros_.load(std::memory_order_relaxed);
+    while (micros > seen && !coldReadMaxMicros_.compare_exchange_weak(seen, micros, std::memory_order_relaxed)) {}
+    return messages;
+}
+
+void ChatManager::setTieringOptions(TieringOptions options) {
+    auto lock = lockExclusive("setTieringOptions/exclusive");
+    tiering_ = std::move(options);
+}
+
+// Freezes rooms idle past the threshold, then spills the least recently
+// active frozen rooms to disk until resident frozen bytes fit the budget.
+// Candidates are copied under the shared lock and compressed and written
+// without it; the exclusive lock only swaps the results in, and a room
+// written to in the meantime keeps its history.
+TieringStats ChatManager::tierIdleRooms() {
+    AllocScope alloc(AllocTag::ROOM_MESSAGES);
+    std::lock_guard pass(tieringMutex_);
+
+    struct Candidate {
+        ChatRoomId                           id;
+        std::uint64_t                        version;
+        Clock::time_point                    lastActivity;
+        std::vector<Message>                 messages;
+        std::shared_ptr<const FrozenHistory> frozen;
+    };
+
+    TieringOptions options;
+    std::vector<Candidate> candidates;
+    {
+        SharedProfiledLock lock(mutex_, "tierIdleRooms/shared");
+        options = tiering_;
+        const auto cutoff = now() - options.idleAfter;
+
+        for (const auto& [roomId, room] : chatRooms_) {
+            auto frozen = room->shareFrozenHistory();
+            if (frozen && !frozen->isSpilled()) {
+                candidates.push_back({roomId, room->historyVersion(), room->lastActivity(), {}, std::move(frozen)});
+            } else if (!frozen && room->lastActivity() <= cutoff && !room->getMessages().empty()) {
+                candidates.push_back({roomId, room->historyVersion(), room->lastActivity(), room->getMessages(), {}});
+            }
+        }
+    }
+
+    std::size_t resident = 0;
+    for (auto& candidate : candidates) {
+        if (!candidate.frozen) {
+            candidate.frozen = FrozenHistory::freeze(candidate.messages);
+            candidate.messages = {};
+        }
+        resident += candidate.frozen->residentBytes();
+    }
+
+    if (resident > options.memoryBudget) {
+        std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+            return a.lastActivity < b.lastActivity;
+        });
+
+        std::error_code ec;
+        std::filesystem::create_directories(options.spillDirectory, ec);
+
+        for (auto& candidate : candidates) {
+            if (resident <= options.memoryBudget) {
+                break;
+            }
+
+            const auto bytes = candidate.frozen->residentBytes();
+            auto file = options.spillDirectory / (uuidToString(candidate.id) + ".blk");
+            if (auto spilled = candidate.frozen->spill(file, options.spillWriter)) {
+                candidate.frozen = std::move(spilled);
+                resident -= bytes;
+            }
+        }
+    }
+
+    auto lock = lockExclusive("tierIdleRooms/exclusive");
+    for (const auto& candidate : candidates) {
+        auto it = chatRooms_.find(candidate.id);
+        if (it != chatRooms_.end() && it->second->frozenHistory() != candidate.frozen.get()) {
+            it->second->installFrozen(candidate.version, candidate.frozen);
+        }
+    }
+
+    return collectTieringStats();
+}
+
+void ChatManager::setDedupOptions(DedupOptions options) {
+    auto lock = lockExclusive("setDedupOptions/exclusive");
+    dedup_.setOptions(options);
+}
+
+DedupStats ChatManager::dedupStats() const {
+    SharedProfiledLock lock(mutex_, "dedupStats/shared");
+    return dedup_.stats();
+}
+
+TieringStats ChatManager::tieringStats() const {
+    SharedProfiledLock lock(mutex_, "tieringStats/shared");
+    return collectTieringStats();
+}
+
+TieringStats ChatManager::collectTieringStats() const {
+    TieringStats stats;
+    for (const auto& [roomId, room] : chatRooms_) {
+        const auto* frozen = room->frozenHistory();
+        if (!frozen) {
+            ++stats.hotRooms;
+            stats.hotMessages += room->getMessages().size();
+            continue;
+        }
+
+        ++stats.frozenRooms;
+        stats.frozenMessages += frozen->messageCount();
+        stats.residentFrozenBytes += frozen->residentBytes();
+        if (frozen->isSpilled()) {
+            ++stats.spilledRooms;
+            stats.spilledBytes += frozen->compressedBytes();
+        }
+    }
+
+    stats.coldReads = coldReads_.load(std::memory_order_relaxed);
+    stats.coldReadMaxMicros = coldReadMaxMicros_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// Windowed rather than a running average: a window without exclusive
+// acquisitions reads as zero, so an old spike cannot outlive the load
+// that caused it. Approximate when it races a writer.
+std::chrono::microseconds ChatManager::takeLockWait() {
+    const auto waited = lockWaitMicros_.exchange(0, std::memory_order_relaxed);
+    const auto acquisitions = lockAcquisitions_.exchange(0, std::memory_order_relaxed);
+    return std::chrono::microseconds(acquisitions > 0 ? waited / acquisitions : 0);
+}
+
 ChatManager::ChatRoomId ChatManager::createPersonalChat(const std::string& name, UserId user1, UserId user2) {
-    std::unique_lock lock(mutex_);
+    AllocScope alloc(AllocTag::ROOM_MESSAGES);
+    auto lock = lockExclusive("createPersonalChat/exclusive");
+    auto personal_chat_id = generateChatRoomId();
 
-    if (!validateUserExists(user1) || !validateUserExists(user2)) {
+    if (!retainUser(user1) || !retainUser(user2)) {
         return {};
     }
 
-    auto personal_chat_id = generateChatRoomId();
     auto personal_chat = std::make_unique<PersonalChat>(personal_chat_id, name);
+    personal_chat->touch(now());
 
     personal_chat->addParticipant(user1, user1);
     personal_chat->addParticipant(user2, user2);
 
     chatRooms_.emplace(personal_chat_id, std::move(personal_chat));
+    publishMembership(ChatEvent::Type::MEMBER_JOINED, personal_chat_id, user1);
+    publishMembership(ChatEvent::Type::MEMBER_JOINED, personal_chat_id, user2);
     return personal_chat_id;
 }
 
 ChatManager::ChatRoomId ChatManager::createOpenGroup(const std::string& name, UserId admin_id) {
-    std::unique_lock lock(mutex_);
+    AllocScope alloc(AllocTag::ROOM_MESSAGES);
+    auto lock = lockExclusive("createOpenGroup/exclusive");
+    auto open_group_id = generateChatRoomId();
 
-    if (!validateUserExists(admin_id)) {
+    if (!retainUser(admin_id)) {
         return {};
     }
 
-    auto open_group_id = generateChatRoomId();
     auto open_chat = std::make_unique<OpenGroupChat>(open_group_id, name, admin_id);
+    open_chat->touch(now());
 
     chatRooms_.emplace(open_group_id, std::move(open_chat));
+    publishMembership(ChatEvent::Type::MEMBER_JOINED, open_group_id, admin_id);
     return open_group_id;
 }
 
 ChatManager::ChatRoomId ChatManager::createCloseGroup(const std::string& name, UserId admin_id) {
-    std::unique_lock lock(mutex_);
+    AllocScope alloc(AllocTag::ROOM_MESSAGES);
+    auto lock = lockExclusive("createCloseGroup/exclusive");
+    auto close_group_id = generateChatRoomId();
 
-    if (!validateUserExists(admin_id)) {
+    if (!retainUser(admin_id)) {
         return {};
     }
 
-    auto close_group_id = generateChatRoomId();
     auto close_chat = std::make_unique<CloseGroupChat>(close_group_id, name, admin_id);
+    close_chat->touch(now());
 
     chatRooms_.emplace(close_group_id, std::move(close_chat));
+    publishMembership(ChatEvent::Type::MEMBER_JOINED, close_group_id, admin_id);
     return close_group_id;
 }
 
+ChatManager::ChatRoomId ChatManager::createBroadcastChat(const std::string& name, UserId admin_id) {
+    AllocScope alloc(AllocTag::ROOM_MESSAGES);
+    auto lock = lockExclusive("createBroadcastChat/exclusive");
+    auto broadcast_id = generateChatRoomId();
+
+    if (!retainUser(admin_id)) {
+        return {};
+    }
+
+    auto broadcast_chat = std::make_unique<BroadcastChat>(broadcast_id, name, admin_id);
+    broadcast_chat->touch(now());
+
+    chatRooms_.emplace(broadcast_id, std::move(broadcast_chat));
+    publishMembership(ChatEvent::Type::MEMBER_JOINED, broadcast_id, admin_id);
+    return broadcast_id;
+}
+
 bool ChatManager::deleteChat(ChatRoomId id, UserId user_id) {
-    std::unique_lock lock(mutex_);
+    auto lock = lockExclusive("deleteChat/exclusive");
 
     if (!validateUserExists(user_id)) {
         return false;
     }
 
-    auto it = chatRooms_.find(id);
+    auto it = findWritable(id);
     if (it == chatRooms_.end()) return false;
 
     if (!it->second->canDeleteChat(user_id)) return false;
 
-    chatRooms_.erase(it);
+    eraseRoom(id);
+    publishMembership(ChatEvent::Type::ROOM_CLOSED, id);
     return true;
 }
 
 
+// Membership changes publish a new participant snapshot, so they only need
+// the room to stay alive, not exclusive access to the manager. Removals are
+// exclusive, so a join is never published out of order with a leave.
 bool ChatManager::addParticipant(ChatRoomId room_id, UserId user_add, UserId user_get_add) {
-    std::unique_lock lock(mutex_);
+    SharedProfiledLock lock(mutex_, "addParticipant/shared");
 
-    if (!validateUserExists(user_add) || !validateUserExists(user_get_add)) {
+    if (!validateUserExists(user_add) || !retainUser(user_get_add)) {
         return false;
     }
 
-    auto it = chatRooms_.find(room_id);
+    auto it = findWritable(room_id);
     if (it == chatRooms_.end()) return false;
 
-    return it->second->addParticipant(user_add, user_get_add);
+    if (!it->second->addParticipant(user_add, user_get_add)) {
+        return false;
+    }
+    publishMembership(ChatEvent::Type::MEMBER_JOINED, room_id, user_get_add);
+    return true;
 }
 
 bool ChatManager::removeParticipant(ChatRoomId room_id, UserId user_remove, UserId user_get_remove) {
-    std::unique_lock lock(mutex_);
+    auto lock = lockExclusive("removeParticipant/exclusive");
 
     if (!validateUserExists(user_remove) || !validateUserExists(user_get_remove)) {
         return false;
     }
 
-    auto it = chatRooms_.find(room_id);
+    auto it = findWritable(room_id);
     if (it == chatRooms_.end()) return false;
 
-    bool result = it->second->removeParticipant(user_remove, user_get_remove);
+    if (!it->second->removeParticipant(user_remove, user_get_remove)) {
+        return false;
+    }
+    publishMembership(ChatEvent::Type::MEMBER_LEFT, room_id, user_get_remove);
 
-    if (result && dynamic_cast<AbstractGroupChat*>(it->second.get())->getParticipants().empty()) {
-        chatRooms_.erase(it);
+    if (it->second->participantCount() == 0) {
+        eraseRoom(room_id);
+        publishMembership(ChatEvent::Type::ROOM_CLOSED, room_id);
     }
 
-    return result;
+    return true;
 }
 
 bool ChatManager::sendMessage(ChatRoomId room_id, UserId sender_id, const std::string& message) {
-    std::unique_lock lock(mutex_);
+    return sendMessage(room_id, sender_id, message, {}).has_value();
+}
+
+// A non-empty key makes the send idempotent: a retry with the same key
+// returns the id assigned the first time instead of appending again.
+std::optional<ChatManager::MessageId> ChatManager::sendMessage(ChatRoomId room_id, UserId sender_id,
+    const std::string& message, std::string_view idempotency_key) {
+
+    TraceScope trace("ChatManager::sendMessage");
+    AllocScope alloc(AllocTag::ROOM_MESSAGES);
+    auto message_id = generateMessageId();
+    auto lock = lockExclusive("sendMessage/exclusive");
 
     if (!validateUserExists(sender_id)) {
-        return false;
+        return std::nullopt;
     }
 
-    auto it = chatRooms_.find(room_id);
-    if (it == chatRooms_.end()) return false;
+    if (!idempotency_key.empty()) {
+        if (!dedup_.accepts(idempotency_key)) {
+            return std::nullopt;
+        }
+        if (auto seen = dedup_.find(sender_id, idempotency_key, room_id, now())) {
+            if (seen->conflict) {
+                return std::nullopt;
+            }
+            return seen->messageId;
+        }
+    }
 
-    const auto& participants = it->second->getParticipants();
-    if (std::find(participants.begin(), participants.end(), sender_id) == participants.end()) {
-        return false;
+    auto it = findWritable(room_id);
+    if (it == chatRooms_.end()) return std::nullopt;
+
+    if (!it->second->canPost(sender_id)) {
+        return std::nullopt;
     }
 
-    Message msg(generateMessageId(), sender_id, message, now());
+    message_id = it->second->orderedId(message_id);
+    Message msg(message_id, sender_id, message, now());
     it->second->addMessage(msg);
-    return true;
+    it->second->touch(msg.getTimestamp());
+    if (auto ttl = it->second->getMessageTtl(); ttl.count() > 0) {
+        expiryWheel_.schedule(room_id, message_id, msg.getTimestamp() + ttl);
+    }
+    searchIndex_.addMessage(room_id, msg);
+    if (!idempotency_key.empty()) {
+        dedup_.remember(sender_id, idempotency_key, room_id, message_id, msg.getTimestamp());
+    }
+
+    auto event = makeEvent(ChatEvent::Type::MESSAGE_SENT, *it->second, message_id, sender_id, message);
+    lock.unlock();
+
+    publish(event);
+    return message_id;
 }
 
 bool ChatManager::editMessage(ChatRoomId room_id, UserId user_edit, MessageId id, const std::string& new_text) {
-    std::unique_lock lock(mutex_);
+    TraceScope trace("ChatManager::editMessage");
+    AllocScope alloc(AllocTag::ROOM_MESSAGES);
+    auto lock = lockExclusive("editMessage/exclusive");
 
     if (!validateUserExists(user_edit)) {
         return false;
     }
 
-    auto it = chatRooms_.find(room_id);
+    auto it = findWritable(room_id);
     if (it == chatRooms_.end()) return false;
 
-    return it->second->editMessage(user_edit, id, new_text, now());
+    if (!it->second->editMessage(user_edit, id, new_text, now())) {
+        return false;
+    }
+    it->second->touch(now());
+
+    searchIndex_.updateMessage(room_id, *it->second->findMessage(id));
+
+    auto event = makeEvent(ChatEvent::Type::MESSAGE_EDITED, *it->second, id, user_edit, new_text);
+    lock.unlock();
+
+    publish(event);
+    return true;
 }
 
 bool ChatManager::removeMessage(ChatRoomId room_id, UserId user_remove, MessageId id) {
-    std::unique_lock lock(mutex_);
+    TraceScope trace("ChatManager::removeMessage");
+    auto lock = lockExclusive("removeMessage/exclusive");
 
     if (!validateUserExists(user_remove)) {
         return false;
     }
 
-    auto it = chatRooms_.find(room_id);
+    auto it = findWritable(room_id);
     if (it == chatRooms_.end()) return false;
 
-    return it->second->removeMessage(id, user_remove, now());
+    if (!it->second->removeMessage(id, user_remove, now())) {
+        return false;
+    }
+    it->second->touch(now());
+
+    searchIndex_.removeMessage(id);
+    expiryWheel_.cancel(id);
+
+    auto event = makeEvent(ChatEvent::Type::MESSAGE_REMOVED, *it->second, id, user_remove, {});
+    lock.unlock();
+
+    publish(event);
+    return true;
+}
+
+
+bool ChatManager::setMessageTtl(ChatRoomId room_id, UserId user_id, std::chrono::seconds ttl) {
+    auto lock = lockExclusive("setMessageTtl/exclusive");
+
+    if (!validateUserExists(user_id) || ttl.count() < 0) {
+        return false;
+    }
+
+    auto it = findWritable(room_id);
+    if (it == chatRooms_.end() || !it->second->canDeleteChat(user_id)) {
+        return false;
+    }
+
+    it->second->setMessageTtl(ttl);
+    return true;
+}
+
+// Expired messages leave exactly as if removed by hand: index entry dropped
+// and MESSAGE_REMOVED pushed, with a nil actor so every participant hears.
+void ChatManager::expireMessages(Clock::time_point now) {
+    std::vector<ChatEvent> events;
+    {
+        auto lock = lockExclusive("expireMessages/exclusive");
+
+        for (const auto& expiry : expiryWheel_.advance(now)) {
+            auto it = findWritable(expiry.roomId);
+            if (it == chatRooms_.end() || !it->second->eraseMessage(expiry.messageId)) {
+                continue;
+            }
+
+            searchIndex_.removeMessage(expiry.messageId);
+            events.push_back(makeEvent(ChatEvent::Type::MESSAGE_REMOVED, *it->second, expiry.messageId, UserId{}, {}));
+        }
+    }
+
+    for (const auto& event : events) {
+        publish(event);
+    }
 }
 
+std::size_t ChatManager::pendingExpirations() const {
+    SharedProfiledLock lock(mutex_, "pendingExpirations/shared");
+    return expiryWheel_.size();
+}
 
 std::vector<Message> ChatManager::getHistory(ChatRoomId roomId) const {
-    std::shared_lock lock(mutex_);
+    TraceScope trace("ChatManager::getHistory");
+    SharedProfiledLock lock(mutex_, "getHistory/shared");
 
     auto it = chatRooms_.find(roomId);
-    return it != chatRooms_.end() ? it->second->getMessages() : std::vector<Message>{};
+    return it != chatRooms_.end() ? readHistory(*it->second) : std::vector<Message>{};
+}
+
+std::vector<Message> ChatManager::getHistoryAfter(ChatRoomId roomId, MessageId after) const {
+    TraceScope trace("ChatManager::getHistoryAfter");
+    SharedProfiledLock lock(mutex_, "getHistoryAfter/shared");
+
+    auto it = chatRooms_.find(roomId);
+    if (it == chatRooms_.end()) return {};
+
+    auto messages = readHistory(*it->second);
+    auto from = std::upper_bound(messages.begin(), messages.end(), after,
+        [](const MessageId& id, const Message& m) { return id < m.getId(); });
+    messages.erase(messages.begin(), from);
+    return messages;
+}
+
+// Serializers walk hot rooms in place under the shared lock instead of
+// copying every message; frozen rooms are decoded once as usual.
+void ChatManager::visitHistory(ChatRoomId room_id, std::optional<MessageId> after,
+    const std::function<void(const Message&)>& visitor) const {
+
+    TraceScope trace("ChatManager::visitHistory");
+    SharedProfiledLock lock(mutex_, "visitHistory/shared");
+
+    auto it = chatRooms_.find(room_id);
+    if (it == chatRooms_.end()) return;
+
+    std::vector<Message> thawed;
+    if (it->second->frozenHistory()) {
+        thawed = readHistory(*it->second);
+    }
+    const auto& messages = it->second->frozenHistory() ? thawed : it->second->getMessages();
+
+    auto from = messages.begin();
+    if (after) {
+        from = std::upper_bound(messages.begin(), messages.end(), *after,
+            [](const MessageId& id, const Message& m) { return id < m.getId(); });
+    }
+    std::for_each(from, messages.end(), visitor);
 }
 
 User::UserId ChatManager::getChatAdmin(ChatRoomId room_id) const {
-    std::shared_lock lock(mutex_);
+    SharedProfiledLock lock(mutex_, "getChatAdmin/shared");
 
     auto it = chatRooms_.find(room_id);
     if (it == chatRooms_.end()) return {};
@@ -189,16 +607,16 @@ User::UserId ChatManager::getChatAdmin(ChatRoomId room_id) const {
 
 
 bool ChatManager::chatExists(ChatRoomId roomId) const {
-    std::shared_lock lock(mutex_);
+    SharedProfiledLock lock(mutex_, "chatExists/shared");
     return chatRooms_.contains(roomId);
 }
 
 std::vector<ChatManager::ChatRoomId> ChatManager::getUserChats(UserId user_id) const {
-    std::shared_lock lock(mutex_);
+    SharedProfiledLock lock(mutex_, "getUserChats/shared");
     std::vector<ChatRoomId> out;
     for (auto const& [roomId, roomPtr] : chatRooms_) {
-        auto participants = roomPtr->getParticipants();
-        if (std::find(participants.begin(), participants.end(), user_id) != participants.end()) {
+        // Listed by the node it is being handed to, not twice.
+        if (roomPtr->isParticipant(user_id) && !handingOff_.contains(roomId)) {
             out.push_back(roomId);
         }
     }
@@ -206,8 +624,163 @@ std::vector<ChatManager::ChatRoomId> ChatManager::getUserChats(UserId user_id) c
 }
 
 std::vector<ChatManager::UserId> ChatManager::getChatParticipants(ChatRoomId room_id) const {
-    std::shared_lock lock(mutex_);
+    SharedProfiledLock lock(mutex_, "getChatParticipants/shared");
     auto it = chatRooms_.find(room_id);
     if (it == chatRooms_.end()) return {};
     return it->second->getParticipants();
 }
+
+std::vector<SearchIndex::Hit> ChatManager::searchMessages(UserId user_id, const std::string& query,
+    std::size_t limit) const {
+    TraceScope trace("ChatManager::searchMessages");
+    SharedProfiledLock lock(mutex_, "searchMessages/shared");
+
+    std::unordered_set<ChatRoomId> rooms;
+    for (auto const& [roomId, roomPtr] : chatRooms_) {
+        if (roomPtr->isParticipant(user_id)) {
+            rooms.insert(roomId);
+        }
+    }
+
+    return searchIndex_.search(query, rooms, limit);
+}
+
+std::size_t ChatManager::searchIndexMemoryUsage() const {
+    SharedProfiledLock lock(mutex_, "searchIndexMemoryUsage/shared");
+    return searchIndex_.memoryUsage();
+}
+
+std::size_t ChatManager::searchIndexDocumentCount() const {
+    SharedProfiledLock lock(mutex_, "searchIndexDocumentCount/shared");
+    return searchIndex_.documentCount();
+}
+
+std::size_t ChatManager::searchIndexTermCount() const {
+    SharedProfiledLock lock(mutex_, "searchIndexTermCount/shared");
+    return searchIndex_.termCount();
+}
+
+std::vector<ChatManager::ChatRoomId> ChatManager::roomIds() const {
+    SharedProfiledLock lock(mutex_, "roomIds/shared");
+    std::vector<ChatRoomId> out;
+    out.reserve(chatRooms_.size());
+    for (const auto& [roomId, room] : chatRooms_) {
+        out.push_back(roomId);
+    }
+    return out;
+}
+
+RoomSnapshot ChatManager::snapshotRoom(const AbstractChat& room) {
+    RoomSnapshot snapshot;
+    snapshot.id = room.getId();
+    snapshot.name = room.getName();
+    snapshot.participants = room.getParticipants();
+    snapshot.messageTtl = room.getMessageTtl();
+    snapshot.lastActivity = room.lastActivity();
+    snapshot.messages = room.copyMessages();
+    if (auto* group = dynamic_cast<const AbstractGroupChat*>(&room)) {
+        snapshot.adminId = group->getAdminId();
+        snapshot.kind = dynamic_cast<const BroadcastChat*>(&room) ? RoomSnapshot::Kind::BROADCAST
+            : dynamic_cast<const CloseGroupChat*>(&room) ? RoomSnapshot::Kind::CLOSE_GROUP
+            : RoomSnapshot::Kind::OPEN_GROUP;
+    }
+    return snapshot;
+}
+
+std::optional<RoomSnapshot> ChatManager::extractRoom(ChatRoomId room_id) {
+    auto lock = lockExclusive("extractRoom/exclusive");
+
+    auto it = chatRooms_.find(room_id);
+    if (it == chatRooms_.end()) {
+        return std::nullopt;
+    }
+
+    auto snapshot = snapshotRoom(*it->second);
+    eraseRoom(room_id);
+    return snapshot;
+}
+
+std::vector<RoomSnapshot> ChatManager::changePlacement(const std::function<void()>& update) {
+    auto lock = lockExclusive("changePlacement/exclusive");
+    update();
+
+    std::vector<RoomSnapshot> leaving;
+    if (!placement_) {
+        return leaving;
+    }
+    for (const auto& [roomId, room] : chatRooms_) {
+        if (!placement_(roomId)) {
+            leaving.push_back(snapshotRoom(*room));
+            handingOff_.insert(roomId);
+        }
+    }
+    return leaving;
+}
+
+bool ChatManager::dropRoom(ChatRoomId room_id) {
+    auto lock = lockExclusive("dropRoom/exclusive");
+    handingOff_.erase(room_id);
+    if (!chatRooms_.contains(room_id)) {
+        return false;
+    }
+    eraseRoom(room_id);
+    return true;
+}
+
+void ChatManager::keepRoom(ChatRoomId room_id) {
+    auto lock = lockExclusive("keepRoom/exclusive");
+    handingOff_.erase(room_id);
+}
+
+bool ChatManager::adoptRoom(RoomSnapshot snapshot) {
+    AllocScope alloc(AllocTag::ROOM_MESSAGES);
+    auto lock = lockExclusive("adoptRoom/exclusive");
+
+    if (chatRooms_.contains(snapshot.id)) {
+        return false;
+    }
+    for (const auto& participant : snapshot.participants) {
+        if (!validateUserExists(participant)) {
+            return false;
+        }
+    }
+    for (const auto& participant : snapshot.participants) {
+        retainUser(participant);
+    }
+
+    std::unique_ptr<AbstractChat> room;
+    switch (snapshot.kind) {
+        case RoomSnapshot::Kind::PERSONAL:
+            room = std::make_unique<PersonalChat>(snapshot.id, snapshot.name);
+            break;
+        case RoomSnapshot::Kind::OPEN_GROUP:
+            room = std::make_unique<OpenGroupChat>(snapshot.id, snapshot.name, snapshot.adminId);
+            break;
+        case RoomSnapshot::Kind::CLOSE_GROUP:
+            room = std::make_unique<CloseGroupChat>(snapshot.id, snapshot.name, snapshot.adminId);
+            break;
+        case RoomSnapshot::Kind::BROADCAST:
+            room = std::make_unique<BroadcastChat>(snapshot.id, snapshot.name, snapshot.adminId);
+            break;
+    }
+
+    // Group rooms already hold their admin; every kind accepts an insert
+    // made by the admin or by the joining user.
+    const auto inviter = snapshot.kind == RoomSnapshot::Kind::PERSONAL ? User::UserId{} : snapshot.adminId;
+    for (const auto& participant : snapshot.participants) {
+        room->addParticipant(inviter.is_nil() ? participant : inviter, participant);
+    }
+
+    room->setMessageTtl(snapshot.messageTtl);
+    for (const auto& message : snapshot.messages) {
+        room->addMessage(message);
+        searchIndex_.addMessage(snapshot.id, message);
+        if (snapshot.messageTtl.count() > 0) {
+            expiryWheel_.schedule(snapshot.id, message.getId(), message.getTimestamp() + snapshot.messageTtl);
+        }
+    }
+    room->touch(snapshot.lastActivity);
+
+    chatRooms_.emplace(snapshot.id, std::move(room));
+    return true;
+}
@@ -1,6 +1,9 @@
+#include <algorithm>
+#include <cassert>
 #include <utility>
 
 #include "chat_room/abstract_chat.h"
+#include "uuid_v7.h"
 
 
 AbstractChat::AbstractChat(ChatRoomId id, std::string  name)
@@ -15,24 +18,134 @@ const std::string& AbstractChat::getName() const {
     return name_;
 }
 
-const std::vector<User::UserId>& AbstractChat::getParticipants() const {
-    return participants_;
+std::vector<User::UserId> AbstractChat::getParticipants() const {
+    return participants_.members();
+}
+
+bool AbstractChat::isParticipant(User::UserId user_id) const {
+    return participants_.contains(user_id);
+}
+
+std::size_t AbstractChat::participantCount() const {
+    return participants_.size();
+}
+
+bool AbstractChat::canPost(User::UserId user_id) const {
+    return participants_.contains(user_id);
 }
 
 const std::vector<Message>& AbstractChat::getMessages() const {
+    assert(!frozen_ && "frozen rooms are read through copyMessages");
     return messages_;
 }
 
+std::vector<Message> AbstractChat::copyMessages() const {
+    return frozen_ ? frozen_->thaw() : messages_;
+}
+
+bool AbstractChat::installFrozen(std::uint64_t version, const std::shared_ptr<const FrozenHistory>& frozen) {
+    if (version != historyVersion_) {
+        return false;
+    }
+
+    frozen_ = frozen;
+    messages_.clear();
+    messages_.shrink_to_fit();
+    ++historyVersion_;
+    return true;
+}
+
+void AbstractChat::thaw() {
+    if (!frozen_) {
+        return;
+    }
+
+    messages_ = frozen_->thaw();
+    frozen_.reset();
+    ++historyVersion_;
+}
+
+const FrozenHistory* AbstractChat::frozenHistory() const {
+    return frozen_.get();
+}
+
+std::shared_ptr<const FrozenHistory> AbstractChat::shareFrozenHistory() const {
+    return frozen_;
+}
+
+std::uint64_t AbstractChat::historyVersion() const {
+    return historyVersion_;
+}
+
+void AbstractChat::touch(std::chrono::system_clock::time_point now) {
+    lastActivity_ = now;
+}
+
+std::chrono::system_clock::time_point AbstractChat::lastActivity() const {
+    return lastActivity_;
+}
+
+namespace {
+
+bool idLess(const Message& m, const Message::MessageId& id) {
+    return m.getId() < id;
+}
+
+} // namespace
+
+const Message* AbstractChat::findMessage(Message::MessageId message_id) const {
+    assert(!frozen_ && "frozen rooms are read through copyMessages");
+    auto it = std::lower_bound(messages_.begin(), messages_.end(), message_id, idLess);
+    return it != messages_.end() && it->getId() == message_id ? &*it : nullptr;
+}
+
+std::vector<Message>::iterator AbstractChat::locateMessage(Message::MessageId message_id) {
+    thaw();
+    ++historyVersion_;
+    auto it = std::lower_bound(messages_.begin(), messages_.end(), message_id, idLess);
+    return it != messages_.end() && it->getId() == message_id ? it : messages_.end();
+}
+
+Message::MessageId AbstractChat::orderedId(Message::MessageId drawn) const {
+    return lastMessageId_ < drawn ? drawn : timeOrderedIdAfter(lastMessageId_);
+}
+
 void AbstractChat::addMessage(const Message& message) {
-    messages_.emplace_back(message);
+    thaw();
+    ++historyVersion_;
+    lastMessageId_ = std::max(lastMessageId_, message.getId());
+    if (messages_.empty() || messages_.back().getId() < message.getId()) {
+        messages_.emplace_back(message);
+        return;
+    }
+
+    auto it = std::lower_bound(messages_.begin(), messages_.end(), message.getId(), idLess);
+    messages_.insert(it, message);
+}
+
+bool AbstractChat::eraseMessage(Message::MessageId message_id) {
+    auto it = locateMessage(message_id);
+    if (it == messages_.end()) {
+        return false;
+    }
+
+    messages_.erase(it);
+    return true;
+}
+
+void AbstractChat::setMessageTtl(std::chrono::seconds ttl) {
+    messageTtl_ = ttl;
+}
+
+std::chrono::seconds AbstractChat::getMessageTtl() const {
+    return messageTtl_;
 }
 
 bool AbstractChat::editMessage(User::UserId user, Message::MessageId message_id,
     const std::string& new_text,
     std::chrono::system_clock::time_point now) {
 
-    auto it = std::find_if(messages_.begin(), messages_.end(),
-        [message_id](const Message& m) {return m.getId() == message_id;});
+    auto it = locateMessage(message_id);
     if (it == messages_.end()) {
         return false;
     }
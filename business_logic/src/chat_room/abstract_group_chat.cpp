@@ -3,7 +3,7 @@
 
 AbstractGroupChat::AbstractGroupChat(ChatRoomId id, const std::string& name, User::UserId admin_id)
     : AbstractChat(id, name), adminId_(admin_id) {
-    participants_.emplace_back(admin_id);
+    participants_.insert(admin_id);
 }
 
 User::UserId AbstractGroupChat::getAdminId() const {
@@ -11,16 +11,17 @@ User::UserId AbstractGroupChat::getAdminId() const {
 }
 
 bool AbstractGroupChat::removeParticipant(User::UserId user_remove, User::UserId user_get_removed) {
-    auto it = std::find(participants_.begin(), participants_.end(), user_get_removed);
-    if (it == participants_.end()) {
+    if (!participants_.contains(user_get_removed)) {
         return false;
     }
 
     if (user_remove == user_get_removed) {
-        participants_.erase(it);
+        participants_.erase(user_get_removed);
 
-        if (user_remove == adminId_ && !participants_.empty()) {
-            adminId_ = participants_.front();
+        if (user_remove == adminId_) {
+            if (auto next = participants_.first()) {
+                adminId_ = *next;
+            }
         }
 
         return true;
@@ -30,7 +31,7 @@ bool AbstractGroupChat::removeParticipant(User::UserId user_remove, User::UserId
         return false;
     }
 
-    participants_.erase(it);
+    participants_.erase(user_get_removed);
 
     return true;
 }
@@ -38,7 +39,7 @@ bool AbstractGroupChat::removeParticipant(User::UserId user_remove, User::UserId
 bool AbstractGroupChat::removeMessage(Message::MessageId message_id, User::UserId user_id,
     std::chrono::system_clock::time_point now) {
 
-    auto it = std::find_if(messages_.begin(), messages_.end(),[message_id](const Message& m) {return m.getId() == message_id;});
+    auto it = locateMessage(message_id);
     if (it == messages_.end()) {
         return false;
     }
@@ -0,0 +1,18 @@
+#include "chat_room/broadcast_chat.h"
+
+
+BroadcastChat::BroadcastChat(ChatRoomId id, const std::string& name, User::UserId admin_id)
+    : AbstractGroupChat(id, name, admin_id)
+{}
+
+bool BroadcastChat::addParticipant(User::UserId user_add, User::UserId user_get_added) {
+    if (user_add != user_get_added && user_add != adminId_) {
+        return false;
+    }
+
+    return participants_.insert(user_get_added);
+}
+
+bool BroadcastChat::canPost(User::UserId user_id) const {
+    return user_id == adminId_;
+}
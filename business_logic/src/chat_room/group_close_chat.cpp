@@ -10,10 +10,5 @@ bool CloseGroupChat::addParticipant(User::UserId user_add, User::UserId user_get
         return false;
     }
 
-    if (std::find(participants_.begin(), participants_.end(), user_get_add) != participants_.end()) {
-        return false;
-    }
-
-    participants_.emplace_back(user_get_add);
-    return true;
+    return participants_.insert(user_get_add);
 }
\ No newline at end of file
@@ -6,15 +6,9 @@ OpenGroupChat::OpenGroupChat(ChatRoomId id, const std::string& name, User::UserI
 {}
 
 bool OpenGroupChat::addParticipant(User::UserId user_add, User::UserId user_get_added) {
-    if (std::find(participants_.begin(), participants_.end(), user_add) == participants_.end()) {
+    if (!participants_.contains(user_add)) {
         return false;
     }
 
-    if (std::find(participants_.begin(), participants_.end(), user_get_added) != participants_.end()) {
-        return false;
-    }
-
-    participants_.emplace_back(user_get_added);
-
-    return true;
+    return participants_.insert(user_get_added);
 }
@@ -0,0 +1,86 @@
+#include "chat_room/participant_set.h"
+
+#include <algorithm>
+
+#include "epoch.h"
+
+
+ParticipantSet::ParticipantSet()
+    : current_(new Snapshot{})
+{}
+
+ParticipantSet::~ParticipantSet() {
+    auto* last = current_.load(std::memory_order_relaxed);
+    EpochDomain::instance().retire([last] { delete last; });
+}
+
+bool ParticipantSet::contains(UserId user_id) const {
+    EpochDomain::Guard guard(EpochDomain::instance());
+
+    const auto* snapshot = current_.load(std::memory_order_acquire);
+    return std::binary_search(snapshot->sorted.begin(), snapshot->sorted.end(), user_id);
+}
+
+std::vector<ParticipantSet::UserId> ParticipantSet::members() const {
+    EpochDomain::Guard guard(EpochDomain::instance());
+    return current_.load(std::memory_order_acquire)->ordered;
+}
+
+std::optional<ParticipantSet::UserId> ParticipantSet::first() const {
+    EpochDomain::Guard guard(EpochDomain::instance());
+
+    const auto* snapshot = current_.load(std::memory_order_acquire);
+    if (snapshot->ordered.empty()) {
+        return std::nullopt;
+    }
+    return snapshot->ordered.front();
+}
+
+std::size_t ParticipantSet::size() const {
+    EpochDomain::Guard guard(EpochDomain::instance());
+    return current_.load(std::memory_order_acquire)->ordered.size();
+}
+
+bool ParticipantSet::empty() const {
+    return size() == 0;
+}
+
+bool ParticipantSet::insert(UserId user_id, std::size_t capacity) {
+    std::lock_guard lock(writerMutex_);
+
+    const auto* snapshot = current_.load(std::memory_order_relaxed);
+    if (snapshot->ordered.size() >= capacity) {
+        return false;
+    }
+
+    auto pos = std::lower_bound(snapshot->sorted.begin(), snapshot->sorted.end(), user_id);
+    if (pos != snapshot->sorted.end() && *pos == user_id) {
+        return false;
+    }
+
+    auto* next = new Snapshot(*snapshot);
+    next->ordered.push_back(user_id);
+    next->sorted.insert(next->sorted.begin() + (pos - snapshot->sorted.begin()), user_id);
+    publish(next);
+    return true;
+}
+
+bool ParticipantSet::erase(UserId user_id) {
+    std::lock_guard lock(writerMutex_);
+
+    const auto* snapshot = current_.load(std::memory_order_relaxed);
+    if (!std::binary_search(snapshot->sorted.begin(), snapshot->sorted.end(), user_id)) {
+        return false;
+    }
+
+    auto* next = new Snapshot(*snapshot);
+    next->ordered.erase(std::find(next->ordered.begin(), next->ordered.end(), user_id));
+    next->sorted.erase(std::lower_bound(next->sorted.begin(), next->sorted.end(), user_id));
+    publish(next);
+    return true;
+}
+
+void ParticipantSet::publish(const Snapshot* next) {
+    const auto* previous = current_.exchange(next, std::memory_order_seq_cst);
+    EpochDomain::instance().retire([previous] { delete previous; });
+}
@@ -6,23 +6,13 @@ PersonalChat::PersonalChat(ChatRoomId id, const std::string& name)
 {}
 
 bool PersonalChat::addParticipant(User::UserId user_add, User::UserId user_get_added) {
-    if (participants_.size() > 1) {
-        return false;
-    }
-
-    if (std::find(participants_.begin(), participants_.end(), user_get_added) != participants_.end()) {
-        return false;
-    }
-
-    participants_.emplace_back(user_get_added);
-
-    return true;
+    return participants_.insert(user_get_added, 2);
 }
 
 bool PersonalChat::removeMessage(Message::MessageId message_id, User::UserId user_id,
         std::chrono::system_clock::time_point now) {
 
-    auto it = std::find_if(messages_.begin(), messages_.end(),[message_id](const Message& m) {return m.getId() == message_id;});
+    auto it = locateMessage(message_id);
     if (it == messages_.end()) {
         return false;
     }
@@ -45,5 +35,5 @@ bool PersonalChat::removeParticipant(User::UserId user_remove, User::UserId user
 }
 
 bool PersonalChat::canDeleteChat(User::UserId user_id) {
-    return std::find(participants_.begin(), participants_.end(), user_id) != participants_.end();
+    return participants_.contains(user_id);
 }
@@ -0,0 +1,77 @@
+#include "dedup_table.h"
+
+#include <boost/container_hash/hash.hpp>
+
+
+DedupTable::DedupTable(DedupOptions options)
+    : options_(options)
+{}
+
+std::size_t DedupTable::KeyHash::operator()(const Key& key) const {
+    std::size_t seed = boost::hash_range(key.user.begin(), key.user.end());
+    boost::hash_combine(seed, boost::hash_range(key.bytes.begin(), key.bytes.end()));
+    return seed;
+}
+
+DedupTable::Key DedupTable::makeKey(UserId user_id, std::string_view key) {
+    return {user_id, std::string(key)};
+}
+
+bool DedupTable::accepts(std::string_view key) const {
+    return key.size() <= options_.maxKeyBytes;
+}
+
+std::optional<DedupTable::Lookup> DedupTable::find(UserId user_id, std::string_view key, ChatRoomId room_id,
+    TimePoint now) {
+
+    evict(now);
+
+    auto it = entries_.find(makeKey(user_id, key));
+    if (it == entries_.end()) {
+        return std::nullopt;
+    }
+
+    if (it->second.roomId != room_id) {
+        ++conflicts_;
+        return Lookup{true, it->second.messageId};
+    }
+
+    ++hits_;
+    return Lookup{false, it->second.messageId};
+}
+
+void DedupTable::remember(UserId user_id, std::string_view key, ChatRoomId room_id, MessageId message_id,
+    TimePoint now) {
+
+    auto [it, inserted] = entries_.try_emplace(makeKey(user_id, key), Entry{room_id, message_id, now});
+    if (!inserted) {
+        return;
+    }
+
+    order_.push_back(it->first);
+    evict(now);
+}
+
+void DedupTable::evict(TimePoint now) {
+    while (!order_.empty()) {
+        auto it = entries_.find(order_.front());
+        const bool expired = it == entries_.end() || it->second.insertedAt + options_.window <= now;
+        if (!expired && entries_.size() <= options_.maxKeys) {
+            break;
+        }
+
+        if (it != entries_.end()) {
+            entries_.erase(it);
+            ++evicted_;
+        }
+        order_.pop_front();
+    }
+}
+
+void DedupTable::setOptions(DedupOptions options) {
+    options_ = options;
+}
+
+DedupStats DedupTable::stats() const {
+    return {entries_.size(), hits_, conflicts_, evicted_};
+}
@@ -0,0 +1,112 @@
+#include "epoch.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+
+namespace {
+
+struct ThreadPin {
+    std::atomic<std::uint64_t>* epoch = nullptr;
+    std::atomic<bool>*          claimed = nullptr;
+    std::size_t                 depth = 0;
+
+    ~ThreadPin() {
+        if (claimed) {
+            claimed->store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadPin threadPin;
+
+} // namespace
+
+EpochDomain::Guard::Guard(EpochDomain& domain)
+    : domain_(domain) {
+    domain_.enter();
+}
+
+EpochDomain::Guard::~Guard() {
+    domain_.leave();
+}
+
+EpochDomain& EpochDomain::instance() {
+    static EpochDomain domain;
+    return domain;
+}
+
+std::atomic<std::uint64_t>& EpochDomain::threadEpoch() {
+    if (!threadPin.epoch) {
+        for (auto& slot : slots_) {
+            bool expected = false;
+            if (slot.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                threadPin.epoch = &slot.epoch;
+                threadPin.claimed = &slot.claimed;
+                break;
+            }
+        }
+        if (!threadPin.epoch) {
+            throw std::runtime_error("EpochDomain: too many threads");
+        }
+    }
+    return *threadPin.epoch;
+}
+
+void EpochDomain::enter() {
+    auto& pinned = threadEpoch();
+    if (threadPin.depth++ == 0) {
+        pinned.store(epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+}
+
+void EpochDomain::leave() {
+    if (--threadPin.depth == 0) {
+        threadPin.epoch->store(kIdle, std::memory_order_release);
+    }
+}
+
+void EpochDomain::retire(std::function<void()> reclaim) {
+    const auto epoch = epoch_.fetch_add(1, std::memory_order_seq_cst);
+
+    std::size_t pending = 0;
+    {
+        std::lock_guard lock(retiredMutex_);
+        retired_.push_back({epoch, std::move(reclaim)});
+        pending = retired_.size();
+    }
+
+    if (pending >= kCollectThreshold) {
+        collect();
+    }
+}
+
+void EpochDomain::collect() {
+    std::uint64_t oldestPinned = kIdle;
+    for (const auto& slot : slots_) {
+        oldestPinned = std::min(oldestPinned, slot.epoch.load(std::memory_order_seq_cst));
+    }
+
+    std::vector<Retired> ready;
+    {
+        std::lock_guard lock(retiredMutex_);
+        auto split = std::partition(retired_.begin(), retired_.end(),
+            [oldestPinned](const Retired& r) { return r.epoch >= oldestPinned; });
+        ready.assign(std::make_move_iterator(split), std::make_move_iterator(retired_.end()));
+        retired_.erase(split, retired_.end());
+    }
+
+    for (auto& r : ready) {
+        r.reclaim();
+    }
+    reclaimed_.fetch_add(ready.size(), std::memory_order_relaxed);
+}
+
+std::size_t EpochDomain::pendingCount() const {
+    std::lock_guard lock(retiredMutex_);
+    return retired_.size();
+}
+
+std::uint64_t EpochDomain::reclaimedCount() const {
+    return reclaimed_.load(std::memory_order_relaxed);
+}
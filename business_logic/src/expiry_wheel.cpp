@@ -0,0 +1,104 @@
+#include "expiry_wheel.h"
+
+
+namespace {
+
+std::size_t slotAt(std::uint64_t tick, std::size_t level, std::size_t bits, std::size_t slots) {
+    return static_cast<std::size_t>((tick >> (level * bits)) & (slots - 1));
+}
+
+} // namespace
+
+ExpiryWheel::ExpiryWheel(TimePoint start)
+    : current_(toTick(start))
+{}
+
+std::uint64_t ExpiryWheel::toTick(TimePoint time) {
+    return static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count());
+}
+
+void ExpiryWheel::schedule(ChatRoomId room_id, MessageId message_id, TimePoint deadline) {
+    cancel(message_id);
+    place({{room_id, message_id}, std::max(toTick(deadline), current_ + 1)});
+}
+
+void ExpiryWheel::place(Entry entry) {
+    const auto delta = entry.deadline - current_;
+
+    std::size_t level = 0;
+    while (level + 1 < kLevels && delta >= (std::uint64_t{1} << ((level + 1) * kSlotBits))) {
+        ++level;
+    }
+
+    // Beyond the wheel's horizon: park in the farthest slot of the top level.
+    std::uint64_t target = entry.deadline;
+    if (level == kLevels - 1 && delta >= (std::uint64_t{1} << (kLevels * kSlotBits))) {
+        target = current_ + ((std::uint64_t{kSlots} - 1) << (level * kSlotBits));
+    }
+
+    const auto slot = slotAt(target, level, kSlotBits, kSlots);
+    auto& list = wheel_[level][slot];
+    const auto messageId = entry.expiry.messageId;
+    list.push_front(std::move(entry));
+    locations_[messageId] = {level, slot, list.begin()};
+}
+
+bool ExpiryWheel::cancel(MessageId message_id) {
+    auto it = locations_.find(message_id);
+    if (it == locations_.end()) {
+        return false;
+    }
+
+    wheel_[it->second.level][it->second.slot].erase(it->second.entry);
+    locations_.erase(it);
+    return true;
+}
+
+void ExpiryWheel::cascade(std::size_t level) {
+    auto& slot = wheel_[level][slotAt(current_, level, kSlotBits, kSlots)];
+    Slot pending;
+    pending.swap(slot);
+
+    for (auto& entry : pending) {
+        locations_.erase(entry.expiry.messageId);
+        place(std::move(entry));
+    }
+}
+
+std::vector<ExpiryWheel::Expiry> ExpiryWheel::advance(TimePoint now) {
+    const auto target = toTick(now);
+    std::vector<Expiry> expired;
+
+    while (current_ < target) {
+        if (locations_.empty()) {
+            current_ = target;
+            break;
+        }
+
+        ++current_;
+        for (std::size_t level = kLevels - 1; level > 0; --level) {
+            const auto lowerMask = (std::uint64_t{1} << (level * kSlotBits)) - 1;
+            if ((current_ & lowerMask) == 0) {
+                cascade(level);
+            }
+        }
+
+        auto& slot = wheel_[0][slotAt(current_, 0, kSlotBits, kSlots)];
+        for (auto it = slot.begin(); it != slot.end();) {
+            if (it->deadline <= current_) {
+                expired.push_back(it->expiry);
+                locations_.erase(it->expiry.messageId);
+                it = slot.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    return expired;
+}
+
+std::size_t ExpiryWheel::size() const {
+    return locations_.size();
+}
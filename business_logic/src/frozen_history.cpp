@@ -0,0 +1,202 @@
+#include "frozen_history.h"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <boost/beast/zlib/deflate_stream.hpp>
+#include <boost/interprocess/exceptions.hpp>
+#include <boost/beast/zlib/inflate_stream.hpp>
+
+
+namespace {
+
+namespace zlib = boost::beast::zlib;
+
+// Per message: id(16) author(16) timestamp(8, ns since epoch) edited(1) length(4) text.
+constexpr std::size_t kFixedRecordSize = 16 + 16 + 8 + 1 + 4;
+
+template <typename T>
+void put(std::vector<std::uint8_t>& out, T value) {
+    const auto* bytes = reinterpret_cast<const std::uint8_t*>(&value);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T take(const std::uint8_t*& in) {
+    T value;
+    std::memcpy(&value, in, sizeof(T));
+    in += sizeof(T);
+    return value;
+}
+
+std::vector<std::uint8_t> encode(const std::vector<Message>& messages) {
+    std::size_t size = 0;
+    for (const auto& message : messages) {
+        size += kFixedRecordSize + message.getText().size();
+    }
+
+    std::vector<std::uint8_t> raw;
+    raw.reserve(size);
+    for (const auto& message : messages) {
+        const auto id = message.getId();
+        const auto author = message.getAuthorId();
+        raw.insert(raw.end(), id.begin(), id.end());
+        raw.insert(raw.end(), author.begin(), author.end());
+        put<std::int64_t>(raw, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            message.getTimestamp().time_since_epoch()).count());
+        put<std::uint8_t>(raw, message.isEdited() ? 1 : 0);
+        put<std::uint32_t>(raw, static_cast<std::uint32_t>(message.getText().size()));
+        raw.insert(raw.end(), message.getText().begin(), message.getText().end());
+    }
+    return raw;
+}
+
+std::vector<Message> decode(const std::vector<std::uint8_t>& raw, std::size_t count) {
+    std::vector<Message> messages;
+    messages.reserve(count);
+
+    const std::uint8_t* in = raw.data();
+    for (std::size_t i = 0; i < count; ++i) {
+        Message::MessageId id;
+        std::memcpy(id.data, in, 16);
+        User::UserId author;
+        std::memcpy(author.data, in + 16, 16);
+        in += 32;
+
+        auto nanos = take<std::int64_t>(in);
+        bool edited = take<std::uint8_t>(in) != 0;
+        auto length = take<std::uint32_t>(in);
+        std::string text(reinterpret_cast<const char*>(in), length);
+        in += length;
+
+        Message::TimePoint timestamp(std::chrono::duration_cast<Message::TimePoint::duration>(
+            std::chrono::nanoseconds(nanos)));
+        messages.emplace_back(id, author, std::move(text), timestamp, edited);
+    }
+    return messages;
+}
+
+} // namespace
+
+std::unique_ptr<FrozenHistory> FrozenHistory::freeze(const std::vector<Message>& messages) {
+    auto raw = encode(messages);
+
+    std::unique_ptr<FrozenHistory> frozen(new FrozenHistory());
+    frozen->rawSize_ = raw.size();
+    frozen->messageCount_ = messages.size();
+
+    zlib::deflate_stream deflater;
+    frozen->block_.resize(deflater.upper_bound(raw.size()));
+
+    zlib::z_params params;
+    params.next_in = raw.data();
+    params.avail_in = raw.size();
+    params.next_out = frozen->block_.data();
+    params.avail_out = frozen->block_.size();
+
+    boost::system::error_code ec;
+    deflater.write(params, zlib::Flush::finish, ec);
+    if (ec && ec != zlib::error::end_of_stream) {
+        throw std::runtime_error("FrozenHistory: deflate failed: " + ec.message());
+    }
+
+    frozen->compressedSize_ = params.total_out;
+    frozen->block_.resize(frozen->compressedSize_);
+    frozen->block_.shrink_to_fit();
+    return frozen;
+}
+
+FrozenHistory::~FrozenHistory() {
+    region_.reset();
+    mapping_.reset();
+    if (!file_.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(file_, ec);
+    }
+}
+
+const std::uint8_t* FrozenHistory::data() const {
+    return region_ ? static_cast<const std::uint8_t*>(region_->get_address()) : block_.data();
+}
+
+std::vector<Message> FrozenHistory::thaw() const {
+    std::vector<std::uint8_t> raw(rawSize_);
+
+    zlib::inflate_stream inflater;
+    zlib::z_params params;
+    params.next_in = data();
+    params.avail_in = compressedSize_;
+    params.next_out = raw.data();
+    params.avail_out = raw.size();
+
+    boost::system::error_code ec;
+    inflater.write(params, zlib::Flush::finish, ec);
+    if (params.total_out != rawSize_) {
+        throw std::runtime_error("FrozenHistory: inflate failed: " + ec.message());
+    }
+
+    return decode(raw, messageCount_);
+}
+
+std::unique_ptr<FrozenHistory> FrozenHistory::spill(const std::filesystem::path& file, const Writer& writer) const {
+    if (region_ || compressedSize_ == 0) {
+        return nullptr;
+    }
+
+    // A failed spill leaves no file behind, so the room keeps its resident
+    // block and the next pass can try again.
+    auto discard = [&file] {
+        std::error_code ec;
+        std::filesystem::remove(file, ec);
+        return nullptr;
+    };
+
+    if (writer) {
+        if (!writer(file, std::span<const std::uint8_t>(block_.data(), compressedSize_))) {
+            return discard();
+        }
+    } else {
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(block_.data()), static_cast<std::streamsize>(compressedSize_));
+        out.close();
+        if (out.fail()) {
+            return discard();
+        }
+    }
+
+    // Whatever wrote it, a short file would map fine and fail on first read.
+    std::error_code ec;
+    if (std::filesystem::file_size(file, ec) != compressedSize_ || ec) {
+        return discard();
+    }
+
+    std::unique_ptr<FrozenHistory> spilled(new FrozenHistory());
+    spilled->compressedSize_ = compressedSize_;
+    spilled->rawSize_ = rawSize_;
+    spilled->messageCount_ = messageCount_;
+    try {
+        spilled->mapping_.emplace(file.string().c_str(), boost::interprocess::read_only);
+        spilled->region_.emplace(*spilled->mapping_, boost::interprocess::read_only, 0, compressedSize_);
+    } catch (const boost::interprocess::interprocess_exception&) {
+        return discard();
+    }
+    spilled->file_ = file;
+    return spilled;
+}
+
+bool FrozenHistory::isSpilled() const {
+    return region_.has_value();
+}
+
+std::size_t FrozenHistory::messageCount() const {
+    return messageCount_;
+}
+
+std::size_t FrozenHistory::compressedBytes() const {
+    return compressedSize_;
+}
+
+std::size_t FrozenHistory::residentBytes() const {
+    return block_.capacity();
+}
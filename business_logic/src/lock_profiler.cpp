@@ -0,0 +1,140 @@
+#include "lock_profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
+
+namespace {
+
+// Bucket i holds durations in [2^i, 2^(i+1)) nanoseconds.
+constexpr std::size_t kBuckets = 40;
+
+struct Histogram {
+    std::array<std::uint64_t, kBuckets> buckets{};
+    std::uint64_t max = 0;
+
+    void add(std::chrono::nanoseconds value) {
+        auto nanos = static_cast<std::uint64_t>(std::max<std::int64_t>(value.count(), 0));
+        auto bucket = std::min<std::size_t>(std::bit_width(nanos), kBuckets) - (nanos ? 1 : 0);
+        ++buckets[bucket];
+        max = std::max(max, nanos);
+    }
+
+    void merge(const Histogram& other) {
+        for (std::size_t i = 0; i < kBuckets; ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        max = std::max(max, other.max);
+    }
+
+    // Upper bound of the bucket holding the percentile, capped by max.
+    std::uint64_t percentile(double p) const {
+        std::uint64_t total = 0;
+        for (auto count : buckets) total += count;
+        if (total == 0) {
+            return 0;
+        }
+
+        auto rank = static_cast<std::uint64_t>(p * static_cast<double>(total - 1)) + 1;
+        for (std::size_t i = 0; i < kBuckets; ++i) {
+            if (rank <= buckets[i]) {
+                return std::min(max, (std::uint64_t{1} << (i + 1)) - 1);
+            }
+            rank -= buckets[i];
+        }
+        return max;
+    }
+};
+
+struct SiteStats {
+    std::uint64_t acquisitions = 0;
+    std::uint64_t contended = 0;
+    Histogram     wait;
+    Histogram     hold;
+};
+
+// Only the owning thread writes; the mutex is contended by report() alone.
+struct ThreadTable {
+    std::mutex mutex;
+    std::unordered_map<const char*, SiteStats> sites;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadTable>> tables;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+ThreadTable& localTable() {
+    thread_local std::shared_ptr<ThreadTable> table = [] {
+        auto created = std::make_shared<ThreadTable>();
+        auto& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        reg.tables.push_back(created);
+        return created;
+    }();
+    return *table;
+}
+
+} // namespace
+
+void LockProfiler::record(const char* site, std::chrono::nanoseconds wait, std::chrono::nanoseconds hold,
+    bool contended) {
+
+    auto& table = localTable();
+    std::lock_guard lock(table.mutex);
+
+    auto& stats = table.sites[site];
+    ++stats.acquisitions;
+    stats.contended += contended ? 1 : 0;
+    stats.wait.add(wait);
+    stats.hold.add(hold);
+}
+
+std::vector<LockProfiler::SiteReport> LockProfiler::report() {
+    std::map<std::string, SiteStats> merged;
+    {
+        auto& reg = registry();
+        std::lock_guard registryLock(reg.mutex);
+        for (const auto& table : reg.tables) {
+            std::lock_guard lock(table->mutex);
+            for (const auto& [site, stats] : table->sites) {
+                auto& into = merged[site];
+                into.acquisitions += stats.acquisitions;
+                into.contended += stats.contended;
+                into.wait.merge(stats.wait);
+                into.hold.merge(stats.hold);
+            }
+        }
+    }
+
+    std::vector<SiteReport> out;
+    out.reserve(merged.size());
+    for (const auto& [site, stats] : merged) {
+        out.push_back({site, stats.acquisitions, stats.contended,
+            {stats.wait.percentile(0.5), stats.wait.percentile(0.99), stats.wait.max},
+            {stats.hold.percentile(0.5), stats.hold.percentile(0.99), stats.hold.max}});
+    }
+
+    std::sort(out.begin(), out.end(), [](const SiteReport& a, const SiteReport& b) {
+        return a.waitNanos.p99 != b.waitNanos.p99 ? a.waitNanos.p99 > b.waitNanos.p99 : a.site < b.site;
+    });
+    return out;
+}
+
+void LockProfiler::reset() {
+    auto& reg = registry();
+    std::lock_guard registryLock(reg.mutex);
+    for (const auto& table : reg.tables) {
+        std::lock_guard lock(table->mutex);
+        table->sites.clear();
+    }
+}
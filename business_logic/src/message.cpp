@@ -3,12 +3,12 @@
 #include <utility>
 
 
-Message::Message(MessageId id, User::UserId author_id,std::string text,TimePoint timestamp)
+Message::Message(MessageId id, User::UserId author_id,std::string text,TimePoint timestamp, bool edited)
     : id_(id),
       authorId_(author_id),
       text_(std::move(text)),
       timestamp_(timestamp),
-      isEdited_(false)
+      isEdited_(edited)
 {}
 
 Message::MessageId Message::getId() const {
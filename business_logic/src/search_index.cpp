@@ -0,0 +1,298 @@
+#include "search_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <limits>
+
+
+namespace {
+
+constexpr std::size_t kCompactionMinDead = 4096;
+constexpr std::size_t kSmallStringCapacity = 15;
+
+bool isWordByte(unsigned char c) {
+    return std::isalnum(c) || c >= 0x80;
+}
+
+// ASCII and Cyrillic (UTF-8, two-byte) letters are folded to lower case.
+void foldCase(std::string& word) {
+    for (std::size_t i = 0; i < word.size(); ++i) {
+        auto c = static_cast<unsigned char>(word[i]);
+        if (c < 0x80) {
+            word[i] = static_cast<char>(std::tolower(c));
+            continue;
+        }
+
+        if (i + 1 >= word.size()) {
+            break;
+        }
+
+        auto next = static_cast<unsigned char>(word[i + 1]);
+        if (c == 0xD0 && next >= 0x90 && next <= 0x9F) {        // А..П -> а..п
+            word[i + 1] = static_cast<char>(next + 0x20);
+        } else if (c == 0xD0 && next >= 0xA0 && next <= 0xAF) { // Р..Я -> р..я
+            word[i] = static_cast<char>(0xD1);
+            word[i + 1] = static_cast<char>(next - 0x20);
+        } else if (c == 0xD0 && next == 0x81) {                  // Ё -> ё
+            word[i] = static_cast<char>(0xD1);
+            word[i + 1] = static_cast<char>(0x91);
+        }
+        ++i;
+    }
+}
+
+template <typename Map>
+std::size_t hashMapOverhead(const Map& map) {
+    using Node = std::pair<typename Map::key_type, typename Map::mapped_type>;
+    return map.bucket_count() * sizeof(void*) + map.size() * (sizeof(Node) + 2 * sizeof(void*));
+}
+
+} // namespace
+
+std::vector<std::string> SearchIndex::tokenize(const std::string& text) {
+    std::vector<std::string> out;
+    std::string current;
+
+    for (char ch : text) {
+        if (isWordByte(static_cast<unsigned char>(ch))) {
+            current.push_back(ch);
+        } else if (!current.empty()) {
+            foldCase(current);
+            out.push_back(std::move(current));
+            current.clear();
+        }
+    }
+
+    if (!current.empty()) {
+        foldCase(current);
+        out.push_back(std::move(current));
+    }
+
+    return out;
+}
+
+SearchIndex::RoomSlot SearchIndex::roomSlot(ChatRoomId room_id) {
+    auto it = roomSlots_.find(room_id);
+    if (it != roomSlots_.end()) {
+        return it->second;
+    }
+
+    RoomSlot slot;
+    if (!freeSlots_.empty()) {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+    } else {
+        slot = static_cast<RoomSlot>(rooms_.size());
+        rooms_.emplace_back();
+    }
+    rooms_[slot].id = room_id;
+    roomSlots_.emplace(room_id, slot);
+    return slot;
+}
+
+void SearchIndex::addMessage(ChatRoomId room_id, const Message& message) {
+    if (docByMessage_.contains(message.getId())) {
+        return;
+    }
+
+    const auto slot = roomSlot(room_id);
+    auto doc = static_cast<DocId>(documents_.size());
+    documents_.push_back({message.getId(), slot, true});
+    docByMessage_.emplace(message.getId(), doc);
+
+    auto terms = tokenize(message.getText());
+    std::sort(terms.begin(), terms.end());
+
+    auto& postings = rooms_[slot].postings;
+    for (auto it = terms.begin(); it != terms.end();) {
+        auto end = std::find_if(it, terms.end(), [&](const std::string& t) { return t != *it; });
+        postings[*it].push_back({doc, static_cast<std::uint32_t>(end - it)});
+        ++documentFrequency_[*it];
+        it = end;
+    }
+}
+
+void SearchIndex::updateMessage(ChatRoomId room_id, const Message& message) {
+    removeMessage(message.getId());
+    addMessage(room_id, message);
+}
+
+void SearchIndex::removeMessage(MessageId message_id) {
+    auto it = docByMessage_.find(message_id);
+    if (it == docByMessage_.end()) {
+        return;
+    }
+
+    documents_[it->second].alive = false;
+    docByMessage_.erase(it);
+    ++deadDocuments_;
+
+    if (deadDocuments_ >= kCompactionMinDead && deadDocuments_ * 2 > documents_.size()) {
+        compact();
+    }
+}
+
+void SearchIndex::removeRoom(ChatRoomId room_id) {
+    auto slot = roomSlots_.find(room_id);
+    if (slot == roomSlots_.end()) {
+        return;
+    }
+
+    auto& room = rooms_[slot->second];
+    for (const auto& [term, list] : room.postings) {
+        for (const auto& posting : list) {
+            auto& doc = documents_[posting.doc];
+            if (doc.alive) {
+                doc.alive = false;
+                docByMessage_.erase(doc.messageId);
+                ++deadDocuments_;
+            }
+        }
+
+        auto frequency = documentFrequency_.find(term);
+        frequency->second -= static_cast<std::uint32_t>(list.size());
+        if (frequency->second == 0) {
+            documentFrequency_.erase(frequency);
+        }
+    }
+
+    room.postings = {};
+    freeSlots_.push_back(slot->second);
+    roomSlots_.erase(slot);
+
+    if (deadDocuments_ >= kCompactionMinDead && deadDocuments_ * 2 > documents_.size()) {
+        compact();
+    }
+}
+
+void SearchIndex::compact() {
+    constexpr auto kDropped = std::numeric_limits<DocId>::max();
+
+    std::vector<DocId> remap(documents_.size(), kDropped);
+    std::vector<Document> live;
+    live.reserve(documents_.size() - deadDocuments_);
+
+    for (DocId doc = 0; doc < documents_.size(); ++doc) {
+        if (documents_[doc].alive) {
+            remap[doc] = static_cast<DocId>(live.size());
+            docByMessage_[documents_[doc].messageId] = remap[doc];
+            live.push_back(documents_[doc]);
+        }
+    }
+
+    documentFrequency_.clear();
+    for (auto& room : rooms_) {
+        for (auto it = room.postings.begin(); it != room.postings.end();) {
+            auto& list = it->second;
+            std::size_t kept = 0;
+            for (const auto& posting : list) {
+                if (remap[posting.doc] != kDropped) {
+                    list[kept++] = {remap[posting.doc], posting.frequency};
+                }
+            }
+
+            if (kept == 0) {
+                it = room.postings.erase(it);
+                continue;
+            }
+
+            list.resize(kept);
+            list.shrink_to_fit();
+            documentFrequency_[it->first] += static_cast<std::uint32_t>(kept);
+            ++it;
+        }
+    }
+
+    documents_ = std::move(live);
+    deadDocuments_ = 0;
+}
+
+std::vector<SearchIndex::Hit> SearchIndex::search(const std::string& query,
+    const std::unordered_set<ChatRoomId>& rooms, std::size_t limit) const {
+
+    auto terms = tokenize(query);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    std::vector<const RoomIndex*> allowed;
+    allowed.reserve(rooms.size());
+    for (const auto& room : rooms) {
+        if (auto it = roomSlots_.find(room); it != roomSlots_.end()) {
+            allowed.push_back(&rooms_[it->second]);
+        }
+    }
+
+    const auto liveDocuments = static_cast<double>(documents_.size() - deadDocuments_);
+    std::unordered_map<DocId, double> scores;
+
+    for (const auto& term : terms) {
+        auto frequency = documentFrequency_.find(term);
+        if (frequency == documentFrequency_.end()) {
+            continue;
+        }
+
+        const double idf = std::log(1.0 + liveDocuments / static_cast<double>(frequency->second));
+        for (const auto* room : allowed) {
+            auto it = room->postings.find(term);
+            if (it == room->postings.end()) {
+                continue;
+            }
+            for (const auto& posting : it->second) {
+                if (documents_[posting.doc].alive) {
+                    scores[posting.doc] += (1.0 + std::log(static_cast<double>(posting.frequency))) * idf;
+                }
+            }
+        }
+    }
+
+    std::vector<std::pair<DocId, double>> ranked(scores.begin(), scores.end());
+    auto byScore = [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first > b.first;
+    };
+
+    const auto count = std::min(limit, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + static_cast<std::ptrdiff_t>(count), ranked.end(), byScore);
+
+    std::vector<Hit> out;
+    out.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto& doc = documents_[ranked[i].first];
+        out.push_back({rooms_[doc.room].id, doc.messageId, ranked[i].second});
+    }
+
+    return out;
+}
+
+std::size_t SearchIndex::documentCount() const {
+    return documents_.size() - deadDocuments_;
+}
+
+std::size_t SearchIndex::termCount() const {
+    return documentFrequency_.size();
+}
+
+std::size_t SearchIndex::memoryUsage() const {
+    std::size_t bytes = sizeof(*this);
+    bytes += documents_.capacity() * sizeof(Document);
+    bytes += rooms_.capacity() * sizeof(RoomIndex);
+    bytes += freeSlots_.capacity() * sizeof(RoomSlot);
+    bytes += hashMapOverhead(docByMessage_);
+    bytes += hashMapOverhead(roomSlots_);
+    bytes += hashMapOverhead(documentFrequency_);
+
+    auto termBytes = [](const std::string& term) {
+        return term.capacity() > kSmallStringCapacity ? term.capacity() + 1 : 0;
+    };
+    for (const auto& [term, frequency] : documentFrequency_) {
+        bytes += termBytes(term);
+    }
+    for (const auto& room : rooms_) {
+        bytes += hashMapOverhead(room.postings);
+        for (const auto& [term, list] : room.postings) {
+            bytes += termBytes(term) + list.capacity() * sizeof(Posting);
+        }
+    }
+
+    return bytes;
+}
@@ -2,13 +2,40 @@
 
 
 AbstractTimeProvider::AbstractTimeProvider(std::chrono::system_clock::time_point initial)
-    : currentTime_(initial)
+    : currentTime_(initial.time_since_epoch().count())
 {}
 
 std::chrono::system_clock::time_point AbstractTimeProvider::now() const {
-    return currentTime_;
+    return TimePoint(TimePoint::duration(currentTime_.load()));
 }
 
 void AbstractTimeProvider::advanceTime(std::chrono::seconds delta) {
-    currentTime_ += delta;
+    const auto step = std::chrono::duration_cast<TimePoint::duration>(delta).count();
+    notify(TimePoint(TimePoint::duration(currentTime_.fetch_add(step) + step)));
+}
+
+void AbstractTimeProvider::notify(TimePoint now) const {
+    std::vector<Listener> listeners;
+    {
+        std::lock_guard lock(listenersMutex_);
+        listeners.reserve(listeners_.size());
+        for (const auto& [id, listener] : listeners_) {
+            listeners.push_back(listener);
+        }
+    }
+
+    for (const auto& listener : listeners) {
+        listener(now);
+    }
+}
+
+std::size_t AbstractTimeProvider::subscribe(Listener listener) const {
+    std::lock_guard lock(listenersMutex_);
+    listeners_.emplace(nextListenerId_, std::move(listener));
+    return nextListenerId_++;
+}
+
+void AbstractTimeProvider::unsubscribe(std::size_t id) const {
+    std::lock_guard lock(listenersMutex_);
+    listeners_.erase(id);
 }
\ No newline at end of file
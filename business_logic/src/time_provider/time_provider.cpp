@@ -3,4 +3,14 @@
 
 TimeProvider::TimeProvider()
     : AbstractTimeProvider(std::chrono::system_clock::now())
-{}
\ No newline at end of file
+{}
+
+void TimeProvider::tick() {
+    const auto target = std::chrono::system_clock::now().time_since_epoch().count();
+    auto current = currentTime_.load();
+    while (current < target && !currentTime_.compare_exchange_weak(current, target)) {}
+
+    if (current < target) {
+        notify(TimePoint(TimePoint::duration(target)));
+    }
+}
@@ -0,0 +1,205 @@
+#include "tracer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+
+namespace {
+
+std::atomic<std::uint32_t> sampleOneIn{TraceOptions{}.sampleOneIn};
+std::atomic<std::size_t>   ringCapacity{TraceOptions{}.ringCapacity};
+std::atomic<std::uint64_t> nextTraceId{1};
+
+thread_local std::uint64_t activeTrace = 0;
+
+const auto processStart = std::chrono::steady_clock::now();
+
+struct Span {
+    const char*   name;
+    std::uint64_t trace;
+    Tracer::Nanos start;
+    Tracer::Nanos end;
+};
+
+// Single writer (the owning thread), any number of readers. Fields are
+// relaxed atomics so a torn read is detected by the sequence, not UB.
+class SpanRing {
+ public:
+    SpanRing(std::uint32_t thread_id, std::size_t capacity)
+        : threadId_(thread_id),
+          slots_(std::max<std::size_t>(capacity, 1))
+    {}
+
+    void push(const Span& span) {
+        auto& slot = slots_[head_.load(std::memory_order_relaxed) % slots_.size()];
+
+        const auto sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.name.store(span.name, std::memory_order_relaxed);
+        slot.trace.store(span.trace, std::memory_order_relaxed);
+        slot.start.store(span.start, std::memory_order_relaxed);
+        slot.end.store(span.end, std::memory_order_relaxed);
+
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        head_.fetch_add(1, std::memory_order_release);
+    }
+
+    void collect(std::vector<std::pair<std::uint32_t, Span>>& out) const {
+        const auto head = head_.load(std::memory_order_acquire);
+        const auto count = std::min<std::uint64_t>(head, slots_.size());
+
+        for (auto i = head - count; i < head; ++i) {
+            const auto& slot = slots_[i % slots_.size()];
+
+            const auto before = slot.sequence.load(std::memory_order_acquire);
+            if (before % 2 != 0) {
+                continue;
+            }
+            Span span{slot.name.load(std::memory_order_relaxed), slot.trace.load(std::memory_order_relaxed),
+                slot.start.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed)};
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) != before || !span.name) {
+                continue;
+            }
+
+            out.emplace_back(threadId_, span);
+        }
+    }
+
+ private:
+    struct Slot {
+        std::atomic<std::uint64_t> sequence{0};
+        std::atomic<const char*>   name{nullptr};
+        std::atomic<std::uint64_t> trace{0};
+        std::atomic<Tracer::Nanos> start{0};
+        std::atomic<Tracer::Nanos> end{0};
+    };
+
+    std::uint32_t              threadId_;
+    std::vector<Slot>          slots_;
+    std::atomic<std::uint64_t> head_{0};
+};
+
+// Rings outlive their threads so spans of finished workers stay visible.
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<SpanRing>> rings;
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+SpanRing& localRing() {
+    thread_local std::shared_ptr<SpanRing> ring = [] {
+        auto& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        auto created = std::make_shared<SpanRing>(static_cast<std::uint32_t>(reg.rings.size() + 1),
+            ringCapacity.load(std::memory_order_relaxed));
+        reg.rings.push_back(created);
+        return created;
+    }();
+    return *ring;
+}
+
+void appendMicros(std::ostream& out, Tracer::Nanos nanos) {
+    out << nanos / 1000 << '.' << static_cast<char>('0' + nanos / 100 % 10)
+        << static_cast<char>('0' + nanos / 10 % 10) << static_cast<char>('0' + nanos % 10);
+}
+
+} // namespace
+
+void Tracer::configure(TraceOptions options) {
+    sampleOneIn.store(options.sampleOneIn, std::memory_order_relaxed);
+    ringCapacity.store(options.ringCapacity, std::memory_order_relaxed);
+}
+
+std::uint64_t Tracer::sample() {
+    thread_local std::uint32_t counter = 0;
+
+    const auto every = sampleOneIn.load(std::memory_order_relaxed);
+    if (every == 0 || ++counter < every) {
+        return 0;
+    }
+
+    counter = 0;
+    return nextTraceId.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::uint64_t Tracer::current() {
+    return activeTrace;
+}
+
+Tracer::Nanos Tracer::now() {
+    return static_cast<Nanos>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - processStart).count());
+}
+
+void Tracer::record(const char* name, std::uint64_t trace_id, Nanos start, Nanos end) {
+    if (trace_id == 0) {
+        return;
+    }
+    localRing().push({name, trace_id, start, std::max(start, end)});
+}
+
+std::string Tracer::exportChromeTrace() {
+    std::vector<std::pair<std::uint32_t, Span>> spans;
+    {
+        auto& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        for (const auto& ring : reg.rings) {
+            ring->collect(spans);
+        }
+    }
+
+    std::sort(spans.begin(), spans.end(), [](const auto& a, const auto& b) {
+        return a.second.start < b.second.start;
+    });
+
+    std::ostringstream out;
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (const auto& [thread, span] : spans) {
+        out << (first ? "" : ",") << "{\"name\":\"" << span.name << "\",\"cat\":\"prisecchat\",\"ph\":\"X\",\"ts\":";
+        appendMicros(out, span.start);
+        out << ",\"dur\":";
+        appendMicros(out, span.end - span.start);
+        out << ",\"pid\":1,\"tid\":" << thread << ",\"args\":{\"trace\":" << span.trace << "}}";
+        first = false;
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}";
+    return out.str();
+}
+
+TraceContext::TraceContext(std::uint64_t trace_id)
+    : previous_(activeTrace)
+{
+    activeTrace = trace_id;
+}
+
+TraceContext::~TraceContext() {
+    activeTrace = previous_;
+}
+
+TraceScope::TraceScope(const char* name)
+    : name_(name),
+      trace_(activeTrace)
+{
+    if (trace_ != 0) {
+        start_ = Tracer::now();
+    }
+}
+
+TraceScope::~TraceScope() {
+    if (trace_ != 0) {
+        Tracer::record(name_, trace_, start_, Tracer::now());
+    }
+}
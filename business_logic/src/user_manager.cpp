@@ -1,77 +1,229 @@
 #include "user_manager.h"
 
-UserManager::UserId UserManager::registerUser(const std::string& nickname) {
-    std::unique_lock lock(mutex_);
+#include "alloc_tracker.h"
+#include "lock_profiler.h"
+#include "uuid_v7.h"
+
+
+UserManager::Stripe& UserManager::stripeFor(const UserId& id) {
+    // The tail of a UUIDv7 is random, so it spreads users evenly.
+    return stripes_[id.data[15] % kStripeCount];
+}
+
+const UserManager::Stripe& UserManager::stripeFor(const UserId& id) const {
+    return stripes_[id.data[15] % kStripeCount];
+}
+
+UserManager::UserId UserManager::insertUser(UserId id, const std::string& nickname, bool ephemeral,
+    bool adopted) {
+    AllocScope alloc(AllocTag::USER_TABLE);
+    auto& stripe = stripeFor(id);
+
+    {
+        ExclusiveProfiledLock lock(stripe.mutex, "insertUser/stripe-exclusive");
+        auto& record = stripe.users.try_emplace(id, User(id, nickname)).first->second;
+        record.ephemeral = ephemeral;
+        record.adopted = adopted;
+        stripe.ephemeralCount += ephemeral ? 1 : 0;
+    }
 
-    UserId id = generator_();
-    users_.emplace(id, User(id, nickname));
+    ExclusiveProfiledLock lock(directoryMutex_, "insertUser/directory-exclusive");
+    nameIndex_.emplace(nickname, id);
     return id;
 }
 
+UserManager::UserId UserManager::registerUser(const std::string& nickname) {
+    return insertUser(generateTimeOrderedId(), nickname, false);
+}
+
+UserManager::UserId UserManager::registerEphemeralUser() {
+    return insertUser(generateTimeOrderedId(), "Anonymous", true);
+}
+
+void UserManager::adoptUser(const UserId& id, const std::string& nickname, bool ephemeral) {
+    if (!renameUser(id, nickname)) {
+        insertUser(id, nickname, ephemeral, true);
+    } else if (!ephemeral) {
+        pinUser(id);
+    }
+}
+
+bool UserManager::pinUser(const UserId& id) {
+    auto& stripe = stripeFor(id);
+    {
+        SharedProfiledLock lock(stripe.mutex, "pinUser/stripe-shared");
+        auto it = stripe.users.find(id);
+        if (it == stripe.users.end()) {
+            return false;
+        }
+        if (!it->second.ephemeral) {
+            return true;
+        }
+    }
+
+    ExclusiveProfiledLock lock(stripe.mutex, "pinUser/stripe-exclusive");
+    auto it = stripe.users.find(id);
+    if (it == stripe.users.end()) {
+        return false;
+    }
+    if (it->second.ephemeral) {
+        it->second.ephemeral = false;
+        --stripe.ephemeralCount;
+    }
+    return true;
+}
+
+bool UserManager::releaseUser(const UserId& id) {
+    return release(id, false);
+}
+
+bool UserManager::releaseAdoptedUser(const UserId& id) {
+    return release(id, true);
+}
+
+bool UserManager::isEphemeral(const UserId& id) const {
+    const auto& stripe = stripeFor(id);
+    SharedProfiledLock lock(stripe.mutex, "isEphemeral/stripe-shared");
+    auto it = stripe.users.find(id);
+    return it != stripe.users.end() && it->second.ephemeral;
+}
+
+bool UserManager::release(const UserId& id, bool adopted) {
+    auto& stripe = stripeFor(id);
+    std::string name;
+
+    {
+        ExclusiveProfiledLock lock(stripe.mutex, "releaseUser/stripe-exclusive");
+        auto it = stripe.users.find(id);
+        if (it == stripe.users.end() || !it->second.ephemeral || it->second.adopted != adopted) {
+            return false;
+        }
+
+        if (it->second.loggedIn.load(std::memory_order_relaxed)) {
+            loggedIn_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        name = it->second.user.getName();
+        stripe.users.erase(it);
+        --stripe.ephemeralCount;
+    }
+
+    {
+        ExclusiveProfiledLock lock(directoryMutex_, "releaseUser/directory-exclusive");
+        nameIndex_.erase({name, id});
+    }
+
+    reclaimed_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
 bool UserManager::renameUser(User::UserId id, const std::string& newName) {
-    std::unique_lock lock(mutex_);
+    AllocScope alloc(AllocTag::USER_TABLE);
+    auto& stripe = stripeFor(id);
+    ExclusiveProfiledLock lock(stripe.mutex, "renameUser/stripe-exclusive");
 
-    auto it = users_.find(id);
-    if (it == users_.end()) {
+    auto it = stripe.users.find(id);
+    if (it == stripe.users.end()) {
         return false;
     }
 
-    it->second.setName(newName);
+    ExclusiveProfiledLock directoryLock(directoryMutex_, "renameUser/directory-exclusive");
+    nameIndex_.erase({it->second.user.getName(), id});
+    it->second.user.setName(newName);
+    nameIndex_.emplace(newName, id);
     return true;
 }
 
-std::optional<std::reference_wrapper<User>> UserManager::getUser(const UserId& id) {
-    std::shared_lock lock(mutex_);
+std::optional<UserManager::UserSnapshot> UserManager::getUser(const UserId& id) const {
+    const auto& stripe = stripeFor(id);
+    SharedProfiledLock lock(stripe.mutex, "getUser/stripe-shared");
 
-    auto it = users_.find(id);
-    if (it != users_.end()) {
-        return it->second;
+    auto it = stripe.users.find(id);
+    if (it == stripe.users.end()) {
+        return std::nullopt;
     }
 
-    return std::nullopt;
+    const auto& record = it->second;
+    return UserSnapshot{id, record.user.getName(), record.ephemeral, record.adopted,
+        record.loggedIn.load(std::memory_order_relaxed)};
 }
 
 bool UserManager::userExists(const UserId& id) const {
-    std::shared_lock lock(mutex_);
+    const auto& stripe = stripeFor(id);
+    SharedProfiledLock lock(stripe.mutex, "userExists/stripe-shared");
 
-    return users_.find(id) != users_.end();
+    return stripe.users.find(id) != stripe.users.end();
 }
 
-std::vector<std::pair<User::UserId, std::string>> UserManager::getAllUsers() const {
-    std::vector<std::pair<User::UserId, std::string>> out;
-    for (auto const& [id, user] : users_) {
-        out.emplace_back(id, user.getName());
+std::vector<UserManager::DirectoryEntry> UserManager::listUsers(const std::string& prefix,
+    const std::optional<DirectoryEntry>& after, std::size_t limit) const {
+
+    SharedProfiledLock lock(directoryMutex_, "listUsers/directory-shared");
+
+    auto it = nameIndex_.lower_bound({prefix, UserId{}});
+    if (after) {
+        auto resume = nameIndex_.upper_bound({after->name, after->id});
+        if (it != nameIndex_.end() && (resume == nameIndex_.end() || *it < *resume)) {
+            it = resume;
+        }
+    }
+
+    std::vector<DirectoryEntry> out;
+    for (; it != nameIndex_.end() && out.size() < limit; ++it) {
+        if (it->first.compare(0, prefix.size(), prefix) != 0) {
+            break;
+        }
+        out.push_back({it->second, it->first});
     }
 
     return out;
 }
 
 bool UserManager::nameExists(const std::string& name) const {
-    std::shared_lock lock(mutex_);
-    for (auto const& [id, user] : users_) {
-        if (user.getName() == name) return true;
-    }
-    return false;
+    return findByName(name).has_value();
 }
 
 std::optional<UserManager::UserId> UserManager::findByName(const std::string& name) const {
-    std::shared_lock lock(mutex_);
-    for (auto const& [id, user] : users_) {
-        if (user.getName() == name) return id;
+    SharedProfiledLock lock(directoryMutex_, "findByName/directory-shared");
+
+    auto it = nameIndex_.lower_bound({name, UserId{}});
+    if (it != nameIndex_.end() && it->first == name) {
+        return it->second;
     }
     return std::nullopt;
 }
 
 void UserManager::setLoggedIn(UserId id, bool loggedIn) {
-    std::unique_lock lock(mutex_);
-    if (loggedIn) {
-        loggedIn_.insert(id);
-    } else {
-        loggedIn_.erase(id);
+    auto& stripe = stripeFor(id);
+    SharedProfiledLock lock(stripe.mutex, "setLoggedIn/stripe-shared");
+
+    auto it = stripe.users.find(id);
+    if (it == stripe.users.end()) {
+        return;
+    }
+
+    if (it->second.loggedIn.exchange(loggedIn, std::memory_order_relaxed) != loggedIn) {
+        if (loggedIn) {
+            loggedIn_.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            loggedIn_.fetch_sub(1, std::memory_order_relaxed);
+        }
     }
 }
 
 bool UserManager::isLoggedIn(UserId id) const {
-    std::shared_lock lock(mutex_);
-    return loggedIn_.count(id) != 0;
-}
\ No newline at end of file
+    const auto& stripe = stripeFor(id);
+    SharedProfiledLock lock(stripe.mutex, "isLoggedIn/stripe-shared");
+
+    auto it = stripe.users.find(id);
+    return it != stripe.users.end() && it->second.loggedIn.load(std::memory_order_relaxed);
+}
+
+UserManager::Stats UserManager::getStats() const {
+    Stats stats{0, 0, reclaimed_.load(std::memory_order_relaxed), loggedIn_.load(std::memory_order_relaxed)};
+    for (const auto& stripe : stripes_) {
+        SharedProfiledLock lock(stripe.mutex, "getStats/stripe-shared");
+        stats.liveUsers += stripe.users.size();
+        stats.reclaimableUsers += stripe.ephemeralCount;
+    }
+    return stats;
+}
@@ -0,0 +1,208 @@
+#include "uuid_text.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+// PRISECCHAT_UUID_TEXT_SCALAR forces the fallback, e.g. to benchmark it.
+#if defined(PRISECCHAT_UUID_TEXT_SCALAR)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define UUID_TEXT_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UUID_TEXT_SSE2 1
+#endif
+
+
+namespace {
+
+// Start of each hex group in the text form, and where it lands in the
+// 32 dash-free digits.
+constexpr std::array<std::size_t, 5> kGroupText = {0, 9, 14, 19, 24};
+constexpr std::array<std::size_t, 5> kGroupDigits = {0, 8, 12, 16, 20};
+constexpr std::array<std::size_t, 5> kGroupLength = {8, 4, 4, 4, 12};
+
+void scatterDigits(const char* digits, char* out) {
+    for (std::size_t group = 0; group < kGroupText.size(); ++group) {
+        std::memcpy(out + kGroupText[group], digits + kGroupDigits[group], kGroupLength[group]);
+        if (group + 1 < kGroupText.size()) {
+            out[kGroupText[group] + kGroupLength[group]] = '-';
+        }
+    }
+}
+
+// False unless the dashes sit where the canonical form puts them.
+bool gatherDigits(std::string_view text, char* digits) {
+    if (text.size() != kUuidTextLength || text[8] != '-' || text[13] != '-' || text[18] != '-' || text[23] != '-') {
+        return false;
+    }
+    for (std::size_t group = 0; group < kGroupText.size(); ++group) {
+        std::memcpy(digits + kGroupDigits[group], text.data() + kGroupText[group], kGroupLength[group]);
+    }
+    return true;
+}
+
+#if !UUID_TEXT_AVX2 && !UUID_TEXT_SSE2
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+constexpr std::array<std::uint8_t, 256> makeNibbleTable() {
+    std::array<std::uint8_t, 256> table{};
+    for (auto& value : table) value = 0xFF;
+    for (int c = '0'; c <= '9'; ++c) table[c] = std::uint8_t(c - '0');
+    for (int c = 'a'; c <= 'f'; ++c) table[c] = std::uint8_t(c - 'a' + 10);
+    for (int c = 'A'; c <= 'F'; ++c) table[c] = std::uint8_t(c - 'A' + 10);
+    return table;
+}
+
+constexpr auto kNibble = makeNibbleTable();
+
+void formatDigits(const boost::uuids::uuid& id, char* digits) {
+    for (std::size_t i = 0; i < 16; ++i) {
+        digits[2 * i] = kHexDigits[id.data[i] >> 4];
+        digits[2 * i + 1] = kHexDigits[id.data[i] & 0x0F];
+    }
+}
+
+bool parseDigits(const char* digits, boost::uuids::uuid& id) {
+    std::uint8_t bad = 0;
+    for (std::size_t i = 0; i < 16; ++i) {
+        const auto hi = kNibble[static_cast<unsigned char>(digits[2 * i])];
+        const auto lo = kNibble[static_cast<unsigned char>(digits[2 * i + 1])];
+        bad |= hi | lo;
+        id.data[i] = std::uint8_t((hi << 4) | (lo & 0x0F));
+    }
+    return (bad & 0xF0) == 0;
+}
+
+#endif
+
+#if UUID_TEXT_SSE2
+
+// Nibbles 0-15 to '0'-'9', 'a'-'f'.
+__m128i nibblesToAscii(__m128i nibbles) {
+    const __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9)), _mm_set1_epi8('a' - '0' - 10));
+    return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')), letters);
+}
+
+// Sixteen hex characters to nibbles; false if any is not a hex digit.
+// Bytes at or above 0x80 compare negative and so fail both ranges.
+bool asciiToNibbles(__m128i text, __m128i& nibbles) {
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(text, _mm_set1_epi8('0' - 1)),
+        _mm_cmplt_epi8(text, _mm_set1_epi8('9' + 1)));
+    const __m128i lower = _mm_or_si128(text, _mm_set1_epi8(0x20));
+    const __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+        _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF) {
+        return false;
+    }
+
+    nibbles = _mm_or_si128(_mm_and_si128(digit, _mm_sub_epi8(text, _mm_set1_epi8('0'))),
+        _mm_and_si128(alpha, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+    return true;
+}
+
+// Adjacent nibble pairs (high first) to one value per 16-bit lane.
+__m128i joinNibblePairs(__m128i nibbles) {
+    const __m128i high = _mm_and_si128(_mm_slli_epi16(nibbles, 4), _mm_set1_epi16(0x00F0));
+    return _mm_or_si128(high, _mm_srli_epi16(nibbles, 8));
+}
+
+void formatDigits(const boost::uuids::uuid& id, char* digits) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(id.data));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    const __m128i low = _mm_and_si128(bytes, mask);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(digits), nibblesToAscii(_mm_unpacklo_epi8(high, low)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(digits + 16), nibblesToAscii(_mm_unpackhi_epi8(high, low)));
+}
+
+bool parseDigits(const char* digits, boost::uuids::uuid& id) {
+    __m128i first;
+    __m128i second;
+    if (!asciiToNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(digits)), first)
+        || !asciiToNibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(digits + 16)), second)) {
+        return false;
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(id.data),
+        _mm_packus_epi16(joinNibblePairs(first), joinNibblePairs(second)));
+    return true;
+}
+
+#endif
+
+#if UUID_TEXT_AVX2
+
+__m256i nibblesToAscii(__m256i nibbles) {
+    const __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9)),
+        _mm256_set1_epi8('a' - '0' - 10));
+    return _mm256_add_epi8(_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')), letters);
+}
+
+void formatDigits(const boost::uuids::uuid& id, char* digits) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(id.data));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    const __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    const __m128i low = _mm_and_si128(bytes, mask);
+    const __m256i nibbles = _mm256_set_m128i(_mm_unpackhi_epi8(high, low), _mm_unpacklo_epi8(high, low));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(digits), nibblesToAscii(nibbles));
+}
+
+// All 32 digits in one register; see the SSE2 version for the ranges.
+bool parseDigits(const char* digits, boost::uuids::uuid& id) {
+    const __m256i text = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(digits));
+    const __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(text, _mm256_set1_epi8('0' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), text));
+    const __m256i lower = _mm256_or_si256(text, _mm256_set1_epi8(0x20));
+    const __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+    if (_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != -1) {
+        return false;
+    }
+
+    const __m256i nibbles = _mm256_or_si256(_mm256_and_si256(digit, _mm256_sub_epi8(text, _mm256_set1_epi8('0'))),
+        _mm256_and_si256(alpha, _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+    const __m256i high = _mm256_and_si256(_mm256_slli_epi16(nibbles, 4), _mm256_set1_epi16(0x00F0));
+    const __m256i pairs = _mm256_or_si256(high, _mm256_srli_epi16(nibbles, 8));
+    // packus works per 128-bit lane; gather the low quadword of each lane.
+    const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(pairs, pairs), 0x08);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(id.data), _mm256_castsi256_si128(packed));
+    return true;
+}
+
+#endif
+
+} // namespace
+
+void formatUuid(const boost::uuids::uuid& id, char* out) {
+    char digits[32];
+    formatDigits(id, digits);
+    scatterDigits(digits, out);
+}
+
+std::string uuidToString(const boost::uuids::uuid& id) {
+    std::string out(kUuidTextLength, '\0');
+    formatUuid(id, out.data());
+    return out;
+}
+
+std::optional<boost::uuids::uuid> parseUuidText(std::string_view text) {
+    char digits[32];
+    boost::uuids::uuid id;
+    if (!gatherDigits(text, digits) || !parseDigits(digits, id)) {
+        return std::nullopt;
+    }
+    return id;
+}
+
+const char* uuidTextBackend() {
+#if UUID_TEXT_AVX2
+    return "avx2";
+#elif UUID_TEXT_SSE2
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
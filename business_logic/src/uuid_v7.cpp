@@ -0,0 +1,76 @@
+#include "uuid_v7.h"
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+
+namespace {
+
+constexpr std::uint16_t kSequenceMask = 0x0FFF;
+constexpr std::uint16_t kSequenceSeedMask = 0x07FF;
+
+struct ThreadIdState {
+    ThreadIdState()
+        : rng(std::random_device{}())
+    {}
+
+    std::mt19937_64 rng;
+    std::uint64_t    lastMillis = 0;
+    std::uint16_t    sequence = 0;
+};
+
+ThreadIdState& threadState() {
+    thread_local ThreadIdState state;
+    return state;
+}
+
+boost::uuids::uuid makeId(std::uint64_t millis, std::uint16_t sequence, std::uint64_t random) {
+    boost::uuids::uuid id{};
+    for (int i = 0; i < 6; ++i) {
+        id.data[i] = static_cast<std::uint8_t>(millis >> (40 - 8 * i));
+    }
+    id.data[6] = static_cast<std::uint8_t>(0x70 | (sequence >> 8));
+    id.data[7] = static_cast<std::uint8_t>(sequence);
+    id.data[8] = static_cast<std::uint8_t>(0x80 | (random & 0x3F));
+    for (int i = 9; i < 16; ++i) {
+        id.data[i] = static_cast<std::uint8_t>(random >> (8 * (i - 8)));
+    }
+    return id;
+}
+
+} // namespace
+
+boost::uuids::uuid generateTimeOrderedId() {
+    auto& state = threadState();
+
+    auto millis = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+
+    if (millis > state.lastMillis) {
+        state.sequence = static_cast<std::uint16_t>(state.rng() & kSequenceSeedMask);
+    } else {
+        millis = state.lastMillis;
+        if (++state.sequence > kSequenceMask) {
+            ++millis;
+            state.sequence = 0;
+        }
+    }
+    state.lastMillis = millis;
+
+    return makeId(millis, state.sequence, state.rng());
+}
+
+boost::uuids::uuid timeOrderedIdAfter(const boost::uuids::uuid& previous) {
+    std::uint64_t millis = 0;
+    for (int i = 0; i < 6; ++i) {
+        millis = (millis << 8) | previous.data[i];
+    }
+    auto sequence = static_cast<std::uint16_t>(((previous.data[6] & 0x0F) << 8) | previous.data[7]);
+
+    if (++sequence > kSequenceMask) {
+        ++millis;
+        sequence = 0;
+    }
+    return makeId(millis, sequence, threadState().rng());
+}
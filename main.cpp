@@ -1,7 +1,12 @@
 #include <iostream>
 #include <csignal>
+#include <cstdlib>
 #include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
 
+#include "web/lib/io_backend.h"
 #include "web/lib/server.h"
 
 std::unique_ptr<Server> serverPtr;
@@ -14,16 +19,72 @@ void signalHandler(int signum) {
     std::_Exit(0);
 }
 
+// "host:port,host:port"
+std::vector<ClusterPeer> parseSeeds(const std::string& text) {
+    std::vector<ClusterPeer> seeds;
+    std::istringstream in(text);
+    std::string seed;
+    while (std::getline(in, seed, ',')) {
+        const auto colon = seed.rfind(':');
+        if (colon == std::string::npos) {
+            throw std::invalid_argument("cluster seed without a port: " + seed);
+        }
+        seeds.push_back({seed.substr(0, colon), static_cast<unsigned short>(std::stoul(seed.substr(colon + 1)))});
+    }
+    return seeds;
+}
+
 int main() {
     const std::size_t threadCount = 2;
-    const std::size_t port = 8080;
+    const char* portOverride = std::getenv("PRISECCHAT_PORT");
+    const std::size_t port = portOverride ? std::stoul(portOverride) : 8080;
+
+    // Epoll is compiled out of io_uring socket builds, so there is nothing to fall back to.
+    if (IoBackend::uringSockets && !IoBackend::uringAvailable()) {
+        std::cerr << "This build drives sockets through io_uring, which this kernel does not provide; "
+                     "use a build without PRISECCHAT_IO_URING_SOCKETS." << std::endl;
+        return 1;
+    }
 
     std::cout << "Starting server on port " << port
               << " with " << threadCount << " threads..." << std::endl;
 
-    serverPtr = std::make_unique<Server>(threadCount, port);
+    ServerOptions options;
+    // Records inbound traffic for the replay tool.
+    if (const char* capture = std::getenv("PRISECCHAT_CAPTURE")) {
+        options.capture.file = capture;
+        std::cout << "Capturing traffic to " << capture << std::endl;
+    }
+    // Operator commands (GET_LOCK_PROFILE, DUMP_TRACE); leave unset on ports
+    // clients can reach.
+    if (std::getenv("PRISECCHAT_DIAGNOSTICS")) {
+        options.diagnostics = true;
+    }
+    // Joins (or, without seeds, starts) a cluster; every process needs its
+    // own PRISECCHAT_PORT and PRISECCHAT_CLUSTER_PORT.
+    if (const char* clusterPort = std::getenv("PRISECCHAT_CLUSTER_PORT")) {
+        options.cluster.port = static_cast<unsigned short>(std::stoul(clusterPort));
+        if (const char* nodeId = std::getenv("PRISECCHAT_NODE_ID")) {
+            options.cluster.nodeId = nodeId;
+        }
+        if (const char* seeds = std::getenv("PRISECCHAT_CLUSTER_SEEDS")) {
+            options.cluster.seeds = parseSeeds(seeds);
+        }
+        // Listening beyond loopback needs the secret every node shares.
+        if (const char* bind = std::getenv("PRISECCHAT_CLUSTER_BIND")) {
+            options.cluster.bindAddress = bind;
+        }
+        if (const char* secret = std::getenv("PRISECCHAT_CLUSTER_SECRET")) {
+            options.cluster.secret = secret;
+        }
+        std::cout << "Cluster port " << options.cluster.port << " with " << options.cluster.seeds.size()
+                  << " seeds" << std::endl;
+    }
+
+    serverPtr = std::make_unique<Server>(threadCount, port, std::make_shared<TimeProvider>(), options);
 
-    {
+    // Joining nodes get these from their seeds.
+    if (options.cluster.seeds.empty()) {
         auto um = serverPtr->getUserManager();
         auto id1 = um->registerUser();
         um->renameUser(id1, "Maximus");
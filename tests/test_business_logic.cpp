@@ -1,6 +1,21 @@
 #include "gtest/gtest.h"
 
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <thread>
+
+#include <boost/uuid/uuid_io.hpp>
+
+#include "../business_logic/lib/alloc_tracker.h"
 #include "../business_logic/lib/chat_manager.h"
+#include "../business_logic/lib/chat_room/personal_chat.h"
+#include "../business_logic/lib/epoch.h"
+#include "../business_logic/lib/expiry_wheel.h"
+#include "../business_logic/lib/lock_profiler.h"
+#include "../business_logic/lib/tracer.h"
+#include "../business_logic/lib/uuid_text.h"
+#include "../business_logic/lib/uuid_v7.h"
 #include "../business_logic/lib/time_provider/mock_time_provider.h"
 
 class ChatTestFixture : public ::testing::Test {
@@ -23,7 +38,21 @@ TEST_F(ChatTestFixture, RegisterUser) {
     auto userId = registerUser("Maximus");
     auto userOpt = userManager_->getUser(userId);
     ASSERT_TRUE(userOpt.has_value());
-    EXPECT_EQ(userOpt->get().getName(), "Maximus");
+    EXPECT_EQ(userOpt->name, "Maximus");
+    EXPECT_FALSE(userOpt->ephemeral);
+}
+
+TEST_F(ChatTestFixture, UserSnapshotsOutliveRenameAndRelease) {
+    auto guest = userManager_->registerEphemeralUser();
+    auto before = userManager_->getUser(guest);
+    ASSERT_TRUE(before.has_value());
+    EXPECT_TRUE(before->ephemeral);
+
+    userManager_->renameUser(guest, "Nobody");
+    EXPECT_TRUE(userManager_->releaseUser(guest));
+    EXPECT_FALSE(userManager_->getUser(guest).has_value());
+    // The copy is still whole after its record was renamed and erased.
+    EXPECT_EQ(before->name, "Anonymous");
 }
 
 TEST_F(ChatTestFixture, CreatePersonalChatAndSendMessages) {
@@ -262,3 +291,852 @@ TEST_F(ChatTestFixture, GroupDeletionWhenEmpty) {
 
     EXPECT_FALSE(chatManager_->chatExists(groupId));
 }
+
+TEST_F(ChatTestFixture, SearchFindsMessagesOnlyInOwnChats) {
+    auto user1 = registerUser("Bormoley");
+    auto user2 = registerUser("Achilles");
+    auto user3 = registerUser("Patroclus");
+    auto chatId = chatManager_->createPersonalChat("Chat", user1, user2);
+    auto otherChatId = chatManager_->createPersonalChat("Other", user2, user3);
+
+    chatManager_->sendMessage(chatId, user1, "Meet me at the Trojan gates");
+    chatManager_->sendMessage(chatId, user2, "Gates are closed, gates are guarded");
+    chatManager_->sendMessage(otherChatId, user3, "Secret gates plan");
+
+    auto hits = chatManager_->searchMessages(user1, "GATES", 10);
+    ASSERT_EQ(hits.size(), 2);
+    EXPECT_EQ(hits.front().messageId, chatManager_->getHistory(chatId).back().getId());
+    for (const auto& hit : hits) {
+        EXPECT_EQ(hit.roomId, chatId);
+    }
+
+    EXPECT_EQ(chatManager_->searchMessages(user2, "gates", 10).size(), 3);
+    EXPECT_TRUE(chatManager_->searchMessages(user1, "secret", 10).empty());
+}
+
+TEST_F(ChatTestFixture, SearchFollowsEditsAndRemovals) {
+    auto user1 = registerUser("Bormoley");
+    auto user2 = registerUser("Achilles");
+    auto chatId = chatManager_->createPersonalChat("Chat", user1, user2);
+
+    chatManager_->sendMessage(chatId, user1, "Hello Sparta");
+    auto messageId = chatManager_->getHistory(chatId).back().getId();
+    EXPECT_EQ(chatManager_->searchMessages(user1, "sparta", 10).size(), 1);
+
+    chatManager_->editMessage(chatId, user1, messageId, "Hello Athens");
+    EXPECT_TRUE(chatManager_->searchMessages(user1, "sparta", 10).empty());
+    EXPECT_EQ(chatManager_->searchMessages(user1, "athens", 10).size(), 1);
+
+    chatManager_->removeMessage(chatId, user1, messageId);
+    EXPECT_TRUE(chatManager_->searchMessages(user1, "athens", 10).empty());
+    EXPECT_EQ(chatManager_->searchIndexDocumentCount(), 0);
+}
+
+TEST_F(ChatTestFixture, SearchForgetsDeletedRooms) {
+    auto user1 = registerUser("Bormoley");
+    auto user2 = registerUser("Achilles");
+
+    for (int round = 0; round < 3; ++round) {
+        auto chatId = chatManager_->createPersonalChat("Chat", user1, user2);
+        chatManager_->sendMessage(chatId, user1, "Hello Sparta");
+        chatManager_->sendMessage(chatId, user2, "Hello Athens");
+        EXPECT_EQ(chatManager_->searchMessages(user1, "hello", 10).size(), 2);
+
+        EXPECT_TRUE(chatManager_->deleteChat(chatId, user1));
+        EXPECT_TRUE(chatManager_->searchMessages(user1, "hello", 10).empty());
+        EXPECT_EQ(chatManager_->searchIndexDocumentCount(), 0);
+        EXPECT_EQ(chatManager_->searchIndexTermCount(), 0);
+    }
+}
+
+TEST_F(ChatTestFixture, MessageIdsAreTimeOrdered) {
+    auto user1 = registerUser("Bormoley");
+    auto user2 = registerUser("Achilles");
+    auto chatId = chatManager_->createPersonalChat("Chat", user1, user2);
+
+    for (int i = 0; i < 100; ++i) {
+        chatManager_->sendMessage(chatId, i % 2 ? user1 : user2, "Message " + std::to_string(i));
+    }
+
+    auto history = chatManager_->getHistory(chatId);
+    ASSERT_EQ(history.size(), 100);
+    for (std::size_t i = 1; i < history.size(); ++i) {
+        EXPECT_LT(history[i - 1].getId(), history[i].getId());
+        EXPECT_EQ(history[i].getId().data[6] >> 4, 7);
+    }
+
+    auto tail = chatManager_->getHistoryAfter(chatId, history[89].getId());
+    ASSERT_EQ(tail.size(), 10);
+    EXPECT_EQ(tail.front().getText(), "Message 90");
+    EXPECT_TRUE(chatManager_->getHistoryAfter(chatId, history.back().getId()).empty());
+}
+
+TEST_F(ChatTestFixture, IdsDrawnOutOfOrderStillAppendInOrder) {
+    auto user1 = registerUser("Bormoley");
+    auto user2 = registerUser("Achilles");
+    auto chatId = chatManager_->createPersonalChat("Chat", user1, user2);
+
+    // Four senders draw ids on their own threads before taking the lock.
+    std::vector<std::thread> senders;
+    std::vector<std::vector<Message::MessageId>> sent(4);
+    for (std::size_t t = 0; t < sent.size(); ++t) {
+        senders.emplace_back([&, t] {
+            for (int i = 0; i < 200; ++i) {
+                auto id = chatManager_->sendMessage(chatId, t % 2 ? user1 : user2, "Message", {});
+                ASSERT_TRUE(id.has_value());
+                sent[t].push_back(*id);
+            }
+        });
+    }
+    for (auto& sender : senders) {
+        sender.join();
+    }
+
+    for (const auto& ids : sent) {
+        EXPECT_TRUE(std::is_sorted(ids.begin(), ids.end()));
+    }
+    auto history = chatManager_->getHistory(chatId);
+    ASSERT_EQ(history.size(), 800);
+    for (std::size_t i = 1; i < history.size(); ++i) {
+        EXPECT_LT(history[i - 1].getId(), history[i].getId());
+    }
+
+    // An id drawn before the newest one is moved past it.
+    auto stale = generateTimeOrderedId();
+    chatManager_->sendMessage(chatId, user1, "Newest");
+    auto newest = chatManager_->getHistory(chatId).back().getId();
+    PersonalChat room(chatId, "Chat");
+    room.addMessage(Message(newest, user1, "Newest", {}));
+    EXPECT_LT(newest, room.orderedId(stale));
+}
+
+TEST_F(ChatTestFixture, UnusedEphemeralUserIsReclaimed) {
+    auto anonymous = userManager_->registerEphemeralUser();
+    auto named = registerUser("Bormoley");
+    EXPECT_EQ(userManager_->getStats().reclaimableUsers, 1);
+
+    EXPECT_FALSE(userManager_->releaseUser(named));
+    EXPECT_TRUE(userManager_->releaseUser(anonymous));
+    EXPECT_FALSE(userManager_->userExists(anonymous));
+
+    auto stats = userManager_->getStats();
+    EXPECT_EQ(stats.liveUsers, 1);
+    EXPECT_EQ(stats.reclaimableUsers, 0);
+    EXPECT_EQ(stats.reclaimedUsers, 1);
+}
+
+TEST_F(ChatTestFixture, AdoptedUsersAreReleasedOnlyByTheirHomeNode) {
+    UserManager home;
+    auto registered = home.registerUser("Penelope");
+    auto anonymous = home.registerEphemeralUser();
+
+    userManager_->adoptUser(registered, "Penelope", home.isEphemeral(registered));
+    userManager_->adoptUser(anonymous, "Anonymous", home.isEphemeral(anonymous));
+    EXPECT_EQ(userManager_->getStats().reclaimableUsers, 1);
+
+    // A session here letting go of either user must not drop the copy.
+    EXPECT_FALSE(userManager_->releaseUser(registered));
+    EXPECT_FALSE(userManager_->releaseUser(anonymous));
+
+    EXPECT_FALSE(userManager_->releaseAdoptedUser(registered));
+    EXPECT_TRUE(userManager_->userExists(registered));
+    EXPECT_TRUE(userManager_->releaseAdoptedUser(anonymous));
+    EXPECT_FALSE(userManager_->userExists(anonymous));
+}
+
+TEST_F(ChatTestFixture, EphemeralUserInChatIsKept) {
+    auto admin = userManager_->registerEphemeralUser();
+    auto guest = userManager_->registerEphemeralUser();
+    auto groupId = chatManager_->createOpenGroup("Group", admin);
+    ASSERT_TRUE(chatManager_->addParticipant(groupId, admin, guest));
+
+    EXPECT_FALSE(userManager_->releaseUser(admin));
+    EXPECT_FALSE(userManager_->releaseUser(guest));
+    EXPECT_TRUE(userManager_->userExists(guest));
+    EXPECT_EQ(userManager_->getStats().reclaimableUsers, 0);
+}
+
+TEST_F(ChatTestFixture, MessageEventsArePublishedToOtherParticipants) {
+    std::vector<ChatEvent> events;
+    chatManager_->setEventListener([&events](const ChatEvent& event) { events.push_back(event); });
+
+    auto admin = registerUser("Bormoley");
+    auto user1 = registerUser("Achilles");
+    auto user2 = registerUser("Patroclus");
+    auto groupId = chatManager_->createOpenGroup("Group", admin);
+    chatManager_->addParticipant(groupId, admin, user1);
+    chatManager_->addParticipant(groupId, admin, user2);
+
+    chatManager_->sendMessage(groupId, user1, "Hello");
+    auto messageId = chatManager_->getHistory(groupId).back().getId();
+    chatManager_->editMessage(groupId, user1, messageId, "Hello again");
+    chatManager_->removeMessage(groupId, admin, messageId);
+
+    ASSERT_EQ(events.size(), 6);
+    for (std::size_t i = 0; i < 3; ++i) {
+        EXPECT_EQ(events[i].type, ChatEvent::Type::MEMBER_JOINED);
+        EXPECT_EQ(events[i].roomId, groupId);
+    }
+    EXPECT_EQ(events[0].actorId, admin);
+    EXPECT_EQ(events[1].actorId, user1);
+    EXPECT_EQ(events[2].actorId, user2);
+    EXPECT_EQ(events[3].type, ChatEvent::Type::MESSAGE_SENT);
+    EXPECT_EQ(events[3].actorId, user1);
+    EXPECT_EQ(events[4].type, ChatEvent::Type::MESSAGE_EDITED);
+    EXPECT_EQ(events[4].text, "Hello again");
+    EXPECT_EQ(events[5].type, ChatEvent::Type::MESSAGE_REMOVED);
+    EXPECT_EQ(events[5].actorId, admin);
+}
+
+TEST_F(ChatTestFixture, UserDirectoryPagesByPrefix) {
+    registerUser("Hector");
+    auto helen = registerUser("Helen");
+    registerUser("Hermes");
+    registerUser("Achilles");
+    auto paris = registerUser("Paris");
+
+    auto first = userManager_->listUsers("He", std::nullopt, 2);
+    ASSERT_EQ(first.size(), 2);
+    EXPECT_EQ(first[0].name, "Hector");
+    EXPECT_EQ(first[1].name, "Helen");
+
+    auto second = userManager_->listUsers("He", first.back(), 2);
+    ASSERT_EQ(second.size(), 1);
+    EXPECT_EQ(second[0].name, "Hermes");
+
+    userManager_->renameUser(paris, "Hera");
+    auto renamed = userManager_->listUsers("Her", std::nullopt, 10);
+    ASSERT_EQ(renamed.size(), 2);
+    EXPECT_EQ(renamed[0].id, paris);
+    EXPECT_FALSE(userManager_->nameExists("Paris"));
+    EXPECT_EQ(userManager_->findByName("Helen"), helen);
+
+    EXPECT_EQ(userManager_->listUsers("", std::nullopt, 100).size(), 5);
+}
+
+TEST_F(ChatTestFixture, PresenceIsTrackedPerUser) {
+    auto user1 = registerUser("Castor");
+    auto user2 = registerUser("Pollux");
+
+    userManager_->setLoggedIn(user1, true);
+    userManager_->setLoggedIn(user1, true);
+    EXPECT_TRUE(userManager_->isLoggedIn(user1));
+    EXPECT_FALSE(userManager_->isLoggedIn(user2));
+    EXPECT_EQ(userManager_->getStats().loggedInUsers, 1);
+
+    auto guest = userManager_->registerEphemeralUser();
+    userManager_->setLoggedIn(guest, true);
+    EXPECT_EQ(userManager_->getStats().loggedInUsers, 2);
+    EXPECT_TRUE(userManager_->releaseUser(guest));
+    EXPECT_FALSE(userManager_->isLoggedIn(guest));
+
+    userManager_->setLoggedIn(user1, false);
+    EXPECT_EQ(userManager_->getStats().loggedInUsers, 0);
+}
+
+TEST(ParticipantSetTest, ReadersSeeConsistentSnapshotsWhileWritersChurn) {
+    ParticipantSet participants;
+    std::vector<User::UserId> stable;
+    for (int i = 0; i < 100; ++i) {
+        stable.push_back(generateTimeOrderedId());
+        participants.insert(stable.back());
+    }
+
+    const auto reclaimedBefore = EpochDomain::instance().reclaimedCount();
+    std::atomic<bool> stop{false};
+    std::atomic<bool> missing{false};
+
+    std::thread reader([&] {
+        while (!stop.load()) {
+            for (const auto& id : stable) {
+                if (!participants.contains(id)) {
+                    missing = true;
+                }
+            }
+            if (participants.members().size() < stable.size()) {
+                missing = true;
+            }
+        }
+    });
+
+    for (int i = 0; i < 1000; ++i) {
+        auto guest = generateTimeOrderedId();
+        EXPECT_TRUE(participants.insert(guest));
+        EXPECT_FALSE(participants.insert(guest));
+        EXPECT_TRUE(participants.erase(guest));
+    }
+
+    stop = true;
+    reader.join();
+
+    EXPECT_FALSE(missing.load());
+    EXPECT_EQ(participants.size(), stable.size());
+    EXPECT_EQ(participants.first(), stable.front());
+
+    EpochDomain::instance().collect();
+    EXPECT_GE(EpochDomain::instance().reclaimedCount() - reclaimedBefore, 1900);
+}
+
+TEST_F(ChatTestFixture, BroadcastChatOnlyAdminPosts) {
+    auto admin = registerUser("Herald");
+    auto listener = registerUser("Townsman");
+    auto outsider = registerUser("Stranger");
+    auto chatId = chatManager_->createBroadcastChat("News", admin);
+
+    std::vector<ChatEvent> events;
+    chatManager_->setEventListener([&](const ChatEvent& event) { events.push_back(event); });
+
+    EXPECT_TRUE(chatManager_->addParticipant(chatId, listener, listener));
+    EXPECT_FALSE(chatManager_->addParticipant(chatId, listener, outsider));
+
+    EXPECT_FALSE(chatManager_->sendMessage(chatId, listener, "Hello?"));
+    EXPECT_TRUE(chatManager_->sendMessage(chatId, admin, "Hear ye"));
+
+    ASSERT_EQ(events.size(), 2);
+    EXPECT_EQ(events[0].type, ChatEvent::Type::MEMBER_JOINED);
+    EXPECT_EQ(events[0].actorId, listener);
+    EXPECT_EQ(events[1].type, ChatEvent::Type::MESSAGE_SENT);
+    EXPECT_EQ(events[1].actorId, admin);
+}
+
+TEST_F(ChatTestFixture, LeavingAndClosingRoomsArePublished) {
+    auto admin = registerUser("Nestor");
+    auto user1 = registerUser("Ajax");
+    auto camp = chatManager_->createOpenGroup("Camp", admin);
+    auto tent = chatManager_->createOpenGroup("Tent", user1);
+    chatManager_->addParticipant(camp, admin, user1);
+
+    std::vector<ChatEvent> events;
+    chatManager_->setEventListener([&](const ChatEvent& event) { events.push_back(event); });
+
+    EXPECT_TRUE(chatManager_->removeParticipant(camp, admin, user1));
+    EXPECT_TRUE(chatManager_->removeParticipant(camp, admin, admin));
+    EXPECT_TRUE(chatManager_->deleteChat(tent, user1));
+
+    ASSERT_EQ(events.size(), 4);
+    EXPECT_EQ(events[0].type, ChatEvent::Type::MEMBER_LEFT);
+    EXPECT_EQ(events[0].actorId, user1);
+    EXPECT_EQ(events[1].type, ChatEvent::Type::MEMBER_LEFT);
+    EXPECT_EQ(events[1].actorId, admin);
+    EXPECT_EQ(events[2].type, ChatEvent::Type::ROOM_CLOSED);
+    EXPECT_EQ(events[2].roomId, camp);
+    EXPECT_EQ(events[3].type, ChatEvent::Type::ROOM_CLOSED);
+    EXPECT_EQ(events[3].roomId, tent);
+}
+
+TEST_F(ChatTestFixture, IdleRoomsAreFrozenSpilledAndThawed) {
+    auto user1 = registerUser("Persephone");
+    auto user2 = registerUser("Demeter");
+    auto quiet = chatManager_->createPersonalChat("Winter", user1, user2);
+    auto busy = chatManager_->createPersonalChat("Summer", user1, user2);
+
+    for (int i = 0; i < 100; ++i) {
+        chatManager_->sendMessage(quiet, user1, "Pomegranate seed " + std::to_string(i));
+    }
+    auto before = chatManager_->getHistory(quiet);
+
+    TieringOptions options;
+    options.idleAfter = std::chrono::hours(1);
+    options.memoryBudget = 0;
+    options.spillDirectory = std::filesystem::temp_directory_path() / "prisecchat-test-spill";
+    chatManager_->setTieringOptions(options);
+
+    mockTimeProvider_.advanceTime(std::chrono::hours(2));
+    chatManager_->sendMessage(busy, user2, "Harvest");
+
+    auto stats = chatManager_->tierIdleRooms();
+    EXPECT_EQ(stats.frozenRooms, 1);
+    EXPECT_EQ(stats.spilledRooms, 1);
+    EXPECT_EQ(stats.frozenMessages, 100);
+    EXPECT_EQ(stats.residentFrozenBytes, 0);
+
+    auto cold = chatManager_->getHistory(quiet);
+    ASSERT_EQ(cold.size(), before.size());
+    EXPECT_EQ(cold.back().getId(), before.back().getId());
+    EXPECT_EQ(cold.back().getText(), before.back().getText());
+    EXPECT_EQ(cold.back().getTimestamp(), before.back().getTimestamp());
+    EXPECT_EQ(chatManager_->tieringStats().coldReads, 1);
+
+    EXPECT_TRUE(chatManager_->sendMessage(quiet, user2, "Spring returns"));
+    EXPECT_EQ(chatManager_->tieringStats().frozenRooms, 0);
+    EXPECT_EQ(chatManager_->getHistory(quiet).size(), 101);
+}
+
+TEST_F(ChatTestFixture, SpillsGoThroughTheConfiguredWriter) {
+    auto user1 = registerUser("Hades");
+    auto user2 = registerUser("Hermes");
+    auto room = chatManager_->createPersonalChat("Underworld", user1, user2);
+    for (int i = 0; i < 20; ++i) {
+        chatManager_->sendMessage(room, user1, "Obol " + std::to_string(i));
+    }
+
+    bool accept = false;
+    std::size_t calls = 0;
+    TieringOptions options;
+    options.idleAfter = std::chrono::hours(1);
+    options.memoryBudget = 0;
+    options.spillDirectory = std::filesystem::temp_directory_path() / "prisecchat-test-spill";
+    options.spillWriter = [&](const std::filesystem::path& file, std::span<const std::uint8_t> bytes) {
+        ++calls;
+        if (!accept) {
+            return false;
+        }
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        return bool(out);
+    };
+    chatManager_->setTieringOptions(options);
+    mockTimeProvider_.advanceTime(std::chrono::hours(2));
+
+    auto stats = chatManager_->tierIdleRooms();
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(stats.spilledRooms, 0);
+    EXPECT_GT(stats.residentFrozenBytes, 0);
+
+    accept = true;
+    stats = chatManager_->tierIdleRooms();
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(stats.spilledRooms, 1);
+    EXPECT_EQ(chatManager_->getHistory(room).back().getText(), "Obol 19");
+}
+
+TEST_F(ChatTestFixture, FailedSpillKeepsTheRoomResident) {
+    auto user1 = registerUser("Orpheus");
+    auto user2 = registerUser("Eurydice");
+    auto room = chatManager_->createPersonalChat("Descent", user1, user2);
+    for (int i = 0; i < 20; ++i) {
+        chatManager_->sendMessage(room, user1, "Verse " + std::to_string(i));
+    }
+
+    std::filesystem::path written;
+    TieringOptions options;
+    options.idleAfter = std::chrono::hours(1);
+    options.memoryBudget = 0;
+    options.spillDirectory = std::filesystem::temp_directory_path() / "prisecchat-test-spill";
+    // Claims success after writing half the block.
+    options.spillWriter = [&](const std::filesystem::path& file, std::span<const std::uint8_t> bytes) {
+        written = file;
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size() / 2));
+        return true;
+    };
+    chatManager_->setTieringOptions(options);
+    mockTimeProvider_.advanceTime(std::chrono::hours(2));
+
+    auto stats = chatManager_->tierIdleRooms();
+    EXPECT_EQ(stats.spilledRooms, 0);
+    EXPECT_GT(stats.residentFrozenBytes, 0);
+    EXPECT_FALSE(written.empty());
+    EXPECT_FALSE(std::filesystem::exists(written));
+    EXPECT_EQ(chatManager_->getHistory(room).back().getText(), "Verse 19");
+}
+
+TEST_F(ChatTestFixture, RoomsWrittenDuringATieringPassStayHot) {
+    auto user1 = registerUser("Icarus");
+    auto user2 = registerUser("Daedalus");
+    auto room = chatManager_->createPersonalChat("Labyrinth", user1, user2);
+    for (int i = 0; i < 20; ++i) {
+        chatManager_->sendMessage(room, user1, "Feather " + std::to_string(i));
+    }
+
+    std::filesystem::path written;
+    TieringOptions options;
+    options.idleAfter = std::chrono::hours(1);
+    options.memoryBudget = 0;
+    options.spillDirectory = std::filesystem::temp_directory_path() / "prisecchat-test-spill";
+    // Runs without the manager lock, so the room can change under it.
+    options.spillWriter = [&](const std::filesystem::path& file, std::span<const std::uint8_t> bytes) {
+        written = file;
+        EXPECT_TRUE(chatManager_->sendMessage(room, user2, "Not so close to the sun"));
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        return bool(out);
+    };
+    chatManager_->setTieringOptions(options);
+    mockTimeProvider_.advanceTime(std::chrono::hours(2));
+
+    auto stats = chatManager_->tierIdleRooms();
+    EXPECT_EQ(stats.frozenRooms, 0);
+    EXPECT_EQ(stats.hotMessages, 21);
+    EXPECT_FALSE(std::filesystem::exists(written));
+    EXPECT_EQ(chatManager_->getHistory(room).back().getText(), "Not so close to the sun");
+}
+
+TEST(ExpiryWheelTest, CascadesAndCancelsAcrossLevels) {
+    const auto start = std::chrono::system_clock::time_point{} + std::chrono::hours(1000);
+    ExpiryWheel wheel(start);
+    boost::uuids::uuid room{};
+    auto soon = generateTimeOrderedId();
+    auto later = generateTimeOrderedId();
+    auto far = generateTimeOrderedId();
+    auto cancelled = generateTimeOrderedId();
+
+    wheel.schedule(room, soon, start + std::chrono::seconds(5));
+    wheel.schedule(room, later, start + std::chrono::seconds(4000));
+    wheel.schedule(room, far, start + std::chrono::days(400));
+    wheel.schedule(room, cancelled, start + std::chrono::seconds(70));
+    EXPECT_TRUE(wheel.cancel(cancelled));
+    EXPECT_FALSE(wheel.cancel(cancelled));
+    EXPECT_EQ(wheel.size(), 3);
+
+    EXPECT_TRUE(wheel.advance(start + std::chrono::seconds(4)).empty());
+    auto fired = wheel.advance(start + std::chrono::seconds(5));
+    ASSERT_EQ(fired.size(), 1);
+    EXPECT_EQ(fired[0].messageId, soon);
+
+    EXPECT_TRUE(wheel.advance(start + std::chrono::seconds(3999)).empty());
+    fired = wheel.advance(start + std::chrono::seconds(4000));
+    ASSERT_EQ(fired.size(), 1);
+    EXPECT_EQ(fired[0].messageId, later);
+
+    EXPECT_TRUE(wheel.advance(start + std::chrono::days(399)).empty());
+    fired = wheel.advance(start + std::chrono::days(401));
+    ASSERT_EQ(fired.size(), 1);
+    EXPECT_EQ(fired[0].messageId, far);
+    EXPECT_EQ(wheel.size(), 0);
+}
+
+TEST(TimeProviderTest, ListenersMayUnsubscribeWhileNotified) {
+    MockTimeProvider clock;
+    int first = 0;
+    int second = 0;
+    std::size_t firstId = 0;
+    firstId = clock.subscribe([&](AbstractTimeProvider::TimePoint) {
+        ++first;
+        clock.unsubscribe(firstId);
+    });
+    clock.subscribe([&](AbstractTimeProvider::TimePoint) { ++second; });
+
+    clock.advanceTime(std::chrono::seconds(1));
+    clock.advanceTime(std::chrono::seconds(1));
+
+    EXPECT_EQ(first, 1);
+    EXPECT_EQ(second, 2);
+}
+
+TEST_F(ChatTestFixture, DisappearingMessagesExpireWithTime) {
+    std::vector<ChatEvent> events;
+    chatManager_->setEventListener([&events](const ChatEvent& event) { events.push_back(event); });
+
+    auto user1 = registerUser("Cinderella");
+    auto user2 = registerUser("Charming");
+    auto chatId = chatManager_->createPersonalChat("Ball", user1, user2);
+    auto outsider = registerUser("Stepmother");
+
+    EXPECT_FALSE(chatManager_->setMessageTtl(chatId, outsider, std::chrono::seconds(30)));
+    EXPECT_TRUE(chatManager_->setMessageTtl(chatId, user1, std::chrono::hours(1)));
+
+    chatManager_->sendMessage(chatId, user1, "Midnight");
+    chatManager_->sendMessage(chatId, user2, "Slipper");
+    auto removed = chatManager_->getHistory(chatId).back().getId();
+    chatManager_->removeMessage(chatId, user2, removed);
+    EXPECT_EQ(chatManager_->pendingExpirations(), 1);
+
+    EXPECT_TRUE(chatManager_->setMessageTtl(chatId, user2, std::chrono::seconds(0)));
+    chatManager_->sendMessage(chatId, user2, "Forever");
+    events.clear();
+
+    mockTimeProvider_.advanceTime(std::chrono::minutes(59));
+    EXPECT_EQ(chatManager_->getHistory(chatId).size(), 2);
+
+    mockTimeProvider_.advanceTime(std::chrono::minutes(1));
+    auto history = chatManager_->getHistory(chatId);
+    ASSERT_EQ(history.size(), 1);
+    EXPECT_EQ(history[0].getText(), "Forever");
+    EXPECT_TRUE(chatManager_->searchMessages(user1, "midnight", 10).empty());
+    EXPECT_EQ(chatManager_->pendingExpirations(), 0);
+
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0].type, ChatEvent::Type::MESSAGE_REMOVED);
+    EXPECT_EQ(events[0].roomId, chatId);
+}
+
+TEST_F(ChatTestFixture, RetriedSendsWithSameKeyAreDeduplicated) {
+    auto user1 = registerUser("Sisyphus");
+    auto user2 = registerUser("Thanatos");
+    auto chatId = chatManager_->createPersonalChat("Hill", user1, user2);
+    auto otherId = chatManager_->createPersonalChat("Valley", user1, user2);
+    chatManager_->setDedupOptions({std::chrono::seconds(60), 2});
+
+    auto first = chatManager_->sendMessage(chatId, user1, "Push", "k1");
+    ASSERT_TRUE(first.has_value());
+    EXPECT_EQ(chatManager_->sendMessage(chatId, user1, "Push", "k1"), first);
+    EXPECT_FALSE(chatManager_->sendMessage(otherId, user1, "Push", "k1").has_value());
+    EXPECT_NE(chatManager_->sendMessage(chatId, user2, "Push", "k1"), first);
+    EXPECT_EQ(chatManager_->getHistory(chatId).size(), 2);
+
+    auto stats = chatManager_->dedupStats();
+    EXPECT_EQ(stats.keys, 2);
+    EXPECT_EQ(stats.hits, 1);
+    EXPECT_EQ(stats.conflicts, 1);
+
+    chatManager_->sendMessage(chatId, user1, "Roll", "k2");
+    EXPECT_EQ(chatManager_->dedupStats().keys, 2);
+    EXPECT_EQ(chatManager_->dedupStats().evicted, 1);
+
+    mockTimeProvider_.advanceTime(std::chrono::seconds(61));
+    EXPECT_NE(chatManager_->sendMessage(chatId, user1, "Roll", "k2"), std::nullopt);
+    EXPECT_EQ(chatManager_->getHistory(chatId).size(), 4);
+    EXPECT_EQ(chatManager_->dedupStats().keys, 1);
+
+    EXPECT_FALSE(chatManager_->sendMessage(chatId, user1, "Roll", std::string(65, 'k')).has_value());
+    EXPECT_EQ(chatManager_->getHistory(chatId).size(), 4);
+}
+
+TEST(DedupTableTest, KeysAreComparedWhole) {
+    DedupTable table;
+    const auto now = std::chrono::system_clock::time_point{} + std::chrono::hours(1);
+    const auto user = generateTimeOrderedId();
+    const auto room = generateTimeOrderedId();
+    const auto first = generateTimeOrderedId();
+    const auto second = generateTimeOrderedId();
+
+    // Keys that differ only past what a short hash or prefix would cover.
+    const std::string key(64, 'x');
+    auto other = key;
+    other.back() = 'y';
+
+    table.remember(user, key, room, first, now);
+    table.remember(user, other, room, second, now);
+
+    EXPECT_EQ(table.find(user, key, room, now)->messageId, first);
+    EXPECT_EQ(table.find(user, other, room, now)->messageId, second);
+    EXPECT_FALSE(table.find(user, key.substr(1), room, now).has_value());
+    EXPECT_FALSE(table.accepts(key + 'z'));
+    EXPECT_EQ(table.stats().keys, 2);
+}
+
+TEST_F(ChatTestFixture, LockWaitIsReportedPerWindow) {
+    auto user1 = registerUser("Tortoise");
+    auto user2 = registerUser("Hare");
+    auto chatId = chatManager_->createPersonalChat("Race", user1, user2);
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&, t] {
+            for (int i = 0; i < 200; ++i) {
+                chatManager_->sendMessage(chatId, t % 2 ? user1 : user2, "step");
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    EXPECT_GE(chatManager_->takeLockWait().count(), 0);
+    // Nothing took the lock since: the next window must not carry the old wait.
+    EXPECT_EQ(chatManager_->takeLockWait().count(), 0);
+}
+
+TEST_F(ChatTestFixture, LockProfilerReportsContendedCallSites) {
+    LockProfiler::reset();
+    auto user1 = registerUser("Tantalus");
+    auto user2 = registerUser("Pelops");
+    auto chatId = chatManager_->createPersonalChat("Feast", user1, user2);
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&, t] {
+            for (int i = 0; i < 200; ++i) {
+                chatManager_->sendMessage(chatId, t % 2 ? user1 : user2, "Course " + std::to_string(i));
+            }
+        });
+    }
+    for (auto& writer : writers) writer.join();
+    EXPECT_EQ(chatManager_->getHistory(chatId).size(), 800);
+
+    auto report = LockProfiler::report();
+    if (!LockProfiler::enabled) {
+        // Compiled out: the locks are plain locks and nothing is recorded.
+        EXPECT_TRUE(report.empty());
+        return;
+    }
+
+    auto send = std::find_if(report.begin(), report.end(), [](const LockProfiler::SiteReport& site) {
+        return site.site == "sendMessage/exclusive";
+    });
+    ASSERT_NE(send, report.end());
+    EXPECT_EQ(send->acquisitions, 800);
+    EXPECT_LE(send->contended, send->acquisitions);
+    EXPECT_LE(send->holdNanos.p50, send->holdNanos.max);
+    EXPECT_TRUE(std::any_of(report.begin(), report.end(), [](const LockProfiler::SiteReport& site) {
+        return site.site == "getUser/stripe-shared" || site.site == "userExists/stripe-shared";
+    }));
+}
+
+TEST_F(ChatTestFixture, AllocTrackerChargesTagsAndCommands) {
+    if (!AllocTracker::enabled) {
+        // Compiled out: scopes still nest, but operator new is the stock one
+        // and nothing is charged.
+        auto user1 = registerUser("Procrustes");
+        auto user2 = registerUser("Sinis");
+        auto chatId = chatManager_->createPersonalChat("Bed", user1, user2);
+        {
+            AllocScope alloc(AllocTag::DISPATCH_TEMPORARIES, 63);
+            AllocScope inner(AllocTag::ROOM_MESSAGES);
+            EXPECT_TRUE(chatManager_->sendMessage(chatId, user1, std::string(2048, 'm')));
+        }
+        for (std::size_t tag = 0; tag < std::size_t(AllocTag::COUNT); ++tag) {
+            EXPECT_EQ(AllocTracker::tagUsage(AllocTag(tag)).allocations, 0);
+        }
+        EXPECT_TRUE(AllocTracker::commandUsage().empty());
+        return;
+    }
+
+    const auto usersBefore = AllocTracker::tagUsage(AllocTag::USER_TABLE);
+    auto user1 = registerUser("Procrustes");
+    auto user2 = registerUser("Sinis");
+    EXPECT_GT(AllocTracker::tagUsage(AllocTag::USER_TABLE).liveBytes, usersBefore.liveBytes);
+
+    auto chatId = chatManager_->createPersonalChat("Bed", user1, user2);
+    const auto roomsBefore = AllocTracker::tagUsage(AllocTag::ROOM_MESSAGES);
+    const auto dispatchBefore = AllocTracker::tagUsage(AllocTag::DISPATCH_TEMPORARIES);
+    constexpr int kCommand = 63;
+    {
+        AllocScope alloc(AllocTag::DISPATCH_TEMPORARIES, kCommand);
+        auto scratch = std::make_unique<std::string>(4096, 's');
+        EXPECT_GE(AllocTracker::tagUsage(AllocTag::DISPATCH_TEMPORARIES).liveBytes, dispatchBefore.liveBytes + 4096);
+        chatManager_->sendMessage(chatId, user1, std::string(2048, 'm'));
+    }
+
+    const auto rooms = AllocTracker::tagUsage(AllocTag::ROOM_MESSAGES);
+    EXPECT_GE(rooms.liveBytes, roomsBefore.liveBytes + 2048);
+    EXPECT_GE(rooms.peakBytes, rooms.liveBytes);
+    EXPECT_GT(rooms.allocations, roomsBefore.allocations);
+    EXPECT_EQ(AllocTracker::tagUsage(AllocTag::DISPATCH_TEMPORARIES).liveBytes, dispatchBefore.liveBytes);
+
+    auto commands = AllocTracker::commandUsage();
+    auto command = std::find_if(commands.begin(), commands.end(), [](const AllocTracker::CommandUsage& entry) {
+        return entry.command == kCommand;
+    });
+    ASSERT_NE(command, commands.end());
+    // The nested room scope keeps the command, so the stored message stays charged to it.
+    EXPECT_GE(command->usage.liveBytes, 2048);
+    EXPECT_GE(command->usage.peakBytes, 4096 + 2048);
+}
+
+TEST_F(ChatTestFixture, SampledRequestsExportChromeTraceSpans) {
+    auto user1 = registerUser("Ariadne");
+    auto user2 = registerUser("Theseus");
+    auto chatId = chatManager_->createPersonalChat("Labyrinth", user1, user2);
+
+    Tracer::configure({0, 64});
+    EXPECT_EQ(Tracer::sample(), 0);
+    Tracer::configure({1, 64});
+    const auto traceId = Tracer::sample();
+    ASSERT_NE(traceId, 0);
+
+    {
+        TraceContext context(traceId);
+        chatManager_->sendMessage(chatId, user1, "Follow the thread");
+    }
+    chatManager_->sendMessage(chatId, user2, "Untraced");
+    Tracer::configure({});
+
+    const auto json = Tracer::exportChromeTrace();
+    const auto tag = "\"args\":{\"trace\":" + std::to_string(traceId) + "}";
+    EXPECT_EQ(json.rfind("{\"traceEvents\":[", 0), 0);
+    for (const std::string name : {"ChatManager::sendMessage", "ChatManager::lockWait",
+                                   "ChatManager::generateMessageId", "ChatManager::publish"}) {
+        auto at = json.find("\"name\":\"" + name + "\"");
+        ASSERT_NE(at, std::string::npos) << name;
+        EXPECT_NE(json.find(tag, at), std::string::npos) << name;
+    }
+}
+
+TEST(UuidTextTest, MatchesBoostAndRejectsMalformedText) {
+    std::vector<boost::uuids::uuid> ids = {boost::uuids::uuid{}, generateTimeOrderedId()};
+    ids.push_back(boost::uuids::uuid{});
+    for (auto& byte : ids.back().data) byte = 0xFF;
+    for (int i = 0; i < 100; ++i) ids.push_back(generateTimeOrderedId());
+
+    for (const auto& id : ids) {
+        const auto text = uuidToString(id);
+        EXPECT_EQ(text, boost::uuids::to_string(id));
+        EXPECT_EQ(parseUuidText(text), id);
+
+        auto upper = text;
+        for (auto& c : upper) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        EXPECT_EQ(parseUuidText(upper), id);
+    }
+
+    const auto good = uuidToString(ids[1]);
+    for (std::size_t at = 0; at < good.size(); ++at) {
+        for (char bad : {'g', 'G', '/', ':', '@', '`', ' ', '\x80', '-'}) {
+            auto text = good;
+            if (text[at] == bad) continue;
+            text[at] = bad;
+            EXPECT_FALSE(parseUuidText(text)) << text;
+        }
+    }
+    EXPECT_FALSE(parseUuidText(""));
+    EXPECT_FALSE(parseUuidText(good.substr(1)));
+    EXPECT_FALSE(parseUuidText(good + "0"));
+    EXPECT_FALSE(parseUuidText("{" + good.substr(1)));
+}
+
+TEST_F(ChatTestFixture, RoomsMoveBetweenManagersWithTheirHistory) {
+    auto admin = registerUser("Odysseus");
+    auto crew = registerUser("Eurylochus");
+    auto groupId = chatManager_->createCloseGroup("Ship", admin);
+    chatManager_->addParticipant(groupId, admin, crew);
+    EXPECT_TRUE(chatManager_->setMessageTtl(groupId, admin, std::chrono::hours(2)));
+    chatManager_->sendMessage(groupId, admin, "Row");
+    chatManager_->sendMessage(groupId, crew, "Sirens ahead");
+
+    UserManager otherUsers;
+    ChatManager other(mockTimeProvider_, otherUsers);
+    auto snapshot = chatManager_->extractRoom(groupId);
+    ASSERT_TRUE(snapshot.has_value());
+    EXPECT_FALSE(chatManager_->chatExists(groupId));
+    EXPECT_TRUE(chatManager_->searchMessages(crew, "sirens", 10).empty());
+
+    EXPECT_FALSE(other.adoptRoom(*snapshot));
+    otherUsers.adoptUser(admin, "Odysseus", false);
+    otherUsers.adoptUser(crew, "Eurylochus", true);
+    ASSERT_TRUE(other.adoptRoom(*snapshot));
+    EXPECT_FALSE(other.adoptRoom(*snapshot));
+
+    EXPECT_EQ(other.getChatAdmin(groupId), admin);
+    EXPECT_EQ(other.getChatParticipants(groupId), (std::vector<User::UserId>{admin, crew}));
+    EXPECT_EQ(other.getHistory(groupId).size(), 2);
+    EXPECT_EQ(other.searchMessages(crew, "sirens", 10).size(), 1);
+    EXPECT_FALSE(other.addParticipant(groupId, crew, otherUsers.registerUser("Polyphemus")));
+
+    mockTimeProvider_.advanceTime(std::chrono::hours(2));
+    EXPECT_TRUE(other.getHistory(groupId).empty());
+
+    other.setPlacement([](ChatManager::ChatRoomId id) { return id.data[15] % 4 == 0; });
+    for (int i = 0; i < 20; ++i) {
+        EXPECT_EQ(other.createOpenGroup("Raft", admin).data[15] % 4, 0);
+    }
+    EXPECT_EQ(other.roomIds().size(), 21);
+}
+
+TEST_F(ChatTestFixture, PlacementChangesKeepRoomsUntilDropped) {
+    auto admin = registerUser("Aeneas");
+    auto leaving = chatManager_->createOpenGroup("Troy", admin);
+    auto staying = chatManager_->createOpenGroup("Carthage", admin);
+    chatManager_->sendMessage(leaving, admin, "Sail");
+
+    bool moved = false;
+    chatManager_->setPlacement([&](ChatManager::ChatRoomId id) { return !moved || id != leaving; });
+    auto snapshots = chatManager_->changePlacement([&] { moved = true; });
+    ASSERT_EQ(snapshots.size(), 1);
+    EXPECT_EQ(snapshots[0].id, leaving);
+    EXPECT_EQ(snapshots[0].messages.size(), 1);
+
+    // Still readable while the new owner is being handed it, not writable.
+    EXPECT_EQ(chatManager_->getHistory(leaving).size(), 1);
+    EXPECT_FALSE(chatManager_->sendMessage(leaving, admin, "Lost"));
+    EXPECT_TRUE(chatManager_->sendMessage(staying, admin, "Stay"));
+    EXPECT_EQ(chatManager_->getUserChats(admin), std::vector<ChatManager::ChatRoomId>{staying});
+
+    chatManager_->keepRoom(leaving);
+    EXPECT_TRUE(chatManager_->sendMessage(leaving, admin, "Kept"));
+
+    EXPECT_EQ(chatManager_->changePlacement([] {}).size(), 1);
+    EXPECT_TRUE(chatManager_->dropRoom(leaving));
+    EXPECT_FALSE(chatManager_->chatExists(leaving));
+    EXPECT_TRUE(chatManager_->chatExists(staying));
+}
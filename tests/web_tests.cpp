@@ -10,14 +10,52 @@
 
 #define BOOST_TEST_MODULE WebTests
 #include <boost/test/included/unit_test.hpp>
+#include <boost/algorithm/string.hpp>
 #include <boost/format.hpp>
 
 #include "../web/lib/server.h"
 #include "../web/lib/commands.h"
+#include "../web/lib/hash_ring.h"
+#include "../web/lib/traffic_replay.h"
+#include "../business_logic/lib/alloc_tracker.h"
+#include "../business_logic/lib/uuid_v7.h"
 
 using tcp = ip::tcp;
 namespace websocket = beast::websocket;
 
+#if PRISECCHAT_ALLOC_TRACKING
+// The server's tracker already owns operator new; count through it.
+std::uint64_t allocationCount() {
+    std::uint64_t total = 0;
+    for (std::size_t tag = 0; tag < std::size_t(AllocTag::COUNT); ++tag) {
+        total += AllocTracker::tagUsage(AllocTag(tag)).allocations;
+    }
+    return total;
+}
+#else
+std::atomic<std::uint64_t> globalAllocations{0};
+
+std::uint64_t allocationCount() {
+    return globalAllocations.load();
+}
+
+void* operator new(std::size_t size) {
+    globalAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#endif
+
 struct MessageWs {
     OutCommand code;
     std::string message;
@@ -28,12 +66,19 @@ struct TestClient {
         : resolver_(ioc), ws_(ioc)
     {}
 
-    void connect() {
-        auto const results = resolver_.resolve("localhost", "8080");
+    void connect(const std::string& port = "8080") {
+        auto const results = resolver_.resolve("localhost", port);
         asio::connect(ws_.next_layer(), results.begin(), results.end());
         ws_.handshake("localhost", "/");
     }
 
+    // Offers permessage-deflate; takes effect on the next connect.
+    void offerCompression() {
+        websocket::permessage_deflate deflate;
+        deflate.client_enable = true;
+        ws_.set_option(deflate);
+    }
+
     void disconnect() {
         ws_.close(websocket::close_code::normal);
     }
@@ -54,6 +99,14 @@ struct TestClient {
         return static_cast<ErrorCode>(std::stoi(text));
     }
 
+    // Reuses the caller's request and buffer, so the client side of the
+    // exchange stops allocating once the buffer has grown.
+    std::size_t roundTrip(const std::string& request, beast::flat_buffer& buffer) {
+        ws_.write(asio::buffer(request));
+        buffer.clear();
+        return ws_.read(buffer);
+    }
+
 private:
     std::pair<OutCommand, std::string> receiveRaw() {
         beast::flat_buffer buffer;
@@ -92,9 +145,15 @@ std::vector<std::tuple<std::string, std::string, std::string>> parseHistory(cons
     return out;
 }
 
+ServerOptions withDiagnostics() {
+    ServerOptions options;
+    options.diagnostics = true;
+    return options;
+}
+
 struct WsTestGlobalFixture {
     WsTestGlobalFixture()
-        : server(2, 8080)
+        : server(2, 8080, std::make_shared<TimeProvider>(), withDiagnostics())
     {
         thread = std::thread([this]{ server.start(); });
         std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -363,3 +422,908 @@ BOOST_FIXTURE_TEST_CASE(UnknownAndBadFormatCommands, WsTestFixture) {
     auto err1 = client1.receiveError();
     BOOST_CHECK(err1 == ErrorCode::UNKNOWN_COMMAND);
 }
+
+BOOST_FIXTURE_TEST_CASE(SearchMessages, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::CREATE_PERSONAL_CHAT, clientId2 + " SChat");
+    auto cr = client1.receiveMessage();
+    BOOST_CHECK(cr.code == OutCommand::CHAT_CREATED);
+    std::string cid = cr.message;
+
+    client1.sendMessage(InCommand::SEND_MESSAGE, cid + " Wooden horse delivered");
+    client1.receiveMessage();
+    client1.sendMessage(InCommand::SEND_MESSAGE, cid + " Nothing to see here");
+    client1.receiveMessage();
+
+    client1.sendMessage(InCommand::SEARCH, "horse");
+    auto found = client1.receiveMessage();
+    BOOST_CHECK(found.code == OutCommand::SEARCH_RESULTS);
+    BOOST_CHECK(found.message.rfind(cid + ";", 0) == 0);
+
+    client1.sendMessage(InCommand::SEARCH);
+    auto err = client1.receiveError();
+    BOOST_CHECK(err == ErrorCode::INCORRECT_FORMAT);
+
+    client1.sendMessage(InCommand::SEARCH, " ,");
+    BOOST_CHECK(client1.receiveError() == ErrorCode::INCORRECT_FORMAT);
+}
+
+BOOST_FIXTURE_TEST_CASE(StatsReportUserGauges, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::GET_STATS);
+    auto stats = client1.receiveMessage();
+    BOOST_CHECK(stats.code == OutCommand::STATS);
+    BOOST_CHECK(stats.message.find("users_live=") != std::string::npos);
+    BOOST_CHECK(stats.message.find("users_reclaimable=") != std::string::npos);
+}
+
+BOOST_FIXTURE_TEST_CASE(ResumeReplaysMissedEvents, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::SIGN_UP, "Odysseus");
+    auto signUp = client1.receiveMessage();
+    BOOST_REQUIRE(signUp.code == OutCommand::SIGN_UP_SUCCESS);
+    std::vector<std::string> fields;
+    boost::split(fields, signUp.message, boost::is_any_of(" "));
+    BOOST_REQUIRE(fields.size() == 3);
+    const std::string& userId = fields[0];
+    const std::string& token = fields[1];
+    const std::string& sequence = fields[2];
+
+    client2.sendMessage(InCommand::CREATE_PERSONAL_CHAT, userId + " Ithaca");
+    auto cr = client2.receiveMessage();
+    BOOST_REQUIRE(cr.code == OutCommand::CHAT_CREATED);
+
+    client1.disconnect();
+
+    client2.sendMessage(InCommand::SEND_MESSAGE, cr.message + " Penelope waits");
+    BOOST_CHECK(client2.receiveMessage().code == OutCommand::MESSAGE_SENT);
+    client2.sendMessage(InCommand::SEND_MESSAGE, cr.message + " Suitors arrived");
+    BOOST_CHECK(client2.receiveMessage().code == OutCommand::MESSAGE_SENT);
+
+    TestClient client3{ioc};
+    client3.connect();
+    client3.receiveMessage();
+
+    client3.sendMessage(InCommand::RESUME, "not-a-token " + sequence);
+    BOOST_CHECK(client3.receiveMessage().code == OutCommand::RESUME_FAIL);
+
+    client3.sendMessage(InCommand::RESUME, token + " " + sequence);
+    auto resumed = client3.receiveMessage();
+    BOOST_REQUIRE(resumed.code == OutCommand::RESUME_SUCCESS);
+    BOOST_CHECK(resumed.message.rfind(userId + " ", 0) == 0);
+    BOOST_CHECK(resumed.message.back() == '1');
+
+    auto first = client3.receiveMessage();
+    BOOST_CHECK(first.code == OutCommand::PUSH_MSG_SENT);
+    BOOST_CHECK(first.message.ends_with("Penelope waits"));
+    auto second = client3.receiveMessage();
+    BOOST_CHECK(second.code == OutCommand::PUSH_MSG_SENT);
+    BOOST_CHECK(second.message.ends_with("Suitors arrived"));
+
+    client3.sendMessage(InCommand::RESUME, token + " " + sequence);
+    BOOST_CHECK(client3.receiveMessage().code == OutCommand::RESUME_FAIL);
+}
+
+BOOST_FIXTURE_TEST_CASE(HeavyCommandsKeepReplyOrder, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::CREATE_OPEN_GROUP, "Pipeline");
+    auto cr = client1.receiveMessage();
+    BOOST_REQUIRE(cr.code == OutCommand::CHAT_CREATED);
+
+    client1.sendMessage(InCommand::GET_HISTORY, cr.message);
+    client1.sendMessage(InCommand::SEND_MESSAGE, cr.message + " After history");
+    client1.sendMessage(InCommand::LIST_CHATS);
+    client1.sendMessage(InCommand::RENAME_USER, "Pipelined");
+
+    BOOST_CHECK(client1.receiveMessage().code == OutCommand::HISTORY);
+    BOOST_CHECK(client1.receiveMessage().code == OutCommand::MESSAGE_SENT);
+    BOOST_CHECK(client1.receiveMessage().code == OutCommand::CHATS_LIST);
+    BOOST_CHECK(client1.receiveMessage().code == OutCommand::USER_RENAMED);
+
+    client1.sendMessage(InCommand::GET_STATS);
+    auto stats = client1.receiveMessage();
+    BOOST_CHECK(stats.message.find("compute_queue_p99_us=") != std::string::npos);
+    BOOST_CHECK(stats.message.find("io_run_count=") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(OverloadControllerThresholds) {
+    OverloadLimits limits;
+    limits.maxLoopLag = std::chrono::milliseconds(10);
+    limits.maxLockWait = std::chrono::milliseconds(10);
+    limits.maxOutboundBytes = 1000;
+    limits.retryAfter = std::chrono::milliseconds(100);
+
+    OverloadController controller(limits);
+    BOOST_CHECK(!controller.overloaded());
+    BOOST_CHECK(controller.retryAfter() == std::chrono::milliseconds(100));
+
+    controller.recordLoopLag(std::chrono::milliseconds(5));
+    controller.addOutboundBytes(900);
+    BOOST_CHECK(!controller.overloaded());
+
+    controller.recordLockWait(std::chrono::milliseconds(30));
+    BOOST_CHECK(controller.overloaded());
+    BOOST_CHECK(controller.retryAfter() == std::chrono::milliseconds(300));
+
+    controller.recordLockWait(std::chrono::milliseconds(0));
+    controller.addOutboundBytes(200);
+    BOOST_CHECK(controller.overloaded());
+
+    controller.removeOutboundBytes(1100);
+    controller.recordLoopLag(std::chrono::seconds(10));
+    BOOST_CHECK(controller.retryAfter() == std::chrono::milliseconds(1000));
+
+    controller.recordLoopLag(std::chrono::milliseconds(0));
+    BOOST_CHECK(!controller.overloaded());
+}
+
+BOOST_AUTO_TEST_CASE(TokenBucketRefillsOverTime) {
+    auto start = TokenBucket::Clock::now();
+    SessionRateLimiter limiter(RateLimits{{0, 0}, {10, 2}, {0, 0}, {0, 0}}, start);
+
+    BOOST_CHECK(!limiter.admit(CommandClass::WRITE, start));
+    BOOST_CHECK(!limiter.admit(CommandClass::WRITE, start));
+
+    auto rejection = limiter.admit(CommandClass::WRITE, start);
+    BOOST_REQUIRE(rejection);
+    BOOST_CHECK(rejection->scope == RateScope::WRITES);
+    BOOST_CHECK(rejection->retryAfter == std::chrono::milliseconds(100));
+    BOOST_CHECK(!limiter.admit(CommandClass::HISTORY_READ, start));
+
+    BOOST_CHECK(!limiter.admit(CommandClass::WRITE, start + std::chrono::milliseconds(100)));
+    BOOST_CHECK(limiter.admit(CommandClass::WRITE, start + std::chrono::milliseconds(100)));
+}
+
+namespace {
+
+class RecordingTarget : public PushTarget {
+public:
+    void push(std::shared_ptr<const std::string> frame) override { frames.push_back(*frame); }
+    void supersede() override {}
+
+    std::vector<std::string> frames;
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(PushShardsFollowRoomMembership) {
+    PushHub hub(ReplayOptions{}, FanoutOptions{4});
+    const auto room = generateTimeOrderedId();
+    std::vector<User::UserId> users;
+    std::vector<std::shared_ptr<RecordingTarget>> targets;
+    for (int i = 0; i < 8; ++i) {
+        users.push_back(generateTimeOrderedId());
+        targets.push_back(std::make_shared<RecordingTarget>());
+        hub.attach(users.back(), targets.back());
+    }
+
+    auto membership = [&](ChatEvent::Type type, User::UserId user) {
+        hub.publish(ChatEvent{type, room, {}, user, {}});
+    };
+    auto send = [&](User::UserId sender) {
+        hub.publish(ChatEvent{ChatEvent::Type::MESSAGE_SENT, room, generateTimeOrderedId(), sender, "hi"});
+    };
+
+    for (int i = 0; i < 6; ++i) {
+        membership(ChatEvent::Type::MEMBER_JOINED, users[i]);
+    }
+    send(users[0]);
+    membership(ChatEvent::Type::MEMBER_LEFT, users[1]);
+    send(users[0]);
+    hub.publish(ChatEvent{ChatEvent::Type::ROOM_CLOSED, room, {}, {}, {}});
+    send(users[0]);
+
+    BOOST_CHECK(targets[0]->frames.empty());
+    BOOST_CHECK_EQUAL(targets[1]->frames.size(), 1);
+    for (int i = 2; i < 6; ++i) {
+        BOOST_CHECK_EQUAL(targets[i]->frames.size(), 2);
+    }
+    BOOST_CHECK(targets[6]->frames.empty() && targets[7]->frames.empty());
+    BOOST_CHECK_EQUAL(hub.lastSequence(), 3);
+}
+
+BOOST_FIXTURE_TEST_CASE(DirectoryReadsAreRateLimited, WsTestFixture) {
+    connectClients();
+
+    const int burst = static_cast<int>(RateLimits{}.directoryReads.burst);
+    for (int i = 0; i < burst + 1; ++i) {
+        client1.sendMessage(InCommand::LIST_CHATS);
+    }
+    for (int i = 0; i < burst; ++i) {
+        BOOST_CHECK(client1.receiveMessage().code == OutCommand::CHATS_LIST);
+    }
+    BOOST_CHECK(client1.receiveError() == ErrorCode::RATE_LIMITED);
+
+    client1.sendMessage(InCommand::RENAME_USER, "Throttled");
+    BOOST_CHECK(client1.receiveMessage().code == OutCommand::USER_RENAMED);
+
+    client1.sendMessage(InCommand::GET_STATS);
+    BOOST_CHECK(client1.receiveMessage().message.find("ratelimit_directory_rejected=") != std::string::npos);
+}
+
+BOOST_FIXTURE_TEST_CASE(SearchUsersByPrefixWithCursor, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::RENAME_USER, "Telemachus");
+    BOOST_REQUIRE(client1.receiveMessage().code == OutCommand::USER_RENAMED);
+    client2.sendMessage(InCommand::RENAME_USER, "Telegonus");
+    BOOST_REQUIRE(client2.receiveMessage().code == OutCommand::USER_RENAMED);
+
+    client1.sendMessage(InCommand::SEARCH_USERS, "Tele 1");
+    auto first = client1.receiveMessage();
+    BOOST_REQUIRE(first.code == OutCommand::USERS_FOUND);
+    std::vector<std::string> parts;
+    boost::split(parts, first.message, boost::is_any_of(" "));
+    BOOST_REQUIRE_EQUAL(parts.size(), 2u);
+    BOOST_CHECK_EQUAL(parts[1], clientId2 + ";Telegonus");
+
+    client1.sendMessage(InCommand::SEARCH_USERS, "Tele 1 " + parts[0]);
+    auto second = client1.receiveMessage();
+    BOOST_REQUIRE(second.code == OutCommand::USERS_FOUND);
+    BOOST_CHECK_EQUAL(second.message, "- " + clientId1 + ";Telemachus");
+
+    client1.sendMessage(InCommand::SEARCH_USERS, "Tele 1 broken");
+    BOOST_CHECK(client1.receiveError() == ErrorCode::INCORRECT_FORMAT);
+
+    client1.sendMessage(InCommand::LIST_USERS, "1");
+    auto page = client1.receiveMessage();
+    BOOST_CHECK(page.code == OutCommand::USERS_LIST);
+    BOOST_CHECK(page.message.find('|') == std::string::npos);
+}
+
+BOOST_FIXTURE_TEST_CASE(BroadcastReachesJoinedListeners, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::CREATE_BROADCAST, "Agora");
+    auto cr = client1.receiveMessage();
+    BOOST_REQUIRE(cr.code == OutCommand::CHAT_CREATED);
+
+    client2.sendMessage(InCommand::ADD_PARTICIPANT, cr.message + " " + clientId2);
+    BOOST_REQUIRE(client2.receiveMessage().code == OutCommand::PARTICIPANT_ADDED);
+
+    client2.sendMessage(InCommand::SEND_MESSAGE, cr.message + " Objection");
+    BOOST_CHECK(client2.receiveError() == ErrorCode::ERROR_SEND_MESSAGE);
+
+    client1.sendMessage(InCommand::SEND_MESSAGE, cr.message + " Assembly at noon");
+    BOOST_CHECK(client1.receiveMessage().code == OutCommand::MESSAGE_SENT);
+
+    auto pushed = client2.receiveMessage();
+    BOOST_CHECK(pushed.code == OutCommand::PUSH_MSG_SENT);
+    BOOST_CHECK(pushed.message.ends_with("Assembly at noon"));
+}
+
+BOOST_FIXTURE_TEST_CASE(MessageTtlIsSetByParticipants, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::CREATE_PERSONAL_CHAT, clientId2 + " TtlChat");
+    auto cr = client1.receiveMessage();
+    BOOST_REQUIRE(cr.code == OutCommand::CHAT_CREATED);
+
+    client2.sendMessage(InCommand::SET_MESSAGE_TTL, cr.message + " 30");
+    BOOST_CHECK(client2.receiveMessage().code == OutCommand::TTL_SET);
+
+    client1.sendMessage(InCommand::SET_MESSAGE_TTL, cr.message + " -5");
+    BOOST_CHECK(client1.receiveError() == ErrorCode::ERROR_SET_TTL);
+
+    client1.sendMessage(InCommand::SET_MESSAGE_TTL, cr.message);
+    BOOST_CHECK(client1.receiveError() == ErrorCode::INCORRECT_FORMAT);
+}
+
+// The fixture server runs on the real clock; nothing here advances it.
+BOOST_FIXTURE_TEST_CASE(TtlMessagesExpireOnTheServerClock, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::CREATE_PERSONAL_CHAT, clientId2 + " FleetingChat");
+    auto cr = client1.receiveMessage();
+    BOOST_REQUIRE(cr.code == OutCommand::CHAT_CREATED);
+
+    client1.sendMessage(InCommand::SET_MESSAGE_TTL, cr.message + " 1");
+    BOOST_REQUIRE(client1.receiveMessage().code == OutCommand::TTL_SET);
+    client1.sendMessage(InCommand::SEND_MESSAGE, cr.message + " Gone soon");
+    BOOST_REQUIRE(client1.receiveMessage().code == OutCommand::MESSAGE_SENT);
+
+    BOOST_CHECK(client2.receiveMessage().code == OutCommand::PUSH_MSG_SENT);
+    const auto start = std::chrono::steady_clock::now();
+    BOOST_CHECK(client2.receiveMessage().code == OutCommand::PUSH_MSG_REMOVED);
+    BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    // Expiry has no actor, so the sender hears it too.
+    BOOST_CHECK(client1.receiveMessage().code == OutCommand::PUSH_MSG_REMOVED);
+
+    client1.sendMessage(InCommand::GET_HISTORY, cr.message);
+    auto history = client1.receiveMessage();
+    BOOST_CHECK(history.code == OutCommand::HISTORY);
+    BOOST_CHECK(parseHistory(history.message).empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(SendMessageOnceIsIdempotent, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::CREATE_PERSONAL_CHAT, clientId2 + " OnceChat");
+    auto cr = client1.receiveMessage();
+    BOOST_REQUIRE(cr.code == OutCommand::CHAT_CREATED);
+
+    client1.sendMessage(InCommand::SEND_MESSAGE_ONCE, cr.message + " retry-7 Only once");
+    auto first = client1.receiveMessage();
+    BOOST_REQUIRE(first.code == OutCommand::MESSAGE_SENT);
+
+    client1.sendMessage(InCommand::SEND_MESSAGE_ONCE, cr.message + " retry-7 Only once");
+    auto retry = client1.receiveMessage();
+    BOOST_CHECK(retry.code == OutCommand::MESSAGE_SENT);
+    BOOST_CHECK_EQUAL(retry.message, first.message);
+
+    client1.sendMessage(InCommand::GET_HISTORY, cr.message);
+    auto history = parseHistory(client1.receiveMessage().message);
+    BOOST_REQUIRE(history.size() == 1);
+    BOOST_CHECK_EQUAL(std::get<0>(history[0]), first.message);
+}
+
+BOOST_FIXTURE_TEST_CASE(SendMessageOnceTakesTextAfterAShortKey, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::CREATE_PERSONAL_CHAT, clientId2 + " KeyChat");
+    auto cr = client1.receiveMessage();
+    BOOST_REQUIRE(cr.code == OutCommand::CHAT_CREATED);
+
+    // The key also occurs inside the chat id, ahead of where it stands.
+    const std::string key(1, cr.message[0]);
+    client1.sendMessage(InCommand::SEND_MESSAGE_ONCE, cr.message + " " + key + " Short key");
+    BOOST_REQUIRE(client1.receiveMessage().code == OutCommand::MESSAGE_SENT);
+
+    client1.sendMessage(InCommand::GET_HISTORY, cr.message);
+    auto history = parseHistory(client1.receiveMessage().message);
+    BOOST_REQUIRE(history.size() == 1);
+    BOOST_CHECK_EQUAL(std::get<2>(history[0]), "Short key");
+}
+
+BOOST_FIXTURE_TEST_CASE(LockProfileIsServedWhenDiagnosticsAreOn, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::CREATE_PERSONAL_CHAT, clientId2 + " ProfiledChat");
+    auto cr = client1.receiveMessage();
+    BOOST_REQUIRE(cr.code == OutCommand::CHAT_CREATED);
+    client1.sendMessage(InCommand::SEND_MESSAGE, cr.message + " Timed");
+    BOOST_REQUIRE(client1.receiveMessage().code == OutCommand::MESSAGE_SENT);
+
+    client1.sendMessage(InCommand::GET_LOCK_PROFILE);
+    auto profile = client1.receiveMessage();
+    BOOST_CHECK(profile.code == OutCommand::LOCK_PROFILE);
+    if (LockProfiler::enabled) {
+        BOOST_CHECK(profile.message.find("sendMessage/exclusive;") != std::string::npos);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(TraceDumpIsChromeJson, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::DUMP_TRACE);
+    auto dump = client1.receiveMessage();
+    BOOST_CHECK(dump.code == OutCommand::TRACE_DUMP);
+    BOOST_CHECK(dump.message.starts_with("{\"traceEvents\":["));
+    BOOST_CHECK(dump.message.ends_with("}"));
+}
+
+BOOST_FIXTURE_TEST_CASE(DispatchAllocatesFromSessionArena, WsTestFixture) {
+    connectClients();
+
+    client1.sendMessage(InCommand::CREATE_PERSONAL_CHAT, clientId2 + " ArenaChat");
+    auto full = client1.receiveMessage();
+    BOOST_REQUIRE(full.code == OutCommand::CHAT_CREATED);
+    client1.sendMessage(InCommand::CREATE_OPEN_GROUP, "EmptyChat");
+    auto empty = client1.receiveMessage();
+    BOOST_REQUIRE(empty.code == OutCommand::CHAT_CREATED);
+
+    for (int i = 0; i < 5; ++i) {
+        client1.sendMessage(InCommand::SEND_MESSAGE, full.message + " Message number " + std::to_string(i));
+        BOOST_REQUIRE(client1.receiveMessage().code == OutCommand::MESSAGE_SENT);
+    }
+    for (int i = 0; i < 5; ++i) {
+        client2.receiveMessage();
+    }
+
+    beast::flat_buffer buffer;
+    // Stays inside the history-read burst so no command is rate limited.
+    constexpr int kCommands = 15;
+    auto measure = [&](const std::string& chat) {
+        const std::string request = std::to_string(int(InCommand::GET_HISTORY)) + ' ' + chat;
+        client1.roundTrip(request, buffer);
+        // The median of single round trips, so that an allocation on some
+        // unrelated server thread does not land in the measurement.
+        std::vector<std::uint64_t> counts;
+        for (int i = 0; i < kCommands; ++i) {
+            const auto before = allocationCount();
+            client1.roundTrip(request, buffer);
+            counts.push_back(allocationCount() - before);
+        }
+        std::nth_element(counts.begin(), counts.begin() + kCommands / 2, counts.end());
+        return counts[kCommands / 2];
+    };
+
+    // A read of a room that does not exist takes the same path through the
+    // transport and executors and does no dispatch work, so it is the
+    // baseline. On top of it dispatch may cost at most one allocation per
+    // command (the transport's own count wobbles by one), however many
+    // messages are returned.
+    const auto transportCost = measure("00000000-0000-0000-0000-000000000000");
+    const auto emptyCost = measure(empty.message);
+    const auto fullCost = measure(full.message);
+
+    BOOST_TEST_MESSAGE("allocations per GET_HISTORY: missing room " << transportCost << ", empty "
+        << emptyCost << ", five messages " << fullCost);
+    BOOST_CHECK_LE(emptyCost, transportCost + 1);
+    BOOST_CHECK_LE(fullCost, transportCost + 1);
+
+#if PRISECCHAT_ALLOC_TRACKING
+    // With tracking, dispatch is counted on its own: it should not allocate.
+    const auto dispatchBefore = AllocTracker::tagUsage(AllocTag::DISPATCH_TEMPORARIES).allocations;
+    measure(full.message);
+    const auto dispatchAllocations = AllocTracker::tagUsage(AllocTag::DISPATCH_TEMPORARIES).allocations - dispatchBefore;
+    BOOST_CHECK_LT(double(dispatchAllocations) / (kCommands + 1), 0.5);
+#endif
+}
+
+BOOST_FIXTURE_TEST_CASE(SessionsArePooledAndShedLargeBuffers, WsTestFixture) {
+    connectClients();
+
+    for (int i = 0; i < 3; ++i) {
+        TestClient transient(ioc);
+        transient.connect();
+        BOOST_REQUIRE(transient.receiveMessage().code == OutCommand::USER_CREATED);
+        transient.disconnect();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    client1.sendMessage(InCommand::CREATE_PERSONAL_CHAT, clientId2 + " Bulk");
+    auto cr = client1.receiveMessage();
+    BOOST_REQUIRE(cr.code == OutCommand::CHAT_CREATED);
+    client1.sendMessage(InCommand::SEND_MESSAGE, cr.message + ' ' + std::string(256 * 1024, 'x'));
+    BOOST_REQUIRE(client1.receiveMessage().code == OutCommand::MESSAGE_SENT);
+    client2.receiveMessage();
+
+    client1.sendMessage(InCommand::GET_STATS);
+    auto stats = client1.receiveMessage();
+    BOOST_REQUIRE(stats.code == OutCommand::STATS);
+
+    auto stat = [&stats](const std::string& name) {
+        auto at = stats.message.find(name + '=');
+        BOOST_REQUIRE(at != std::string::npos);
+        return std::stoull(stats.message.substr(at + name.size() + 1));
+    };
+    BOOST_TEST_MESSAGE("resident bytes per connection: " << stat("session_resident_bytes_per_conn"));
+    BOOST_CHECK_GT(stat("session_pool_hits"), 0u);
+    BOOST_CHECK_GE(stat("sessions_open"), 2u);
+    // The 256 KiB frame must not stay pinned in either session's read buffer.
+    BOOST_CHECK_LT(stat("session_resident_bytes_per_conn"), 64u * 1024);
+}
+
+BOOST_AUTO_TEST_CASE(CoroutineSessionsServeRepliesAndPushes) {
+    ServerOptions options;
+    options.coroutineSessions = true;
+    Server server(2, 8081, std::make_shared<MockTimeProvider>(), options);
+    std::thread thread([&server]{ server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    {
+        asio::io_context ioc;
+        TestClient alice(ioc), bob(ioc);
+        alice.connect("8081");
+        auto aliceId = alice.receiveMessage();
+        BOOST_REQUIRE(aliceId.code == OutCommand::USER_CREATED);
+        bob.connect("8081");
+        auto bobId = bob.receiveMessage().message;
+
+        alice.sendMessage(InCommand::CREATE_PERSONAL_CHAT, bobId + " Coro");
+        auto chat = alice.receiveMessage();
+        BOOST_REQUIRE(chat.code == OutCommand::CHAT_CREATED);
+
+        // Pipelined commands still come back in request order.
+        for (int i = 0; i < 10; ++i) {
+            alice.sendMessage(InCommand::SEND_MESSAGE, chat.message + " m" + std::to_string(i));
+        }
+        for (int i = 0; i < 10; ++i) {
+            BOOST_CHECK(alice.receiveMessage().code == OutCommand::MESSAGE_SENT);
+        }
+        for (int i = 0; i < 10; ++i) {
+            auto push = bob.receiveMessage();
+            BOOST_CHECK(push.code == OutCommand::PUSH_MSG_SENT);
+            BOOST_CHECK(boost::algorithm::ends_with(push.message, " m" + std::to_string(i)));
+        }
+
+        alice.sendMessage(InCommand::RENAME_USER);
+        BOOST_CHECK(alice.receiveError() == ErrorCode::INCORRECT_FORMAT);
+
+        // Operator commands are off unless the server turns them on.
+        alice.sendMessage(InCommand::GET_LOCK_PROFILE);
+        BOOST_CHECK(alice.receiveError() == ErrorCode::UNKNOWN_COMMAND);
+        alice.sendMessage(InCommand::DUMP_TRACE);
+        BOOST_CHECK(alice.receiveError() == ErrorCode::UNKNOWN_COMMAND);
+
+        alice.disconnect();
+        bob.disconnect();
+    }
+
+    server.stop();
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(CompressesLargeRepliesAndReportsSavings) {
+    ServerOptions options;
+    options.compression.enabled = true;
+    Server server(2, 8082, std::make_shared<MockTimeProvider>(), options);
+    std::thread thread([&server]{ server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    {
+        asio::io_context ioc;
+        TestClient alice(ioc), bob(ioc);
+        alice.offerCompression();
+        bob.offerCompression();
+        alice.connect("8082");
+        BOOST_REQUIRE(alice.receiveMessage().code == OutCommand::USER_CREATED);
+        bob.connect("8082");
+        auto bobId = bob.receiveMessage().message;
+
+        alice.sendMessage(InCommand::CREATE_PERSONAL_CHAT, bobId + " Deflate");
+        auto chat = alice.receiveMessage();
+        BOOST_REQUIRE(chat.code == OutCommand::CHAT_CREATED);
+
+        std::string text;
+        for (int i = 0; i < 400; ++i) {
+            text += "line " + std::to_string(i % 10) + " of a fairly repetitive message; ";
+        }
+        alice.sendMessage(InCommand::SEND_MESSAGE, chat.message + ' ' + text);
+        BOOST_REQUIRE(alice.receiveMessage().code == OutCommand::MESSAGE_SENT);
+        auto push = bob.receiveMessage();
+        BOOST_REQUIRE(push.code == OutCommand::PUSH_MSG_SENT);
+        BOOST_CHECK(boost::algorithm::ends_with(push.message, text));
+
+        alice.sendMessage(InCommand::GET_STATS);
+        auto stats = alice.receiveMessage();
+        BOOST_REQUIRE(stats.code == OutCommand::STATS);
+        auto stat = [&stats](const std::string& name) {
+            auto at = stats.message.find(name + '=');
+            BOOST_REQUIRE(at != std::string::npos);
+            return std::stoull(stats.message.substr(at + name.size() + 1));
+        };
+        BOOST_CHECK_EQUAL(stat("ws_compression"), 1u);
+        BOOST_CHECK_GE(stat("ws_compressible_messages"), 1u);
+        BOOST_CHECK_GT(stat("ws_payload_bytes"), text.size());
+        BOOST_CHECK_GT(stat("ws_bytes_saved"), text.size() / 2);
+
+        alice.disconnect();
+        bob.disconnect();
+    }
+
+    server.stop();
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(DetachedUsersLoseReplayStateAfterTheGracePeriod) {
+    ServerOptions options;
+    options.replay.gracePeriod = std::chrono::seconds(1);
+    // The chat clock never moves here; the grace period must pass anyway.
+    Server server(2, 8090, std::make_shared<MockTimeProvider>(), options);
+    std::thread thread([&server]{ server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    {
+        asio::io_context ioc;
+        TestClient alice(ioc), bob(ioc);
+        alice.connect("8090");
+        alice.receiveMessage();
+        alice.sendMessage(InCommand::SIGN_UP, "Odysseus");
+        auto signUp = alice.receiveMessage();
+        BOOST_REQUIRE(signUp.code == OutCommand::SIGN_UP_SUCCESS);
+        std::vector<std::string> fields;
+        boost::split(fields, signUp.message, boost::is_any_of(" "));
+        BOOST_REQUIRE(fields.size() == 3);
+
+        bob.connect("8090");
+        bob.receiveMessage();
+        auto resumable = [&bob] {
+            bob.sendMessage(InCommand::GET_STATS);
+            auto stats = bob.receiveMessage().message;
+            const std::string name = "push_resumable_users=";
+            auto at = stats.find(name);
+            BOOST_REQUIRE(at != std::string::npos);
+            return std::stoull(stats.substr(at + name.size()));
+        };
+        BOOST_CHECK_EQUAL(resumable(), 1u);
+
+        alice.disconnect();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        BOOST_CHECK_EQUAL(resumable(), 1u);
+
+        // Nobody else detaches, so only the server's sweep can release it.
+        std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+        BOOST_CHECK_EQUAL(resumable(), 0u);
+
+        TestClient carol(ioc);
+        carol.connect("8090");
+        carol.receiveMessage();
+        carol.sendMessage(InCommand::RESUME, fields[1] + " " + fields[2]);
+        BOOST_CHECK(carol.receiveMessage().code == OutCommand::RESUME_FAIL);
+
+        bob.disconnect();
+        carol.disconnect();
+    }
+
+    server.stop();
+    thread.join();
+}
+
+BOOST_AUTO_TEST_CASE(CapturedTrafficReplaysWithTheSameOutcomes) {
+    const auto capture = std::filesystem::temp_directory_path() / "prisecchat_web_test.cap";
+    {
+        auto clock = std::make_shared<MockTimeProvider>();
+        ServerOptions options;
+        options.capture.file = capture;
+        Server server(2, 8083, clock, options);
+        std::thread thread([&server]{ server.start(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        asio::io_context ioc;
+        TestClient alice(ioc), bob(ioc);
+        alice.connect("8083");
+        alice.receiveMessage();
+        bob.connect("8083");
+        auto bobId = bob.receiveMessage().message;
+
+        alice.sendMessage(InCommand::CREATE_PERSONAL_CHAT, bobId + " Replay");
+        auto chat = alice.receiveMessage().message;
+        alice.sendMessage(InCommand::SEND_MESSAGE_ONCE, chat + " k1 hello");
+        auto sent = alice.receiveMessage();
+        BOOST_REQUIRE(sent.code == OutCommand::MESSAGE_SENT);
+        alice.sendMessage(InCommand::EDIT_MESSAGE, chat + ' ' + sent.message + " fixed");
+        BOOST_REQUIRE(alice.receiveMessage().code == OutCommand::MESSAGE_EDITED);
+
+        // Past the edit window; only the replayed clock can make this fail again.
+        clock->advanceTime(std::chrono::hours(2));
+        alice.sendMessage(InCommand::EDIT_MESSAGE, chat + ' ' + sent.message + " late");
+        BOOST_REQUIRE(alice.receiveError() == ErrorCode::ERROR_EDIT_MESSAGE);
+
+        alice.disconnect();
+        bob.disconnect();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        server.stop();
+        thread.join();
+    }
+
+    auto clock = std::make_shared<MockTimeProvider>();
+    const auto startedAt = clock->now();
+    Server server(2, 8084, clock);
+    std::thread thread([&server]{ server.start(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    CaptureReplayOptions options;
+    options.port = "8084";
+    auto report = CaptureReplayer(*clock, options).run(capture);
+
+    server.stop();
+    thread.join();
+    std::filesystem::remove(capture);
+
+    BOOST_TEST_MESSAGE(report.summary());
+    BOOST_CHECK_EQUAL(report.sessions, 2u);
+    BOOST_CHECK_EQUAL(report.commands, 4u);
+    BOOST_CHECK_EQUAL(report.mismatchedReplies, 0u);
+    BOOST_CHECK_EQUAL(report.lostReplies, 0u);
+    BOOST_CHECK_EQUAL(report.latency.count, 4u);
+    BOOST_CHECK(clock->now() - startedAt == std::chrono::hours(2));
+}
+
+BOOST_AUTO_TEST_CASE(HashRingMovesKeysOnlyToTheNewNode) {
+    HashRing ring;
+    for (const auto* node : {"a", "b", "c"}) {
+        ring.addNode(node);
+    }
+
+    std::vector<boost::uuids::uuid> keys;
+    std::map<std::string, std::size_t> shares;
+    std::vector<std::string> before;
+    for (int i = 0; i < 10'000; ++i) {
+        keys.push_back(generateTimeOrderedId());
+        before.push_back(ring.owner(keys.back()));
+        ++shares[before.back()];
+    }
+    BOOST_CHECK_EQUAL(shares.size(), 3u);
+    for (const auto& [node, count] : shares) {
+        BOOST_CHECK_GT(count, 2'000u);
+        BOOST_CHECK_LT(count, 4'700u);
+    }
+
+    ring.addNode("d");
+    std::size_t moved = 0;
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        const auto& owner = ring.owner(keys[i]);
+        if (owner != before[i]) {
+            BOOST_CHECK_EQUAL(owner, "d");
+            ++moved;
+        }
+    }
+    BOOST_CHECK_GT(moved, 1'500u);
+    BOOST_CHECK_LT(moved, 3'500u);
+    BOOST_CHECK_EQUAL(ring.nodes().size(), 4u);
+}
+
+BOOST_AUTO_TEST_CASE(ClusterServesRoomsFromAnyNodeAndRebalances) {
+    constexpr unsigned short kFirstPort = 8085;
+    constexpr unsigned short kFirstClusterPort = 9085;
+
+    std::vector<std::unique_ptr<Server>> servers;
+    std::vector<std::thread> threads;
+    auto addNode = [&servers, &threads] {
+        ServerOptions options;
+        options.rateLimits = {{0, 0}, {0, 0}, {0, 0}, {0, 0}};
+        options.cluster.port = kFirstClusterPort + servers.size();
+        options.cluster.secret = "test-cluster";
+        for (std::size_t i = 0; i < servers.size(); ++i) {
+            options.cluster.seeds.push_back({"127.0.0.1", static_cast<unsigned short>(kFirstClusterPort + i)});
+        }
+        servers.push_back(std::make_unique<Server>(2, kFirstPort + servers.size(),
+            std::make_shared<MockTimeProvider>(), options));
+        threads.emplace_back([server = servers.back().get()] { server->start(); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    };
+    auto port = [](std::size_t node) { return std::to_string(kFirstPort + node); };
+
+    for (int i = 0; i < 3; ++i) {
+        addNode();
+    }
+
+    {
+        asio::io_context ioc;
+        TestClient alice(ioc), bob(ioc), carol(ioc);
+        alice.connect(port(0));
+        auto aliceId = alice.receiveMessage().message;
+        bob.connect(port(1));
+        auto bobId = bob.receiveMessage().message;
+        carol.connect(port(2));
+        auto carolId = carol.receiveMessage().message;
+        // Users reach the other nodes asynchronously.
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        // Created on alice's node; bob's messages travel there.
+        alice.sendMessage(InCommand::CREATE_PERSONAL_CHAT, bobId + " Pair");
+        auto pair = alice.receiveMessage();
+        BOOST_REQUIRE(pair.code == OutCommand::CHAT_CREATED);
+        bob.sendMessage(InCommand::SEND_MESSAGE, pair.message + " hello from B");
+        BOOST_REQUIRE(bob.receiveMessage().code == OutCommand::MESSAGE_SENT);
+        auto push = alice.receiveMessage();
+        BOOST_REQUIRE(push.code == OutCommand::PUSH_MSG_SENT);
+        BOOST_CHECK(boost::algorithm::ends_with(push.message, "hello from B"));
+
+        carol.sendMessage(InCommand::CREATE_CLOSE_GROUP, "Trio");
+        auto trio = carol.receiveMessage();
+        BOOST_REQUIRE(trio.code == OutCommand::CHAT_CREATED);
+        for (const auto& id : {aliceId, bobId}) {
+            carol.sendMessage(InCommand::ADD_PARTICIPANT, trio.message + ' ' + id);
+            BOOST_REQUIRE(carol.receiveMessage().code == OutCommand::PARTICIPANT_ADDED);
+        }
+        alice.sendMessage(InCommand::SEND_MESSAGE, trio.message + " hello from A");
+        BOOST_REQUIRE(alice.receiveMessage().code == OutCommand::MESSAGE_SENT);
+        BOOST_CHECK(bob.receiveMessage().code == OutCommand::PUSH_MSG_SENT);
+        BOOST_CHECK(carol.receiveMessage().code == OutCommand::PUSH_MSG_SENT);
+
+        // Frank joins the trio before the fourth node exists and signs in
+        // there later; that node learns the trio's members when it joins.
+        {
+            TestClient frank(ioc);
+            frank.connect(port(0));
+            frank.receiveMessage();
+            frank.sendMessage(InCommand::SIGN_UP, "Frank");
+            auto signUp = frank.receiveMessage();
+            BOOST_REQUIRE(signUp.code == OutCommand::SIGN_UP_SUCCESS);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            carol.sendMessage(InCommand::ADD_PARTICIPANT,
+                trio.message + ' ' + signUp.message.substr(0, signUp.message.find(' ')));
+            BOOST_REQUIRE(carol.receiveMessage().code == OutCommand::PARTICIPANT_ADDED);
+            frank.sendMessage(InCommand::SIGN_OUT);
+            BOOST_REQUIRE(frank.receiveMessage().code == OutCommand::SIGN_OUT_SUCCESS);
+            frank.disconnect();
+        }
+
+        bob.sendMessage(InCommand::LIST_CHATS);
+        auto chats = bob.receiveMessage();
+        BOOST_REQUIRE(chats.code == OutCommand::CHATS_LIST);
+        BOOST_CHECK(chats.message.find(pair.message) != std::string::npos);
+        BOOST_CHECK(chats.message.find(trio.message) != std::string::npos);
+
+        std::vector<std::string> rooms;
+        for (int i = 0; i < 40; ++i) {
+            alice.sendMessage(InCommand::CREATE_OPEN_GROUP, "Room" + std::to_string(i));
+            rooms.push_back(alice.receiveMessage().message);
+            alice.sendMessage(InCommand::SEND_MESSAGE, rooms.back() + " before the move");
+            BOOST_REQUIRE(alice.receiveMessage().code == OutCommand::MESSAGE_SENT);
+        }
+        rooms.push_back(pair.message);
+        rooms.push_back(trio.message);
+
+        addNode();
+        TestClient dave(ioc);
+        dave.connect(port(3));
+        dave.receiveMessage();
+
+        // Every room keeps its history wherever it ended up, and every
+        // node finds it.
+        std::vector<TestClient*> clients = {&alice, &bob, &carol, &dave};
+        for (auto* client : clients) {
+            for (const auto& room : rooms) {
+                client->sendMessage(InCommand::GET_HISTORY, room);
+                auto history = client->receiveMessage();
+                BOOST_REQUIRE(history.code == OutCommand::HISTORY);
+                BOOST_CHECK_EQUAL(parseHistory(history.message).size(), 1u);
+            }
+        }
+
+        TestClient frank(ioc);
+        frank.connect(port(3));
+        frank.receiveMessage();
+        frank.sendMessage(InCommand::SIGN_IN, "Frank");
+        BOOST_REQUIRE(frank.receiveMessage().code == OutCommand::SIGN_IN_SUCCESS);
+        alice.sendMessage(InCommand::SEND_MESSAGE, trio.message + " hello again");
+        BOOST_REQUIRE(alice.receiveMessage().code == OutCommand::MESSAGE_SENT);
+        BOOST_CHECK(bob.receiveMessage().code == OutCommand::PUSH_MSG_SENT);
+        BOOST_CHECK(carol.receiveMessage().code == OutCommand::PUSH_MSG_SENT);
+        push = frank.receiveMessage();
+        BOOST_REQUIRE(push.code == OutCommand::PUSH_MSG_SENT);
+        BOOST_CHECK(boost::algorithm::ends_with(push.message, "hello again"));
+        frank.disconnect();
+
+        dave.sendMessage(InCommand::GET_STATS);
+        auto stats = dave.receiveMessage();
+        auto stat = [&stats](const std::string& name) {
+            auto at = stats.message.find(name + '=');
+            BOOST_REQUIRE(at != std::string::npos);
+            return std::stoull(stats.message.substr(at + name.size() + 1));
+        };
+        BOOST_CHECK_EQUAL(stat("cluster_nodes"), 4u);
+        BOOST_CHECK_GT(stat("cluster_rooms_adopted"), 0u);
+        BOOST_CHECK_GT(stat("cluster_forwarded"), 0u);
+        BOOST_CHECK_EQUAL(stat("cluster_forward_failures"), 0u);
+
+        // Seeds count a room as handed off only once dave acknowledged it.
+        std::uint64_t handedOff = 0;
+        for (auto* seed : {&alice, &bob, &carol}) {
+            seed->sendMessage(InCommand::GET_STATS);
+            stats = seed->receiveMessage();
+            handedOff += stat("cluster_rooms_handed_off");
+            BOOST_CHECK_EQUAL(stat("cluster_handoffs_refused"), 0u);
+        }
+        BOOST_CHECK_GT(handedOff, 0u);
+
+        alice.sendMessage(InCommand::LIST_CHATS);
+        auto aliceChats = alice.receiveMessage().message;
+        BOOST_CHECK_EQUAL(std::count(aliceChats.begin(), aliceChats.end(), '|') + 1, 42);
+
+        for (auto* client : clients) {
+            client->disconnect();
+        }
+    }
+
+    // A link that skips HELLO, or says it with the wrong secret, is dropped.
+    for (const std::string payload : {std::string("\x03", 1), std::string("\x01\x04" "evil" "\x05" "wrong", 12)}) {
+        asio::io_context ioc;
+        tcp::socket intruder(ioc);
+        intruder.connect({ip::make_address("127.0.0.1"), kFirstClusterPort});
+        std::string frame;
+        for (std::size_t i = 0; i < 4; ++i) {
+            frame.push_back(char((payload.size() >> (8 * i)) & 0xFF));
+        }
+        asio::write(intruder, asio::buffer(frame + payload));
+        char byte;
+        boost::system::error_code ec;
+        asio::read(intruder, asio::buffer(&byte, 1), ec);
+        BOOST_CHECK(ec == asio::error::eof || ec == asio::error::connection_reset);
+    }
+
+    for (auto& server : servers) {
+        server->stop();
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
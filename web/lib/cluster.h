@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "chat_manager.h"
+#include "executor.h"
+#include "hash_ring.h"
+#include "push_hub.h"
+#include "user_manager.h"
+
+
+struct ClusterPeer {
+    std::string    host = "127.0.0.1";
+    unsigned short port = 0;
+};
+
+struct ClusterOptions {
+    // Zero leaves the server standalone.
+    unsigned short port = 0;
+    // The cluster port trusts its peers with every room, so it listens on
+    // loopback unless told otherwise.
+    std::string    bindAddress = "127.0.0.1";
+    // Every HELLO must carry it before a link may send anything else.
+    // Required whenever bindAddress is not a loopback address; it travels
+    // in the clear, so the links still belong on a private network.
+    std::string    secret;
+    // Defaults to "node-<port>"; must be unique and stable across restarts
+    // for rooms to hash to the same place.
+    std::string    nodeId;
+    // Every current member. A node joining with an empty list starts a
+    // new cluster.
+    std::vector<ClusterPeer> seeds;
+    std::size_t    virtualNodes = 64;
+    // Threads running commands forwarded here by other nodes.
+    std::size_t    forwardThreads = 2;
+    std::chrono::milliseconds forwardTimeout{2000};
+    std::chrono::milliseconds joinTimeout{10000};
+};
+
+// Rooms are sharded across nodes by consistent hashing of their id; users
+// are replicated to every node, so a client can connect anywhere. A
+// command for a room owned elsewhere travels to the owner as a FORWARD
+// frame and its reply comes back as a REPLY; the owner's chat events go
+// to every node, whose PushHub delivers them to the users attached there.
+// Each node's PushHub keeps the members of every room: membership changes
+// travel as events like messages do, and message events name only the
+// room, so a room's members cross the wire once rather than per message.
+// Nodes form a full mesh of TCP links with length-prefixed binary frames.
+//
+// Joining: the new node connects to every seed. Each seed adds it to its
+// ring, sends it the user directory, the members of the rooms it holds
+// and every room it now owns, then REBALANCED; start() returns once all
+// seeds have done so. A seed drops its copy of a room only once the new
+// owner acknowledges holding it.
+class ClusterNode {
+public:
+    using UserId = User::UserId;
+    using ChatRoomId = ChatManager::ChatRoomId;
+    // Runs a command for `user` on this node, without forwarding it again.
+    using Handler = std::function<std::string(UserId, const std::string&)>;
+    using Reply = std::function<void(std::string)>;
+    using Replies = std::function<void(std::vector<std::string>)>;
+
+    ClusterNode(ClusterOptions options, std::shared_ptr<ChatManager> chat_manager,
+        std::shared_ptr<UserManager> user_manager, std::shared_ptr<PushHub> push_hub);
+    ~ClusterNode();
+
+    ClusterNode(const ClusterNode&) = delete;
+    ClusterNode& operator=(const ClusterNode&) = delete;
+
+    void setHandler(Handler handler);
+
+    // Throws std::invalid_argument if bindAddress is not loopback and there
+    // is no secret, std::runtime_error if the port is taken or a seed does
+    // not finish handing over within joinTimeout.
+    void start();
+    void stop();
+
+    [[nodiscard]] bool owns(const ChatRoomId& room) const;
+    [[nodiscard]] const std::string& nodeId() const;
+
+    // `done` runs on a cluster thread. Without a link to the owner it gets
+    // ERROR_NODE_UNAVAILABLE and nothing ran. If the owner does not answer
+    // within forwardTimeout, or the link drops after the command went out,
+    // it gets ERROR_OUTCOME_UNKNOWN: the owner may still apply the command,
+    // so only idempotent ones (SEND_MESSAGE_ONCE) are safe to retry.
+    void forward(const ChatRoomId& room, UserId user, std::string line, Reply done);
+    // Runs `line` on every node, this one included; replies come in ring
+    // order.
+    void gather(UserId user, std::string line, Replies done);
+
+    void announceUser(UserId user, const std::string& name, bool ephemeral);
+    // Only from the user's home node; other nodes hold copies it owns.
+    void releaseUser(UserId user);
+    void publish(const ChatEvent& event);
+
+    [[nodiscard]] std::string stats() const;
+
+private:
+    class Link;
+    struct Pending {
+        Reply                                 done;
+        std::chrono::steady_clock::time_point deadline;
+        std::string                           peer;
+    };
+
+    void accept();
+    void sweep();
+    void onFrame(const std::shared_ptr<Link>& link, std::uint8_t type, std::string_view payload);
+    void onClosed(const std::shared_ptr<Link>& link);
+    void welcome(const std::shared_ptr<Link>& link);
+    void route(const std::string& node, UserId user, std::string line, Reply done);
+    void broadcast(std::string frame);
+    [[nodiscard]] std::string unavailable() const;
+    [[nodiscard]] std::string outcomeUnknown() const;
+
+    const ClusterOptions options_;
+    const std::string    nodeId_;
+    std::shared_ptr<ChatManager> chatManager_;
+    std::shared_ptr<UserManager> userManager_;
+    std::shared_ptr<PushHub>     pushHub_;
+    Handler                      handler_;
+    Executor                     executor_;
+
+    mutable std::shared_mutex ringMutex_;
+    HashRing                  ring_;
+
+    // Touched only on the cluster thread.
+    boost::asio::io_context        ioc_;
+    boost::asio::ip::tcp::acceptor acceptor_;
+    boost::asio::steady_timer      sweepTimer_;
+    std::unordered_map<std::string, std::shared_ptr<Link>> links_;
+    std::unordered_map<std::uint64_t, Pending>              pending_;
+    // Rooms sent to their new owner and not yet acknowledged, by peer.
+    std::unordered_map<ChatRoomId, std::string>             handoffs_;
+    std::uint64_t                                           nextRequest_ = 1;
+    std::thread                    thread_;
+    std::atomic<bool>              stopped_{false};
+
+    std::mutex              joinMutex_;
+    std::condition_variable joined_;
+    std::size_t             rebalanced_ = 0;
+
+    std::atomic<std::uint64_t> forwarded_{0};
+    std::atomic<std::uint64_t> served_{0};
+    std::atomic<std::uint64_t> failed_{0};
+    std::atomic<std::uint64_t> eventsSent_{0};
+    std::atomic<std::uint64_t> eventsReceived_{0};
+    std::atomic<std::uint64_t> roomsAdopted_{0};
+    std::atomic<std::uint64_t> roomsHandedOff_{0};
+    std::atomic<std::uint64_t> handoffsRefused_{0};
+};
@@ -19,6 +19,15 @@ enum class InCommand {
     SIGN_OUT             = 14,
     LIST_CHATS           = 15,
     LIST_PARTICIPANTS    = 16,
+    SEARCH               = 17,
+    GET_STATS            = 18,
+    RESUME               = 19,
+    SEARCH_USERS         = 20,
+    CREATE_BROADCAST     = 21,
+    SET_MESSAGE_TTL      = 22,
+    SEND_MESSAGE_ONCE    = 23,
+    GET_LOCK_PROFILE     = 24,
+    DUMP_TRACE           = 25,
 };
 
 enum class OutCommand {
@@ -42,6 +51,17 @@ enum class OutCommand {
     SIGN_OUT_FAIL       = 15,
     CHATS_LIST          = 16,
     PARTICIPANTS_LIST   = 17,
+    SEARCH_RESULTS      = 18,
+    STATS               = 19,
+    PUSH_MSG_SENT       = 20,
+    PUSH_MSG_EDITED     = 21,
+    PUSH_MSG_REMOVED    = 22,
+    RESUME_SUCCESS      = 23,
+    RESUME_FAIL         = 24,
+    USERS_FOUND         = 25,
+    TTL_SET             = 26,
+    LOCK_PROFILE        = 27,
+    TRACE_DUMP          = 28,
 };
 
 enum class ErrorCode {
@@ -58,4 +78,11 @@ enum class ErrorCode {
     ERROR_USER_NOT_FOUND     = 10,
     ERROR_CHAT_NOT_FOUND     = 11,
     ERROR_MESSAGE_NOT_FOUND  = 12,
+    SERVER_BUSY              = 13,
+    RATE_LIMITED             = 14,
+    ERROR_SET_TTL            = 15,
+    ERROR_NODE_UNAVAILABLE   = 16,
+    // A forwarded command that went out but got no reply; it may still
+    // have run on the owning node.
+    ERROR_OUTCOME_UNKNOWN    = 17,
 };
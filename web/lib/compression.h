@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <boost/beast/core/rate_policy.hpp>
+#include <boost/beast/core/tcp_stream.hpp>
+#include <boost/beast/websocket/option.hpp>
+#include <boost/version.hpp>
+
+
+// permessage-deflate (RFC 7692) as negotiated with clients. The extension
+// has no preset dictionaries; with context takeover the window carries over
+// between messages, which is what makes the repeated ids in listings cheap.
+struct CompressionOptions {
+    bool        enabled = false;
+    // Smaller messages, such as most pushes, go out uncompressed. Needs
+    // Boost 1.75; older Boost compresses every message once negotiated.
+    std::size_t minMessageBytes = 1024;
+    int         windowBits = 15;         // 9..15; 2^bits of window per connection
+    int         memLevel = 4;            // 1..9; deflate state is about 2^(memLevel + 9) bytes
+    int         level = 6;               // 0..9
+    bool        contextTakeover = true;  // false frees the window after each message
+};
+
+// Server-wide totals. Wire bytes are counted below the websocket layer,
+// so they include framing; CPU is estimated from a sampled side deflate of
+// one eligible message in kSampleEvery with the same settings.
+class CompressionStats {
+public:
+    static constexpr std::uint64_t kSampleEvery = 64;
+
+    explicit CompressionStats(CompressionOptions options);
+
+    void recordWire(std::size_t bytes);
+    void recordMessage(std::string_view payload);
+
+    [[nodiscard]] std::string stats() const;
+
+private:
+    void sample(std::string_view payload);
+
+    CompressionOptions options_;
+
+    std::atomic<std::uint64_t> payloadBytes_{0};
+    std::atomic<std::uint64_t> wireBytes_{0};
+    std::atomic<std::uint64_t> eligibleMessages_{0};
+    std::atomic<std::uint64_t> eligibleBytes_{0};
+    std::atomic<std::uint64_t> sampledBytes_{0};
+    std::atomic<std::uint64_t> sampledNanos_{0};
+};
+
+[[nodiscard]] boost::beast::websocket::permessage_deflate permessageDeflate(const CompressionOptions& options);
+
+// Rate policy that never limits and reports socket writes to the stats it
+// is attached to; unattached it does nothing.
+class WireCounter {
+public:
+    void attach(std::shared_ptr<CompressionStats> stats) {
+        stats_ = std::move(stats);
+    }
+
+private:
+    friend class boost::beast::rate_policy_access;
+
+    static constexpr std::size_t kUnlimited = (std::numeric_limits<std::size_t>::max)();
+
+    std::size_t available_read_bytes() const noexcept { return kUnlimited; }
+    std::size_t available_write_bytes() const noexcept { return kUnlimited; }
+    void transfer_read_bytes(std::size_t) const noexcept {}
+    void transfer_write_bytes(std::size_t bytes) const noexcept {
+        if (stats_) {
+            stats_->recordWire(bytes);
+        }
+    }
+    void on_timer() const noexcept {}
+
+    std::shared_ptr<CompressionStats> stats_;
+};
+
+using WireStream = boost::beast::basic_stream<boost::asio::ip::tcp, boost::beast::tcp_stream::executor_type,
+    WireCounter>;
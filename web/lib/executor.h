@@ -0,0 +1,31 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+
+#include <boost/asio/thread_pool.hpp>
+
+#include "metrics.h"
+
+
+// Runs command handlers either inline on the calling thread (threads == 0)
+// or on a dedicated thread pool, recording queue and run times.
+class Executor {
+public:
+    Executor(std::string name, std::size_t threads);
+
+    void execute(std::function<void()> task);
+    void stop();
+
+    [[nodiscard]] const std::string& name() const;
+    [[nodiscard]] bool isInline() const;
+    [[nodiscard]] std::string stats() const;
+
+private:
+    std::string name_;
+    std::optional<boost::asio::thread_pool> pool_;
+
+    LatencyHistogram queueTime_;
+    LatencyHistogram runTime_;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/uuid/uuid.hpp>
+
+
+// Consistent hashing over node names. Each node holds `virtualNodes`
+// points on a 64-bit ring and owns the keys hashing up to each point, so
+// adding a node moves about 1/n of the keys, all of them to the new node.
+// Not thread-safe; ClusterNode guards it.
+class HashRing {
+public:
+    explicit HashRing(std::size_t virtual_nodes = 64);
+
+    void addNode(const std::string& node);
+    void removeNode(const std::string& node);
+
+    // Empty while the ring has no nodes.
+    [[nodiscard]] const std::string& owner(const boost::uuids::uuid& key) const;
+    [[nodiscard]] std::vector<std::string> nodes() const;
+    [[nodiscard]] bool contains(const std::string& node) const;
+
+private:
+    std::size_t virtualNodes_;
+    std::map<std::uint64_t, std::string> points_;
+};
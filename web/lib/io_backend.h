@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <span>
+#include <string>
+
+#include <boost/version.hpp>
+
+#ifndef PRISECCHAT_IO_URING
+#define PRISECCHAT_IO_URING 0
+#endif
+
+#ifndef PRISECCHAT_IO_URING_SOCKETS
+#define PRISECCHAT_IO_URING_SOCKETS 0
+#endif
+
+#if PRISECCHAT_IO_URING && BOOST_VERSION < 107800
+#error "PRISECCHAT_IO_URING needs Boost.Asio 1.78 or newer"
+#endif
+
+#if PRISECCHAT_IO_URING_SOCKETS && !PRISECCHAT_IO_URING
+#error "PRISECCHAT_IO_URING_SOCKETS requires PRISECCHAT_IO_URING"
+#endif
+
+#if PRISECCHAT_IO_URING
+#include <boost/asio/io_context.hpp>
+#endif
+
+
+// Which kernel interface Asio drives. Sockets go through io_uring only in
+// builds with PRISECCHAT_IO_URING_SOCKETS, which compiles epoll out; spill
+// files go through it whenever io_uring is compiled in and the running
+// kernel provides it, and through ofstream otherwise.
+class IoBackend {
+public:
+    static constexpr bool uringCompiled = PRISECCHAT_IO_URING;
+    static constexpr bool uringSockets = PRISECCHAT_IO_URING_SOCKETS;
+
+    [[nodiscard]] static const char* socketBackend();
+    // Probed once; false on kernels without io_uring or where it is disabled.
+    [[nodiscard]] static bool uringAvailable();
+    [[nodiscard]] static std::string stats();
+};
+
+#if PRISECCHAT_IO_URING
+
+// Writes spill files through an io_uring-backed Asio file. Spills are rare
+// and already serialized by the tiering pass, so one private context run
+// to completion per file is enough.
+class UringFileWriter {
+public:
+    bool operator()(const std::filesystem::path& file, std::span<const std::uint8_t> bytes);
+
+    [[nodiscard]] static std::uint64_t writes();
+
+private:
+    std::mutex mutex_;
+    boost::asio::io_context ioc_;
+};
+
+#endif
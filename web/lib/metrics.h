@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+class LatencyHistogram {
+public:
+    static constexpr std::size_t kBuckets = 32;
+
+    void record(std::chrono::nanoseconds elapsed);
+
+    [[nodiscard]] std::uint64_t count() const;
+    [[nodiscard]] std::uint64_t percentileMicros(double p) const;
+    [[nodiscard]] std::uint64_t maxMicros() const;
+
+    // "<prefix>_count=..|<prefix>_p50_us=..|<prefix>_p99_us=..|<prefix>_max_us=.."
+    [[nodiscard]] std::string format(const std::string& prefix) const;
+
+private:
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets_{};
+    std::atomic<std::uint64_t> count_{0};
+    std::atomic<std::uint64_t> maxMicros_{0};
+};
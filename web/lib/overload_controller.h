@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+
+struct OverloadLimits {
+    std::chrono::milliseconds maxLoopLag{200};
+    std::chrono::milliseconds maxLockWait{100};
+    std::size_t               maxOutboundBytes = 256 * 1024 * 1024;
+    std::chrono::milliseconds retryAfter{250};
+    std::chrono::milliseconds probeInterval{50};
+};
+
+// Combines io loop lag, ChatManager lock wait and queued outbound bytes
+// into a single pressure value; above 1.0 the server sheds load.
+class OverloadController {
+public:
+    explicit OverloadController(OverloadLimits limits = {});
+
+    void recordLoopLag(std::chrono::microseconds lag);
+    void recordLockWait(std::chrono::microseconds wait);
+    void addOutboundBytes(std::size_t bytes);
+    void removeOutboundBytes(std::size_t bytes);
+
+    [[nodiscard]] double pressure() const;
+    [[nodiscard]] bool overloaded() const;
+    [[nodiscard]] std::chrono::milliseconds retryAfter() const;
+    [[nodiscard]] const OverloadLimits& limits() const;
+
+    void countShedCommand();
+    void countRejectedConnection();
+
+    [[nodiscard]] std::string stats() const;
+
+private:
+    OverloadLimits limits_;
+
+    std::atomic<std::int64_t> loopLagMicros_{0};
+    std::atomic<std::int64_t> lockWaitMicros_{0};
+    std::atomic<std::size_t>  outboundBytes_{0};
+
+    std::atomic<std::uint64_t> shedCommands_{0};
+    std::atomic<std::uint64_t> rejectedConnections_{0};
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/uuid/random_generator.hpp>
+
+#include "chat_event.h"
+
+
+struct ReplayOptions {
+    std::size_t          capacity = 256;
+    std::chrono::seconds gracePeriod{120};
+};
+
+struct FanoutOptions {
+    std::size_t shards = 1;
+};
+
+class PushTarget {
+public:
+    virtual ~PushTarget() = default;
+
+    virtual void push(std::shared_ptr<const std::string> frame) = 0;
+    virtual void supersede() = 0;
+};
+
+// Users are partitioned into shards by id, and each shard keeps the rooms
+// its own users are in, updated from the membership events. A message is
+// one task per shard with one shared frame; the shard walks only its own
+// members of the room. Given an executor, shards run on their strands, so
+// fan-out uses all io threads. Every event is queued under one mutex and
+// reaches each shard in order, which the member lists and replay rings
+// rely on.
+class PushHub {
+public:
+    using UserId = User::UserId;
+    using ChatRoomId = boost::uuids::uuid;
+    using Frame = std::shared_ptr<const std::string>;
+    // Grace periods are real time whatever clock the chat manager runs on.
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+
+    struct Resumption {
+        UserId                                   userId;
+        std::string                              token;
+        bool                                     complete;
+        std::vector<Frame>                       missed;
+        std::vector<std::shared_ptr<PushTarget>> displaced;
+    };
+
+    explicit PushHub(ReplayOptions options = {}, FanoutOptions fanout = {},
+        std::optional<boost::asio::any_io_executor> executor = std::nullopt);
+
+    void attach(UserId user_id, const std::shared_ptr<PushTarget>& target);
+    bool detach(UserId user_id, const PushTarget* target);
+    void publish(const ChatEvent& event);
+
+    std::string issueResumeToken(UserId user_id);
+    void revokeResumeToken(UserId user_id);
+    std::optional<Resumption> resume(const std::string& token, std::uint64_t last_sequence,
+        const std::shared_ptr<PushTarget>& target);
+    // Releases the replay state of users detached for longer than the grace
+    // period. detach() and resume() only sweep their own shard, so the
+    // server calls this on a timer to reach shards nobody touches.
+    void expireDetached();
+
+    std::uint64_t lastSequence() const;
+    std::size_t onlineUsers() const;
+    std::size_t resumableUsers() const;
+    std::size_t shardCount() const;
+
+    static std::string encode(const ChatEvent& event, std::uint64_t sequence);
+
+private:
+    class ReplayRing {
+    public:
+        explicit ReplayRing(std::size_t capacity);
+
+        void push(std::uint64_t sequence, Frame frame);
+        std::vector<Frame> since(std::uint64_t sequence) const;
+        std::uint64_t droppedThrough() const;
+
+    private:
+        std::vector<std::pair<std::uint64_t, Frame>> slots_;
+        std::size_t   next_ = 0;
+        std::size_t   size_ = 0;
+        std::uint64_t droppedThrough_ = 0;
+    };
+
+    struct ReplayState {
+        std::string              token;
+        ReplayRing               ring;
+        std::optional<TimePoint> detachedAt;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<UserId, std::vector<std::weak_ptr<PushTarget>>> targets;
+        std::unordered_map<UserId, ReplayState> replay;
+        // This shard's users in each room, in join order.
+        std::unordered_map<ChatRoomId, std::vector<UserId>> rooms;
+        std::deque<std::pair<TimePoint, UserId>> expiryQueue;
+        std::optional<boost::asio::strand<boost::asio::any_io_executor>> strand;
+    };
+
+    Shard& shardFor(const UserId& user_id);
+    template <class Task>
+    void run(Shard& shard, Task task);
+    void applyMembership(Shard& shard, const ChatEvent& event);
+    void deliver(Shard& shard, ChatRoomId room_id, UserId actor_id, std::uint64_t sequence, const Frame& frame);
+    void expire(Shard& shard, TimePoint now);
+
+    ReplayOptions               options_;
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    // Held from taking a sequence number until the event is queued on every
+    // shard, so no shard sees a later sequence before an earlier one.
+    std::mutex                 publishMutex_;
+    std::atomic<std::uint64_t> sequence_{0};
+
+    mutable std::mutex tokensMutex_;
+    std::unordered_map<std::string, UserId> tokens_;
+    boost::uuids::random_generator tokenGenerator_;
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "commands.h"
+
+
+enum class CommandClass {
+    OTHER,
+    WRITE,
+    HISTORY_READ,
+    DIRECTORY_READ,
+    // Operator reports: heavy, but only behind the session bucket.
+    DIAGNOSTIC,
+};
+
+CommandClass classify(InCommand command);
+
+// ratePerSecond == 0 disables the bucket.
+struct BucketLimits {
+    double ratePerSecond;
+    double burst;
+};
+
+struct RateLimits {
+    BucketLimits session{200, 400};
+    BucketLimits writes{50, 100};
+    BucketLimits historyReads{20, 40};
+    BucketLimits directoryReads{10, 20};
+};
+
+class TokenBucket {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket(BucketLimits limits, Clock::time_point now);
+
+    // Refills and reports how long until one token is available (zero if it is now).
+    Clock::duration wait(Clock::time_point now);
+    void consume();
+
+private:
+    BucketLimits      limits_;
+    double            tokens_;
+    Clock::time_point refilledAt_;
+};
+
+enum class RateScope {
+    SESSION,
+    WRITES,
+    HISTORY_READS,
+    DIRECTORY_READS,
+};
+
+class RateLimitCounters {
+public:
+    void count(RateScope scope);
+
+    [[nodiscard]] std::uint64_t rejected(RateScope scope) const;
+    [[nodiscard]] std::string stats() const;
+
+private:
+    std::atomic<std::uint64_t> rejected_[4]{};
+};
+
+// Not thread-safe: a session consults its limiter from its own strand.
+class SessionRateLimiter {
+public:
+    struct Rejection {
+        RateScope                 scope;
+        std::chrono::milliseconds retryAfter;
+    };
+
+    explicit SessionRateLimiter(const RateLimits& limits, TokenBucket::Clock::time_point now = TokenBucket::Clock::now());
+
+    std::optional<Rejection> admit(CommandClass command_class, TokenBucket::Clock::time_point now);
+
+private:
+    TokenBucket session_;
+    TokenBucket writes_;
+    TokenBucket historyReads_;
+    TokenBucket directoryReads_;
+};
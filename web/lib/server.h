@@ -1,18 +1,44 @@
 #pragma once
 
+#include <mutex>
+
 #include "chat_manager.h"
+#include "cluster.h"
+#include "overload_controller.h"
 #include "session.h"
 #include "time_provider/mock_time_provider.h"
+#include "time_provider/time_provider.h"
 
 namespace ip = asio::ip;
 namespace websocket = beast::websocket;
 
+struct ServerOptions {
+    std::size_t    computeThreads = 2;
+    OverloadLimits overload;
+    RateLimits     rateLimits;
+    TieringOptions tiering;
+    DedupOptions   dedup;
+    ReplayOptions  replay;
+    TraceOptions   tracing;
+    SessionPoolOptions sessionPool;
+    // Run sessions as a read coroutine and a write coroutine instead of
+    // chained completion handlers.
+    bool           coroutineSessions = false;
+    CompressionOptions compression;
+    CaptureOptions     capture;
+    ClusterOptions     cluster;
+    std::chrono::seconds tieringInterval{60};
+    // Operator commands (lock profile, trace dump) are refused as unknown
+    // unless set; they expose internals and cost a full report to build.
+    bool           diagnostics = false;
+};
 
 class Server {
 public:
     Server(std::size_t threadCount,
            std::size_t port,
-           std::shared_ptr<AbstractTimeProvider> timeProvider = std::make_shared<MockTimeProvider>());
+           std::shared_ptr<AbstractTimeProvider> timeProvider = std::make_shared<TimeProvider>(),
+           ServerOptions options = {});
 
     void start();
 
@@ -22,15 +48,48 @@ public:
 
 private:
     void onAcceptAsync();
+    void probeLoad();
+    void scheduleTiering();
+    void sweepReplay();
+    void tickClock();
+    std::string runForwarded(User::UserId user_id, const std::string& line);
+
+    // Declared first so it outlives ioc_: sessions still queued in ioc_ at
+    // shutdown can hold the last ChatManager, which unsubscribes from it.
+    std::shared_ptr<AbstractTimeProvider> timeProvider_;
 
     asio::io_context  ioc_;
     asio::thread_pool pool_;
     ip::tcp::acceptor acceptor_;
+    asio::steady_timer loadProbe_;
+    asio::steady_timer tieringTimer_;
+    asio::steady_timer replaySweep_;
+    asio::steady_timer clockTimer_;
 
     std::size_t threadCount_;
     std::size_t port_;
+    std::chrono::seconds tieringInterval_;
 
-    std::shared_ptr<AbstractTimeProvider> timeProvider_;
     std::shared_ptr<UserManager> userManager_;
     std::shared_ptr<ChatManager> chatManager_;
+    std::shared_ptr<PushHub>     pushHub_;
+    std::shared_ptr<Executor>    ioExecutor_;
+    std::shared_ptr<Executor>    computeExecutor_;
+    std::shared_ptr<OverloadController> overload_;
+    std::shared_ptr<RateLimitCounters>  rateLimitCounters_;
+    RateLimits                          rateLimits_;
+    std::shared_ptr<SessionPool>        sessionPool_;
+    bool                                coroutineSessions_;
+    CompressionOptions                  compressionOptions_;
+    std::shared_ptr<CompressionStats>   compressionStats_;
+    std::shared_ptr<TrafficCapture>     capture_;
+    bool                                diagnostics_;
+
+    // Commands forwarded by other nodes run on never-started sessions,
+    // kept out of sessionPool_'s counts.
+    std::shared_ptr<SessionPool>          forwardSessionPool_;
+    std::mutex                            forwardMutex_;
+    std::vector<std::shared_ptr<Session>> forwardSessions_;
+    // Declared last so it stops running commands before the rest goes.
+    std::shared_ptr<ClusterNode>          cluster_;
 };
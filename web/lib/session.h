@@ -1,15 +1,28 @@
 #pragma once
 
 #include <deque>
-#include <mutex>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <boost/beast.hpp>
 #include <boost/beast/websocket.hpp>
 #include <boost/asio.hpp>
 
 #include "chat_manager.h"
+#include "cluster.h"
+#include "compression.h"
+#include "executor.h"
+#include "overload_controller.h"
+#include "push_hub.h"
+#include "rate_limiter.h"
+#include "session_pool.h"
+#include "tracer.h"
+#include "traffic_capture.h"
 
 
 namespace beast = boost::beast;
@@ -17,32 +30,148 @@ namespace websocket = beast::websocket;
 namespace asio = boost::asio;
 namespace ip = asio::ip;
 
-class Session : public std::enable_shared_from_this<Session> {
+struct SessionServices {
+    std::shared_ptr<ChatManager> chatManager;
+    std::shared_ptr<UserManager> userManager;
+    std::shared_ptr<PushHub>     pushHub;
+    std::shared_ptr<Executor>    ioExecutor;
+    std::shared_ptr<Executor>    computeExecutor;
+    std::shared_ptr<OverloadController> overload;
+    std::shared_ptr<RateLimitCounters>  rateLimitCounters;
+    RateLimits                          rateLimits;
+    std::shared_ptr<SessionPool>        sessionPool;
+    bool                                coroutines = false;
+    // Null unless permessage-deflate is on.
+    std::shared_ptr<CompressionStats>   compression;
+    // Null unless traffic capture is on.
+    std::shared_ptr<TrafficCapture>     capture;
+    // Null unless the server is part of a cluster.
+    std::shared_ptr<ClusterNode>        cluster;
+    // Serve operator commands: GET_LOCK_PROFILE, DUMP_TRACE.
+    bool                                diagnostics = false;
+};
+
+class Session : public PushTarget, public std::enable_shared_from_this<Session> {
 public:
     Session(
-        std::shared_ptr<websocket::stream<beast::tcp_stream>> ws,
-        std::shared_ptr<ChatManager> chat_manager,
-        std::shared_ptr<UserManager> user_manager,
-        User::UserId user_id
+        std::shared_ptr<websocket::stream<WireStream>> ws,
+        const SessionServices& services
     );
+    ~Session() override;
 
     void start();
+    // Runs a command another node forwarded here, as `user_id`. Only for
+    // sessions that are never started and have no cluster of their own.
+    std::string runForwarded(User::UserId user_id, const std::string& line);
+    void push(PushHub::Frame frame) override;
+    void supersede() override;
 
 private:
 
     void doRead();
+    void execute(std::string line);
+    void pauseReads(std::chrono::milliseconds delay);
     void doWrite();
-    void writeAsync(const std::string& message);
+
+    // Coroutine mode: one loop reads and dispatches, the other drains the
+    // outbound queue; enqueue() wakes the writer through writeSignal_.
+    // `self` is never read: held in the coroutine frame, it keeps the
+    // session alive for as long as the loop runs.
+    asio::awaitable<void> readLoop([[maybe_unused]] std::shared_ptr<Session> self);
+    asio::awaitable<void> writeLoop([[maybe_unused]] std::shared_ptr<Session> self);
+    void closeWriteLoop();
+
+    // Shared by both modes.
+    std::string takeLine();
+    void logReadError(boost::system::error_code ec);
+    std::optional<std::chrono::milliseconds> refuse(CommandClass command_class);
+    template <typename Done>
+    void runOnExecutor(std::string line, CommandClass command_class, std::uint64_t trace, Done done);
+    // Commands for rooms owned by another node, and LIST_CHATS, which
+    // every node answers for its own rooms.
+    bool routesToCluster(const std::string& line) const;
+    template <typename Done>
+    void runOnCluster(std::string line, std::uint64_t trace, Done done);
+    asio::const_buffer beginWrite();
+    void finishWrite();
+
+    void writeAsync(std::string message, std::uint64_t trace = 0);
+    void onDisconnect();
+    void switchUser(User::UserId user_id);
+    void announceUser(User::UserId user_id);
+    void releaseUser(User::UserId user_id);
 
     std::string dispatchCommand(const std::string& line);
+    void runCommand(const std::string& line, std::string& reply);
+
+    // Pushes share one frame between sessions; replies own their string,
+    // which is recycled once written.
+    struct Outbound {
+        PushHub::Frame frame;
+        std::string    owned;
+        std::uint64_t  trace;
+        Tracer::Nanos  queuedAt;
+        Tracer::Nanos  writeStartedAt;
 
-    std::deque<std::string> messageQueue_;
-    std::mutex messageQueueMutex_;
+        [[nodiscard]] const std::string& payload() const {
+            return frame ? *frame : owned;
+        }
+    };
 
-    std::shared_ptr<websocket::stream<beast::tcp_stream>> ws_;
+    void enqueue(Outbound outbound);
+
+    std::string takeSpareFrame();
+    void recycleFrame(std::string frame);
+    void account(std::size_t& reported, std::size_t now);
+
+    std::deque<Outbound> messageQueue_;
+
+    // One command runs at a time per session: the next read is armed only
+    // after the reply is queued, so the arena needs no locking.
+    static constexpr std::size_t kArenaChunkBytes = 4 * 1024;
+    static constexpr std::size_t kReplyReserve = 256;
+    // Past these an idle session hands memory back instead of pinning the
+    // high-water mark of one large command or frame.
+    static constexpr std::size_t kArenaRetainBytes = 32 * 1024;
+    static constexpr std::size_t kReadBufferRetainBytes = 16 * 1024;
+    static constexpr std::size_t kSpareFrames = 2;
+    static constexpr std::size_t kSpareFrameMaxBytes = 4 * 1024;
+
+    CountingResource                       arenaUpstream_;
+    std::pmr::unsynchronized_pool_resource arenaPool_{{0, 64 * 1024}, &arenaUpstream_};
+    std::pmr::monotonic_buffer_resource    arena_{kArenaChunkBytes, &arenaPool_};
+
+    std::mutex               spareMutex_;
+    std::vector<std::string> spareFrames_;
+
+    std::shared_ptr<websocket::stream<WireStream>> ws_;
     beast::flat_buffer buffer_;
+    asio::steady_timer readPause_;
 
     std::shared_ptr<ChatManager>  chatManager_;
     std::shared_ptr<UserManager>  userManager_;
+    std::shared_ptr<PushHub>      pushHub_;
+    std::shared_ptr<Executor>     ioExecutor_;
+    std::shared_ptr<Executor>     computeExecutor_;
+    std::shared_ptr<OverloadController> overload_;
+    std::shared_ptr<RateLimitCounters>  rateLimitCounters_;
+    SessionRateLimiter            rateLimiter_;
+    std::shared_ptr<SessionPool>  sessionPool_;
+    const bool                    coroutines_;
+    std::shared_ptr<CompressionStats> compression_;
+    std::shared_ptr<TrafficCapture> capture_;
+    std::uint64_t                 captureSession_ = 0;
+    std::shared_ptr<ClusterNode>  cluster_;
+    const bool                    diagnostics_;
+    asio::steady_timer            writeSignal_;
+    bool                          writesClosed_ = false;
     User::UserId                  userId_;
+    std::size_t                   queuedBytes_ = 0;
+
+    // What this session last reported to sessionPool_, per component.
+    std::size_t residentFixed_ = 0;
+    std::size_t residentReadBuffer_ = 0;
+    std::size_t residentArena_ = 0;
+    std::size_t residentQueue_ = 0;
+    std::size_t residentSpares_ = 0;
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+struct SessionPoolOptions {
+    std::size_t maxCachedPerThread = 256;
+};
+
+// Recycles the fixed-size blocks behind sessions and their websocket
+// streams. Each io thread allocates from its own shard; a block goes back
+// to the shard it came from, whichever thread drops the last reference.
+// Also sums what live sessions keep resident, so idle cost is visible.
+class SessionPool {
+public:
+    explicit SessionPool(std::size_t shards, SessionPoolOptions options = {});
+    ~SessionPool();
+
+    SessionPool(const SessionPool&) = delete;
+    SessionPool& operator=(const SessionPool&) = delete;
+
+    void* allocate(std::size_t bytes);
+    void deallocate(void* block, std::size_t bytes);
+
+    void sessionOpened();
+    void sessionClosed();
+    void adjustResident(std::ptrdiff_t delta);
+
+    [[nodiscard]] std::size_t openSessions() const;
+    [[nodiscard]] std::size_t residentBytes() const;
+    [[nodiscard]] std::size_t cachedBlocks() const;
+    [[nodiscard]] std::string stats() const;
+
+    template <typename T>
+    class Allocator {
+    public:
+        using value_type = T;
+
+        explicit Allocator(std::shared_ptr<SessionPool> pool)
+            : pool_(std::move(pool))
+        {}
+
+        template <typename U>
+        Allocator(const Allocator<U>& other)
+            : pool_(other.pool_)
+        {}
+
+        T* allocate(std::size_t n) {
+            return static_cast<T*>(pool_->allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T* p, std::size_t n) {
+            pool_->deallocate(p, n * sizeof(T));
+        }
+
+        template <typename U>
+        bool operator==(const Allocator<U>& other) const {
+            return pool_ == other.pool_;
+        }
+
+    private:
+        template <typename U> friend class Allocator;
+
+        std::shared_ptr<SessionPool> pool_;
+    };
+
+    template <typename T, typename... Args>
+    static std::shared_ptr<T> make(const std::shared_ptr<SessionPool>& pool, Args&&... args) {
+        return std::allocate_shared<T>(Allocator<T>(pool), std::forward<Args>(args)...);
+    }
+
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        // Few distinct sizes are pooled, so a linear scan beats a map.
+        std::vector<std::pair<std::size_t, std::vector<void*>>> free;
+        std::size_t cached = 0;
+    };
+
+    std::size_t localShard() const;
+
+    SessionPoolOptions options_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::size_t>   openSessions_{0};
+    std::atomic<std::ptrdiff_t> residentBytes_{0};
+};
+
+// Upstream for a session's arena pool; counts what the pool holds on to.
+class CountingResource : public std::pmr::memory_resource {
+public:
+    [[nodiscard]] std::size_t bytes() const;
+
+private:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+    std::size_t bytes_ = 0;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <boost/uuid/uuid.hpp>
+
+#include "time_provider/abstract_time_provider.h"
+
+
+struct CaptureOptions {
+    // Empty leaves capture off.
+    std::filesystem::path file;
+};
+
+// One line of a capture. Sessions are numbered in accept order. Replies
+// keep only their code and the ids in them, which is what a replay needs
+// to check its own replies and to map the ids it is given to the ids the
+// capture refers to.
+struct CaptureRecord {
+    enum class Kind : std::uint8_t { OPEN = 0, COMMAND = 1, REPLY = 2, CLOSE = 3 };
+
+    Kind          kind = Kind::OPEN;
+    std::uint64_t session = 0;
+    std::chrono::microseconds elapsed{0};   // since the capture started
+    std::int64_t  clockSeconds = 0;         // server clock, seconds since epoch
+    std::string   line;                     // COMMAND
+    int           code = 0;                 // REPLY
+    std::vector<boost::uuids::uuid> ids;    // REPLY
+};
+
+// Inbound commands, direct replies and session lifetimes as a binary log:
+// a magic header, then one record per event with varint fields and time
+// stored as deltas, so a typical command costs its text plus a few bytes.
+// Pushes are not captured; the replay regenerates them.
+class TrafficCapture {
+public:
+    TrafficCapture(const std::filesystem::path& file, std::shared_ptr<AbstractTimeProvider> clock);
+
+    [[nodiscard]] std::uint64_t openSession();
+    void command(std::uint64_t session, std::string_view line);
+    void reply(std::uint64_t session, std::string_view message);
+    void closeSession(std::uint64_t session);
+
+    void flush();
+
+private:
+    void append(CaptureRecord::Kind kind, std::uint64_t session, std::string_view body);
+
+    std::shared_ptr<AbstractTimeProvider> clock_;
+    const std::chrono::steady_clock::time_point started_;
+
+    std::mutex    mutex_;
+    std::ofstream out_;
+    std::uint64_t nextSession_ = 1;
+    std::chrono::microseconds lastElapsed_{0};
+    std::int64_t  lastClock_ = 0;
+};
+
+class CaptureReader {
+public:
+    // Throws std::runtime_error if the file is missing or not a capture.
+    explicit CaptureReader(const std::filesystem::path& file);
+
+    // nullopt at the end of the file, or at a record cut short by a crash.
+    std::optional<CaptureRecord> next();
+
+private:
+    std::ifstream in_;
+    std::chrono::microseconds elapsed_{0};
+    std::int64_t  clock_ = 0;
+};
+
+// Every canonical-form UUID in a reply, in order.
+std::vector<boost::uuids::uuid> uuidsIn(std::string_view text);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "time_provider/abstract_time_provider.h"
+
+
+struct CaptureReplayOptions {
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    // 1 keeps the captured pacing, 10 runs ten times faster; 0 sends each
+    // command as soon as the window allows.
+    double      speed = 0;
+    // Commands in flight across all sessions. 1 reproduces the captured
+    // interleaving exactly; more measures pipelined throughput.
+    std::size_t window = 1;
+};
+
+struct LatencySummary {
+    std::uint64_t count = 0;
+    std::uint64_t p50Micros = 0;
+    std::uint64_t p90Micros = 0;
+    std::uint64_t p99Micros = 0;
+    std::uint64_t p999Micros = 0;
+    std::uint64_t maxMicros = 0;
+
+    static LatencySummary of(std::vector<std::uint64_t> micros);
+};
+
+struct ReplayReport {
+    std::uint64_t sessions = 0;
+    std::uint64_t commands = 0;
+    std::uint64_t pushes = 0;
+    // Replies whose code differs from the captured one; nonzero means the
+    // replay did not follow the capture.
+    std::uint64_t mismatchedReplies = 0;
+    std::uint64_t lostReplies = 0;
+    std::chrono::duration<double> elapsed{0};
+    LatencySummary latency;
+    std::map<int, LatencySummary> latencyByCommand;
+
+    [[nodiscard]] double commandsPerSecond() const;
+    [[nodiscard]] std::string summary() const;
+};
+
+// Feeds a capture to a running Server over websockets, one client per
+// captured session. Ids in commands are rewritten to the ids this server
+// handed out in the matching replies, and the clock the server was built
+// with is advanced along with the captured one, so edit windows and TTLs
+// see the same elapsed time as they did live. The clock only moves once
+// every command in flight has been answered.
+class CaptureReplayer {
+public:
+    CaptureReplayer(AbstractTimeProvider& clock, CaptureReplayOptions options);
+
+    ReplayReport run(const std::filesystem::path& capture);
+
+private:
+    AbstractTimeProvider& clock_;
+    CaptureReplayOptions options_;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include <boost/uuid/uuid.hpp>
+
+
+// LEB128 varints, zigzag for signed values; shared by the capture file and
+// the cluster protocol.
+inline void putVarint(std::string& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+inline void putSigned(std::string& out, std::int64_t value) {
+    putVarint(out, (std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63));
+}
+
+inline void putBytes(std::string& out, std::string_view bytes) {
+    putVarint(out, bytes.size());
+    out.append(bytes);
+}
+
+inline void putUuid(std::string& out, const boost::uuids::uuid& id) {
+    out.append(reinterpret_cast<const char*>(id.data), sizeof(id.data));
+}
+
+// Reads what the put* functions wrote. A read past the end, or a length
+// larger than what is left, marks the reader failed and yields zeros.
+class WireReader {
+public:
+    explicit WireReader(std::string_view bytes)
+        : bytes_(bytes)
+    {}
+
+    std::uint64_t varint() {
+        std::uint64_t value = 0;
+        for (int shift = 0; shift < 64 && at_ < bytes_.size(); shift += 7) {
+            const auto byte = std::uint8_t(bytes_[at_++]);
+            value |= std::uint64_t(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        failed_ = true;
+        return 0;
+    }
+
+    std::int64_t signedVarint() {
+        const auto raw = varint();
+        return std::int64_t(raw >> 1) ^ -std::int64_t(raw & 1);
+    }
+
+    std::string_view bytes() {
+        const auto size = varint();
+        if (size > bytes_.size() - at_) {
+            failed_ = true;
+            return {};
+        }
+        auto out = bytes_.substr(at_, size);
+        at_ += size;
+        return out;
+    }
+
+    boost::uuids::uuid uuid() {
+        boost::uuids::uuid id{};
+        if (bytes_.size() - at_ < sizeof(id.data)) {
+            failed_ = true;
+            return id;
+        }
+        std::memcpy(id.data, bytes_.data() + at_, sizeof(id.data));
+        at_ += sizeof(id.data);
+        return id;
+    }
+
+    [[nodiscard]] std::size_t remaining() const {
+        return bytes_.size() - at_;
+    }
+
+    [[nodiscard]] bool ok() const {
+        return !failed_;
+    }
+
+private:
+    std::string_view bytes_;
+    std::size_t      at_ = 0;
+    bool             failed_ = false;
+};
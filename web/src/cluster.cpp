@@ -0,0 +1,779 @@
+#include <utility>
+
+#include "lib/cluster.h"
+
+#include <array>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+
+#include "lib/commands.h"
+#include "lib/wire_format.h"
+
+
+namespace {
+
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+
+enum class FrameType : std::uint8_t {
+    HELLO      = 1,   // node id, shared secret
+    USER       = 2,   // user id, name, ephemeral
+    RELEASE    = 3,   // user id
+    FORWARD    = 4,   // request id, user id, command line
+    REPLY      = 5,   // request id, reply
+    EVENT      = 6,   // event type, room id, message id, actor id, text
+    ROOM       = 7,   // RoomSnapshot
+    REBALANCED = 8,   // -
+    ROOM_HELD  = 9,   // room id, whether the receiver now holds it
+    MEMBERS    = 10,  // room id, participant ids
+};
+
+constexpr std::size_t kHeaderBytes = 4;
+constexpr std::uint32_t kMaxFrameBytes = 64 * 1024 * 1024;
+// Until a link has said HELLO, it gets no more than a HELLO needs.
+constexpr std::uint32_t kMaxHelloBytes = 4 * 1024;
+constexpr std::size_t kUserPage = 1024;
+constexpr auto kSweepInterval = std::chrono::milliseconds(100);
+
+// A little-endian length of what follows, then the type and its payload.
+std::string makeFrame(FrameType type, std::string_view payload) {
+    const auto size = std::uint32_t(payload.size() + 1);
+    std::string frame;
+    frame.reserve(kHeaderBytes + size);
+    for (std::size_t i = 0; i < kHeaderBytes; ++i) {
+        frame.push_back(char((size >> (8 * i)) & 0xFF));
+    }
+    frame.push_back(char(type));
+    frame.append(payload);
+    return frame;
+}
+
+// Takes the same time wherever the first difference is.
+bool sameSecret(std::string_view a, std::string_view b) {
+    unsigned char diff = a.size() == b.size() ? 0 : 1;
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        diff |= std::uint8_t(a[i]) ^ std::uint8_t(i < b.size() ? b[i] : ~a[i]);
+    }
+    return diff == 0;
+}
+
+std::int64_t toMicros(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count();
+}
+
+std::chrono::system_clock::time_point fromMicros(std::int64_t micros) {
+    return std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(micros)));
+}
+
+std::string encodeEvent(const ChatEvent& event) {
+    std::string out;
+    out.push_back(char(event.type));
+    putUuid(out, event.roomId);
+    putUuid(out, event.messageId);
+    putUuid(out, event.actorId);
+    putBytes(out, event.text);
+    return out;
+}
+
+std::optional<ChatEvent> decodeEvent(WireReader& in) {
+    ChatEvent event;
+    event.type = ChatEvent::Type(in.varint());
+    event.roomId = in.uuid();
+    event.messageId = in.uuid();
+    event.actorId = in.uuid();
+    event.text = in.bytes();
+    return in.ok() ? std::optional(std::move(event)) : std::nullopt;
+}
+
+std::string encodeRoom(const RoomSnapshot& room) {
+    std::string out;
+    out.push_back(char(room.kind));
+    putUuid(out, room.id);
+    putBytes(out, room.name);
+    putUuid(out, room.adminId);
+    putVarint(out, room.participants.size());
+    for (const auto& participant : room.participants) {
+        putUuid(out, participant);
+    }
+    putSigned(out, room.messageTtl.count());
+    putSigned(out, toMicros(room.lastActivity));
+    putVarint(out, room.messages.size());
+    for (const auto& message : room.messages) {
+        putUuid(out, message.getId());
+        putUuid(out, message.getAuthorId());
+        putBytes(out, message.getText());
+        putSigned(out, toMicros(message.getTimestamp()));
+        out.push_back(char(message.isEdited()));
+    }
+    return out;
+}
+
+std::optional<RoomSnapshot> decodeRoom(WireReader& in) {
+    RoomSnapshot room;
+    room.kind = RoomSnapshot::Kind(in.varint());
+    room.id = in.uuid();
+    room.name = in.bytes();
+    room.adminId = in.uuid();
+    const auto participants = in.varint();
+    for (std::uint64_t i = 0; i < participants && in.ok(); ++i) {
+        room.participants.push_back(in.uuid());
+    }
+    room.messageTtl = std::chrono::seconds(in.signedVarint());
+    room.lastActivity = fromMicros(in.signedVarint());
+    const auto messages = in.varint();
+    for (std::uint64_t i = 0; i < messages && in.ok(); ++i) {
+        const auto id = in.uuid();
+        const auto author = in.uuid();
+        std::string text(in.bytes());
+        const auto timestamp = fromMicros(in.signedVarint());
+        room.messages.emplace_back(id, author, std::move(text), timestamp, in.varint() != 0);
+    }
+    return in.ok() ? std::optional(std::move(room)) : std::nullopt;
+}
+
+} // namespace
+
+// One TCP connection to a peer. Runs only on the cluster thread.
+class ClusterNode::Link : public std::enable_shared_from_this<Link> {
+public:
+    Link(tcp::socket socket, ClusterNode& node, bool accepted)
+        : accepted(accepted)
+        , socket_(std::move(socket))
+        , node_(node)
+    {}
+
+    void start() {
+        readHeader();
+    }
+
+    void send(std::string frame) {
+        if (down_) {
+            return;
+        }
+        outbox_.push_back(std::move(frame));
+        if (outbox_.size() == 1) {
+            write();
+        }
+    }
+
+    void close() {
+        boost::system::error_code ec;
+        socket_.close(ec);
+    }
+
+    // Whichever of the read and write sides fails first closes the socket
+    // and tells the node, once, so pending forwards fail right away rather
+    // than at their deadline.
+    void fail() {
+        if (down_) {
+            return;
+        }
+        down_ = true;
+        close();
+        node_.onClosed(shared_from_this());
+    }
+
+    // Empty until the peer's HELLO arrives.
+    std::string peer;
+    const bool  accepted;
+
+private:
+    void readHeader() {
+        asio::async_read(socket_, asio::buffer(header_), [self = shared_from_this()](
+            boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                self->fail();
+                return;
+            }
+
+            std::uint32_t size = 0;
+            for (std::size_t i = 0; i < kHeaderBytes; ++i) {
+                size |= std::uint32_t(std::uint8_t(self->header_[i])) << (8 * i);
+            }
+            const auto limit = self->peer.empty() ? kMaxHelloBytes : kMaxFrameBytes;
+            if (size == 0 || size > limit) {
+                self->fail();
+                return;
+            }
+
+            self->body_.resize(size);
+            self->readBody();
+        });
+    }
+
+    void readBody() {
+        asio::async_read(socket_, asio::buffer(body_), [self = shared_from_this()](
+            boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                self->fail();
+                return;
+            }
+
+            self->node_.onFrame(self, std::uint8_t(self->body_[0]), std::string_view(self->body_).substr(1));
+            self->readHeader();
+        });
+    }
+
+    void write() {
+        asio::async_write(socket_, asio::buffer(outbox_.front()), [self = shared_from_this()](
+            boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                self->fail();
+                return;
+            }
+
+            self->outbox_.pop_front();
+            if (!self->outbox_.empty()) {
+                self->write();
+            }
+        });
+    }
+
+    tcp::socket                     socket_;
+    ClusterNode&                    node_;
+    std::array<char, kHeaderBytes>  header_{};
+    std::string                     body_;
+    std::deque<std::string>         outbox_;
+    bool                            down_ = false;
+};
+
+ClusterNode::ClusterNode(ClusterOptions options, std::shared_ptr<ChatManager> chat_manager,
+    std::shared_ptr<UserManager> user_manager, std::shared_ptr<PushHub> push_hub)
+    : options_(std::move(options))
+    , nodeId_(options_.nodeId.empty() ? "node-" + std::to_string(options_.port) : options_.nodeId)
+    , chatManager_(std::move(chat_manager))
+    , userManager_(std::move(user_manager))
+    , pushHub_(std::move(push_hub))
+    , executor_("cluster", std::max<std::size_t>(options_.forwardThreads, 1))
+    , ring_(options_.virtualNodes)
+    , acceptor_(ioc_)
+    , sweepTimer_(ioc_)
+{
+    ring_.addNode(nodeId_);
+}
+
+ClusterNode::~ClusterNode() {
+    stop();
+}
+
+void ClusterNode::setHandler(Handler handler) {
+    handler_ = std::move(handler);
+}
+
+void ClusterNode::start() {
+    const auto address = asio::ip::make_address(options_.bindAddress);
+    if (!address.is_loopback() && options_.secret.empty()) {
+        throw std::invalid_argument("ClusterNode: a cluster port on " + options_.bindAddress + " needs a secret");
+    }
+    const tcp::endpoint endpoint(address, options_.port);
+    acceptor_.open(endpoint.protocol());
+    acceptor_.set_option(tcp::acceptor::reuse_address(true));
+    acceptor_.bind(endpoint);
+    acceptor_.listen();
+
+    accept();
+    sweep();
+    thread_ = std::thread([this] {
+        auto work = asio::make_work_guard(ioc_);
+        ioc_.run();
+    });
+
+    const std::string hello = makeFrame(FrameType::HELLO, [this] {
+        std::string payload;
+        putBytes(payload, nodeId_);
+        putBytes(payload, options_.secret);
+        return payload;
+    }());
+    for (const auto& seed : options_.seeds) {
+        tcp::socket socket(ioc_);
+        asio::connect(socket, tcp::resolver(ioc_).resolve(seed.host, std::to_string(seed.port)));
+        socket.set_option(tcp::no_delay(true));
+
+        auto link = std::make_shared<Link>(std::move(socket), *this, false);
+        asio::post(ioc_, [link, hello] {
+            link->start();
+            link->send(hello);
+        });
+    }
+
+    std::unique_lock lock(joinMutex_);
+    if (!joined_.wait_for(lock, options_.joinTimeout, [this] { return rebalanced_ == options_.seeds.size(); })) {
+        throw std::runtime_error("ClusterNode: " + nodeId_ + " timed out joining the cluster");
+    }
+}
+
+void ClusterNode::stop() {
+    if (stopped_.exchange(true)) {
+        return;
+    }
+
+    ioc_.stop();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    executor_.stop();
+
+    boost::system::error_code ec;
+    acceptor_.close(ec);
+    for (auto& [peer, link] : links_) {
+        link->close();
+    }
+    links_.clear();
+}
+
+bool ClusterNode::owns(const ChatRoomId& room) const {
+    std::shared_lock lock(ringMutex_);
+    return ring_.owner(room) == nodeId_;
+}
+
+const std::string& ClusterNode::nodeId() const {
+    return nodeId_;
+}
+
+void ClusterNode::forward(const ChatRoomId& room, UserId user, std::string line, Reply done) {
+    asio::post(ioc_, [this, room, user, line = std::move(line), done = std::move(done)]() mutable {
+        std::string owner;
+        {
+            std::shared_lock lock(ringMutex_);
+            owner = ring_.owner(room);
+        }
+        route(owner, user, std::move(line), std::move(done));
+    });
+}
+
+void ClusterNode::gather(UserId user, std::string line, Replies done) {
+    struct Gathered {
+        std::mutex               mutex;
+        std::vector<std::string> replies;
+        std::size_t              remaining = 0;
+        Replies                  done;
+    };
+
+    asio::post(ioc_, [this, user, line = std::move(line), done = std::move(done)]() mutable {
+        std::vector<std::string> nodes;
+        {
+            std::shared_lock lock(ringMutex_);
+            nodes = ring_.nodes();
+        }
+
+        auto gathered = std::make_shared<Gathered>();
+        gathered->replies.resize(nodes.size());
+        gathered->remaining = nodes.size();
+        gathered->done = std::move(done);
+        for (std::size_t i = 0; i < nodes.size(); ++i) {
+            route(nodes[i], user, line, [gathered, i](std::string reply) {
+                {
+                    std::lock_guard lock(gathered->mutex);
+                    gathered->replies[i] = std::move(reply);
+                    if (--gathered->remaining > 0) {
+                        return;
+                    }
+                }
+                gathered->done(std::move(gathered->replies));
+            });
+        }
+    });
+}
+
+void ClusterNode::announceUser(UserId user, const std::string& name, bool ephemeral) {
+    std::string payload;
+    putUuid(payload, user);
+    putBytes(payload, name);
+    putVarint(payload, ephemeral);
+    broadcast(makeFrame(FrameType::USER, payload));
+}
+
+void ClusterNode::releaseUser(UserId user) {
+    std::string payload;
+    putUuid(payload, user);
+    broadcast(makeFrame(FrameType::RELEASE, payload));
+}
+
+void ClusterNode::publish(const ChatEvent& event) {
+    eventsSent_.fetch_add(1, std::memory_order_relaxed);
+    broadcast(makeFrame(FrameType::EVENT, encodeEvent(event)));
+}
+
+std::string ClusterNode::stats() const {
+    std::size_t nodes;
+    {
+        std::shared_lock lock(ringMutex_);
+        nodes = ring_.nodes().size();
+    }
+
+    std::ostringstream out;
+    out << "cluster_node=" << nodeId_ << '|'
+        << "cluster_nodes=" << nodes << '|'
+        << "cluster_forwarded=" << forwarded_.load(std::memory_order_relaxed) << '|'
+        << "cluster_served=" << served_.load(std::memory_order_relaxed) << '|'
+        << "cluster_forward_failures=" << failed_.load(std::memory_order_relaxed) << '|'
+        << "cluster_events_sent=" << eventsSent_.load(std::memory_order_relaxed) << '|'
+        << "cluster_events_received=" << eventsReceived_.load(std::memory_order_relaxed) << '|'
+        << "cluster_rooms_adopted=" << roomsAdopted_.load(std::memory_order_relaxed) << '|'
+        << "cluster_rooms_handed_off=" << roomsHandedOff_.load(std::memory_order_relaxed) << '|'
+        << "cluster_handoffs_refused=" << handoffsRefused_.load(std::memory_order_relaxed);
+    return out.str();
+}
+
+void ClusterNode::accept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, tcp::socket socket) {
+        if (ec == asio::error::operation_aborted) {
+            return;
+        }
+
+        if (!ec) {
+            socket.set_option(tcp::no_delay(true), ec);
+            std::make_shared<Link>(std::move(socket), *this, true)->start();
+        } else {
+            std::cerr << "Cluster accept error: " << ec.message() << "\n";
+        }
+        accept();
+    });
+}
+
+// Forwards whose owner went quiet are failed here rather than with a
+// timer each.
+void ClusterNode::sweep() {
+    sweepTimer_.expires_after(kSweepInterval);
+    sweepTimer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) {
+            return;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            if (it->second.deadline > now) {
+                ++it;
+                continue;
+            }
+            failed_.fetch_add(1, std::memory_order_relaxed);
+            auto done = std::move(it->second.done);
+            it = pending_.erase(it);
+            done(outcomeUnknown());
+        }
+        sweep();
+    });
+}
+
+void ClusterNode::onFrame(const std::shared_ptr<Link>& link, std::uint8_t type, std::string_view payload) {
+    WireReader in(payload);
+
+    // Nothing but a HELLO with the shared secret is taken from a link that
+    // has not introduced itself.
+    if (link->peer.empty() && FrameType(type) != FrameType::HELLO) {
+        std::cerr << "Cluster: frame " << int(type) << " before HELLO; closing the link\n";
+        link->close();
+        return;
+    }
+
+    switch (FrameType(type)) {
+        case FrameType::HELLO: {
+            std::string peer(in.bytes());
+            const auto secret = in.bytes();
+            if (!in.ok() || !link->peer.empty() || peer.empty() || peer == nodeId_) {
+                link->close();
+                return;
+            }
+            if (!sameSecret(secret, options_.secret)) {
+                std::cerr << "Cluster: " << peer << " sent the wrong secret; closing the link\n";
+                link->close();
+                return;
+            }
+
+            link->peer = peer;
+            if (auto old = links_.find(peer); old != links_.end() && old->second != link) {
+                old->second->close();
+            }
+            links_[peer] = link;
+            if (link->accepted) {
+                welcome(link);
+            } else {
+                std::unique_lock lock(ringMutex_);
+                if (!ring_.contains(peer)) {
+                    ring_.addNode(peer);
+                }
+            }
+            break;
+        }
+
+        case FrameType::USER: {
+            const auto user = in.uuid();
+            std::string name(in.bytes());
+            const bool ephemeral = in.varint() != 0;
+            if (in.ok()) {
+                userManager_->adoptUser(user, name, ephemeral);
+            }
+            break;
+        }
+
+        case FrameType::RELEASE: {
+            const auto user = in.uuid();
+            if (in.ok()) {
+                userManager_->releaseAdoptedUser(user);
+            }
+            break;
+        }
+
+        case FrameType::FORWARD: {
+            const auto request = in.varint();
+            const auto user = in.uuid();
+            std::string line(in.bytes());
+            if (!in.ok()) {
+                break;
+            }
+
+            served_.fetch_add(1, std::memory_order_relaxed);
+            executor_.execute([this, link, request, user, line = std::move(line)] {
+                std::string payload;
+                putVarint(payload, request);
+                putBytes(payload, handler_ ? handler_(user, line) : unavailable());
+                asio::post(ioc_, [link, frame = makeFrame(FrameType::REPLY, payload)]() mutable {
+                    link->send(std::move(frame));
+                });
+            });
+            break;
+        }
+
+        case FrameType::REPLY: {
+            const auto request = in.varint();
+            std::string reply(in.bytes());
+            auto it = pending_.find(request);
+            if (!in.ok() || it == pending_.end()) {
+                break;
+            }
+
+            auto done = std::move(it->second.done);
+            pending_.erase(it);
+            done(std::move(reply));
+            break;
+        }
+
+        case FrameType::EVENT: {
+            if (auto event = decodeEvent(in)) {
+                eventsReceived_.fetch_add(1, std::memory_order_relaxed);
+                pushHub_->publish(*event);
+            }
+            break;
+        }
+
+        // The current members of a room held by the peer, sent once in its
+        // welcome; from then on they change only by membership events.
+        case FrameType::MEMBERS: {
+            const auto room = in.uuid();
+            const auto count = in.varint();
+            std::vector<UserId> members;
+            for (std::uint64_t i = 0; i < count && in.ok(); ++i) {
+                members.push_back(in.uuid());
+            }
+            if (!in.ok()) {
+                break;
+            }
+
+            for (const auto& member : members) {
+                pushHub_->publish(ChatEvent{ChatEvent::Type::MEMBER_JOINED, room, {}, member, {}});
+            }
+            break;
+        }
+
+        case FrameType::ROOM: {
+            auto room = decodeRoom(in);
+            if (!room) {
+                break;
+            }
+
+            const auto id = room->id;
+            const bool adopted = chatManager_->adoptRoom(std::move(*room));
+            if (adopted) {
+                roomsAdopted_.fetch_add(1, std::memory_order_relaxed);
+            }
+            // Already holding it means an earlier handoff got here but its
+            // acknowledgement did not get back.
+            std::string payload;
+            putUuid(payload, id);
+            putVarint(payload, adopted || chatManager_->chatExists(id));
+            link->send(makeFrame(FrameType::ROOM_HELD, payload));
+            break;
+        }
+
+        case FrameType::ROOM_HELD: {
+            const auto id = in.uuid();
+            const bool held = in.varint() != 0;
+            auto handoff = handoffs_.find(id);
+            if (!in.ok() || handoff == handoffs_.end() || handoff->second != link->peer) {
+                break;
+            }
+
+            handoffs_.erase(handoff);
+            if (held) {
+                chatManager_->dropRoom(id);
+                roomsHandedOff_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                chatManager_->keepRoom(id);
+                handoffsRefused_.fetch_add(1, std::memory_order_relaxed);
+                std::cerr << "Cluster: " << link->peer << " refused a room; keeping it until it rejoins\n";
+            }
+            break;
+        }
+
+        case FrameType::REBALANCED: {
+            std::lock_guard lock(joinMutex_);
+            ++rebalanced_;
+            joined_.notify_all();
+            break;
+        }
+
+        default:
+            std::cerr << "Cluster: unknown frame " << int(type) << " from " << link->peer << "\n";
+            break;
+    }
+}
+
+void ClusterNode::onClosed(const std::shared_ptr<Link>& link) {
+    if (auto it = links_.find(link->peer); it != links_.end() && it->second == link) {
+        links_.erase(it);
+    }
+
+    // Unacknowledged handoffs stay here; the peer's next HELLO retries them.
+    for (auto it = handoffs_.begin(); it != handoffs_.end();) {
+        if (it->second != link->peer) {
+            ++it;
+            continue;
+        }
+        chatManager_->keepRoom(it->first);
+        it = handoffs_.erase(it);
+    }
+
+    // These went out, so the peer may have run them before the link died.
+    for (auto it = pending_.begin(); it != pending_.end();) {
+        if (it->second.peer != link->peer) {
+            ++it;
+            continue;
+        }
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        auto done = std::move(it->second.done);
+        it = pending_.erase(it);
+        done(outcomeUnknown());
+    }
+}
+
+// Users go first so the rooms that follow can name them, then the members
+// of every room held here, so the peer's PushHub can deliver their events. The peer joins
+// the ring under the chat lock, so no room is created against the old
+// ring after the list of rooms to move is taken. Those rooms stay here,
+// read-only, until the owner acknowledges them with ROOM_HELD.
+void ClusterNode::welcome(const std::shared_ptr<Link>& link) {
+    std::string payload;
+    putBytes(payload, nodeId_);
+    putBytes(payload, options_.secret);
+    link->send(makeFrame(FrameType::HELLO, payload));
+
+    std::optional<UserManager::DirectoryEntry> after;
+    while (true) {
+        auto page = userManager_->listUsers("", after, kUserPage);
+        for (const auto& entry : page) {
+            payload.clear();
+            putUuid(payload, entry.id);
+            putBytes(payload, entry.name);
+            putVarint(payload, userManager_->isEphemeral(entry.id));
+            link->send(makeFrame(FrameType::USER, payload));
+        }
+        if (page.size() < kUserPage) {
+            break;
+        }
+        after = page.back();
+    }
+
+    // Membership changes made after this reach the peer as events behind
+    // these frames, since they are broadcast from this thread.
+    for (const auto& room : chatManager_->roomIds()) {
+        const auto members = chatManager_->getChatParticipants(room);
+        if (members.empty()) {
+            continue;
+        }
+        payload.clear();
+        putUuid(payload, room);
+        putVarint(payload, members.size());
+        for (const auto& member : members) {
+            putUuid(payload, member);
+        }
+        link->send(makeFrame(FrameType::MEMBERS, payload));
+    }
+
+    const auto leaving = chatManager_->changePlacement([this, &link] {
+        std::unique_lock lock(ringMutex_);
+        if (!ring_.contains(link->peer)) {
+            ring_.addNode(link->peer);
+        }
+    });
+    for (const auto& snapshot : leaving) {
+        // Usually the peer; a room kept from a refused handoff may belong
+        // to another node, which is retried while the link is up.
+        std::string owner;
+        {
+            std::shared_lock lock(ringMutex_);
+            owner = ring_.owner(snapshot.id);
+        }
+        auto target = links_.find(owner);
+        if (target == links_.end()) {
+            chatManager_->keepRoom(snapshot.id);
+            continue;
+        }
+        handoffs_[snapshot.id] = owner;
+        target->second->send(makeFrame(FrameType::ROOM, encodeRoom(snapshot)));
+    }
+
+    link->send(makeFrame(FrameType::REBALANCED, {}));
+}
+
+// Runs on the cluster thread. Commands for this node run on the executor
+// like forwarded ones, so the caller never blocks on them.
+void ClusterNode::route(const std::string& node, UserId user, std::string line, Reply done) {
+    if (node == nodeId_) {
+        executor_.execute([this, user, line = std::move(line), done = std::move(done)] {
+            done(handler_ ? handler_(user, line) : unavailable());
+        });
+        return;
+    }
+
+    auto link = links_.find(node);
+    if (link == links_.end()) {
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        done(unavailable());
+        return;
+    }
+
+    const auto request = nextRequest_++;
+    pending_.emplace(request, Pending{std::move(done), std::chrono::steady_clock::now() + options_.forwardTimeout,
+        node});
+    forwarded_.fetch_add(1, std::memory_order_relaxed);
+
+    std::string payload;
+    putVarint(payload, request);
+    putUuid(payload, user);
+    putBytes(payload, line);
+    link->second->send(makeFrame(FrameType::FORWARD, payload));
+}
+
+void ClusterNode::broadcast(std::string frame) {
+    asio::post(ioc_, [this, frame = std::move(frame)] {
+        for (auto& [peer, link] : links_) {
+            link->send(frame);
+        }
+    });
+}
+
+std::string ClusterNode::unavailable() const {
+    return std::to_string(int(OutCommand::ERRORR)) + ' ' + std::to_string(int(ErrorCode::ERROR_NODE_UNAVAILABLE));
+}
+
+std::string ClusterNode::outcomeUnknown() const {
+    return std::to_string(int(OutCommand::ERRORR)) + ' ' + std::to_string(int(ErrorCode::ERROR_OUTCOME_UNKNOWN));
+}
@@ -0,0 +1,80 @@
+#include "lib/compression.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <boost/beast/zlib/deflate_stream.hpp>
+
+
+CompressionStats::CompressionStats(CompressionOptions options)
+    : options_(options)
+{}
+
+void CompressionStats::recordWire(std::size_t bytes) {
+    wireBytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void CompressionStats::recordMessage(std::string_view payload) {
+    payloadBytes_.fetch_add(payload.size(), std::memory_order_relaxed);
+    if (payload.size() < options_.minMessageBytes) {
+        return;
+    }
+
+    eligibleBytes_.fetch_add(payload.size(), std::memory_order_relaxed);
+    if (eligibleMessages_.fetch_add(1, std::memory_order_relaxed) % kSampleEvery == 0) {
+        sample(payload);
+    }
+}
+
+void CompressionStats::sample(std::string_view payload) {
+    namespace zlib = boost::beast::zlib;
+
+    thread_local std::vector<std::uint8_t> out;
+    out.resize(payload.size() + payload.size() / 8 + 64);
+
+    const auto start = std::chrono::steady_clock::now();
+    zlib::deflate_stream deflater;
+    deflater.reset(options_.level, options_.windowBits, options_.memLevel, zlib::Strategy::normal);
+    zlib::z_params params;
+    params.next_in = payload.data();
+    params.avail_in = payload.size();
+    params.next_out = out.data();
+    params.avail_out = out.size();
+    boost::system::error_code ec;
+    deflater.write(params, zlib::Flush::sync, ec);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    sampledBytes_.fetch_add(payload.size(), std::memory_order_relaxed);
+    sampledNanos_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+        std::memory_order_relaxed);
+}
+
+std::string CompressionStats::stats() const {
+    const auto payload = payloadBytes_.load(std::memory_order_relaxed);
+    const auto wire = wireBytes_.load(std::memory_order_relaxed);
+    const auto eligible = eligibleBytes_.load(std::memory_order_relaxed);
+    const auto sampledBytes = sampledBytes_.load(std::memory_order_relaxed);
+    const auto sampledNanos = sampledNanos_.load(std::memory_order_relaxed);
+
+    const auto estimatedMicros = sampledBytes ? eligible * sampledNanos / sampledBytes / 1000 : 0;
+    return "ws_compression=" + std::to_string(options_.enabled ? 1 : 0) + '|'
+        + "ws_payload_bytes=" + std::to_string(payload) + '|'
+        + "ws_wire_bytes=" + std::to_string(wire) + '|'
+        + "ws_bytes_saved=" + std::to_string(payload > wire ? payload - wire : 0) + '|'
+        + "ws_compressible_messages=" + std::to_string(eligibleMessages_.load(std::memory_order_relaxed)) + '|'
+        + "ws_deflate_cpu_us_estimate=" + std::to_string(estimatedMicros);
+}
+
+boost::beast::websocket::permessage_deflate permessageDeflate(const CompressionOptions& options) {
+    boost::beast::websocket::permessage_deflate deflate;
+    deflate.server_enable = options.enabled;
+    deflate.server_max_window_bits = std::clamp(options.windowBits, 9, 15);
+    deflate.server_no_context_takeover = !options.contextTakeover;
+    deflate.compLevel = std::clamp(options.level, 0, 9);
+    deflate.memLevel = std::clamp(options.memLevel, 1, 9);
+#if BOOST_VERSION >= 107500
+    deflate.msg_size_threshold = options.minMessageBytes;
+#endif
+    return deflate;
+}
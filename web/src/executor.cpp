@@ -0,0 +1,52 @@
+#include "lib/executor.h"
+
+#include <chrono>
+
+#include <boost/asio/post.hpp>
+
+
+Executor::Executor(std::string name, std::size_t threads)
+    : name_(std::move(name))
+{
+    if (threads > 0) {
+        pool_.emplace(threads);
+    }
+}
+
+void Executor::execute(std::function<void()> task) {
+    using Clock = std::chrono::steady_clock;
+
+    if (!pool_) {
+        auto start = Clock::now();
+        task();
+        queueTime_.record(std::chrono::nanoseconds::zero());
+        runTime_.record(Clock::now() - start);
+        return;
+    }
+
+    boost::asio::post(*pool_, [this, task = std::move(task), enqueued = Clock::now()] {
+        auto start = Clock::now();
+        queueTime_.record(start - enqueued);
+        task();
+        runTime_.record(Clock::now() - start);
+    });
+}
+
+void Executor::stop() {
+    if (pool_) {
+        pool_->stop();
+        pool_->join();
+    }
+}
+
+const std::string& Executor::name() const {
+    return name_;
+}
+
+bool Executor::isInline() const {
+    return !pool_;
+}
+
+std::string Executor::stats() const {
+    return queueTime_.format(name_ + "_queue") + '|' + runTime_.format(name_ + "_run");
+}
@@ -0,0 +1,66 @@
+#include "lib/hash_ring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+
+namespace {
+
+// splitmix64's finalizer: room ids are time-ordered, so their leading
+// bytes cluster and have to be mixed before they spread over the ring.
+std::uint64_t mix(std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+std::uint64_t hashText(const std::string& text, std::uint64_t seed) {
+    std::uint64_t h = mix(seed);
+    for (unsigned char c : text) {
+        h = mix(h ^ c);
+    }
+    return h;
+}
+
+} // namespace
+
+HashRing::HashRing(std::size_t virtual_nodes)
+    : virtualNodes_(std::max<std::size_t>(virtual_nodes, 1))
+{}
+
+void HashRing::addNode(const std::string& node) {
+    for (std::size_t i = 0; i < virtualNodes_; ++i) {
+        points_.emplace(hashText(node, i), node);
+    }
+}
+
+void HashRing::removeNode(const std::string& node) {
+    std::erase_if(points_, [&node](const auto& point) { return point.second == node; });
+}
+
+const std::string& HashRing::owner(const boost::uuids::uuid& key) const {
+    static const std::string none;
+    if (points_.empty()) {
+        return none;
+    }
+
+    std::uint64_t high, low;
+    std::memcpy(&high, key.data, sizeof(high));
+    std::memcpy(&low, key.data + sizeof(high), sizeof(low));
+    auto it = points_.lower_bound(mix(high ^ mix(low)));
+    return (it == points_.end() ? points_.begin() : it)->second;
+}
+
+std::vector<std::string> HashRing::nodes() const {
+    std::set<std::string> unique;
+    for (const auto& [point, node] : points_) {
+        unique.insert(node);
+    }
+    return {unique.begin(), unique.end()};
+}
+
+bool HashRing::contains(const std::string& node) const {
+    return std::any_of(points_.begin(), points_.end(), [&node](const auto& point) { return point.second == node; });
+}
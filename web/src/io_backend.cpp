@@ -0,0 +1,78 @@
+#include "lib/io_backend.h"
+
+#if PRISECCHAT_IO_URING
+#include <boost/asio/stream_file.hpp>
+#include <boost/asio/write.hpp>
+#include <liburing.h>
+#endif
+
+
+namespace {
+
+#if PRISECCHAT_IO_URING
+std::atomic<std::uint64_t> uringWrites{0};
+
+bool probeUring() {
+    io_uring ring;
+    if (io_uring_queue_init(2, &ring, 0) != 0) {
+        return false;
+    }
+    io_uring_queue_exit(&ring);
+    return true;
+}
+#endif
+
+} // namespace
+
+const char* IoBackend::socketBackend() {
+    return uringSockets ? "io_uring" : "epoll";
+}
+
+bool IoBackend::uringAvailable() {
+#if PRISECCHAT_IO_URING
+    static const bool available = probeUring();
+    return available;
+#else
+    return false;
+#endif
+}
+
+std::string IoBackend::stats() {
+    std::string out = std::string("io_socket_backend=") + socketBackend() + '|'
+        + "io_file_backend=" + (uringAvailable() ? "io_uring" : "ofstream");
+#if PRISECCHAT_IO_URING
+    out += "|io_uring_file_writes=" + std::to_string(UringFileWriter::writes());
+#endif
+    return out;
+}
+
+#if PRISECCHAT_IO_URING
+
+bool UringFileWriter::operator()(const std::filesystem::path& file, std::span<const std::uint8_t> bytes) {
+    std::lock_guard lock(mutex_);
+
+    boost::system::error_code ec;
+    boost::asio::stream_file out(ioc_);
+    out.open(file.string(), boost::asio::file_base::write_only | boost::asio::file_base::create
+        | boost::asio::file_base::truncate, ec);
+    if (ec) {
+        return false;
+    }
+
+    boost::asio::async_write(out, boost::asio::buffer(bytes.data(), bytes.size()),
+        [&ec](boost::system::error_code result, std::size_t) { ec = result; });
+    ioc_.restart();
+    ioc_.run();
+    if (ec) {
+        return false;
+    }
+
+    uringWrites.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+std::uint64_t UringFileWriter::writes() {
+    return uringWrites.load(std::memory_order_relaxed);
+}
+
+#endif
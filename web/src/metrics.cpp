@@ -0,0 +1,51 @@
+#include "lib/metrics.h"
+
+#include <algorithm>
+#include <bit>
+
+
+void LatencyHistogram::record(std::chrono::nanoseconds elapsed) {
+    const auto micros = static_cast<std::uint64_t>(
+        std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), 0));
+
+    const auto bucket = std::min<std::size_t>(std::bit_width(micros), kBuckets - 1);
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    auto seen = maxMicros_.load(std::memory_order_relaxed);
+    while (micros > seen && !maxMicros_.compare_exchange_weak(seen, micros, std::memory_order_relaxed)) {
+    }
+}
+
+std::uint64_t LatencyHistogram::count() const {
+    return count_.load(std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::percentileMicros(double p) const {
+    const auto total = count();
+    if (total == 0) {
+        return 0;
+    }
+
+    const auto rank = static_cast<std::uint64_t>(p * static_cast<double>(total - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += buckets_[bucket].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // Upper bound of the bucket: values in [2^(b-1), 2^b).
+            return bucket == 0 ? 0 : std::min((std::uint64_t{1} << bucket) - 1, maxMicros());
+        }
+    }
+    return maxMicros();
+}
+
+std::uint64_t LatencyHistogram::maxMicros() const {
+    return maxMicros_.load(std::memory_order_relaxed);
+}
+
+std::string LatencyHistogram::format(const std::string& prefix) const {
+    return prefix + "_count=" + std::to_string(count()) + '|'
+        + prefix + "_p50_us=" + std::to_string(percentileMicros(0.5)) + '|'
+        + prefix + "_p99_us=" + std::to_string(percentileMicros(0.99)) + '|'
+        + prefix + "_max_us=" + std::to_string(maxMicros());
+}
@@ -0,0 +1,79 @@
+#include "lib/overload_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+constexpr double kMaxRetryScale = 10.0;
+
+double ratio(double value, double limit) {
+    return limit > 0 ? value / limit : 0.0;
+}
+
+} // namespace
+
+OverloadController::OverloadController(OverloadLimits limits)
+    : limits_(limits)
+{}
+
+void OverloadController::recordLoopLag(std::chrono::microseconds lag) {
+    loopLagMicros_.store(lag.count(), std::memory_order_relaxed);
+}
+
+void OverloadController::recordLockWait(std::chrono::microseconds wait) {
+    lockWaitMicros_.store(wait.count(), std::memory_order_relaxed);
+}
+
+void OverloadController::addOutboundBytes(std::size_t bytes) {
+    outboundBytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void OverloadController::removeOutboundBytes(std::size_t bytes) {
+    outboundBytes_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+double OverloadController::pressure() const {
+    using std::chrono::microseconds;
+
+    const auto lag = ratio(static_cast<double>(loopLagMicros_.load(std::memory_order_relaxed)),
+        static_cast<double>(microseconds(limits_.maxLoopLag).count()));
+    const auto lock = ratio(static_cast<double>(lockWaitMicros_.load(std::memory_order_relaxed)),
+        static_cast<double>(microseconds(limits_.maxLockWait).count()));
+    const auto outbound = ratio(static_cast<double>(outboundBytes_.load(std::memory_order_relaxed)),
+        static_cast<double>(limits_.maxOutboundBytes));
+
+    return std::max({lag, lock, outbound});
+}
+
+bool OverloadController::overloaded() const {
+    return pressure() > 1.0;
+}
+
+std::chrono::milliseconds OverloadController::retryAfter() const {
+    const auto scale = std::clamp(pressure(), 1.0, kMaxRetryScale);
+    return std::chrono::milliseconds(static_cast<std::int64_t>(
+        std::ceil(static_cast<double>(limits_.retryAfter.count()) * scale)));
+}
+
+const OverloadLimits& OverloadController::limits() const {
+    return limits_;
+}
+
+void OverloadController::countShedCommand() {
+    shedCommands_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void OverloadController::countRejectedConnection() {
+    rejectedConnections_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string OverloadController::stats() const {
+    return "overload_pressure_pct=" + std::to_string(static_cast<int>(pressure() * 100)) + '|'
+        + "overload_loop_lag_us=" + std::to_string(loopLagMicros_.load(std::memory_order_relaxed)) + '|'
+        + "overload_lock_wait_us=" + std::to_string(lockWaitMicros_.load(std::memory_order_relaxed)) + '|'
+        + "overload_outbound_bytes=" + std::to_string(outboundBytes_.load(std::memory_order_relaxed)) + '|'
+        + "overload_shed_commands=" + std::to_string(shedCommands_.load(std::memory_order_relaxed)) + '|'
+        + "overload_rejected_connections=" + std::to_string(rejectedConnections_.load(std::memory_order_relaxed));
+}
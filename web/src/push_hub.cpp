@@ -0,0 +1,344 @@
+#include "lib/push_hub.h"
+
+#include <algorithm>
+
+#include <boost/asio/post.hpp>
+
+#include "lib/commands.h"
+#include "alloc_tracker.h"
+#include "uuid_text.h"
+
+
+PushHub::ReplayRing::ReplayRing(std::size_t capacity)
+    : slots_(std::max<std::size_t>(capacity, 1))
+{}
+
+void PushHub::ReplayRing::push(std::uint64_t sequence, Frame frame) {
+    if (size_ == slots_.size()) {
+        droppedThrough_ = slots_[next_].first;
+    } else {
+        ++size_;
+    }
+
+    slots_[next_] = {sequence, std::move(frame)};
+    next_ = (next_ + 1) % slots_.size();
+}
+
+std::vector<PushHub::Frame> PushHub::ReplayRing::since(std::uint64_t sequence) const {
+    std::vector<Frame> out;
+    const std::size_t oldest = (next_ + slots_.size() - size_) % slots_.size();
+    for (std::size_t i = 0; i < size_; ++i) {
+        const auto& [seq, frame] = slots_[(oldest + i) % slots_.size()];
+        if (seq > sequence) {
+            out.push_back(frame);
+        }
+    }
+    return out;
+}
+
+std::uint64_t PushHub::ReplayRing::droppedThrough() const {
+    return droppedThrough_;
+}
+
+PushHub::PushHub(ReplayOptions options, FanoutOptions fanout, std::optional<boost::asio::any_io_executor> executor)
+    : options_(options)
+{
+    for (std::size_t i = 0; i < std::max<std::size_t>(fanout.shards, 1); ++i) {
+        auto shard = std::make_unique<Shard>();
+        if (executor) {
+            shard->strand.emplace(boost::asio::make_strand(*executor));
+        }
+        shards_.push_back(std::move(shard));
+    }
+}
+
+std::string PushHub::encode(const ChatEvent& event, std::uint64_t sequence) {
+    OutCommand code = OutCommand::PUSH_MSG_SENT;
+    if (event.type == ChatEvent::Type::MESSAGE_EDITED) {
+        code = OutCommand::PUSH_MSG_EDITED;
+    } else if (event.type == ChatEvent::Type::MESSAGE_REMOVED) {
+        code = OutCommand::PUSH_MSG_REMOVED;
+    }
+
+    std::string frame = std::to_string(int(code)) + ' ' + std::to_string(sequence) + ' '
+        + uuidToString(event.roomId) + ' ' + uuidToString(event.messageId) + ' ' + uuidToString(event.actorId);
+    if (event.type != ChatEvent::Type::MESSAGE_REMOVED) {
+        frame += ' ';
+        frame += event.text;
+    }
+    return frame;
+}
+
+PushHub::Shard& PushHub::shardFor(const UserId& user_id) {
+    return *shards_[user_id.data[15] % shards_.size()];
+}
+
+void PushHub::attach(UserId user_id, const std::shared_ptr<PushTarget>& target) {
+    auto& shard = shardFor(user_id);
+    std::lock_guard lock(shard.mutex);
+
+    shard.targets[user_id].push_back(target);
+
+    auto it = shard.replay.find(user_id);
+    if (it != shard.replay.end()) {
+        it->second.detachedAt.reset();
+    }
+}
+
+bool PushHub::detach(UserId user_id, const PushTarget* target) {
+    auto& shard = shardFor(user_id);
+    std::lock_guard lock(shard.mutex);
+
+    auto it = shard.targets.find(user_id);
+    if (it == shard.targets.end()) {
+        return false;
+    }
+
+    auto& list = it->second;
+    list.erase(std::remove_if(list.begin(), list.end(), [target](const std::weak_ptr<PushTarget>& weak) {
+        auto locked = weak.lock();
+        return !locked || locked.get() == target;
+    }), list.end());
+
+    if (!list.empty()) {
+        return false;
+    }
+    shard.targets.erase(it);
+
+    const auto now = Clock::now();
+    auto state = shard.replay.find(user_id);
+    if (state != shard.replay.end()) {
+        state->second.detachedAt = now;
+        shard.expiryQueue.emplace_back(now + options_.gracePeriod, user_id);
+    }
+
+    expire(shard, now);
+    return true;
+}
+
+template <class Task>
+void PushHub::run(Shard& shard, Task task) {
+    if (shard.strand) {
+        boost::asio::post(*shard.strand, std::move(task));
+    } else {
+        task();
+    }
+}
+
+void PushHub::applyMembership(Shard& shard, const ChatEvent& event) {
+    std::lock_guard lock(shard.mutex);
+
+    if (event.type == ChatEvent::Type::ROOM_CLOSED) {
+        shard.rooms.erase(event.roomId);
+        return;
+    }
+
+    auto& members = shard.rooms[event.roomId];
+    auto it = std::find(members.begin(), members.end(), event.actorId);
+    if (event.type == ChatEvent::Type::MEMBER_JOINED) {
+        if (it == members.end()) {
+            members.push_back(event.actorId);
+        }
+        return;
+    }
+
+    if (it != members.end()) {
+        members.erase(it);
+    }
+    if (members.empty()) {
+        shard.rooms.erase(event.roomId);
+    }
+}
+
+void PushHub::deliver(Shard& shard, ChatRoomId room_id, UserId actor_id, std::uint64_t sequence,
+    const Frame& frame) {
+
+    std::vector<std::shared_ptr<PushTarget>> targets;
+    {
+        std::lock_guard lock(shard.mutex);
+
+        auto room = shard.rooms.find(room_id);
+        if (room == shard.rooms.end()) {
+            return;
+        }
+
+        for (const auto& recipient : room->second) {
+            if (recipient == actor_id) {
+                continue;
+            }
+
+            auto state = shard.replay.find(recipient);
+            if (state != shard.replay.end()) {
+                state->second.ring.push(sequence, frame);
+            }
+
+            auto online = shard.targets.find(recipient);
+            if (online == shard.targets.end()) {
+                continue;
+            }
+            for (const auto& weak : online->second) {
+                if (auto target = weak.lock()) {
+                    targets.push_back(std::move(target));
+                }
+            }
+        }
+    }
+
+    for (const auto& target : targets) {
+        target->push(frame);
+    }
+}
+
+void PushHub::publish(const ChatEvent& event) {
+    AllocScope alloc(AllocTag::OUTBOUND_QUEUES);
+    std::lock_guard lock(publishMutex_);
+
+    if (event.isMembershipChange()) {
+        for (const auto& shard : shards_) {
+            if (event.type == ChatEvent::Type::ROOM_CLOSED || shard.get() == &shardFor(event.actorId)) {
+                run(*shard, [this, &shard = *shard, event] { applyMembership(shard, event); });
+            }
+        }
+        return;
+    }
+
+    const auto sequence = ++sequence_;
+    Frame frame = std::make_shared<const std::string>(encode(event, sequence));
+
+    for (const auto& shard : shards_) {
+        run(*shard, [this, &shard = *shard, room_id = event.roomId, actor_id = event.actorId, sequence, frame] {
+            deliver(shard, room_id, actor_id, sequence, frame);
+        });
+    }
+}
+
+std::string PushHub::issueResumeToken(UserId user_id) {
+    auto& shard = shardFor(user_id);
+    std::lock_guard lock(shard.mutex);
+    std::lock_guard tokensLock(tokensMutex_);
+
+    std::string token = uuidToString(tokenGenerator_());
+
+    auto it = shard.replay.find(user_id);
+    if (it == shard.replay.end()) {
+        it = shard.replay.emplace(user_id, ReplayState{{}, ReplayRing(options_.capacity), std::nullopt}).first;
+    } else {
+        tokens_.erase(it->second.token);
+    }
+
+    it->second.token = token;
+    tokens_.emplace(token, user_id);
+    return token;
+}
+
+void PushHub::revokeResumeToken(UserId user_id) {
+    auto& shard = shardFor(user_id);
+    std::lock_guard lock(shard.mutex);
+
+    auto it = shard.replay.find(user_id);
+    if (it == shard.replay.end()) {
+        return;
+    }
+
+    std::lock_guard tokensLock(tokensMutex_);
+    tokens_.erase(it->second.token);
+    shard.replay.erase(it);
+}
+
+std::optional<PushHub::Resumption> PushHub::resume(const std::string& token, std::uint64_t last_sequence,
+    const std::shared_ptr<PushTarget>& target) {
+
+    UserId userId;
+    {
+        std::lock_guard tokensLock(tokensMutex_);
+        auto owner = tokens_.find(token);
+        if (owner == tokens_.end()) {
+            return std::nullopt;
+        }
+        userId = owner->second;
+    }
+
+    auto& shard = shardFor(userId);
+    std::lock_guard lock(shard.mutex);
+
+    expire(shard, Clock::now());
+
+    auto state = shard.replay.find(userId);
+    if (state == shard.replay.end() || state->second.token != token) {
+        return std::nullopt;
+    }
+
+    auto& replay = state->second;
+    Resumption out{userId, {}, last_sequence >= replay.ring.droppedThrough(), replay.ring.since(last_sequence), {}};
+
+    for (const auto& weak : shard.targets[userId]) {
+        if (auto displaced = weak.lock()) {
+            out.displaced.push_back(std::move(displaced));
+        }
+    }
+    shard.targets[userId] = {target};
+    replay.detachedAt.reset();
+
+    std::lock_guard tokensLock(tokensMutex_);
+    out.token = uuidToString(tokenGenerator_());
+    tokens_.erase(token);
+    replay.token = out.token;
+    tokens_.emplace(out.token, userId);
+
+    return out;
+}
+
+void PushHub::expireDetached() {
+    const auto now = Clock::now();
+    for (const auto& shard : shards_) {
+        std::lock_guard lock(shard->mutex);
+        expire(*shard, now);
+    }
+}
+
+void PushHub::expire(Shard& shard, TimePoint now) {
+    while (!shard.expiryQueue.empty() && shard.expiryQueue.front().first <= now) {
+        auto userId = shard.expiryQueue.front().second;
+        shard.expiryQueue.pop_front();
+
+        auto it = shard.replay.find(userId);
+        if (it == shard.replay.end() || !it->second.detachedAt) {
+            continue;
+        }
+        if (*it->second.detachedAt + options_.gracePeriod > now) {
+            continue;
+        }
+
+        {
+            std::lock_guard tokensLock(tokensMutex_);
+            tokens_.erase(it->second.token);
+        }
+        shard.replay.erase(it);
+    }
+}
+
+std::uint64_t PushHub::lastSequence() const {
+    return sequence_.load();
+}
+
+std::size_t PushHub::onlineUsers() const {
+    std::size_t count = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard lock(shard->mutex);
+        count += shard->targets.size();
+    }
+    return count;
+}
+
+std::size_t PushHub::resumableUsers() const {
+    std::size_t count = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard lock(shard->mutex);
+        count += shard->replay.size();
+    }
+    return count;
+}
+
+std::size_t PushHub::shardCount() const {
+    return shards_.size();
+}
@@ -0,0 +1,135 @@
+#include "lib/rate_limiter.h"
+
+#include <algorithm>
+
+
+namespace {
+
+std::chrono::milliseconds roundUp(TokenBucket::Clock::duration wait) {
+    auto millis = std::chrono::ceil<std::chrono::milliseconds>(wait);
+    return std::max(millis, std::chrono::milliseconds(1));
+}
+
+} // namespace
+
+CommandClass classify(InCommand command) {
+    switch (command) {
+        case InCommand::RENAME_USER:
+        case InCommand::CREATE_PERSONAL_CHAT:
+        case InCommand::CREATE_OPEN_GROUP:
+        case InCommand::CREATE_CLOSE_GROUP:
+        case InCommand::CREATE_BROADCAST:
+        case InCommand::DELETE_CHAT:
+        case InCommand::ADD_PARTICIPANT:
+        case InCommand::REMOVE_PARTICIPANT:
+        case InCommand::SEND_MESSAGE:
+        case InCommand::SEND_MESSAGE_ONCE:
+        case InCommand::EDIT_MESSAGE:
+        case InCommand::REMOVE_MESSAGE:
+        case InCommand::SET_MESSAGE_TTL:
+            return CommandClass::WRITE;
+        case InCommand::GET_HISTORY:
+        case InCommand::SEARCH:
+            return CommandClass::HISTORY_READ;
+        case InCommand::LIST_USERS:
+        case InCommand::LIST_CHATS:
+        case InCommand::LIST_PARTICIPANTS:
+        case InCommand::SEARCH_USERS:
+            return CommandClass::DIRECTORY_READ;
+        case InCommand::GET_LOCK_PROFILE:
+        case InCommand::DUMP_TRACE:
+            return CommandClass::DIAGNOSTIC;
+        default:
+            return CommandClass::OTHER;
+    }
+}
+
+TokenBucket::TokenBucket(BucketLimits limits, Clock::time_point now)
+    : limits_(limits),
+      tokens_(limits.burst),
+      refilledAt_(now)
+{}
+
+TokenBucket::Clock::duration TokenBucket::wait(Clock::time_point now) {
+    if (limits_.ratePerSecond <= 0) {
+        return Clock::duration::zero();
+    }
+
+    if (now > refilledAt_) {
+        std::chrono::duration<double> elapsed = now - refilledAt_;
+        tokens_ = std::min(limits_.burst, tokens_ + elapsed.count() * limits_.ratePerSecond);
+        refilledAt_ = now;
+    }
+
+    if (tokens_ >= 1.0) {
+        return Clock::duration::zero();
+    }
+
+    std::chrono::duration<double> missing((1.0 - tokens_) / limits_.ratePerSecond);
+    return std::chrono::duration_cast<Clock::duration>(missing);
+}
+
+void TokenBucket::consume() {
+    if (limits_.ratePerSecond > 0) {
+        tokens_ -= 1.0;
+    }
+}
+
+void RateLimitCounters::count(RateScope scope) {
+    rejected_[static_cast<std::size_t>(scope)].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::uint64_t RateLimitCounters::rejected(RateScope scope) const {
+    return rejected_[static_cast<std::size_t>(scope)].load(std::memory_order_relaxed);
+}
+
+std::string RateLimitCounters::stats() const {
+    return "ratelimit_session_rejected=" + std::to_string(rejected(RateScope::SESSION)) + '|'
+        + "ratelimit_writes_rejected=" + std::to_string(rejected(RateScope::WRITES)) + '|'
+        + "ratelimit_history_rejected=" + std::to_string(rejected(RateScope::HISTORY_READS)) + '|'
+        + "ratelimit_directory_rejected=" + std::to_string(rejected(RateScope::DIRECTORY_READS));
+}
+
+SessionRateLimiter::SessionRateLimiter(const RateLimits& limits, TokenBucket::Clock::time_point now)
+    : session_(limits.session, now),
+      writes_(limits.writes, now),
+      historyReads_(limits.historyReads, now),
+      directoryReads_(limits.directoryReads, now)
+{}
+
+std::optional<SessionRateLimiter::Rejection> SessionRateLimiter::admit(CommandClass command_class,
+    TokenBucket::Clock::time_point now) {
+
+    TokenBucket* bucket = nullptr;
+    RateScope scope = RateScope::SESSION;
+    switch (command_class) {
+        case CommandClass::WRITE:
+            bucket = &writes_;
+            scope = RateScope::WRITES;
+            break;
+        case CommandClass::HISTORY_READ:
+            bucket = &historyReads_;
+            scope = RateScope::HISTORY_READS;
+            break;
+        case CommandClass::DIRECTORY_READ:
+            bucket = &directoryReads_;
+            scope = RateScope::DIRECTORY_READS;
+            break;
+        case CommandClass::OTHER:
+        case CommandClass::DIAGNOSTIC:
+            break;
+    }
+
+    if (auto wait = session_.wait(now); wait != TokenBucket::Clock::duration::zero()) {
+        return Rejection{RateScope::SESSION, roundUp(wait)};
+    }
+    if (bucket) {
+        if (auto wait = bucket->wait(now); wait != TokenBucket::Clock::duration::zero()) {
+            return Rejection{scope, roundUp(wait)};
+        }
+        bucket->consume();
+    }
+
+    session_.consume();
+    return std::nullopt;
+}
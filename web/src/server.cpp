@@ -1,19 +1,81 @@
 #include <iostream>
 
 #include "lib/server.h"
+#include "lib/io_backend.h"
 
+#include "alloc_tracker.h"
+
+
+namespace {
+
+// How late past its grace period a detached user's replay ring may linger.
+constexpr auto kReplaySweepInterval = std::chrono::seconds(1);
+// How late past its TTL a message may linger, and how coarse the chat
+// manager's clock is.
+constexpr auto kClockTickInterval = std::chrono::seconds(1);
+
+} // namespace
 
 Server::Server(std::size_t threadCount,
                std::size_t port,
-               std::shared_ptr<AbstractTimeProvider> timeProvider)
-    : pool_(threadCount),
+               std::shared_ptr<AbstractTimeProvider> timeProvider,
+               ServerOptions options)
+    : timeProvider_(std::move(timeProvider)),
+      pool_(threadCount),
       acceptor_(ioc_),
+      loadProbe_(ioc_),
+      tieringTimer_(ioc_),
+      replaySweep_(ioc_),
+      clockTimer_(ioc_),
       threadCount_(threadCount),
       port_(port),
-      timeProvider_(std::move(timeProvider)),
+      tieringInterval_(options.tieringInterval),
       userManager_(std::make_shared<UserManager>()),
-      chatManager_(std::make_shared<ChatManager>(*timeProvider_, *userManager_))
-{}
+      chatManager_(std::make_shared<ChatManager>(*timeProvider_, *userManager_)),
+      pushHub_(std::make_shared<PushHub>(options.replay, FanoutOptions{threadCount}, ioc_.get_executor())),
+      ioExecutor_(std::make_shared<Executor>("io", 0)),
+      computeExecutor_(std::make_shared<Executor>("compute", options.computeThreads)),
+      overload_(std::make_shared<OverloadController>(options.overload)),
+      rateLimitCounters_(std::make_shared<RateLimitCounters>()),
+      rateLimits_(options.rateLimits),
+      sessionPool_(std::make_shared<SessionPool>(threadCount, options.sessionPool)),
+      coroutineSessions_(options.coroutineSessions),
+      compressionOptions_(options.compression),
+      compressionStats_(options.compression.enabled
+          ? std::make_shared<CompressionStats>(options.compression) : nullptr),
+      capture_(options.capture.file.empty()
+          ? nullptr : std::make_shared<TrafficCapture>(options.capture.file, timeProvider_)),
+      diagnostics_(options.diagnostics),
+      forwardSessionPool_(std::make_shared<SessionPool>(1))
+{
+#if PRISECCHAT_IO_URING
+    if (!options.tiering.spillWriter && IoBackend::uringAvailable()) {
+        auto writer = std::make_shared<UringFileWriter>();
+        options.tiering.spillWriter = [writer](const std::filesystem::path& file, std::span<const std::uint8_t> bytes) {
+            return (*writer)(file, bytes);
+        };
+    }
+#endif
+    chatManager_->setTieringOptions(options.tiering);
+    chatManager_->setDedupOptions(options.dedup);
+    Tracer::configure(options.tracing);
+    if (options.cluster.port != 0) {
+        cluster_ = std::make_shared<ClusterNode>(options.cluster, chatManager_, userManager_, pushHub_);
+        cluster_->setHandler([this](User::UserId user_id, const std::string& line) {
+            return runForwarded(user_id, line);
+        });
+        chatManager_->setPlacement([cluster = std::weak_ptr(cluster_)](ChatManager::ChatRoomId room_id) {
+            auto node = cluster.lock();
+            return !node || node->owns(room_id);
+        });
+    }
+    chatManager_->setEventListener([hub = pushHub_, cluster = std::weak_ptr(cluster_)](const ChatEvent& event) {
+        hub->publish(event);
+        if (auto node = cluster.lock()) {
+            node->publish(event);
+        }
+    });
+}
 
 
 void Server::start() {
@@ -24,6 +86,15 @@ void Server::start() {
         });
     }
 
+    if (cluster_) {
+        try {
+            cluster_->start();
+        } catch (const std::exception& ex) {
+            std::cerr << "Error joining cluster: " << ex.what() << "\n";
+            return;
+        }
+    }
+
     ip::tcp::endpoint endpoint(ip::tcp::v4(), port_);
     boost::system::error_code ec;
 
@@ -52,17 +123,33 @@ void Server::start() {
     }
 
     onAcceptAsync();
+    probeLoad();
+    scheduleTiering();
+    sweepReplay();
+    tickClock();
     pool_.join();
 }
 
 void Server::stop() {
+    if (cluster_) {
+        cluster_->stop();
+    }
+
     boost::system::error_code ec;
     acceptor_.close(ec);
     if (ec) {
         std::cerr << "Error closing acceptor: " << ec.message() << "\n";
     }
 
+    loadProbe_.cancel();
+    tieringTimer_.cancel();
+    replaySweep_.cancel();
+    clockTimer_.cancel();
     ioc_.stop();
+    computeExecutor_->stop();
+    if (capture_) {
+        capture_->flush();
+    }
 }
 
 std::shared_ptr<UserManager> Server::getUserManager() const {
@@ -70,8 +157,13 @@ std::shared_ptr<UserManager> Server::getUserManager() const {
 }
 
 void Server::onAcceptAsync() {
-    auto ws = std::make_shared<websocket::stream<beast::tcp_stream>>(ioc_);
+    AllocScope alloc(AllocTag::SESSION_BUFFERS);
+    auto ws = SessionPool::make<websocket::stream<WireStream>>(sessionPool_, asio::make_strand(ioc_));
     ws->set_option(websocket::stream_base::timeout::suggested(beast::role_type::server));
+    if (compressionStats_) {
+        ws->set_option(permessageDeflate(compressionOptions_));
+        get_lowest_layer(*ws).rate_policy().attach(compressionStats_);
+    }
 
     acceptor_.async_accept(get_lowest_layer(*ws).socket(), [this, ws](boost::system::error_code ec){
         if (ec == asio::error::operation_aborted) {
@@ -83,10 +175,141 @@ void Server::onAcceptAsync() {
             return;
         }
 
-        auto userId = userManager_->registerUser();
-        auto session = std::make_shared<Session>(ws, chatManager_, userManager_, userId);
+        if (overload_->overloaded()) {
+            overload_->countRejectedConnection();
+            beast::get_lowest_layer(*ws).socket().close(ec);
+            onAcceptAsync();
+            return;
+        }
+
+        // A reply queued behind an unacknowledged push would otherwise wait
+        // out the client's delayed ACK.
+        beast::get_lowest_layer(*ws).socket().set_option(ip::tcp::no_delay(true), ec);
+
+        SessionServices services{
+            .chatManager = chatManager_,
+            .userManager = userManager_,
+            .pushHub = pushHub_,
+            .ioExecutor = ioExecutor_,
+            .computeExecutor = computeExecutor_,
+            .overload = overload_,
+            .rateLimitCounters = rateLimitCounters_,
+            .rateLimits = rateLimits_,
+            .sessionPool = sessionPool_,
+            .coroutines = coroutineSessions_,
+            .compression = compressionStats_,
+            .capture = capture_,
+            .cluster = cluster_,
+            .diagnostics = diagnostics_,
+        };
+        std::shared_ptr<Session> session;
+        {
+            AllocScope alloc(AllocTag::SESSION_BUFFERS);
+            session = SessionPool::make<Session>(sessionPool_, ws, services);
+        }
 
         session->start();
         onAcceptAsync();
     });
 }
+
+// The timer fires late by however long the io_context backlog delays it;
+// that lateness is the loop lag fed to the overload controller.
+void Server::probeLoad() {
+    const auto interval = overload_->limits().probeInterval;
+    const auto deadline = std::chrono::steady_clock::now() + interval;
+
+    loadProbe_.expires_at(deadline);
+    loadProbe_.async_wait([this, deadline](boost::system::error_code ec) {
+        if (ec) {
+            return;
+        }
+
+        auto lag = std::chrono::steady_clock::now() - deadline;
+        overload_->recordLoopLag(std::chrono::duration_cast<std::chrono::microseconds>(lag));
+        overload_->recordLockWait(chatManager_->takeLockWait());
+        probeLoad();
+    });
+}
+
+void Server::scheduleTiering() {
+    tieringTimer_.expires_after(tieringInterval_);
+    tieringTimer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) {
+            return;
+        }
+
+        computeExecutor_->execute([manager = chatManager_] {
+            manager->tierIdleRooms();
+        });
+        scheduleTiering();
+    });
+}
+
+void Server::sweepReplay() {
+    replaySweep_.expires_after(kReplaySweepInterval);
+    replaySweep_.async_wait([this](boost::system::error_code ec) {
+        if (ec) {
+            return;
+        }
+
+        pushHub_->expireDetached();
+        sweepReplay();
+    });
+}
+
+// Expiring messages takes the chat manager's exclusive lock, so the tick
+// runs on the compute pool rather than an io thread.
+void Server::tickClock() {
+    clockTimer_.expires_after(kClockTickInterval);
+    clockTimer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) {
+            return;
+        }
+
+        computeExecutor_->execute([clock = timeProvider_] {
+            clock->tick();
+        });
+        tickClock();
+    });
+}
+
+// Runs on a cluster thread. Sessions are reused, so a burst of forwarded
+// commands costs one session per concurrent command.
+std::string Server::runForwarded(User::UserId user_id, const std::string& line) {
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard lock(forwardMutex_);
+        if (!forwardSessions_.empty()) {
+            session = std::move(forwardSessions_.back());
+            forwardSessions_.pop_back();
+        }
+    }
+    if (!session) {
+        auto ws = std::make_shared<websocket::stream<WireStream>>(asio::make_strand(ioc_));
+        SessionServices services{
+            .chatManager = chatManager_,
+            .userManager = userManager_,
+            .pushHub = pushHub_,
+            .ioExecutor = ioExecutor_,
+            .computeExecutor = computeExecutor_,
+            .overload = overload_,
+            .rateLimitCounters = rateLimitCounters_,
+            .rateLimits = rateLimits_,
+            .sessionPool = forwardSessionPool_,
+            // Never started, so it has no loops and no socket to compress.
+            .coroutines = false,
+            .compression = nullptr,
+            // The node the client is attached to already captured the line.
+            .capture = nullptr,
+            // Must not forward again: the command is for a room owned here.
+            .cluster = nullptr,
+        };
+        session = std::make_shared<Session>(ws, services);
+    }
+
+    auto reply = session->runForwarded(user_id, line);
+    std::lock_guard lock(forwardMutex_);
+    forwardSessions_.push_back(std::move(session));
+    return reply;
+}
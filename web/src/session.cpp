@@ -1,25 +1,273 @@
+#include <algorithm>
+#include <charconv>
 #include <iostream>
+#include <span>
+#include <utility>
 
-#include <boost/algorithm/string.hpp>
+#include <boost/asio/co_spawn.hpp>
+#include <boost/asio/detached.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/uuid/string_generator.hpp>
-#include <boost/uuid/uuid_io.hpp>
 
 #include "lib/session.h"
 
 #include "lib/commands.h"
+#include "lib/io_backend.h"
+#include "alloc_tracker.h"
+#include "lock_profiler.h"
+#include "uuid_text.h"
+
+
+namespace {
+
+constexpr std::size_t kSearchResultLimit = 50;
+constexpr std::size_t kDirectoryPageLimit = 100;
+constexpr std::size_t kDirectoryMaxPageLimit = 1000;
+
+// Appends to the reply frame, a recycled string whose capacity survives
+// from earlier replies, so replies are built without touching the heap.
+class ReplyStringBuf : public std::streambuf {
+public:
+    explicit ReplyStringBuf(std::string& out)
+        : out_(out)
+    {}
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            out_.push_back(traits_type::to_char_type(ch));
+        }
+        return ch;
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        out_.append(data, static_cast<std::size_t>(count));
+        return count;
+    }
+
+private:
+    std::string& out_;
+};
+
+// Same tokens as splitting on every space: empty tokens are kept.
+std::pmr::vector<std::string_view> tokenize(std::string_view line, std::pmr::memory_resource* arena) {
+    std::pmr::vector<std::string_view> tokens(arena);
+    tokens.reserve(8);
+
+    std::size_t start = 0;
+    while (true) {
+        auto space = line.find(' ', start);
+        tokens.push_back(line.substr(start, space == std::string_view::npos ? space : space - start));
+        if (space == std::string_view::npos) {
+            return tokens;
+        }
+        start = space + 1;
+    }
+}
+
+// The rest of the line from `token` on; `token` must be a view into `line`,
+// as tokenize returns. Searching for the token's text instead would match
+// an earlier occurrence of it.
+std::string restOfLine(std::string_view line, std::string_view token) {
+    return std::string(line.substr(static_cast<std::size_t>(token.data() - line.data())));
+}
+
+boost::uuids::uuid parseUuid(std::string_view text) {
+    if (auto id = parseUuidText(text)) {
+        return *id;
+    }
+    // Braced and dash-free forms are still accepted, off the fast path.
+    return boost::uuids::string_generator()(text.begin(), text.end());
+}
+
+template <typename Number>
+Number parseNumber(std::string_view text) {
+    Number value{};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || end == text.data()) {
+        throw std::invalid_argument("number");
+    }
+    return value;
+}
+
+// Leading command number, used to attribute allocations before parsing.
+int commandOf(std::string_view line) {
+    int command = AllocTracker::kNoCommand;
+    std::from_chars(line.data(), line.data() + line.size(), command);
+    return command;
+}
+
+// "|alloc_<tag>_live=..|..." for every tag, then "|alloc_cmd_<n>_live=..|..."
+// for every command that allocated.
+void writeAllocStats(std::ostream& ss) {
+    auto write = [&ss](std::string_view name, const AllocTracker::Usage& usage) {
+        ss << "|alloc_" << name << "_live=" << usage.liveBytes
+           << "|alloc_" << name << "_peak=" << usage.peakBytes
+           << "|alloc_" << name << "_count=" << usage.allocations;
+    };
+
+    for (std::size_t tag = 0; tag < std::size_t(AllocTag::COUNT); ++tag) {
+        write(AllocTracker::tagName(AllocTag(tag)), AllocTracker::tagUsage(AllocTag(tag)));
+    }
+    for (const auto& [command, usage] : AllocTracker::commandUsage()) {
+        write("cmd_" + std::to_string(command), usage);
+    }
+}
+
+// Cursor is "<hex name>.<user id>" of the last entry of the previous page.
+std::string encodeCursor(const UserManager::DirectoryEntry& entry) {
+    static constexpr char kHex[] = "0123456789abcdef";
+
+    std::string cursor;
+    cursor.reserve(entry.name.size() * 2 + 37);
+    for (unsigned char c : entry.name) {
+        cursor.push_back(kHex[c >> 4]);
+        cursor.push_back(kHex[c & 0xF]);
+    }
+    cursor.push_back('.');
+    cursor += uuidToString(entry.id);
+    return cursor;
+}
+
+UserManager::DirectoryEntry decodeCursor(const std::string& cursor) {
+    auto dot = cursor.find('.');
+    if (dot == std::string::npos || dot % 2 != 0) {
+        throw std::invalid_argument("cursor");
+    }
+
+    std::string name;
+    for (std::size_t i = 0; i < dot; i += 2) {
+        name.push_back(static_cast<char>(std::stoi(cursor.substr(i, 2), nullptr, 16)));
+    }
+    return {parseUuid(cursor.substr(dot + 1)), std::move(name)};
+}
+
+// "<code> <next cursor or -> id;name|id;name..."
+void writeDirectoryPage(std::ostream& ss, const UserManager& users, OutCommand code,
+    std::string_view prefix, std::span<const std::string_view> args) {
+
+    std::size_t limit = kDirectoryPageLimit;
+    if (!args.empty() && !args[0].empty()) {
+        limit = std::clamp<std::size_t>(parseNumber<std::size_t>(args[0]), 1, kDirectoryMaxPageLimit);
+    }
+
+    std::optional<UserManager::DirectoryEntry> after;
+    if (args.size() > 1) {
+        after = decodeCursor(std::string(args[1]));
+    }
 
+    auto page = users.listUsers(std::string(prefix), after, limit + 1);
+    const bool more = page.size() > limit;
+    if (more) {
+        page.pop_back();
+    }
+
+    ss << int(code) << ' ' << (more ? encodeCursor(page.back()) : "-");
+    if (!page.empty()) {
+        ss << ' ';
+        bool first = true;
+        for (const auto& entry : page) {
+            if (!first) ss << '|';
+            first = false;
+            ss << UuidText{entry.id} << ';' << entry.name;
+        }
+    }
+}
+
+CommandClass classifyLine(const std::string& line) {
+    int cmdInt = 0;
+    try { cmdInt = std::stoi(line); }
+    catch (...) { return CommandClass::OTHER; }
+
+    return classify(static_cast<InCommand>(cmdInt));
+}
+
+bool isHeavy(CommandClass command_class) {
+    return command_class == CommandClass::HISTORY_READ || command_class == CommandClass::DIRECTORY_READ
+        || command_class == CommandClass::DIAGNOSTIC;
+}
+
+// Commands whose first argument is the room they act on.
+bool isRoomScoped(InCommand command) {
+    switch (command) {
+        case InCommand::DELETE_CHAT:
+        case InCommand::ADD_PARTICIPANT:
+        case InCommand::REMOVE_PARTICIPANT:
+        case InCommand::SEND_MESSAGE:
+        case InCommand::SEND_MESSAGE_ONCE:
+        case InCommand::EDIT_MESSAGE:
+        case InCommand::REMOVE_MESSAGE:
+        case InCommand::SET_MESSAGE_TTL:
+        case InCommand::GET_HISTORY:
+        case InCommand::LIST_PARTICIPANTS:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::optional<boost::uuids::uuid> roomOf(std::string_view line) {
+    const auto space = line.find(' ');
+    if (!isRoomScoped(InCommand(commandOf(line))) || space == std::string_view::npos) {
+        return std::nullopt;
+    }
+
+    auto argument = line.substr(space + 1);
+    return parseUuidText(argument.substr(0, argument.find(' ')));
+}
+
+// One CHATS_LIST out of every node's; nodes that failed to answer are
+// left out rather than failing the whole list.
+std::string mergeChatLists(const std::vector<std::string>& replies) {
+    std::string merged = std::to_string(int(OutCommand::CHATS_LIST));
+    char separator = ' ';
+    for (const auto& reply : replies) {
+        const auto space = reply.find(' ');
+        if (commandOf(reply) != int(OutCommand::CHATS_LIST) || space == std::string::npos) {
+            continue;
+        }
+        merged.push_back(separator);
+        merged.append(reply, space + 1);
+        separator = '|';
+    }
+    return merged;
+}
+
+} // namespace
 
 Session::Session(
-    std::shared_ptr<websocket::stream<beast::tcp_stream>> websocket,
-    std::shared_ptr<ChatManager> chat_manager,
-    std::shared_ptr<UserManager> user_manager,
-    User::UserId user_id)
+    std::shared_ptr<websocket::stream<WireStream>> websocket,
+    const SessionServices& services)
     : ws_(std::move(websocket))
-    , chatManager_(std::move(chat_manager))
-    , userManager_(std::move(user_manager))
-    , userId_(user_id)
-{}
+    , readPause_(ws_->get_executor())
+    , chatManager_(services.chatManager)
+    , userManager_(services.userManager)
+    , pushHub_(services.pushHub)
+    , ioExecutor_(services.ioExecutor)
+    , computeExecutor_(services.computeExecutor)
+    , overload_(services.overload)
+    , rateLimitCounters_(services.rateLimitCounters)
+    , rateLimiter_(services.rateLimits)
+    , sessionPool_(services.sessionPool)
+    , coroutines_(services.coroutines)
+    , compression_(services.compression)
+    , capture_(services.capture)
+    , cluster_(services.cluster)
+    , diagnostics_(services.diagnostics)
+    , writeSignal_(ws_->get_executor())
+{
+    sessionPool_->sessionOpened();
+    account(residentFixed_, sizeof(Session) + sizeof(websocket::stream<WireStream>));
+}
+
+Session::~Session() {
+    overload_->removeOutboundBytes(queuedBytes_);
+    sessionPool_->sessionClosed();
+    sessionPool_->adjustResident(-std::ptrdiff_t(residentFixed_ + residentReadBuffer_ + residentArena_
+        + residentQueue_ + residentSpares_));
+}
 
 void Session::start() {
     ws_->async_accept([
@@ -29,86 +277,459 @@ void Session::start() {
                 std::cerr << "WebSocket handshake error: " << ec.message() << "\n";
                 return;
             }
-            std::string payload = to_string(self->userId_);
+
+            if (self->capture_) {
+                self->captureSession_ = self->capture_->openSession();
+            }
+            self->userId_ = self->userManager_->registerEphemeralUser();
+            self->announceUser(self->userId_);
+            self->pushHub_->attach(self->userId_, self);
+            std::string payload = uuidToString(self->userId_);
             self->writeAsync(std::to_string(int(OutCommand::USER_CREATED)) + " " + payload);
 
-            self->doRead();
+            if (self->coroutines_) {
+                asio::co_spawn(self->ws_->get_executor(), self->readLoop(self), asio::detached);
+                asio::co_spawn(self->ws_->get_executor(), self->writeLoop(self), asio::detached);
+            } else {
+                self->doRead();
+            }
         });
 }
 
+void Session::logReadError(boost::system::error_code ec) {
+    if (ec == websocket::error::closed) {
+        std::cout << "Connection closed\n";
+    } else {
+        std::cerr << "Read error: " << ec.message() << "\n";
+    }
+}
+
+std::string Session::takeLine() {
+    std::string line;
+    {
+        AllocScope alloc(AllocTag::SESSION_BUFFERS);
+        line = beast::buffers_to_string(buffer_.cdata());
+        buffer_.consume(buffer_.size());
+        if (buffer_.capacity() > kReadBufferRetainBytes) {
+            buffer_.shrink_to_fit();
+        }
+    }
+    account(residentReadBuffer_, buffer_.capacity());
+    if (capture_) {
+        capture_->command(captureSession_, line);
+    }
+    return line;
+}
+
 void Session::doRead() {
     ws_->async_read(buffer_, [
         self = shared_from_this()
         ](boost::system::error_code ec, std::size_t) {
             if (ec) {
-                if (ec == websocket::error::closed) {
-                    std::cout << "Connection closed\n";
-                } else {
-                    std::cerr << "Read error: " << ec.message() << "\n";
-                }
-                self->userManager_->setLoggedIn(self->userId_, false);
+                self->logReadError(ec);
+                self->onDisconnect();
                 return;
             }
 
-            const std::string line = beast::buffers_to_string(self->buffer_.cdata());
-            self->buffer_.consume(self->buffer_.size());
+            TraceContext trace(Tracer::sample());
+            TraceScope span("Session::doRead");
 
-            std::string reply = self->dispatchCommand(line);
-            if (!reply.empty()) {
-                self->writeAsync(reply);
-            }
+            self->execute(self->takeLine());
+        });
+}
+
+// Heavy reads run on the compute executor; the next read is armed only
+// after the reply is queued, so replies keep the order of requests.
+void Session::execute(std::string line) {
+    const auto commandClass = classifyLine(line);
 
-            self->doRead();
+    if (auto pause = refuse(commandClass)) {
+        if (pause->count() > 0) {
+            pauseReads(*pause);
+        } else {
+            doRead();
+        }
+        return;
+    }
+
+    auto done = [self = shared_from_this()](std::string reply, std::uint64_t trace) {
+        if (!reply.empty()) {
+            self->writeAsync(std::move(reply), trace);
+        }
+
+        self->doRead();
+    };
+    if (routesToCluster(line)) {
+        runOnCluster(std::move(line), Tracer::current(), std::move(done));
+    } else {
+        runOnExecutor(std::move(line), commandClass, Tracer::current(), std::move(done));
+    }
+}
+
+// Under overload heavy reads are shed so that writes stay responsive.
+// A client over its rate budget is rejected and not read from until the
+// bucket refills, so further commands back up in its TCP window.
+// Returns how long to stop reading when the command is refused (zero when
+// it is shed); the error reply is already queued.
+std::optional<std::chrono::milliseconds> Session::refuse(CommandClass command_class) {
+    if (auto rejection = rateLimiter_.admit(command_class, TokenBucket::Clock::now())) {
+        rateLimitCounters_->count(rejection->scope);
+        writeAsync(std::to_string(int(OutCommand::ERRORR)) + ' ' + std::to_string(int(ErrorCode::RATE_LIMITED))
+            + ' ' + std::to_string(rejection->retryAfter.count()));
+        return rejection->retryAfter;
+    }
+
+    if (isHeavy(command_class) && overload_->overloaded()) {
+        overload_->countShedCommand();
+        writeAsync(std::to_string(int(OutCommand::ERRORR)) + ' ' + std::to_string(int(ErrorCode::SERVER_BUSY))
+            + ' ' + std::to_string(overload_->retryAfter().count()));
+        return std::chrono::milliseconds{0};
+    }
+
+    return std::nullopt;
+}
+
+// `done` receives the reply on the session strand.
+template <typename Done>
+void Session::runOnExecutor(std::string line, CommandClass command_class, std::uint64_t trace, Done done) {
+    auto& executor = isHeavy(command_class) ? *computeExecutor_ : *ioExecutor_;
+
+    executor.execute([self = shared_from_this(), line = std::move(line), done = std::move(done), trace,
+        postedAt = Tracer::now()]() mutable {
+
+        Tracer::record("Session::queueWait", trace, postedAt, Tracer::now());
+
+        std::string reply;
+        {
+            TraceContext context(trace);
+            TraceScope span("Session::dispatchCommand");
+            reply = self->dispatchCommand(line);
+        }
+
+        asio::dispatch(self->ws_->get_executor(), [done = std::move(done), reply = std::move(reply), trace]() mutable {
+            done(std::move(reply), trace);
+        });
+    });
+}
+
+bool Session::routesToCluster(const std::string& line) const {
+    if (!cluster_) {
+        return false;
+    }
+    if (commandOf(line) == int(InCommand::LIST_CHATS)) {
+        return true;
+    }
+
+    auto room = roomOf(line);
+    return room && !cluster_->owns(*room);
+}
+
+// Like runOnExecutor, but the reply comes from other nodes; `done` still
+// receives it on the session strand.
+template <typename Done>
+void Session::runOnCluster(std::string line, std::uint64_t trace, Done done) {
+    auto deliver = [self = shared_from_this(), done = std::move(done), trace](std::string reply) {
+        asio::dispatch(self->ws_->get_executor(), [done, reply = std::move(reply), trace]() mutable {
+            done(std::move(reply), trace);
         });
+    };
+
+    if (auto room = roomOf(line)) {
+        cluster_->forward(*room, userId_, std::move(line), std::move(deliver));
+        return;
+    }
+
+    cluster_->gather(userId_, std::move(line), [deliver = std::move(deliver)](std::vector<std::string> replies) {
+        deliver(mergeChatLists(replies));
+    });
+}
+
+std::string Session::runForwarded(User::UserId user_id, const std::string& line) {
+    userId_ = user_id;
+    return dispatchCommand(line);
+}
+
+// The same pipeline as doRead/execute, as one loop: the next frame is read
+// only once the reply is queued, while writeLoop drains the queue on its
+// own, so a slow reader never stalls the next command's dispatch.
+asio::awaitable<void> Session::readLoop([[maybe_unused]] std::shared_ptr<Session> self) {
+    while (true) {
+        boost::system::error_code ec;
+        co_await ws_->async_read(buffer_, asio::redirect_error(asio::use_awaitable, ec));
+        if (ec) {
+            logReadError(ec);
+            onDisconnect();
+            closeWriteLoop();
+            co_return;
+        }
+
+        const auto trace = Tracer::sample();
+        std::string line;
+        CommandClass commandClass;
+        std::optional<std::chrono::milliseconds> pause;
+        {
+            TraceContext context(trace);
+            TraceScope span("Session::doRead");
+            line = takeLine();
+            commandClass = classifyLine(line);
+            pause = refuse(commandClass);
+        }
+
+        if (pause) {
+            if (pause->count() > 0) {
+                readPause_.expires_after(*pause);
+                co_await readPause_.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+            }
+            continue;
+        }
+
+        std::string reply;
+        auto& executor = isHeavy(commandClass) ? *computeExecutor_ : *ioExecutor_;
+        const bool clustered = routesToCluster(line);
+        if (executor.isInline() && !clustered) {
+            // Completes before returning: `done` is dispatched onto the strand we are already on.
+            runOnExecutor(std::move(line), commandClass, trace, [&reply](std::string out, std::uint64_t) {
+                reply = std::move(out);
+            });
+        } else {
+            reply = co_await asio::async_initiate<decltype(asio::use_awaitable), void(std::string)>(
+                [this, commandClass, trace, clustered](auto handler, std::string line) {
+                    // Executor tasks must be copyable; the handler is move-only.
+                    auto shared = std::make_shared<decltype(handler)>(std::move(handler));
+                    auto done = [shared](std::string reply, std::uint64_t) {
+                        (*shared)(std::move(reply));
+                    };
+                    if (clustered) {
+                        runOnCluster(std::move(line), trace, std::move(done));
+                    } else {
+                        runOnExecutor(std::move(line), commandClass, trace, std::move(done));
+                    }
+                },
+                asio::use_awaitable, std::move(line));
+        }
+
+        if (!reply.empty()) {
+            writeAsync(std::move(reply), trace);
+        }
+    }
 }
 
-void Session::writeAsync(const std::string& message) {
-    std::lock_guard lock(messageQueueMutex_);
-    messageQueue_.emplace_back(message);
+// Sleeps on writeSignal_ while the queue is empty; enqueue() cancels the
+// wait. Both loops run on the session strand, so the queue needs no lock.
+asio::awaitable<void> Session::writeLoop([[maybe_unused]] std::shared_ptr<Session> self) {
+    while (!writesClosed_) {
+        if (messageQueue_.empty()) {
+            writeSignal_.expires_at(asio::steady_timer::time_point::max());
+            boost::system::error_code ec;
+            co_await writeSignal_.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+            continue;
+        }
 
-    if (messageQueue_.size() == 1) {
-        doWrite();
+        boost::system::error_code ec;
+        co_await ws_->async_write(beginWrite(), asio::redirect_error(asio::use_awaitable, ec));
+        if (ec) {
+            std::cerr << "Write error: " << ec.message() << "\n";
+            co_return;
+        }
+        finishWrite();
     }
 }
 
+void Session::closeWriteLoop() {
+    writesClosed_ = true;
+    writeSignal_.cancel();
+}
+
+void Session::pauseReads(std::chrono::milliseconds delay) {
+    readPause_.expires_after(delay);
+    readPause_.async_wait([self = shared_from_this()](boost::system::error_code) {
+        self->doRead();
+    });
+}
+
+void Session::onDisconnect() {
+    if (capture_) {
+        capture_->closeSession(captureSession_);
+    }
+    if (pushHub_->detach(userId_, this)) {
+        userManager_->setLoggedIn(userId_, false);
+    }
+    releaseUser(userId_);
+}
+
+void Session::switchUser(User::UserId user_id) {
+    pushHub_->detach(userId_, this);
+    releaseUser(userId_);
+
+    userId_ = user_id;
+    pushHub_->attach(userId_, shared_from_this());
+}
+
+// Other nodes keep a copy of every user so rooms there can refer to it.
+void Session::announceUser(User::UserId user_id) {
+    if (!cluster_) {
+        return;
+    }
+    if (auto user = userManager_->getUser(user_id)) {
+        cluster_->announceUser(user_id, user->name, user->ephemeral);
+    }
+}
+
+// releaseUser leaves adopted copies alone, so only the home node of an
+// ephemeral user tells the others to drop theirs.
+void Session::releaseUser(User::UserId user_id) {
+    if (userManager_->releaseUser(user_id) && cluster_) {
+        cluster_->releaseUser(user_id);
+    }
+}
+
+void Session::writeAsync(std::string message, std::uint64_t trace) {
+    if (capture_) {
+        capture_->reply(captureSession_, message);
+    }
+    enqueue({nullptr, std::move(message), trace, trace ? Tracer::now() : 0, 0});
+}
+
+void Session::push(PushHub::Frame frame) {
+    enqueue({std::move(frame), {}, 0, 0, 0});
+}
+
+void Session::enqueue(Outbound outbound) {
+    asio::dispatch(ws_->get_executor(), [self = shared_from_this(), outbound = std::move(outbound)]() mutable {
+        AllocScope alloc(AllocTag::OUTBOUND_QUEUES);
+        const auto size = outbound.payload().size();
+        self->queuedBytes_ += size;
+        self->overload_->addOutboundBytes(size);
+        self->messageQueue_.push_back(std::move(outbound));
+        self->account(self->residentQueue_, self->queuedBytes_);
+
+        if (self->coroutines_) {
+            self->writeSignal_.cancel();
+        } else if (self->messageQueue_.size() == 1) {
+            self->doWrite();
+        }
+    });
+}
+
+void Session::supersede() {
+    asio::dispatch(ws_->get_executor(), [self = shared_from_this()] {
+        beast::get_lowest_layer(*self->ws_).close();
+    });
+}
+
+asio::const_buffer Session::beginWrite() {
+    auto& next = messageQueue_.front();
+    if (next.trace) {
+        next.writeStartedAt = Tracer::now();
+        Tracer::record("Session::writeQueue", next.trace, next.queuedAt, next.writeStartedAt);
+    }
+
+    ws_->text(ws_->got_text());
+    return asio::buffer(next.payload());
+}
+
+void Session::finishWrite() {
+    auto& sent = messageQueue_.front();
+    Tracer::record("Session::doWrite", sent.trace, sent.writeStartedAt, Tracer::now());
+
+    const auto written = sent.payload().size();
+    if (compression_) {
+        compression_->recordMessage(sent.payload());
+    }
+    queuedBytes_ -= written;
+    overload_->removeOutboundBytes(written);
+    if (!sent.frame) {
+        recycleFrame(std::move(sent.owned));
+    }
+    messageQueue_.pop_front();
+    account(residentQueue_, queuedBytes_);
+}
+
 void Session::doWrite() {
     if (messageQueue_.empty()) {
         return;
     }
 
-    ws_->text(ws_->got_text());
-    ws_->async_write(asio::buffer(messageQueue_.front()),
-        [self = shared_from_this()](boost::system::error_code ec, std::size_t ...) {
+    ws_->async_write(beginWrite(), [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
         if (ec) {
             std::cerr << "Write error: " << ec.message() << "\n";
             return;
         }
 
-        {
-            std::lock_guard lock(self->messageQueueMutex_);
-            self->messageQueue_.pop_front();
-        }
-
+        self->finishWrite();
         if (!self->messageQueue_.empty()) {
             self->doWrite();
         }
     });
 }
 
+// Everything a command builds lives in the arena, except the reply, which
+// is written straight into a recycled frame and moved out to the writer.
 std::string Session::dispatchCommand(const std::string& line) {
-    std::stringstream ss;
-    std::vector<std::string> tokens;
-    split(tokens, line, boost::is_any_of(" "));
+    AllocScope alloc(AllocTag::DISPATCH_TEMPORARIES, commandOf(line));
+    std::string reply = takeSpareFrame();
+    runCommand(line, reply);
+
+    arena_.release();
+    if (arenaUpstream_.bytes() > kArenaRetainBytes) {
+        arenaPool_.release();
+    }
+    account(residentArena_, arenaUpstream_.bytes());
+    return reply;
+}
+
+std::string Session::takeSpareFrame() {
+    std::lock_guard lock(spareMutex_);
+    if (spareFrames_.empty()) {
+        return {};
+    }
+
+    std::string frame = std::move(spareFrames_.back());
+    spareFrames_.pop_back();
+    account(residentSpares_, residentSpares_ - frame.capacity());
+    return frame;
+}
+
+// Oversized frames are dropped so an idle session does not keep them.
+void Session::recycleFrame(std::string frame) {
+    if (frame.capacity() > kSpareFrameMaxBytes) {
+        return;
+    }
+
+    std::lock_guard lock(spareMutex_);
+    if (spareFrames_.size() < kSpareFrames) {
+        frame.clear();
+        account(residentSpares_, residentSpares_ + frame.capacity());
+        spareFrames_.push_back(std::move(frame));
+    }
+}
+
+void Session::account(std::size_t& reported, std::size_t now) {
+    sessionPool_->adjustResident(std::ptrdiff_t(now) - std::ptrdiff_t(reported));
+    reported = now;
+}
+
+void Session::runCommand(const std::string& line, std::string& reply) {
+    reply.clear();
+    reply.reserve(kReplyReserve);
+    ReplyStringBuf buffer(reply);
+    std::ostream ss(&buffer);
+
+    auto tokens = tokenize(line, &arena_);
 
     if (tokens.empty()) {
-        return std::to_string(int(OutCommand::ERRORR)) + ' ' +
+        reply = std::to_string(int(OutCommand::ERRORR)) + ' ' +
             std::to_string(int(ErrorCode::INCORRECT_FORMAT));
+        return;
     }
 
     int cmdInt = 0;
-    try { cmdInt = std::stoi(tokens[0]); }
-    catch (...) { return std::to_string(int(OutCommand::ERRORR)) + ' ' +
-            std::to_string(int(ErrorCode::INCORRECT_FORMAT)); }
+    try { cmdInt = parseNumber<int>(tokens[0]); }
+    catch (...) {
+        reply = std::to_string(int(OutCommand::ERRORR)) + ' ' +
+            std::to_string(int(ErrorCode::INCORRECT_FORMAT));
+        return;
+    }
 
 
     const auto cmd = static_cast<InCommand>(cmdInt);
@@ -120,9 +741,10 @@ std::string Session::dispatchCommand(const std::string& line) {
                     break;
                 }
 
-                const std::string& newName = tokens[1];
+                const std::string newName(tokens[1]);
                 bool ok = userManager_->renameUser(userId_, newName);
                 if (ok) {
+                    announceUser(userId_);
                     ss << static_cast<int>(OutCommand::USER_RENAMED);
                 } else {
                     ss << static_cast<int>(OutCommand::ERRORR) << ' ' << static_cast<int>(ErrorCode::ERROR_USER_RENAME);
@@ -137,13 +759,13 @@ std::string Session::dispatchCommand(const std::string& line) {
                     break;
                 }
 
-                boost::uuids::uuid other = boost::uuids::string_generator()(tokens[1]);
-                const std::string& name = tokens[2];
+                boost::uuids::uuid other = parseUuid(tokens[1]);
+                const std::string name(tokens[2]);
                 auto chatId = chatManager_->createPersonalChat(name, userId_, other);
                 if (chatId.is_nil()) {
                     ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::ERROR_CHAT_CREATE);
                 } else {
-                    ss << int(OutCommand::CHAT_CREATED) << ' ' << to_string(chatId);
+                    ss << int(OutCommand::CHAT_CREATED) << ' ' << UuidText{chatId};
                 }
 
                 break;
@@ -155,13 +777,13 @@ std::string Session::dispatchCommand(const std::string& line) {
                     break;
                 }
 
-                const std::string& name = tokens[1];
+                const std::string name(tokens[1]);
                 auto chatId = chatManager_->createOpenGroup(name, userId_);
 
                 if (chatId.is_nil()) {
                     ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::ERROR_CHAT_CREATE);
                 } else {
-                    ss << int(OutCommand::CHAT_CREATED) << ' ' << to_string(chatId);
+                    ss << int(OutCommand::CHAT_CREATED) << ' ' << UuidText{chatId};
                 }
 
                 break;
@@ -173,13 +795,31 @@ std::string Session::dispatchCommand(const std::string& line) {
                     break;
                 }
 
-                const std::string& name = tokens[1];
+                const std::string name(tokens[1]);
                 auto chatId = chatManager_->createCloseGroup(name, userId_);
 
                 if (chatId.is_nil()) {
                     ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::ERROR_CHAT_CREATE);
                 } else {
-                    ss << int(OutCommand::CHAT_CREATED) << ' ' << to_string(chatId);
+                    ss << int(OutCommand::CHAT_CREATED) << ' ' << UuidText{chatId};
+                }
+
+                break;
+            }
+
+            case InCommand::CREATE_BROADCAST: {
+                if (tokens.size() < 2) {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
+                    break;
+                }
+
+                const std::string name(tokens[1]);
+                auto chatId = chatManager_->createBroadcastChat(name, userId_);
+
+                if (chatId.is_nil()) {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::ERROR_CHAT_CREATE);
+                } else {
+                    ss << int(OutCommand::CHAT_CREATED) << ' ' << UuidText{chatId};
                 }
 
                 break;
@@ -191,7 +831,7 @@ std::string Session::dispatchCommand(const std::string& line) {
                     break;
                 }
 
-                boost::uuids::uuid chatId = boost::uuids::string_generator()(tokens[1]);
+                boost::uuids::uuid chatId = parseUuid(tokens[1]);
                 bool ok = chatManager_->deleteChat(chatId, userId_);
 
                 if (ok) {
@@ -209,8 +849,8 @@ std::string Session::dispatchCommand(const std::string& line) {
                     break;
                 }
 
-                boost::uuids::uuid chatId = boost::uuids::string_generator()(tokens[1]);
-                boost::uuids::uuid toAdd  = boost::uuids::string_generator()(tokens[2]);
+                boost::uuids::uuid chatId = parseUuid(tokens[1]);
+                boost::uuids::uuid toAdd  = parseUuid(tokens[2]);
                 bool ok = chatManager_->addParticipant(chatId, userId_, toAdd);
 
                 if (ok) {
@@ -228,8 +868,8 @@ std::string Session::dispatchCommand(const std::string& line) {
                     break;
                 }
 
-                boost::uuids::uuid chatId    = boost::uuids::string_generator()(tokens[1]);
-                boost::uuids::uuid toRemove  = boost::uuids::string_generator()(tokens[2]);
+                boost::uuids::uuid chatId    = parseUuid(tokens[1]);
+                boost::uuids::uuid toRemove  = parseUuid(tokens[2]);
                 bool ok = chatManager_->removeParticipant(chatId, userId_, toRemove);
 
                 if (ok) {
@@ -247,8 +887,8 @@ std::string Session::dispatchCommand(const std::string& line) {
                     break;
                 }
 
-                boost::uuids::uuid chatId = boost::uuids::string_generator()(tokens[1]);
-                std::string text = line.substr(line.find(tokens[2]));
+                boost::uuids::uuid chatId = parseUuid(tokens[1]);
+                std::string text = restOfLine(line, tokens[2]);
                 bool ok = chatManager_->sendMessage(chatId, userId_, text);
 
                 if (ok) {
@@ -260,17 +900,34 @@ std::string Session::dispatchCommand(const std::string& line) {
                 break;
             }
 
+            case InCommand::SEND_MESSAGE_ONCE: {
+                if (tokens.size() < 4) {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
+                    break;
+                }
+
+                boost::uuids::uuid chatId = parseUuid(tokens[1]);
+                std::string text = restOfLine(line, tokens[3]);
+                auto messageId = chatManager_->sendMessage(chatId, userId_, text, tokens[2]);
+
+                if (messageId) {
+                    ss << int(OutCommand::MESSAGE_SENT) << ' ' << UuidText{*messageId};
+                } else {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::ERROR_SEND_MESSAGE);
+                }
+
+                break;
+            }
+
             case InCommand::EDIT_MESSAGE: {
                 if (tokens.size() < 4) {
                     ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
                     break;
                 }
 
-                boost::uuids::uuid chatId = boost::uuids::string_generator()(tokens[1]);
-                boost::uuids::uuid msgId  = boost::uuids::string_generator()(tokens[2]);
-                std::string newText = line.substr(
-                    line.find(tokens[2]) + tokens[2].length() + 1
-                );
+                boost::uuids::uuid chatId = parseUuid(tokens[1]);
+                boost::uuids::uuid msgId  = parseUuid(tokens[2]);
+                std::string newText = restOfLine(line, tokens[3]);
                 bool ok = chatManager_->editMessage(chatId, userId_, msgId, newText);
 
                 if (ok) {
@@ -288,8 +945,8 @@ std::string Session::dispatchCommand(const std::string& line) {
                     break;
                 }
 
-                boost::uuids::uuid chatId = boost::uuids::string_generator()(tokens[1]);
-                boost::uuids::uuid msgId  = boost::uuids::string_generator()(tokens[2]);
+                boost::uuids::uuid chatId = parseUuid(tokens[1]);
+                boost::uuids::uuid msgId  = parseUuid(tokens[2]);
                 bool ok = chatManager_->removeMessage(chatId, userId_, msgId);
 
                 if (ok) {
@@ -301,43 +958,63 @@ std::string Session::dispatchCommand(const std::string& line) {
                 break;
             }
 
+            case InCommand::SET_MESSAGE_TTL: {
+                if (tokens.size() < 3) {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
+                    break;
+                }
+
+                boost::uuids::uuid chatId = parseUuid(tokens[1]);
+                std::chrono::seconds ttl{parseNumber<std::int64_t>(tokens[2])};
+                bool ok = chatManager_->setMessageTtl(chatId, userId_, ttl);
+
+                if (ok) {
+                    ss << int(OutCommand::TTL_SET);
+                } else {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::ERROR_SET_TTL);
+                }
+
+                break;
+            }
+
             case InCommand::GET_HISTORY: {
                 if (tokens.size() < 2) {
                     ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
                     break;
                 }
 
-                boost::uuids::uuid chatId = boost::uuids::string_generator()(tokens[1]);
-                auto history = chatManager_->getHistory(chatId);
+                boost::uuids::uuid chatId = parseUuid(tokens[1]);
+                std::optional<boost::uuids::uuid> after;
+                if (tokens.size() >= 3) {
+                    after = parseUuid(tokens[2]);
+                }
                 ss << int(OutCommand::HISTORY);
 
-                if (!history.empty()) {
-                    ss << ' ';
-                    bool first = true;
-                    for (const auto& m : history) {
-                        if (!first) ss << '|';
-                        ss << to_string(m.getId()) << ';'
-                           << m.getAuthorId() << ';'
-                           << m.getText();
-                        first = false;
-                    }
-                }
+                bool first = true;
+                chatManager_->visitHistory(chatId, after, [&ss, &first](const Message& m) {
+                    ss << (first ? ' ' : '|') << UuidText{m.getId()} << ';'
+                       << UuidText{m.getAuthorId()} << ';'
+                       << m.getText();
+                    first = false;
+                });
 
                 break;
             }
 
             case InCommand::LIST_USERS: {
-                auto users = userManager_->getAllUsers();
-                ss << static_cast<int>(OutCommand::USERS_LIST);
-                if (!users.empty()) {
-                    ss << ' ';
-                    bool first = true;
-                    for (auto& [id, name] : users) {
-                        if (!first) ss << '|';
-                        first = false;
-                        ss << to_string(id) << ';' << name;
-                    }
+                writeDirectoryPage(ss, *userManager_, OutCommand::USERS_LIST, "",
+                    std::span(tokens).subspan(1));
+                break;
+            }
+
+            case InCommand::SEARCH_USERS: {
+                if (tokens.size() < 2) {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
+                    break;
                 }
+
+                writeDirectoryPage(ss, *userManager_, OutCommand::USERS_FOUND, tokens[1],
+                    std::span(tokens).subspan(2));
                 break;
             }
 
@@ -346,15 +1023,17 @@ std::string Session::dispatchCommand(const std::string& line) {
                     ss << int(OutCommand::SIGN_UP_FAIL);
                     break;
                 }
-                const std::string name = tokens[1];
+                const std::string name(tokens[1]);
                 if (userManager_->nameExists(name)) {
                     ss << int(OutCommand::SIGN_UP_FAIL);
                 } else {
                     auto newId = userManager_->registerUser();
                     userManager_->renameUser(newId, name);
+                    announceUser(newId);
                     userManager_->setLoggedIn(newId, true);
-                    userId_ = newId;
-                    ss << int(OutCommand::SIGN_UP_SUCCESS) << ' ' << to_string(newId);
+                    switchUser(newId);
+                    ss << int(OutCommand::SIGN_UP_SUCCESS) << ' ' << UuidText{newId} << ' '
+                       << pushHub_->issueResumeToken(newId) << ' ' << pushHub_->lastSequence();
                 }
                 break;
             }
@@ -364,20 +1043,22 @@ std::string Session::dispatchCommand(const std::string& line) {
                     ss << int(OutCommand::SIGN_IN_FAIL);
                     break;
                 }
-                const std::string name = tokens[1];
+                const std::string name(tokens[1]);
                 auto optId = userManager_->findByName(name);
                 if (!optId || userManager_->isLoggedIn(*optId)) {
                     ss << int(OutCommand::SIGN_IN_FAIL);
                 } else {
                     userManager_->setLoggedIn(*optId, true);
-                    userId_ = *optId;
-                    ss << int(OutCommand::SIGN_IN_SUCCESS) << ' ' << to_string(*optId);
+                    switchUser(*optId);
+                    ss << int(OutCommand::SIGN_IN_SUCCESS) << ' ' << UuidText{*optId} << ' '
+                       << pushHub_->issueResumeToken(*optId) << ' ' << pushHub_->lastSequence();
                 }
                 break;
             }
 
             case InCommand::SIGN_OUT: {
                 userManager_->setLoggedIn(userId_, false);
+                pushHub_->revokeResumeToken(userId_);
                 ss << int(OutCommand::SIGN_OUT_SUCCESS);
                 break;
             }
@@ -391,7 +1072,7 @@ std::string Session::dispatchCommand(const std::string& line) {
                     for (auto& cid : chats) {
                         if (!first) ss << '|';
                         first = false;
-                        ss << to_string(cid);
+                        ss << UuidText{cid};
                     }
                 }
                 break;
@@ -402,7 +1083,7 @@ std::string Session::dispatchCommand(const std::string& line) {
                     ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
                     break;
                 }
-                boost::uuids::uuid cid = boost::uuids::string_generator()(tokens[1]);
+                boost::uuids::uuid cid = parseUuid(tokens[1]);
                 auto parts = chatManager_->getChatParticipants(cid);
                 ss << int(OutCommand::PARTICIPANTS_LIST);
                 if (!parts.empty()) {
@@ -411,9 +1092,133 @@ std::string Session::dispatchCommand(const std::string& line) {
                     for (auto& uid : parts) {
                         if (!first) ss << '|';
                         first = false;
-                        ss << to_string(uid);
+                        ss << UuidText{uid};
+                    }
+                }
+                break;
+            }
+
+            case InCommand::SEARCH: {
+                // A query without a single word to look up is malformed.
+                std::string query = tokens.size() < 2 ? std::string() : restOfLine(line, tokens[1]);
+                if (SearchIndex::tokenize(query).empty()) {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
+                    break;
+                }
+
+                auto hits = chatManager_->searchMessages(userId_, query, kSearchResultLimit);
+                ss << int(OutCommand::SEARCH_RESULTS);
+                if (!hits.empty()) {
+                    ss << ' ';
+                    bool first = true;
+                    for (const auto& hit : hits) {
+                        if (!first) ss << '|';
+                        first = false;
+                        ss << UuidText{hit.roomId} << ';' << UuidText{hit.messageId};
+                    }
+                }
+                break;
+            }
+
+            case InCommand::RESUME: {
+                if (tokens.size() < 3) {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
+                    break;
+                }
+
+                auto lastSequence = parseNumber<std::uint64_t>(tokens[2]);
+                auto resumed = pushHub_->resume(std::string(tokens[1]), lastSequence, shared_from_this());
+                if (!resumed) {
+                    ss << int(OutCommand::RESUME_FAIL);
+                    break;
+                }
+
+                for (const auto& stale : resumed->displaced) {
+                    if (stale.get() != this) {
+                        stale->supersede();
                     }
                 }
+
+                userManager_->setLoggedIn(resumed->userId, true);
+                if (resumed->userId != userId_) {
+                    pushHub_->detach(userId_, this);
+                    releaseUser(userId_);
+                    userId_ = resumed->userId;
+                }
+
+                writeAsync(std::to_string(int(OutCommand::RESUME_SUCCESS)) + ' ' + uuidToString(userId_) + ' '
+                    + resumed->token + ' ' + (resumed->complete ? '1' : '0'));
+                for (auto& frame : resumed->missed) {
+                    push(std::move(frame));
+                }
+                break;
+            }
+
+            case InCommand::GET_STATS: {
+                auto users = userManager_->getStats();
+                auto storage = chatManager_->tieringStats();
+                auto dedup = chatManager_->dedupStats();
+                ss << int(OutCommand::STATS) << ' '
+                   << ioExecutor_->stats() << '|'
+                   << computeExecutor_->stats() << '|'
+                   << overload_->stats() << '|'
+                   << rateLimitCounters_->stats() << '|'
+                   << sessionPool_->stats() << '|'
+                   << IoBackend::stats() << '|'
+                   << (compression_ ? compression_->stats() : "ws_compression=0") << '|'
+                   << (cluster_ ? cluster_->stats() : "cluster_nodes=1") << '|'
+                   << "push_online_users=" << pushHub_->onlineUsers() << '|'
+                   << "push_resumable_users=" << pushHub_->resumableUsers() << '|'
+                   << "push_last_sequence=" << pushHub_->lastSequence() << '|'
+                   << "users_live=" << users.liveUsers << '|'
+                   << "users_reclaimable=" << users.reclaimableUsers << '|'
+                   << "users_reclaimed=" << users.reclaimedUsers << '|'
+                   << "users_logged_in=" << users.loggedInUsers << '|'
+                   << "search_index_documents=" << chatManager_->searchIndexDocumentCount() << '|'
+                   << "search_index_bytes=" << chatManager_->searchIndexMemoryUsage() << '|'
+                   << "storage_hot_rooms=" << storage.hotRooms << '|'
+                   << "storage_frozen_rooms=" << storage.frozenRooms << '|'
+                   << "storage_spilled_rooms=" << storage.spilledRooms << '|'
+                   << "storage_frozen_messages=" << storage.frozenMessages << '|'
+                   << "storage_resident_frozen_bytes=" << storage.residentFrozenBytes << '|'
+                   << "storage_spilled_bytes=" << storage.spilledBytes << '|'
+                   << "storage_cold_reads=" << storage.coldReads << '|'
+                   << "storage_cold_read_max_us=" << storage.coldReadMaxMicros << '|'
+                   << "dedup_keys=" << dedup.keys << '|'
+                   << "dedup_hits=" << dedup.hits << '|'
+                   << "dedup_conflicts=" << dedup.conflicts << '|'
+                   << "dedup_evicted=" << dedup.evicted;
+                if (AllocTracker::enabled) {
+                    writeAllocStats(ss);
+                }
+                break;
+            }
+
+            case InCommand::GET_LOCK_PROFILE: {
+                if (!diagnostics_) {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::UNKNOWN_COMMAND);
+                    break;
+                }
+
+                ss << int(OutCommand::LOCK_PROFILE);
+
+                bool first = true;
+                for (const auto& site : LockProfiler::report()) {
+                    ss << (first ? ' ' : '|') << site.site << ';' << site.acquisitions << ';' << site.contended
+                       << ';' << site.waitNanos.p50 << ';' << site.waitNanos.p99 << ';' << site.waitNanos.max
+                       << ';' << site.holdNanos.p50 << ';' << site.holdNanos.p99 << ';' << site.holdNanos.max;
+                    first = false;
+                }
+                break;
+            }
+
+            case InCommand::DUMP_TRACE: {
+                if (!diagnostics_) {
+                    ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::UNKNOWN_COMMAND);
+                    break;
+                }
+
+                ss << int(OutCommand::TRACE_DUMP) << ' ' << Tracer::exportChromeTrace();
                 break;
             }
 
@@ -426,6 +1231,4 @@ std::string Session::dispatchCommand(const std::string& line) {
     catch (...) {
         ss << int(OutCommand::ERRORR) << ' ' << int(ErrorCode::INCORRECT_FORMAT);
     }
-
-    return ss.str();
 }
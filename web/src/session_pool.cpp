@@ -0,0 +1,139 @@
+#include "lib/session_pool.h"
+
+#include <algorithm>
+#include <new>
+
+
+namespace {
+
+// Prefix of every pooled block; keeps the payload max-aligned.
+struct alignas(std::max_align_t) BlockHeader {
+    std::size_t shard;
+};
+
+std::atomic<std::size_t> nextThreadSlot{0};
+
+} // namespace
+
+SessionPool::SessionPool(std::size_t shards, SessionPoolOptions options)
+    : options_(options)
+{
+    for (std::size_t i = 0; i < std::max<std::size_t>(shards, 1); ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+SessionPool::~SessionPool() {
+    for (auto& shard : shards_) {
+        for (auto& [bytes, blocks] : shard->free) {
+            for (void* block : blocks) {
+                ::operator delete(block);
+            }
+        }
+    }
+}
+
+std::size_t SessionPool::localShard() const {
+    thread_local const std::size_t slot = nextThreadSlot.fetch_add(1, std::memory_order_relaxed);
+    return slot % shards_.size();
+}
+
+void* SessionPool::allocate(std::size_t bytes) {
+    const auto index = localShard();
+    auto& shard = *shards_[index];
+    {
+        std::lock_guard lock(shard.mutex);
+        for (auto& [size, blocks] : shard.free) {
+            if (size == bytes && !blocks.empty()) {
+                void* block = blocks.back();
+                blocks.pop_back();
+                --shard.cached;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return static_cast<BlockHeader*>(block) + 1;
+            }
+        }
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    auto* header = static_cast<BlockHeader*>(::operator new(sizeof(BlockHeader) + bytes));
+    header->shard = index;
+    return header + 1;
+}
+
+void SessionPool::deallocate(void* block, std::size_t bytes) {
+    auto* header = static_cast<BlockHeader*>(block) - 1;
+    auto& shard = *shards_[header->shard];
+    {
+        std::lock_guard lock(shard.mutex);
+        if (shard.cached < options_.maxCachedPerThread) {
+            auto it = std::find_if(shard.free.begin(), shard.free.end(),
+                [bytes](const auto& entry) { return entry.first == bytes; });
+            if (it == shard.free.end()) {
+                it = shard.free.emplace(shard.free.end(), bytes, std::vector<void*>{});
+            }
+            it->second.push_back(header);
+            ++shard.cached;
+            return;
+        }
+    }
+    ::operator delete(header);
+}
+
+void SessionPool::sessionOpened() {
+    openSessions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SessionPool::sessionClosed() {
+    openSessions_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void SessionPool::adjustResident(std::ptrdiff_t delta) {
+    residentBytes_.fetch_add(delta, std::memory_order_relaxed);
+}
+
+std::size_t SessionPool::openSessions() const {
+    return openSessions_.load(std::memory_order_relaxed);
+}
+
+std::size_t SessionPool::residentBytes() const {
+    return static_cast<std::size_t>(std::max<std::ptrdiff_t>(residentBytes_.load(std::memory_order_relaxed), 0));
+}
+
+std::size_t SessionPool::cachedBlocks() const {
+    std::size_t total = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard lock(shard->mutex);
+        total += shard->cached;
+    }
+    return total;
+}
+
+std::string SessionPool::stats() const {
+    const auto open = openSessions();
+    const auto resident = residentBytes();
+    return "sessions_open=" + std::to_string(open) + '|'
+        + "session_resident_bytes=" + std::to_string(resident) + '|'
+        + "session_resident_bytes_per_conn=" + std::to_string(open ? resident / open : 0) + '|'
+        + "session_pool_cached=" + std::to_string(cachedBlocks()) + '|'
+        + "session_pool_hits=" + std::to_string(hits_.load(std::memory_order_relaxed)) + '|'
+        + "session_pool_misses=" + std::to_string(misses_.load(std::memory_order_relaxed));
+}
+
+std::size_t CountingResource::bytes() const {
+    return bytes_;
+}
+
+void* CountingResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    void* p = std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    bytes_ += bytes;
+    return p;
+}
+
+void CountingResource::do_deallocate(void* p, std::size_t bytes, std::size_t alignment) {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    bytes_ -= bytes;
+}
+
+bool CountingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
@@ -0,0 +1,195 @@
+#include "lib/traffic_capture.h"
+
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+#include "lib/wire_format.h"
+#include "uuid_text.h"
+
+
+namespace {
+
+constexpr char kMagic[8] = {'P', 'S', 'C', 'A', 'P', '\0', '\0', '\1'};
+
+// Anything larger is taken as a corrupt record rather than allocated.
+constexpr std::uint64_t kMaxLineBytes = 64 * 1024 * 1024;
+constexpr std::uint64_t kMaxReplyIds = 1 << 20;
+
+bool getVarint(std::istream& in, std::uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const int byte = in.get();
+        if (byte == std::char_traits<char>::eof()) {
+            return false;
+        }
+        value |= std::uint64_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool getSigned(std::istream& in, std::int64_t& value) {
+    std::uint64_t raw;
+    if (!getVarint(in, raw)) {
+        return false;
+    }
+    value = std::int64_t(raw >> 1) ^ -std::int64_t(raw & 1);
+    return true;
+}
+
+std::int64_t secondsSinceEpoch(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::seconds>(time.time_since_epoch()).count();
+}
+
+} // namespace
+
+TrafficCapture::TrafficCapture(const std::filesystem::path& file, std::shared_ptr<AbstractTimeProvider> clock)
+    : clock_(std::move(clock))
+    , started_(std::chrono::steady_clock::now())
+    , out_(file, std::ios::binary | std::ios::trunc)
+{
+    if (!out_) {
+        throw std::runtime_error("TrafficCapture: cannot open " + file.string());
+    }
+
+    lastClock_ = secondsSinceEpoch(clock_->now());
+    std::string header(kMagic, sizeof(kMagic));
+    putSigned(header, lastClock_);
+    out_.write(header.data(), std::streamsize(header.size()));
+}
+
+std::uint64_t TrafficCapture::openSession() {
+    std::uint64_t session;
+    {
+        std::lock_guard lock(mutex_);
+        session = nextSession_++;
+    }
+    append(CaptureRecord::Kind::OPEN, session, {});
+    return session;
+}
+
+void TrafficCapture::command(std::uint64_t session, std::string_view line) {
+    std::string body;
+    putBytes(body, line);
+    append(CaptureRecord::Kind::COMMAND, session, body);
+}
+
+void TrafficCapture::reply(std::uint64_t session, std::string_view message) {
+    int code = 0;
+    std::from_chars(message.data(), message.data() + message.size(), code);
+    const auto ids = uuidsIn(message);
+
+    std::string body;
+    putSigned(body, code);
+    putVarint(body, ids.size());
+    for (const auto& id : ids) {
+        putUuid(body, id);
+    }
+    append(CaptureRecord::Kind::REPLY, session, body);
+}
+
+void TrafficCapture::closeSession(std::uint64_t session) {
+    append(CaptureRecord::Kind::CLOSE, session, {});
+}
+
+void TrafficCapture::flush() {
+    std::lock_guard lock(mutex_);
+    out_.flush();
+}
+
+// Times are taken under the lock so the deltas in the file never go
+// backwards.
+void TrafficCapture::append(CaptureRecord::Kind kind, std::uint64_t session, std::string_view body) {
+    thread_local std::string record;
+    record.clear();
+
+    std::lock_guard lock(mutex_);
+    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - started_);
+    const auto clock = secondsSinceEpoch(clock_->now());
+
+    record.push_back(char(kind));
+    putVarint(record, session);
+    putVarint(record, std::uint64_t((elapsed - lastElapsed_).count()));
+    putSigned(record, clock - lastClock_);
+    record.append(body);
+    out_.write(record.data(), std::streamsize(record.size()));
+
+    lastElapsed_ = elapsed;
+    lastClock_ = clock;
+}
+
+CaptureReader::CaptureReader(const std::filesystem::path& file)
+    : in_(file, std::ios::binary)
+{
+    char magic[sizeof(kMagic)] = {};
+    in_.read(magic, sizeof(magic));
+    if (!in_ || std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 || !getSigned(in_, clock_)) {
+        throw std::runtime_error("CaptureReader: " + file.string() + " is not a traffic capture");
+    }
+}
+
+std::optional<CaptureRecord> CaptureReader::next() {
+    const int kind = in_.get();
+    if (kind == std::char_traits<char>::eof() || kind > int(CaptureRecord::Kind::CLOSE)) {
+        return std::nullopt;
+    }
+
+    CaptureRecord record;
+    record.kind = CaptureRecord::Kind(kind);
+    std::uint64_t elapsedDelta;
+    std::int64_t clockDelta;
+    if (!getVarint(in_, record.session) || !getVarint(in_, elapsedDelta) || !getSigned(in_, clockDelta)) {
+        return std::nullopt;
+    }
+
+    if (record.kind == CaptureRecord::Kind::COMMAND) {
+        std::uint64_t size;
+        if (!getVarint(in_, size) || size > kMaxLineBytes) {
+            return std::nullopt;
+        }
+        record.line.resize(size);
+        if (!in_.read(record.line.data(), std::streamsize(size))) {
+            return std::nullopt;
+        }
+    } else if (record.kind == CaptureRecord::Kind::REPLY) {
+        std::int64_t code;
+        std::uint64_t count;
+        if (!getSigned(in_, code) || !getVarint(in_, count) || count > kMaxReplyIds) {
+            return std::nullopt;
+        }
+        record.code = int(code);
+        record.ids.resize(count);
+        for (auto& id : record.ids) {
+            if (!in_.read(reinterpret_cast<char*>(id.data), sizeof(id.data))) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    elapsed_ += std::chrono::microseconds(elapsedDelta);
+    clock_ += clockDelta;
+    record.elapsed = elapsed_;
+    record.clockSeconds = clock_;
+    return record;
+}
+
+std::vector<boost::uuids::uuid> uuidsIn(std::string_view text) {
+    std::vector<boost::uuids::uuid> ids;
+    for (std::size_t at = 0; at + kUuidTextLength <= text.size();) {
+        const bool boundary = at == 0 || !std::isxdigit(static_cast<unsigned char>(text[at - 1]));
+        if (boundary && text[at + 8] == '-') {
+            if (auto id = parseUuidText(text.substr(at, kUuidTextLength))) {
+                ids.push_back(*id);
+                at += kUuidTextLength;
+                continue;
+            }
+        }
+        ++at;
+    }
+    return ids;
+}
@@ -0,0 +1,402 @@
+#include "lib/traffic_replay.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+
+#include "lib/commands.h"
+#include "lib/traffic_capture.h"
+#include "uuid_text.h"
+
+
+namespace {
+
+namespace beast = boost::beast;
+namespace websocket = beast::websocket;
+namespace asio = boost::asio;
+using tcp = asio::ip::tcp;
+using ReplayClock = std::chrono::steady_clock;
+
+// What the capture says the reply to a command was, if it got one.
+struct Expected {
+    bool known = false;
+    int  code = 0;
+    std::vector<boost::uuids::uuid> ids;
+};
+
+struct Step {
+    CaptureRecord record;
+    Expected      expected;
+};
+
+// The USER_CREATED a session gets on connect; not a command, so it is
+// left out of the latencies.
+constexpr int kGreeting = -1;
+
+struct Pending {
+    ReplayClock::time_point sentAt;
+    int      command = 0;
+    Expected expected;
+};
+
+// State shared by the driving thread and the client io thread.
+struct Run {
+    std::mutex              mutex;
+    std::condition_variable answered;
+    std::size_t             inFlight = 0;
+    std::map<boost::uuids::uuid, boost::uuids::uuid> ids;   // captured -> replayed
+    ReplayReport            report;
+    std::vector<std::uint64_t> latencies;
+    std::map<int, std::vector<std::uint64_t>> latenciesByCommand;
+};
+
+int leadingCode(std::string_view text) {
+    int code = 0;
+    std::from_chars(text.data(), text.data() + text.size(), code);
+    return code;
+}
+
+bool isPush(int code) {
+    return code == int(OutCommand::PUSH_MSG_SENT) || code == int(OutCommand::PUSH_MSG_EDITED)
+        || code == int(OutCommand::PUSH_MSG_REMOVED);
+}
+
+// Each open and command gets exactly one direct reply, in order per
+// session, so replies pair with them first-in first-out.
+std::vector<Step> loadSteps(const std::filesystem::path& capture) {
+    CaptureReader reader(capture);
+    std::vector<Step> steps;
+    std::map<std::uint64_t, std::deque<std::size_t>> awaiting;
+
+    while (auto record = reader.next()) {
+        if (record->kind == CaptureRecord::Kind::REPLY) {
+            auto& queue = awaiting[record->session];
+            if (!queue.empty()) {
+                auto& expected = steps[queue.front()].expected;
+                expected.known = true;
+                expected.code = record->code;
+                expected.ids = std::move(record->ids);
+                queue.pop_front();
+            }
+            continue;
+        }
+
+        if (record->kind != CaptureRecord::Kind::CLOSE) {
+            awaiting[record->session].push_back(steps.size());
+        }
+        steps.push_back({std::move(*record), {}});
+    }
+    return steps;
+}
+
+// Swaps every captured id in `line` for the replayed one. Returns false if
+// some id has no mapping yet.
+bool rewriteIds(std::string& line, const std::map<boost::uuids::uuid, boost::uuids::uuid>& ids) {
+    bool complete = true;
+    for (std::size_t at = 0; at + kUuidTextLength <= line.size();) {
+        const bool boundary = at == 0 || !std::isxdigit(static_cast<unsigned char>(line[at - 1]));
+        auto id = boundary ? parseUuidText(std::string_view(line).substr(at, kUuidTextLength)) : std::nullopt;
+        if (!id) {
+            ++at;
+            continue;
+        }
+
+        if (auto found = ids.find(*id); found != ids.end()) {
+            formatUuid(found->second, line.data() + at);
+        } else {
+            complete = false;
+        }
+        at += kUuidTextLength;
+    }
+    return complete;
+}
+
+// One replayed session. Everything but connect() runs on the io thread.
+class Client : public std::enable_shared_from_this<Client> {
+public:
+    Client(asio::io_context& ioc, Run& run)
+        : ws_(ioc)
+        , run_(run)
+    {}
+
+    void connect(const tcp::resolver::results_type& endpoints, const std::string& host) {
+        beast::get_lowest_layer(ws_).connect(endpoints);
+        beast::get_lowest_layer(ws_).socket().set_option(tcp::no_delay(true));
+        ws_.set_option(websocket::stream_base::timeout::suggested(beast::role_type::client));
+        ws_.handshake(host, "/");
+    }
+
+    void start(Pending greeting) {
+        pending_.push_back(std::move(greeting));
+        read();
+    }
+
+    void send(std::string line, Pending pending) {
+        pending_.push_back(std::move(pending));
+        outbox_.push_back(std::move(line));
+        if (outbox_.size() == 1) {
+            write();
+        }
+    }
+
+    void close() {
+        ws_.async_close(websocket::close_code::normal, [self = shared_from_this()](boost::system::error_code) {});
+    }
+
+private:
+    void read() {
+        ws_.async_read(buffer_, [self = shared_from_this()](boost::system::error_code ec, std::size_t) {
+            if (ec) {
+                self->abandon();
+                return;
+            }
+
+            self->onFrame(beast::buffers_to_string(self->buffer_.cdata()));
+            self->buffer_.consume(self->buffer_.size());
+            self->read();
+        });
+    }
+
+    void write() {
+        ws_.async_write(asio::buffer(outbox_.front()), [self = shared_from_this()](boost::system::error_code ec,
+            std::size_t) {
+            if (ec) {
+                return;
+            }
+
+            self->outbox_.pop_front();
+            if (!self->outbox_.empty()) {
+                self->write();
+            }
+        });
+    }
+
+    void onFrame(const std::string& frame) {
+        const auto code = leadingCode(frame);
+        std::lock_guard lock(run_.mutex);
+        if (isPush(code) || pending_.empty()) {
+            ++run_.report.pushes;
+            return;
+        }
+
+        auto sent = std::move(pending_.front());
+        pending_.pop_front();
+        if (sent.command != kGreeting) {
+            const auto micros = std::uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                ReplayClock::now() - sent.sentAt).count());
+            run_.latencies.push_back(micros);
+            run_.latenciesByCommand[sent.command].push_back(micros);
+        }
+
+        if (sent.expected.known) {
+            if (code != sent.expected.code) {
+                ++run_.report.mismatchedReplies;
+            } else {
+                const auto ids = uuidsIn(frame);
+                for (std::size_t i = 0; i < std::min(ids.size(), sent.expected.ids.size()); ++i) {
+                    run_.ids.emplace(sent.expected.ids[i], ids[i]);
+                }
+            }
+        }
+
+        --run_.inFlight;
+        run_.answered.notify_all();
+    }
+
+    void abandon() {
+        std::lock_guard lock(run_.mutex);
+        run_.report.lostReplies += pending_.size();
+        run_.inFlight -= pending_.size();
+        pending_.clear();
+        run_.answered.notify_all();
+    }
+
+    websocket::stream<beast::tcp_stream> ws_;
+    beast::flat_buffer       buffer_;
+    std::deque<std::string>  outbox_;
+    std::deque<Pending>      pending_;
+    Run&                     run_;
+};
+
+} // namespace
+
+LatencySummary LatencySummary::of(std::vector<std::uint64_t> micros) {
+    LatencySummary summary;
+    summary.count = micros.size();
+    if (micros.empty()) {
+        return summary;
+    }
+
+    std::sort(micros.begin(), micros.end());
+    auto at = [&micros](double quantile) {
+        return micros[std::min(micros.size() - 1, std::size_t(quantile * double(micros.size())))];
+    };
+    summary.p50Micros = at(0.5);
+    summary.p90Micros = at(0.9);
+    summary.p99Micros = at(0.99);
+    summary.p999Micros = at(0.999);
+    summary.maxMicros = micros.back();
+    return summary;
+}
+
+double ReplayReport::commandsPerSecond() const {
+    return elapsed.count() > 0 ? double(commands) / elapsed.count() : 0;
+}
+
+std::string ReplayReport::summary() const {
+    std::ostringstream out;
+    auto line = [&out](const LatencySummary& latency) {
+        out << "count=" << latency.count << " p50_us=" << latency.p50Micros << " p90_us=" << latency.p90Micros
+            << " p99_us=" << latency.p99Micros << " p999_us=" << latency.p999Micros
+            << " max_us=" << latency.maxMicros << "\n";
+    };
+
+    out << "sessions=" << sessions << " commands=" << commands << " pushes=" << pushes
+        << " mismatched_replies=" << mismatchedReplies << " lost_replies=" << lostReplies
+        << " seconds=" << elapsed.count() << " commands_per_sec=" << commandsPerSecond() << "\n";
+    out << "all        ";
+    line(latency);
+    for (const auto& [command, byCommand] : latencyByCommand) {
+        out << "command " << command << (command < 10 ? "  " : " ");
+        line(byCommand);
+    }
+    return out.str();
+}
+
+CaptureReplayer::CaptureReplayer(AbstractTimeProvider& clock, CaptureReplayOptions options)
+    : clock_(clock)
+    , options_(std::move(options))
+{
+    options_.window = std::max<std::size_t>(options_.window, 1);
+}
+
+ReplayReport CaptureReplayer::run(const std::filesystem::path& capture) {
+    const auto steps = loadSteps(capture);
+
+    asio::io_context ioc;
+    auto work = asio::make_work_guard(ioc);
+    std::thread io([&ioc] { ioc.run(); });
+
+    Run run;
+    std::map<std::uint64_t, std::shared_ptr<Client>> clients;
+    auto drain = [&run](std::size_t below) {
+        std::unique_lock lock(run.mutex);
+        run.answered.wait(lock, [&run, below] { return run.inFlight < below; });
+    };
+    auto admit = [&run] {
+        std::lock_guard lock(run.mutex);
+        ++run.inFlight;
+    };
+
+    const auto start = ReplayClock::now();
+    std::optional<std::int64_t> clock;
+    try {
+        const auto endpoints = tcp::resolver(ioc).resolve(options_.host, options_.port);
+
+        for (const auto& [record, expected] : steps) {
+            if (options_.speed > 0) {
+                std::this_thread::sleep_until(start + std::chrono::duration_cast<ReplayClock::duration>(
+                    record.elapsed / options_.speed));
+            }
+
+            if (clock && record.clockSeconds > *clock) {
+                drain(1);
+                clock_.advanceTime(std::chrono::seconds(record.clockSeconds - *clock));
+            }
+            if (!clock || record.clockSeconds > *clock) {
+                clock = record.clockSeconds;
+            }
+
+            switch (record.kind) {
+                case CaptureRecord::Kind::OPEN: {
+                    drain(options_.window);
+                    auto client = std::make_shared<Client>(ioc, run);
+                    client->connect(endpoints, options_.host);
+                    clients[record.session] = client;
+                    admit();
+                    ++run.report.sessions;
+                    asio::post(ioc, [client, pending = Pending{ReplayClock::now(), kGreeting, expected}]() mutable {
+                        client->start(std::move(pending));
+                    });
+                    break;
+                }
+
+                case CaptureRecord::Kind::COMMAND: {
+                    auto client = clients.find(record.session);
+                    if (client == clients.end()) {
+                        break;
+                    }
+
+                    drain(options_.window);
+                    std::string line = record.line;
+                    bool complete;
+                    {
+                        std::lock_guard lock(run.mutex);
+                        complete = rewriteIds(line, run.ids);
+                    }
+                    if (!complete) {
+                        // The id may come with a reply still in flight.
+                        drain(1);
+                        line = record.line;
+                        std::lock_guard lock(run.mutex);
+                        rewriteIds(line, run.ids);
+                    }
+
+                    admit();
+                    ++run.report.commands;
+                    asio::post(ioc, [client = client->second, line = std::move(line),
+                        pending = Pending{ReplayClock::now(), leadingCode(record.line), expected}]() mutable {
+                        client->send(std::move(line), std::move(pending));
+                    });
+                    break;
+                }
+
+                case CaptureRecord::Kind::CLOSE: {
+                    auto client = clients.find(record.session);
+                    if (client == clients.end()) {
+                        break;
+                    }
+
+                    drain(1);
+                    asio::post(ioc, [client = client->second] { client->close(); });
+                    clients.erase(client);
+                    break;
+                }
+
+                case CaptureRecord::Kind::REPLY:
+                    break;
+            }
+        }
+        drain(1);
+    } catch (...) {
+        ioc.stop();
+        io.join();
+        throw;
+    }
+
+    run.report.elapsed = ReplayClock::now() - start;
+    for (auto& [session, client] : clients) {
+        asio::post(ioc, [client] { client->close(); });
+    }
+    clients.clear();
+    work.reset();
+    io.join();
+
+    run.report.latency = LatencySummary::of(std::move(run.latencies));
+    for (auto& [command, micros] : run.latenciesByCommand) {
+        run.report.latencyByCommand[command] = LatencySummary::of(std::move(micros));
+    }
+    return run.report;
+}